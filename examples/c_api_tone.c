@@ -0,0 +1,97 @@
+/*
+ * C APIのサンプルプログラム
+ * 共有ライブラリ ym2151_c を使って440Hzの音を1秒間生成し、
+ * 16ビットPCMのWAVファイルとして保存する。
+ * 生成は呼び出し側のバッファへ直接行う（ライブラリ内でのコピーや確保はない）。
+ */
+
+#include "ym2151/ym2151_c.h"
+#include <stdio.h>
+
+#define SAMPLE_RATE 44100
+#define BLOCK_SIZE 512
+
+static void writeLE16(FILE* file, uint16_t value) {
+    fputc(value & 0xFF, file);
+    fputc(value >> 8, file);
+}
+
+static void writeLE32(FILE* file, uint32_t value) {
+    writeLE16(file, (uint16_t)(value & 0xFFFF));
+    writeLE16(file, (uint16_t)(value >> 16));
+}
+
+static void writeWAVHeader(FILE* file, uint32_t samples) {
+    const uint32_t data_size = samples * 2;
+    fwrite("RIFF", 1, 4, file);
+    writeLE32(file, 36 + data_size);
+    fwrite("WAVEfmt ", 1, 8, file);
+    writeLE32(file, 16);
+    writeLE16(file, 1);                /* PCM */
+    writeLE16(file, 1);                /* モノラル */
+    writeLE32(file, SAMPLE_RATE);
+    writeLE32(file, SAMPLE_RATE * 2);
+    writeLE16(file, 2);
+    writeLE16(file, 16);
+    fwrite("data", 1, 4, file);
+    writeLE32(file, data_size);
+}
+
+int main(void) {
+    /* 音色の設定とキーオン（チャンネル0、アルゴリズム7、440Hz） */
+    static const ym2151_write setup[] = {
+        {0x20, 0x07},
+        {0x10, (440 * 2) & 0xFF},
+        {0x18, (440 * 2) >> 8},
+        {0x08, 0x80},
+    };
+    int16_t block[BLOCK_SIZE];
+    ym2151_stats stats;
+    uint32_t written = 0;
+    ym2151_chip* chip;
+    FILE* file;
+
+    if (ym2151_abi_version() != YM2151_C_ABI_VERSION) {
+        fprintf(stderr, "ABIバージョンが一致しません\n");
+        return 1;
+    }
+
+    chip = ym2151_create(3579545, SAMPLE_RATE);
+    if (!chip) {
+        fprintf(stderr, "チップを作成できませんでした\n");
+        return 1;
+    }
+
+    file = fopen("ym2151_c_tone.wav", "wb");
+    if (!file) {
+        fprintf(stderr, "ファイルを開けませんでした: ym2151_c_tone.wav\n");
+        ym2151_destroy(chip);
+        return 1;
+    }
+
+    ym2151_write_registers(chip, setup, sizeof(setup) / sizeof(setup[0]));
+
+    writeWAVHeader(file, SAMPLE_RATE);
+    while (written < SAMPLE_RATE) {
+        size_t count = SAMPLE_RATE - written;
+        if (count > BLOCK_SIZE) {
+            count = BLOCK_SIZE;
+        }
+        ym2151_render_s16(chip, block, count);
+        fwrite(block, sizeof(int16_t), count, file);
+        written += (uint32_t)count;
+    }
+    fclose(file);
+
+    stats.size = sizeof(stats);
+    ym2151_get_stats(chip, &stats);
+    printf("kernel: %s\n", ym2151_kernel_name(chip));
+    printf("samples: %llu, render calls: %llu, register writes: %llu\n",
+           (unsigned long long)stats.samples_rendered,
+           (unsigned long long)stats.render_calls,
+           (unsigned long long)stats.register_writes);
+    printf("WAVファイルを保存しました: ym2151_c_tone.wav\n");
+
+    ym2151_destroy(chip);
+    return 0;
+}
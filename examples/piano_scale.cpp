@@ -1,4 +1,5 @@
 #include "ym2151/ym2151.h"
+#include "ym2151/sequencer.h"
 #include <iostream>
 #include <fstream>
 #include <vector>
@@ -67,105 +68,50 @@ void writeWAV(const std::string& filename, const std::vector<float>& samples, in
     std::cout << "WAVファイルを保存しました: " << filename << std::endl;
 }
 
-// 音階の周波数を計算する関数（A4 = 440Hz基準）
-float noteToFrequency(int note) {
-    // A4 = 69, C4 = 60
-    return 440.0f * std::pow(2.0f, (note - 69) / 12.0f);
-}
-
-// YM2151のレジスタ値に変換する関数（使用しない）
-uint16_t frequencyToRegisterValue(float frequency) {
-    // YM2151の周波数計算は複雑ですが、簡易的に実装
-    // 実際のYM2151では、キーコードとキーフラクションに分けて設定します
-    return static_cast<uint16_t>(frequency * 2.0f);  // 簡易的な変換
-}
-
 // ピアノっぽい音色を設定する関数
 void setupPianoVoice(YM2151::Chip& chip, int channel) {
-    // アルゴリズム4（OP1->OP2->出力, OP3->OP4->出力）とフィードバック0を設定
-    chip.setRegister(0x20 + channel, 4);  // アルゴリズム4, フィードバック0
-    
-// オペレータ1の設定（モジュレータ）
-chip.setRegister(0x40 + channel, 0x7F);  // TL (Total Level) = 127 (最小音量)
-chip.setRegister(0x80 + channel, 0x1F);  // AR (Attack Rate) = 31 (最速)
-chip.setRegister(0xA0 + channel, 0x00);  // DR (Decay Rate) = 0 (最遅)
-chip.setRegister(0xC0 + channel, 0x00);  // SR (Sustain Rate) = 0 (最遅)
-chip.setRegister(0xE0 + channel, 0x0F);  // RR (Release Rate) = 15 (中速)
-
-// オペレータ2の設定（キャリア）
-chip.setRegister(0x41 + channel, 0x00);  // TL (Total Level) = 0 (最大音量)
-chip.setRegister(0x81 + channel, 0x1F);  // AR (Attack Rate) = 31 (最速)
-chip.setRegister(0xA1 + channel, 0x05);  // DR (Decay Rate) = 5
-chip.setRegister(0xC1 + channel, 0x05);  // SR (Sustain Rate) = 5
-chip.setRegister(0xE1 + channel, 0x0F);  // RR (Release Rate) = 15 (中速)
-
-// オペレータ3の設定（モジュレータ）
-chip.setRegister(0x42 + channel, 0x7F);  // TL (Total Level) = 127 (最小音量)
-chip.setRegister(0x82 + channel, 0x1F);  // AR (Attack Rate) = 31 (最速)
-chip.setRegister(0xA2 + channel, 0x00);  // DR (Decay Rate) = 0 (最遅)
-chip.setRegister(0xC2 + channel, 0x00);  // SR (Sustain Rate) = 0 (最遅)
-chip.setRegister(0xE2 + channel, 0x0F);  // RR (Release Rate) = 15 (中速)
-
-// オペレータ4の設定（キャリア）
-chip.setRegister(0x43 + channel, 0x00);  // TL (Total Level) = 0 (最大音量)
-chip.setRegister(0x83 + channel, 0x1F);  // AR (Attack Rate) = 31 (最速)
-chip.setRegister(0xA3 + channel, 0x05);  // DR (Decay Rate) = 5
-chip.setRegister(0xC3 + channel, 0x05);  // SR (Sustain Rate) = 5
-chip.setRegister(0xE3 + channel, 0x0F);  // RR (Release Rate) = 15 (中速)
-    
-// 倍率設定
-chip.setRegister(0x60 + channel, 0x01);  // 倍率 = 1
-chip.setRegister(0x61 + channel, 0x01);  // 倍率 = 1
-chip.setRegister(0x62 + channel, 0x01);  // 倍率 = 1
-chip.setRegister(0x63 + channel, 0x01);  // 倍率 = 1
-}
-
-// 音を鳴らす関数
-void playNote(YM2151::Chip& chip, int channel, int note, float duration, std::vector<float>& buffer, int sample_rate, int& current_sample) {
-    // 周波数の計算
-    float frequency = noteToFrequency(note);
-    
-    // YM2151の周波数設定
-    uint16_t freq_value = static_cast<uint16_t>(frequency * 2.0f);  // 簡易的な変換
-    chip.setRegister(0x10 + channel, freq_value & 0xFF);  // 周波数下位8ビット
-    chip.setRegister(0x18 + channel, freq_value >> 8);    // 周波数上位8ビット
-    
-    // キーオン
-    chip.setRegister(0x08, 0x80 | channel);  // チャンネルのキーオン
-    
-    // 音声生成（キーオン期間）
-    int keyOn_samples = static_cast<int>(duration * 0.8f * sample_rate);  // 80%の時間をキーオン
-    for (int i = 0; i < keyOn_samples; i += 1024) {
-        int samples_to_generate = std::min(1024, keyOn_samples - i);
-        chip.generate(&buffer[current_sample + i], samples_to_generate);
+    // チャンネル相対のレジスタブロック（実際のレジスタ = reg + channel）
+    static const YM2151::RegWrite piano_voice[] = {
+        // アルゴリズム4（OP1->OP2->出力, OP3->OP4->出力）とフィードバック0を設定
+        {0x20, 4},     // アルゴリズム4, フィードバック0
         
-        // バッファの内容を確認（デバッグ用）
-        float sum = 0.0f;
-        for (int j = 0; j < samples_to_generate; j++) {
-            sum += std::abs(buffer[current_sample + i + j]);
-        }
-        std::cout << "キーオン期間のサンプル平均値: " << sum / samples_to_generate << std::endl;
-    }
-    
-    // キーオフ
-    chip.setRegister(0x08, channel);  // キーオフ
-    
-    // 音声生成（キーオフ期間）
-    int keyOff_samples = static_cast<int>(duration * 0.2f * sample_rate);  // 20%の時間をキーオフ（リリース）
-    for (int i = 0; i < keyOff_samples; i += 1024) {
-        int samples_to_generate = std::min(1024, keyOff_samples - i);
-        chip.generate(&buffer[current_sample + keyOn_samples + i], samples_to_generate);
+        // オペレータ1の設定（モジュレータ）
+        {0x40, 0x7F},  // TL (Total Level) = 127 (最小音量)
+        {0x80, 0x1F},  // AR (Attack Rate) = 31 (最速)
+        {0xA0, 0x00},  // DR (Decay Rate) = 0 (最遅)
+        {0xC0, 0x00},  // SR (Sustain Rate) = 0 (最遅)
+        {0xE0, 0x0F},  // RR (Release Rate) = 15 (中速)
         
-        // バッファの内容を確認（デバッグ用）
-        float sum = 0.0f;
-        for (int j = 0; j < samples_to_generate; j++) {
-            sum += std::abs(buffer[current_sample + keyOn_samples + i + j]);
-        }
-        std::cout << "キーオフ期間のサンプル平均値: " << sum / samples_to_generate << std::endl;
-    }
-    
-    // サンプル位置の更新
-    current_sample += static_cast<int>(duration * sample_rate);
+        // オペレータ2の設定（キャリア）
+        {0x41, 0x00},  // TL (Total Level) = 0 (最大音量)
+        {0x81, 0x1F},  // AR (Attack Rate) = 31 (最速)
+        {0xA1, 0x05},  // DR (Decay Rate) = 5
+        {0xC1, 0x05},  // SR (Sustain Rate) = 5
+        {0xE1, 0x0F},  // RR (Release Rate) = 15 (中速)
+        
+        // オペレータ3の設定（モジュレータ）
+        {0x42, 0x7F},  // TL (Total Level) = 127 (最小音量)
+        {0x82, 0x1F},  // AR (Attack Rate) = 31 (最速)
+        {0xA2, 0x00},  // DR (Decay Rate) = 0 (最遅)
+        {0xC2, 0x00},  // SR (Sustain Rate) = 0 (最遅)
+        {0xE2, 0x0F},  // RR (Release Rate) = 15 (中速)
+        
+        // オペレータ4の設定（キャリア）
+        {0x43, 0x00},  // TL (Total Level) = 0 (最大音量)
+        {0x83, 0x1F},  // AR (Attack Rate) = 31 (最速)
+        {0xA3, 0x05},  // DR (Decay Rate) = 5
+        {0xC3, 0x05},  // SR (Sustain Rate) = 5
+        {0xE3, 0x0F},  // RR (Release Rate) = 15 (中速)
+        
+        // 倍率設定
+        {0x60, 0x01},  // 倍率 = 1
+        {0x61, 0x01},  // 倍率 = 1
+        {0x62, 0x01},  // 倍率 = 1
+        {0x63, 0x01},  // 倍率 = 1
+    };
+    
+    // 一括書き込み（チャンネル状態の再計算は1回だけ）
+    chip.setChannelRegisters(channel, piano_voice, sizeof(piano_voice) / sizeof(piano_voice[0]));
 }
 
 int main() {
@@ -186,20 +132,23 @@ int main() {
     const char* note_names[] = {"C", "D", "E", "F", "G", "A", "B"};
     const int note_count = sizeof(notes) / sizeof(notes[0]);
     
-    // 各音の長さ（秒）
-    const float note_duration = 0.5f;
-    
-    // 出力バッファの準備
-    const int total_samples = static_cast<int>(note_count * note_duration * sample_rate);
-    std::vector<float> output_buffer(total_samples, 0.0f);
-    
-    // 各音階を順番に再生
-    int current_sample = 0;
+    // 各音は4分音符（120 BPMで0.5秒）、長さの80%をキーオン、残りをリリースにする
+    YM2151::Sequencer sequencer;
+    sequencer.setSampleRate(sample_rate);
+    const uint32_t quarter = sequencer.getTicksPerQuarter();
     for (int i = 0; i < note_count; i++) {
-        std::cout << "音階 " << note_names[i] << " を再生中..." << std::endl;
-        playNote(chip, channel, notes[i], note_duration, output_buffer, sample_rate, current_sample);
+        const uint32_t tick = i * quarter;
+        sequencer.add(YM2151::SequenceEvent::noteOn(tick, channel, notes[i]));
+        sequencer.add(YM2151::SequenceEvent::noteOff(tick + quarter * 8 / 10, channel));
+        std::cout << "音階 " << note_names[i] << ": " << sequencer.tickToSample(tick) << " サンプル目" << std::endl;
     }
     
+    // 出力バッファの準備と生成（全体を1回で生成。イベントの位置で区切って適用される）
+    const int total_samples = static_cast<int>(sequencer.tickToSample(note_count * quarter));
+    std::vector<float> output_buffer(total_samples, 0.0f);
+    sequencer.render(chip, output_buffer.data(), total_samples);
+    std::cout << "generate() の呼び出し回数: " << sequencer.generateCalls() << std::endl;
+    
     // WAVファイルに保存
     writeWAV("ym2151_piano_scale.wav", output_buffer, 1, sample_rate, 16);
     
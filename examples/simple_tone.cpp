@@ -1,4 +1,6 @@
 #include "ym2151/ym2151.h"
+#include "ym2151/midi.h"
+#include "ym2151/sequencer.h"
 #include <iostream>
 #include <fstream>
 #include <vector>
@@ -117,48 +119,35 @@ int main() {
     chip.setRegister(0x33, 0x01);  // OP4: MULT=1
     
     // A4（440Hz）の設定
-    float frequency = 440.0f;  // A4 = 440Hz
-    uint16_t freq_value = static_cast<uint16_t>(frequency * 2.0f);  // 簡易的な変換
+    // 周波数レジスタの値はシーケンサのノートオンで設定する（midiNoteToFrequency()）
+    const uint8_t note = 69;  // A4 = 440Hz
+    const uint16_t freq_value = YM2151::midiNoteToFrequency(note);
     
-    // 周波数レジスタの設定
-    chip.setRegister(0x10 + channel, freq_value & 0xFF);  // 周波数下位8ビット
-    chip.setRegister(0x18 + channel, freq_value >> 8);    // 周波数上位8ビット
-    
-    // キーオン
-    chip.setRegister(0x08, 0x80 | channel);  // チャンネル0のキーオン
-    
-    std::cout << "Frequency: " << frequency << " Hz" << std::endl;
+    std::cout << "Frequency: 440 Hz" << std::endl;
     std::cout << "Frequency Register Value: 0x" << std::hex << freq_value << std::dec << std::endl;
     
-    // 音声生成
+    // 0秒でキーオン、1秒後にキーオフ（120 BPM、480ティック/4分音符なので1秒 = 960ティック）
+    YM2151::Sequencer sequencer;
+    sequencer.setSampleRate(sample_rate);
+    const YM2151::SequenceEvent events[] = {
+        YM2151::SequenceEvent::noteOn(0, channel, note),
+        YM2151::SequenceEvent::noteOff(960, channel),
+    };
+    sequencer.add(events, sizeof(events) / sizeof(events[0]));
+    
+    // 音声生成（3秒分を1回で生成。イベントの位置で区切ってサンプル単位で正確に適用される）
     const int duration_seconds = 3;
     const int total_samples = sample_rate * duration_seconds;
     std::vector<float> output_buffer(total_samples);
+    sequencer.render(chip, output_buffer.data(), total_samples);
     
-    // バッファに音声データを生成
-    for (int i = 0; i < total_samples; i += 1024) {
-        int samples_to_generate = std::min(1024, total_samples - i);
-        chip.generate(&output_buffer[i], samples_to_generate);
-        
-        // バッファの内容を確認（デバッグ用）
-        float sum = 0.0f;
-        for (int j = 0; j < samples_to_generate; j++) {
-            sum += std::abs(output_buffer[i + j]);
-        }
-        std::cout << "Sample block " << i/1024 << " average value: " << sum / samples_to_generate << std::endl;
-    }
-    
-    // 1秒後にキーオフ
-    const int keyoff_sample = sample_rate;
-    if (keyoff_sample < total_samples) {
-        chip.setRegister(0x08, channel);  // チャンネル0のキーオフ
-        
-        // キーオフ後も音声生成を続ける
-        for (int i = keyoff_sample; i < total_samples; i += 1024) {
-            int samples_to_generate = std::min(1024, total_samples - i);
-            chip.generate(&output_buffer[i], samples_to_generate);
-        }
+    // キーオン期間の平均値（確認用）
+    float sum = 0.0f;
+    for (int i = 0; i < sample_rate; i++) {
+        sum += std::abs(output_buffer[i]);
     }
+    std::cout << "Key-on average value: " << sum / sample_rate << std::endl;
+    std::cout << "generate() calls: " << sequencer.generateCalls() << std::endl;
     
     // WAVファイルに保存
     writeWAV("ym2151_tone.wav", output_buffer, 1, sample_rate, 16);
@@ -0,0 +1,109 @@
+#ifndef YM2151_BOARD_H
+#define YM2151_BOARD_H
+
+#include "ym2151/ym2151.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace YM2151 {
+
+// 複数チップの基板（ミキサー）
+//
+// アーケード基板のような2チップ構成や、複数チップを重ねた構成のためのクラス。
+// チップごとにゲイン、パンを持ち、ステレオ（インターリーブ）に合成して出力する。
+// チップごとのクロックも指定できるが、このコアの出力はクロックによらない（周波数レジスタは
+// Hz単位で解釈する）ため、クロックは Recorder で記録するVGMのヘッダーにだけ反映される。
+//
+// start() でスレッド動作を指定すると、チップごとにワーカースレッドを1つ立ち上げ、
+// 各チップのブロックを並行して生成する。生成と合成はパイプライン化されており、
+// render() は前回の呼び出しで依頼したブロックを合成して返し、同時に次のブロックを依頼する。
+// そのため出力の遅延はちょうど1ブロック（latency() フレーム）で、
+// render() が待つのは最も遅いチップの1ブロック分の生成時間を超えない。
+// ワーカーへの依頼はアトミックなブロック番号とセマフォで行い、ロックは使わない
+// （ワーカーがロックを持つ間オーディオスレッドが待たされることはない）。
+// render() は完了間近のワーカーを短くスピンして待ち、間に合わなければ完了のセマフォで眠る
+// （sched_yield で回り続けることはない）。
+// ワーカーは start() を呼んだスレッドのスケジューリングポリシーと優先度で動く。
+// オーディオスレッドが実時間優先度（SCHED_FIFO など）で動く場合は、start() をそのスレッドか
+// 同じ優先度のスレッドから呼ぶこと（低い優先度のワーカーを待つと優先度逆転になる）。
+// スレッドを使わない場合は render() 内で順に生成し、遅延は0になる。
+//
+// レジスタ書き込み（write()）は次に生成するブロックの先頭で適用する。
+// 書き込みキューはチップごとに固定長で、溢れた書き込みは破棄して数える。
+//
+// addChip / start / stop / chip() はスレッド動作中でないときに呼ぶこと。
+// render / write / setGain / setPan はリアルタイム安全（メモリ確保・ロックを行わない。
+// スレッド動作の render はワーカーを起こすセマフォの通知と、完了のセマフォの待機を行う）。
+// render / write は同じスレッド（オーディオスレッド）から呼ぶこと。
+class Board {
+public:
+    static constexpr int MAX_CHIPS = 8;
+    static constexpr size_t WRITE_QUEUE_CAPACITY = 1024;
+
+    explicit Board(uint32_t sample_rate = 44100);
+    ~Board();
+
+    Board(const Board&) = delete;
+    Board& operator=(const Board&) = delete;
+
+    // チップの追加（pan は -1.0 = 左 〜 1.0 = 右）
+    // 追加したチップの番号を返す。失敗時は error に理由を設定して -1 を返す。
+    int addChip(uint32_t clock = 3579545, float gain = 1.0f, float pan = 0.0f, std::string* error = nullptr);
+    int chipCount() const;
+
+    // チップへの直接のアクセス（音色の初期設定など。スレッド動作中は使わないこと）
+    Chip& chip(int index);
+
+    uint32_t getSampleRate() const;
+
+    // ゲインとパン（他のスレッドからも変更できる。次の合成から反映する）
+    void setGain(int index, float gain) noexcept;
+    void setPan(int index, float pan) noexcept;
+    float getGain(int index) const noexcept;
+    float getPan(int index) const noexcept;
+
+    // 生成の開始（block_frames は render() 1回あたりのフレーム数）
+    // threaded が真ならチップごとのワーカースレッドを起動する
+    // （ワーカーには呼び出し元のスレッドのスケジューリングポリシーと優先度を設定する）
+    bool start(int block_frames, bool threaded = true, std::string* error = nullptr);
+    void stop();
+    bool isRunning() const;
+    bool isThreaded() const;
+    int blockFrames() const;
+
+    // 出力の遅延（フレーム数）
+    int latency() const;
+
+    // レジスタ書き込み（次に生成するブロックの先頭で適用）
+    bool write(int index, uint8_t reg, uint8_t value) noexcept;
+    uint64_t droppedWrites() const noexcept;
+
+    // blockFrames() フレーム分のステレオ出力（左右交互）を書き込む
+    // 生成中でなければ（start() の前、stop() の後）無音を書き込む
+    void render(float* stereo) noexcept;
+
+private:
+    // チップ1つ分の状態とワーカー（board.cpp で定義）
+    struct Slot;
+
+    void dispatch(Slot& slot, uint64_t job) noexcept;
+    void renderJob(Slot& slot, uint64_t job) noexcept;
+    void workerLoop(Slot& slot);
+    void mix(float* stereo, int parity) noexcept;
+
+    uint32_t sample_rate_;
+    std::vector<std::unique_ptr<Slot>> slots_;
+    int block_frames_;
+    bool running_;
+    bool threaded_;
+    uint64_t job_;   // 最後に依頼したブロック番号（0は未依頼）
+    std::atomic<uint64_t> dropped_;
+};
+
+} // namespace YM2151
+
+#endif // YM2151_BOARD_H
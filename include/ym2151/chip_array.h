@@ -0,0 +1,165 @@
+#ifndef YM2151_CHIP_ARRAY_H
+#define YM2151_CHIP_ARRAY_H
+
+#include "ym2151/ym2151.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace YM2151 {
+
+namespace detail {
+
+// 1タイル（キャッシュライン1本分の float）に含まれるレーン数
+constexpr int LANE_TILE = 16;
+
+// ChipArray の状態への参照（ライブラリ内部の処理に渡す）
+// 演算に使う状態は「要素ごとに lanes 個の値が連続する」構造体配列（SoA）で持つ。
+// lanes は LANE_TILE の倍数で、各配列の先頭は64バイト境界に揃っている。
+struct LaneState {
+    int count;                 // 使用するレーン数
+    int lanes;                 // 確保したレーン数（count を LANE_TILE の倍数に切り上げたもの）
+    uint32_t sample_rate;
+    uint8_t* registers;        // [レーン][REGISTER_COUNT]
+
+    // チャンネル状態 [CHANNEL_COUNT][lanes]
+    float* phase;
+    float* increment;
+    float* feedback0;
+    float* feedback1;
+    float* feedback_scale;
+    int32_t* key_on;
+    int32_t* connection;       // アルゴリズムの接続（変調元とキャリアのビット列）
+
+    // オペレータ状態 [CHANNEL_COUNT][4][lanes]
+    float* env_level;
+    float* env_rate;
+    int32_t* env_state;
+
+    // 合成結果の作業領域 [RENDER_BLOCK][lanes]
+    float* mix;
+};
+
+void resetLanes(const LaneState& state) noexcept;
+void resetLane(const LaneState& state, int lane) noexcept;
+void updateLaneIncrements(const LaneState& state) noexcept;
+void writeLaneRegister(const LaneState& state, int lane, uint8_t reg, uint8_t value) noexcept;
+void renderLanes(const LaneState& state, float* const* outputs, int samples) noexcept;
+
+} // namespace detail
+
+// 複数のチップを構造体配列（SoA）の形で保持し、同時に生成するクラス
+//
+// 多数のセッションがそれぞれ1つのチップを持つサーバー向け。
+// Chip を N 個並べる代わりに、全チップの同じ状態（チャンネルの位相、
+// エンベロープなど）を連続した配列に詰め、チャンネル・オペレータの計算を
+// チップ（レーン）方向にベクトル化する。レーンごとのレジスタ書き込みは独立しており、
+// 各レーンの出力は同じ書き込みを与えた Chip の generate() とビット単位で一致する。
+//
+// 演算用の状態はレーン数を16の倍数に切り上げ、64バイト境界に揃えて確保する。
+// レジスタファイル（レンダリング中は参照しない）は演算用の状態とは分けて持つ。
+// オブジェクトが大きくなるため、N が大きい場合は new で確保すること。
+//
+// リアルタイム安全性は Chip と同じ（setRegister / setRegisters / getRegister /
+// generate は noexcept で、メモリ確保やロックを行わない）。
+template <int N>
+class alignas(64) ChipArray {
+    static_assert(N > 0, "ChipArray requires at least one lane");
+
+public:
+    static constexpr int LANE_COUNT = N;
+
+    ChipArray() : sample_rate_(44100) {
+        reset();
+    }
+
+    ChipArray(const ChipArray&) = delete;
+    ChipArray& operator=(const ChipArray&) = delete;
+
+    // 全レーンのリセット
+    void reset() {
+        detail::resetLanes(state());
+    }
+
+    // 1レーンのリセット（他のレーンの状態は変えない）
+    void resetLane(int lane) noexcept {
+        detail::resetLane(state(), lane);
+    }
+
+    // 全レーン共通のサンプリングレート
+    void setSampleRate(uint32_t rate) {
+        sample_rate_ = rate;
+        detail::updateLaneIncrements(state());
+    }
+
+    uint32_t getSampleRate() const {
+        return sample_rate_;
+    }
+
+    // レーンごとのレジスタ書き込み
+    void setRegister(int lane, uint8_t reg, uint8_t value) noexcept {
+        detail::writeLaneRegister(state(), lane, reg, value);
+    }
+
+    void setRegisters(int lane, const RegWrite* writes, size_t count) noexcept {
+        const detail::LaneState s = state();
+        for (size_t i = 0; i < count; ++i) {
+            detail::writeLaneRegister(s, lane, writes[i].reg, writes[i].value);
+        }
+    }
+
+    uint8_t getRegister(int lane, uint8_t reg) const noexcept {
+        return registers_[lane][reg];
+    }
+
+    // 全レーンの音声生成（outputs[lane] に samples 個ずつ書き込む）
+    void generate(float* const outputs[N], int samples) noexcept {
+        detail::renderLanes(state(), outputs, samples);
+    }
+
+private:
+    static constexpr int LANES = (N + detail::LANE_TILE - 1) / detail::LANE_TILE * detail::LANE_TILE;
+    static constexpr int CHANNEL_SLOTS = CHANNEL_COUNT * LANES;
+    static constexpr int OPERATOR_SLOTS = CHANNEL_COUNT * 4 * LANES;
+
+    detail::LaneState state() noexcept {
+        detail::LaneState s;
+        s.count = N;
+        s.lanes = LANES;
+        s.sample_rate = sample_rate_;
+        s.registers = registers_[0].data();
+        s.phase = phase_.data();
+        s.increment = increment_.data();
+        s.feedback0 = feedback0_.data();
+        s.feedback1 = feedback1_.data();
+        s.feedback_scale = feedback_scale_.data();
+        s.key_on = key_on_.data();
+        s.connection = connection_.data();
+        s.env_level = env_level_.data();
+        s.env_rate = env_rate_.data();
+        s.env_state = env_state_.data();
+        s.mix = mix_.data();
+        return s;
+    }
+
+    // 演算用の状態（レーン方向に連続）
+    alignas(64) std::array<float, CHANNEL_SLOTS> phase_;
+    alignas(64) std::array<float, CHANNEL_SLOTS> increment_;
+    alignas(64) std::array<float, CHANNEL_SLOTS> feedback0_;
+    alignas(64) std::array<float, CHANNEL_SLOTS> feedback1_;
+    alignas(64) std::array<float, CHANNEL_SLOTS> feedback_scale_;
+    alignas(64) std::array<int32_t, CHANNEL_SLOTS> key_on_;
+    alignas(64) std::array<int32_t, CHANNEL_SLOTS> connection_;
+    alignas(64) std::array<float, OPERATOR_SLOTS> env_level_;
+    alignas(64) std::array<float, OPERATOR_SLOTS> env_rate_;
+    alignas(64) std::array<int32_t, OPERATOR_SLOTS> env_state_;
+    alignas(64) std::array<float, RENDER_BLOCK * LANES> mix_;
+
+    // レジスタファイル（レーンごと）
+    std::array<std::array<uint8_t, REGISTER_COUNT>, N> registers_;
+    uint32_t sample_rate_;
+};
+
+} // namespace YM2151
+
+#endif // YM2151_CHIP_ARRAY_H
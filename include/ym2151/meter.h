@@ -0,0 +1,85 @@
+#ifndef YM2151_METER_H
+#define YM2151_METER_H
+
+#include "ym2151/ym2151.h"
+#include <atomic>
+#include <cstdint>
+
+namespace YM2151 {
+
+// バス1本分のレベル
+struct BusLevel {
+    float peak;            // 直前のブロックのピーク（絶対値）
+    float rms;             // 直前のブロックの実効値
+    uint32_t clips;        // 直前のブロックで ±1.0 を超えたサンプル数
+    float peak_hold;       // clearHold() 以降のピークの最大値
+    uint64_t total_clips;  // reset() 以降のクリップ数の累計
+};
+
+// レベルメーターの読み出し結果
+struct LevelSnapshot {
+    uint64_t blocks;                     // 公開したブロック数（reset() 以降）
+    uint32_t samples;                    // 直前のブロックのサンプル数
+    BusLevel channels[CHANNEL_COUNT];    // チャンネル別（generateStems() のステムと同じレベル）
+    BusLevel master;                     // ミックスバス（generate() の出力と同じレベル）
+};
+
+// チャンネル別とマスターのレベルメーター
+//
+// Chip::setMeter() で取り付けると、generate / generateStems のミックス処理の中で
+// ピーク、実効値、クリップ数（±1.0 を超えたサンプル数）をチャンネル別とマスターについて集計し、
+// 呼び出し（ブロック）ごとに1回ここに公開する。出力をもう一度走査する必要はない。
+// 集計は出力に影響しない（メーターの有無によらず出力はビット単位で同じ）。
+//
+// 公開はシーケンスロックで行う。書き込み側（レンダリングスレッド）は待たず、
+// 読み出し側（監視スレッドなど）はロックを取らずに一貫したスナップショットを得る
+// （書き込みと重なった場合は読み直す）。
+// 実効値はブロック内の合計の順序が命令セットによって異なるため、最下位ビットが異なることがある。
+class LevelMeter {
+public:
+    LevelMeter();
+    ~LevelMeter();
+
+    LevelMeter(const LevelMeter&) = delete;
+    LevelMeter& operator=(const LevelMeter&) = delete;
+
+    // 集計の初期化（レンダリング中は呼ばないこと）
+    void reset() noexcept;
+
+    // 1ブロック分の集計の公開（Chip から呼ばれる。リアルタイム安全）
+    void publish(const MeterSums& sums) noexcept;
+
+    // 最新のスナップショットの読み出し（任意のスレッドから呼べる。ロックなし）
+    void read(LevelSnapshot& snapshot) const noexcept;
+
+    // ピークホールドの解除を依頼する（任意のスレッドから呼べる。次の公開から反映する）
+    void clearHold() noexcept;
+
+private:
+    struct Bus {
+        std::atomic<float> peak{0.0f};
+        std::atomic<float> rms{0.0f};
+        std::atomic<uint32_t> clips{0};
+        std::atomic<float> peak_hold{0.0f};
+        std::atomic<uint64_t> total_clips{0};
+    };
+
+    static void store(Bus& bus, float peak, float rms, uint32_t clips, float hold, uint64_t total) noexcept;
+    static void load(const Bus& bus, BusLevel& level) noexcept;
+
+    // 奇数の間は書き込み中
+    std::atomic<uint64_t> sequence_;
+    std::atomic<uint64_t> blocks_;
+    std::atomic<uint32_t> samples_;
+    Bus channels_[CHANNEL_COUNT];
+    Bus master_;
+    std::atomic<bool> clear_hold_;
+
+    // 書き込み側だけが使う累積値
+    float hold_[CHANNEL_COUNT + 1];
+    uint64_t total_clips_[CHANNEL_COUNT + 1];
+};
+
+} // namespace YM2151
+
+#endif // YM2151_METER_H
@@ -0,0 +1,114 @@
+#ifndef YM2151_MIDI_H
+#define YM2151_MIDI_H
+
+#include "ym2151/ym2151.h"
+#include "ym2151/patch.h"
+#include <cstddef>
+#include <cstdint>
+#include <array>
+
+namespace YM2151 {
+
+// MIDIのチャンネル数とノート数
+constexpr int MIDI_CHANNEL_COUNT = 16;
+constexpr int MIDI_NOTE_COUNT = 128;
+
+// MIDIノート番号を周波数レジスタ値（0x10-0x1F）に変換（テーブル参照）
+uint16_t midiNoteToFrequency(uint8_t note);
+
+// MIDI→OPM変換ドライバ
+// MIDIメッセージを受け取り、8チャンネルへのボイス割り当てを行い、
+// タイムスタンプ付きのレジスタ書き込みを生成する。
+// プログラムチェンジは音色バンクの事前構築済みレジスタブロックとして適用する。
+// 割り当ては空きスタックと発音順リストによる定数時間処理で、
+// 空きがない場合は最も古いリリース中のボイス、次に最も古い発音中のボイスを奪う。
+// 1つのイベント（ノートオン、ノートオフ、オールノートオフ）の書き込みはまとめてキューに入れ、
+// キューに収まらない場合はイベントごと破棄する（ボイスの状態も変えない）。
+// キーオンだけが欠けるなど、チップとボイスの状態が食い違うことはない。
+class MidiDriver {
+public:
+    // 書き込みキューの容量（事前確保）
+    static constexpr size_t QUEUE_CAPACITY = 1024;
+
+    MidiDriver();
+    ~MidiDriver();
+
+    void reset();
+
+    // プログラムチェンジで参照する音色バンク（音色番号 = プログラム番号）
+    void setPatchBank(const PatchBank* bank);
+
+    // MIDIメッセージの処理（time は書き込みを適用するサンプル時刻）
+    void processMessage(uint32_t time, const uint8_t* data, size_t length);
+
+    void noteOn(uint32_t time, uint8_t midi_channel, uint8_t note, uint8_t velocity);
+    void noteOff(uint32_t time, uint8_t midi_channel, uint8_t note);
+    void programChange(uint32_t time, uint8_t midi_channel, uint8_t program);
+    void allNotesOff(uint32_t time);
+
+    // 生成済みの書き込みを取り出す（時刻順）
+    bool popWrite(TimedWrite& write);
+    size_t pendingWrites() const;
+
+    // 書き込みをサンプル単位の正確な位置で適用しながら1ブロックを生成
+    // 現在時刻より前の書き込みはブロック先頭で適用する
+    void render(Chip& chip, float* buffer, int samples);
+
+    uint32_t currentTime() const;
+
+    // キューに収まらずに破棄したイベントの数と、それらの書き込みの数
+    uint32_t droppedEvents() const;
+    uint32_t droppedWrites() const;
+
+private:
+    static constexpr int8_t NONE = -1;
+
+    // ボイス（チップの1チャンネル）の状態
+    struct Voice {
+        int8_t  prev;
+        int8_t  next;
+        uint8_t midi_channel;
+        uint8_t note;
+        bool    held;       // 発音中（false ならリリース中）
+        int16_t program;    // チャンネルにロード済みのプログラム（-1は未ロード）
+    };
+
+    // 発音順の双方向リスト
+    struct VoiceList {
+        int8_t head;
+        int8_t tail;
+    };
+
+    int nextVoice(uint8_t midi_channel, uint8_t note) const;
+    int allocateVoice();
+    bool reserve(size_t writes);
+    void listPush(VoiceList& list, int voice);
+    void listRemove(VoiceList& list, int voice);
+    void releaseVoice(uint32_t time, int voice);
+    void push(uint32_t time, uint8_t reg, uint8_t value);
+
+    std::array<Voice, CHANNEL_COUNT> voices_;
+    std::array<uint8_t, CHANNEL_COUNT> free_;
+    int free_count_;
+    VoiceList held_;
+    VoiceList released_;
+
+    // (MIDIチャンネル, ノート) → ボイスの逆引き
+    std::array<std::array<int8_t, MIDI_NOTE_COUNT>, MIDI_CHANNEL_COUNT> note_voice_;
+    std::array<uint8_t, MIDI_CHANNEL_COUNT> channel_program_;
+    const PatchBank* bank_;
+
+    // 書き込みキュー（リングバッファ）
+    std::array<TimedWrite, QUEUE_CAPACITY> queue_;
+    size_t queue_head_;
+    size_t queue_size_;
+    uint32_t last_time_;
+    uint32_t dropped_events_;
+    uint32_t dropped_writes_;
+
+    uint32_t now_;
+};
+
+} // namespace YM2151
+
+#endif // YM2151_MIDI_H
@@ -0,0 +1,158 @@
+#ifndef YM2151_NOTE_CACHE_H
+#define YM2151_NOTE_CACHE_H
+
+#include "ym2151/ym2151.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace YM2151 {
+
+// ノートキャッシュの統計
+struct NoteCacheStats {
+    uint64_t hits;                 // キャッシュした出力を再生したキーオン
+    uint64_t misses;               // 見つからなかったキーオン（新しく記録する）
+    uint64_t uncacheable;          // 対象外のキーオン（LFO動作中、空きがない）
+    uint64_t evictions;            // 追い出したノート
+    uint64_t cached_samples;       // キャッシュから再生したサンプル数
+    uint64_t resimulated_samples;  // 途中で止めたノートの状態を求めるために計算し直したサンプル数
+    uint32_t max_resimulated;      // 1回のキーオフなどで計算し直した最大のサンプル数（PAGE_SIZE 未満）
+    size_t entries;                // 保持しているノート数
+    size_t used_bytes;             // 出力の保持に使っている領域
+    size_t capacity_bytes;         // 領域の上限
+};
+
+// 同じノートの出力を再利用するキャッシュ
+//
+// Chip::setNoteCache() で取り付けると、キーオンのたびにチャンネルの開始状態
+// （4オペレータの音色パラメータ、アルゴリズム、フィードバック、位相の増分（周波数）、
+// 位相とフィードバックの履歴）をキーとして探し、同じ状態から発音したノートの出力が
+// 保持されていれば、4オペレータを計算する代わりにその出力をミックスに使う。
+// 見つからなければ、そのノートの出力を記録して次回に備える。
+// チャンネルの位相はキーオンで初期化されないため、開始状態が一致するのはリセット直後の
+// チップで鳴らす効果音やジングルのように、同じ手順で発音し直す場合になる。
+// LFO が動作中（LFO周波数が0以外）のキーオンは対象外とする。
+//
+// 発音中に周波数やアルゴリズムが変わった場合やキーオフの時点では、チャンネルの状態を
+// その時点のものに戻してから通常の計算に切り替えるので、出力はキャッシュの有無によらず
+// ビット単位で同じになる。記録中はページの先頭ごとにチャンネルの状態を保持するので、
+// 状態を戻すために計算し直すのは最大 PAGE_SIZE - 1 サンプル（書き込みの呼び出しの中で行う）。
+// キーオフした時点の状態もノートの長さごとに保持するため、同じ長さで繰り返すノートは
+// 計算し直さずに済む。
+//
+// 出力はページ単位の固定長の領域に保持し、領域が足りなくなると最も長く使われていない
+// ノートから追い出す（LRU）。領域は構築時にまとめて確保し、キーオン・生成中は
+// メモリ確保を行わない（リアルタイム安全）。1つのノートが使う領域は全体の1/4までとする。
+//
+// 1つの Chip にだけ取り付けること。統計は生成と同じスレッドで読むこと。
+class NoteCache {
+public:
+    // 1ページのサンプル数
+    static constexpr size_t PAGE_SIZE = 1024;
+    static constexpr size_t DEFAULT_CAPACITY = 16 * 1024 * 1024;
+
+    // capacity_bytes（出力と管理情報の合計）に収まる数のページを確保する
+    explicit NoteCache(size_t capacity_bytes = DEFAULT_CAPACITY);
+    ~NoteCache();
+
+    NoteCache(const NoteCache&) = delete;
+    NoteCache& operator=(const NoteCache&) = delete;
+
+    // 保持しているノートの消去（取り付けていないときに呼ぶこと）
+    void clear() noexcept;
+
+    NoteCacheStats stats() const noexcept;
+    void resetStats() noexcept;
+
+    // Chip から呼ばれる（いずれもリアルタイム安全）
+    // keyOn: チャンネルのキーオンの直後。cacheable が偽なら記録も再生もしない
+    // release: チャンネルの状態を変える前。チャンネルを現在位置の状態に戻して通常の計算に切り替える
+    // abandon: チャンネルをリセットする前。状態を戻さずに切り替える
+    // render: active() のチャンネルの出力
+    void keyOn(int index, const Channel& channel, bool cacheable) noexcept;
+    void release(int index, Channel& channel) noexcept;
+    void abandon(int index, Channel& channel) noexcept;
+    bool active(int index) const noexcept;
+    void render(int index, Channel& channel, float* out, int samples) noexcept;
+
+private:
+    static constexpr size_t KEY_SIZE = 80;
+    static constexpr int CHECKPOINTS = 4;   // 開始、記録の終わり、途中の2つ
+    static constexpr int32_t NONE = -1;
+
+    using Key = std::array<uint8_t, KEY_SIZE>;
+
+    // ノートの途中のチャンネルの状態
+    struct Checkpoint {
+        bool valid = false;
+        uint32_t position = 0;
+        Channel state;
+    };
+
+    struct Entry {
+        Key key{};
+        uint64_t hash = 0;
+        bool used = false;
+        bool recording = false;
+        int pins = 0;
+        uint32_t length = 0;
+        int32_t first_page = NONE;
+        int32_t last_page = NONE;
+        int32_t lru_prev = NONE;
+        int32_t lru_next = NONE;
+        int next_extra = 0;
+        Checkpoint checkpoints[CHECKPOINTS];
+    };
+
+    enum class Mode : uint8_t { LIVE, RECORDING, PLAYING };
+
+    // チャンネルごとの再生・記録の状態
+    struct Voice {
+        Mode mode = Mode::LIVE;
+        int32_t entry = NONE;
+        uint32_t position = 0;
+        int32_t page = NONE;
+    };
+
+    static void makeKey(const Channel& channel, Key& key) noexcept;
+    static uint64_t hashKey(const Key& key) noexcept;
+
+    int32_t find(const Key& key, uint64_t hash) const noexcept;
+    void insert(int32_t entry) noexcept;
+    void erase(int32_t entry) noexcept;
+
+    void touch(int32_t entry) noexcept;
+    void unlink(int32_t entry) noexcept;
+    bool evictOne() noexcept;
+    void evict(int32_t entry) noexcept;
+
+    int32_t allocateEntry() noexcept;
+    int32_t allocatePage() noexcept;
+
+    void finishRecording(Voice& voice, const Channel& channel) noexcept;
+    void stopPlaying(Voice& voice) noexcept;
+
+    std::vector<float> pages_;
+    std::vector<Channel> page_states_;   // ページの最初のサンプルを計算する前のチャンネルの状態
+    std::vector<int32_t> page_next_;
+    int32_t free_page_;
+    size_t used_pages_;
+
+    std::vector<Entry> entries_;
+    int32_t free_entry_;
+    size_t entry_count_;
+    int32_t lru_head_;   // 最も最近使ったノート
+    int32_t lru_tail_;   // 最も長く使われていないノート
+
+    std::vector<int32_t> table_;   // キーのハッシュ表（開番地法）
+    size_t table_mask_;
+
+    uint32_t max_note_samples_;
+    std::array<Voice, CHANNEL_COUNT> voices_;
+    NoteCacheStats stats_;
+};
+
+} // namespace YM2151
+
+#endif // YM2151_NOTE_CACHE_H
@@ -0,0 +1,59 @@
+#ifndef YM2151_OFFLINE_H
+#define YM2151_OFFLINE_H
+
+#include "ym2151/ym2151.h"
+#include "ym2151/vgm.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace YM2151 {
+
+// チャンネル別の出力（OfflineRenderer::render の stems）
+using OfflineStems = std::array<std::vector<float>, CHANNEL_COUNT>;
+
+// 1つのチップの長い書き込み列のオフライン生成（チャンネル単位の並列化）
+//
+// 長い曲を1つのチップで書き出す場合、チャンネルごとにタイムラインを別々のスレッドで
+// 計算してから合成することで、複数のコアを使って生成する。
+// チャンネルごとに1つの Chip を持ち、書き込み列のうちそのチャンネルに影響するもの
+// （対象チャンネルのキーオン/オフ、周波数、アルゴリズムと、チャンネルを問わない書き込み）を適用する。
+// このコアではチャンネル間で共有する状態（LFO、ノイズ、タイマー）はチャンネルの出力に
+// 影響しないため、チャンネルどうしの依存はない。
+//
+// 出力は、同じ書き込み列をリセット直後の1つの Chip に書き込み時刻で区切りながら
+// generate() した場合（ym2151_render と同じ手順）とビット単位で同じ。
+// 作業領域を抑えるため、タイムラインは WINDOW サンプルごとに区切って生成と合成を繰り返す。
+class OfflineRenderer {
+public:
+    // 1回の生成・合成で処理するサンプル数
+    static constexpr uint32_t WINDOW = 1u << 18;
+
+    // threads が0ならハードウェアのスレッド数を使う（チャンネル数が上限）
+    explicit OfflineRenderer(uint32_t sample_rate = 44100, int threads = 0);
+
+    void setThreads(int threads);
+    int getThreads() const;
+
+    // 制御レート（Chip::setControlRate() と同じ。出力は同じ制御レートの Chip と一致する）
+    void setControlRate(int samples);
+    int getControlRate() const;
+    uint32_t getSampleRate() const;
+
+    // stream を total_samples + tail サンプル分生成し、generate() と同じ出力を mix に書き込む
+    // stems を指定すると generateStems() と同じチャンネル別出力も書き込む
+    // 失敗時は error に理由を設定して false を返す
+    bool render(const RegisterStream& stream, uint32_t tail, std::vector<float>& mix,
+                OfflineStems* stems = nullptr, std::string* error = nullptr) const;
+
+private:
+    uint32_t sample_rate_;
+    int threads_;
+    int control_rate_;
+};
+
+} // namespace YM2151
+
+#endif // YM2151_OFFLINE_H
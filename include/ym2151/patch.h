@@ -0,0 +1,61 @@
+#ifndef YM2151_PATCH_H
+#define YM2151_PATCH_H
+
+#include "ym2151/ym2151.h"
+#include <cstdint>
+#include <array>
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace YM2151 {
+
+// コンパイル済みの音色（チャンネル0基準のレジスタブロック）
+// 現在のコアが解釈するのは 0x20 のアルゴリズム（CON）とフィードバック（FB）だけで、
+// 0x38 とオペレータのレジスタ（0x40〜0xFF）への書き込みはレジスタ値として保持されるだけで
+// 音には影響しない。音色を適用して変わるのは CON / FB のみ。
+// CH: 行の SLOT（キーオンするスロット）は、このコアのキーオンがスロットを区別しないため使わない。
+struct Patch {
+    // 0x20 + 0x38 + 4オペレータ×6レジスタ
+    static constexpr int MAX_REGISTERS = 26;
+
+    int number = 0;
+    std::string name;
+    uint8_t count = 0;
+    std::array<RegWrite, MAX_REGISTERS> registers{};
+
+    // チャンネルに音色を適用（一括書き込み1回）
+    void apply(Chip& chip, int channel) const;
+};
+
+// 音色バンク
+// VOPM形式の .opm ファイルを一度だけ解析し、レジスタブロックとして保持する。
+class PatchBank {
+public:
+    PatchBank();
+    ~PatchBank();
+
+    void clear();
+
+    // .opm ファイルの読み込み（失敗時は error に理由を設定して false を返す）
+    bool loadOPM(const std::string& path, std::string* error = nullptr);
+    bool parseOPM(std::istream& in, std::string* error = nullptr);
+
+    // 音色の追加（同じ番号の音色は置き換える）
+    void add(const Patch& patch);
+
+    // 音色番号による検索（存在しなければ nullptr）
+    const Patch* find(int number) const;
+    size_t size() const;
+
+    // 音色番号の音色をチャンネルに適用（存在しなければ false）
+    bool apply(Chip& chip, int channel, int number) const;
+
+private:
+    std::vector<Patch> patches_;
+    std::array<int16_t, 256> index_;  // 音色番号 → patches_ のインデックス
+};
+
+} // namespace YM2151
+
+#endif // YM2151_PATCH_H
@@ -0,0 +1,81 @@
+#ifndef YM2151_RECORDER_H
+#define YM2151_RECORDER_H
+
+#include "ym2151/ym2151.h"
+#include "ym2151/vgm.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace YM2151 {
+
+// レジスタ書き込みの記録
+//
+// Chip::setRecorder() で取り付けると、Chip へのレジスタ書き込みを
+// その時点のサンプル位置（取り付けてから生成したサンプル数）とともに記録する。
+// 記録した書き込み列は VGM として書き出せるので、本番環境のセッションを
+// オフラインで決定的に再現したり、回帰テスト用の素材として使える。
+//
+// 記録領域は構築時（または reserve()）に固定長のチャンクとしてまとめて確保し、
+// 記録中はメモリ確保や入出力を行わない（record / advance / clear はリアルタイム安全）。
+// 容量を超えた書き込みは記録せず、dropped() で数を確認できる。
+//
+// 再生時に同じ出力を得るには、リセット直後の Chip に取り付けること
+// （取り付け前のレジスタ状態は記録されない）。記録中にサンプリングレートを変更しないこと。
+class Recorder {
+public:
+    // 1チャンクあたりの書き込み数
+    static constexpr size_t CHUNK_SIZE = 4096;
+
+    // capacity 個の書き込みを記録できる領域を確保する
+    explicit Recorder(size_t capacity = 256 * 1024);
+    ~Recorder();
+
+    Recorder(const Recorder&) = delete;
+    Recorder& operator=(const Recorder&) = delete;
+
+    // 記録できる書き込み数を capacity 以上に増やす（レンダリング中は呼ばないこと）
+    void reserve(size_t capacity);
+
+    // 記録内容の消去（確保した領域は保持する）
+    void clear() noexcept;
+
+    // 書き込みの記録とサンプル位置の進行（Chip から呼ばれる）
+    void record(uint8_t reg, uint8_t value) noexcept;
+    void advance(int samples) noexcept;
+
+    // チップの設定（Chip::setRecorder() / setSampleRate() から設定される）
+    void setClock(uint32_t clock) noexcept;
+    void setSampleRate(uint32_t rate) noexcept;
+    uint32_t getClock() const noexcept;
+    uint32_t getSampleRate() const noexcept;
+
+    size_t size() const noexcept;
+    size_t capacity() const noexcept;
+    uint64_t dropped() const noexcept;
+    uint32_t position() const noexcept;
+
+    // i 番目の書き込み
+    const TimedWrite& operator[](size_t index) const noexcept;
+
+    // 記録内容を書き込み列に変換する（時刻はサンプリングレートのサンプル単位）
+    void exportStream(RegisterStream& stream) const;
+
+    // 記録内容をVGMとして書き出す
+    void writeVGM(std::vector<uint8_t>& data) const;
+    bool saveVGM(const std::string& path, std::string* error = nullptr) const;
+
+private:
+    std::vector<std::unique_ptr<TimedWrite[]>> chunks_;
+    size_t size_;
+    uint64_t dropped_;
+    uint32_t position_;
+    uint32_t clock_;
+    uint32_t sample_rate_;
+};
+
+} // namespace YM2151
+
+#endif // YM2151_RECORDER_H
@@ -0,0 +1,66 @@
+#ifndef YM2151_REFERENCE_H
+#define YM2151_REFERENCE_H
+
+#include "ym2151/ym2151.h"
+#include <cstdint>
+#include <array>
+
+namespace YM2151 {
+
+// リファレンス実装
+// OPMのデータパスを1サンプルずつそのまま計算する、読みやすさ優先の実装。
+// 高速化のための事前計算やキャッシュは一切行わない。
+// 製品用の Chip / Channel / Operator を最適化する際の比較対象として使い、
+// Chip と同じ入力に対して同じ出力（ビット単位で一致）を返すことを
+// tools/ym2151_diff.cpp で検査する。
+class ReferenceChip {
+public:
+    ReferenceChip(uint32_t clock = 3579545);
+
+    void reset();
+    void setSampleRate(uint32_t rate);
+    void setRegister(uint8_t reg, uint8_t value);
+    uint8_t getRegister(uint8_t reg) const;
+    void generate(float* buffer, int samples);
+
+    // オペレータのパラメータの設定（Chip の getChannel(channel).getOperator(op).setParameter() に相当）
+    // オペレータのレジスタはまだ解釈しないので、エンベロープなどを変えて比較する場合に使う
+    void setOperatorParameter(int channel, int op, const FMParameter& param);
+
+private:
+    struct OperatorState {
+        FMParameter params;
+        EnvelopeState env_state;
+        float env_level;
+        float env_rate;
+        float envelope;
+    };
+
+    struct ChannelState {
+        std::array<OperatorState, 4> ops;
+        uint16_t frequency;
+        uint8_t algorithm;
+        uint8_t feedback;
+        bool key_on;
+        float phase;
+        float feedback_buffer[2];
+    };
+
+    static void resetOperator(OperatorState& op);
+    static void keyOnOperator(OperatorState& op);
+    static void keyOffOperator(OperatorState& op);
+    static void stepEnvelope(OperatorState& op);
+    static float operatorOutput(OperatorState& op, float phase, float modulation);
+    float channelOutput(ChannelState& channel);
+
+    uint32_t clock_;
+    uint32_t sample_rate_;
+    std::array<uint8_t, REGISTER_COUNT> registers_;
+    std::array<ChannelState, CHANNEL_COUNT> channels_;
+    uint8_t lfo_frequency_;
+    float lfo_phase_;
+};
+
+} // namespace YM2151
+
+#endif // YM2151_REFERENCE_H
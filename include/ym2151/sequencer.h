@@ -0,0 +1,130 @@
+#ifndef YM2151_SEQUENCER_H
+#define YM2151_SEQUENCER_H
+
+#include "ym2151/ym2151.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace YM2151 {
+
+// シーケンサのイベント（時刻はティック単位）
+struct SequenceEvent {
+    enum class Type : uint8_t {
+        NOTE_ON,    // channel のノート note をキーオン（周波数は midiNoteToFrequency()）
+        NOTE_OFF,   // channel をキーオフ
+        REGISTER,   // レジスタ reg に value を書き込む
+        TEMPO       // テンポを tempo（4分音符あたりのマイクロ秒）に変更
+    };
+
+    uint32_t tick;
+    Type type;
+    uint8_t channel;
+    uint8_t note;
+    uint8_t reg;
+    uint8_t value;
+    uint32_t tempo;
+
+    static SequenceEvent noteOn(uint32_t tick, uint8_t channel, uint8_t note) {
+        return SequenceEvent{tick, Type::NOTE_ON, channel, note, 0, 0, 0};
+    }
+
+    static SequenceEvent noteOff(uint32_t tick, uint8_t channel) {
+        return SequenceEvent{tick, Type::NOTE_OFF, channel, 0, 0, 0, 0};
+    }
+
+    static SequenceEvent write(uint32_t tick, uint8_t reg, uint8_t value) {
+        return SequenceEvent{tick, Type::REGISTER, 0, 0, reg, value, 0};
+    }
+
+    static SequenceEvent setTempo(uint32_t tick, uint32_t microseconds_per_quarter) {
+        return SequenceEvent{tick, Type::TEMPO, 0, 0, 0, 0, microseconds_per_quarter};
+    }
+};
+
+// ブロック単位でイベントを処理するシーケンサ
+//
+// 時刻順のイベント列を受け取り、チップへの書き込みとレンダリングを行う。
+// イベントの時刻（ティック）はテンポと分解能からサンプル位置に換算し、
+// イベントの間の区間はそれぞれ1回の Chip::generate() でまとめて生成する
+// （タイミングはサンプル単位で正確で、generate() の呼び出しは最小になる）。
+// 換算はテンポ変更の位置を起点とした整数演算で行うため、長い曲でも誤差は積算しない。
+//
+// イベントは再生中にも追加できる（ライブ入力など）。キューは構築時に確保した固定長の
+// リングバッファで、溢れたイベントは追加できない（add() が false を返す）。
+// 現在位置より前の時刻のイベントは次の render() の先頭で適用する。
+//
+// render / add / pause / resume はメモリ確保を行わない（リアルタイム安全）。
+class Sequencer {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 4096;
+    static constexpr uint16_t DEFAULT_TICKS_PER_QUARTER = 480;
+    static constexpr uint32_t DEFAULT_TEMPO = 500000;  // 120 BPM
+
+    explicit Sequencer(size_t capacity = DEFAULT_CAPACITY);
+    ~Sequencer();
+
+    // イベントの消去と再生位置・テンポの初期化（分解能とサンプリングレートは保持する）
+    void reset() noexcept;
+
+    // サンプリングレート（チップの設定と合わせること）と分解能
+    // 再生位置が0でイベントを適用していない状態で設定すること
+    void setSampleRate(uint32_t rate) noexcept;
+    void setTicksPerQuarter(uint16_t ticks) noexcept;
+    uint32_t getSampleRate() const noexcept;
+    uint16_t getTicksPerQuarter() const noexcept;
+
+    // 再生開始時のテンポ（4分音符あたりのマイクロ秒）
+    void setTempo(uint32_t microseconds_per_quarter) noexcept;
+    uint32_t getTempo() const noexcept;
+
+    // イベントの追加（時刻は直前に追加したイベント以降であること。
+    // 前に戻る時刻は直前のイベントの時刻に揃える）
+    bool add(const SequenceEvent& event) noexcept;
+    // 追加できたイベントの数を返す
+    size_t add(const SequenceEvent* events, size_t count) noexcept;
+
+    // 一時停止中の render() は無音を書き込み、チップも再生位置も進めない
+    void pause() noexcept;
+    void resume() noexcept;
+    bool isPaused() const noexcept;
+
+    // 期限の来たイベントを適用しながら samples サンプルを生成する
+    void render(Chip& chip, float* buffer, int samples) noexcept;
+
+    // ティックをサンプル位置に換算する（現在のテンポが以降も続くとして）
+    uint64_t tickToSample(uint32_t tick) const noexcept;
+
+    uint64_t currentSample() const noexcept;
+    size_t pendingEvents() const noexcept;
+    bool finished() const noexcept;
+
+    // render() 内で呼んだ Chip::generate() の回数
+    uint64_t generateCalls() const noexcept;
+
+private:
+    void apply(Chip& chip, const SequenceEvent& event) noexcept;
+
+    // イベントキュー（リングバッファ）
+    std::vector<SequenceEvent> queue_;
+    size_t queue_head_;
+    size_t queue_size_;
+    uint32_t last_tick_;
+
+    uint32_t sample_rate_;
+    uint16_t ticks_per_quarter_;
+    uint32_t initial_tempo_;
+
+    // テンポの起点（最後にテンポを変更したティックとそのサンプル位置）
+    uint32_t tempo_;
+    uint32_t anchor_tick_;
+    uint64_t anchor_sample_;
+
+    uint64_t now_;
+    bool paused_;
+    uint64_t generate_calls_;
+};
+
+} // namespace YM2151
+
+#endif // YM2151_SEQUENCER_H
@@ -0,0 +1,74 @@
+#ifndef YM2151_VGM_H
+#define YM2151_VGM_H
+
+#include "ym2151/ym2151.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace YM2151 {
+
+// VGMファイルの時間単位（サンプル/秒）
+constexpr uint32_t VGM_SAMPLE_RATE = 44100;
+
+// レジスタ書き込み列（時刻順）と全体の長さ
+struct RegisterStream {
+    std::vector<TimedWrite> writes;
+    uint32_t total_samples = 0;  // 最後の待ち時間を含む長さ
+    uint32_t clock = 3579545;    // チップのクロック
+};
+
+// 書き込み列を書き込み時刻で区切りながら生成する
+// position から samples サンプルの間に時刻が来る書き込み（writes[next] 以降）を apply(write) で適用し、
+// 次の書き込みの時刻までの区間を generate(offset, count) で生成する（offset は position からのサンプル数）。
+// 各書き込みはその時刻のサンプルを生成する前に適用されるので、出力はサンプル単位で正確になる。
+// next は次に適用する書き込みの位置に進む（続きの区間は同じ next で呼び出す）。
+template <typename Apply, typename Generate>
+void renderBetweenWrites(const std::vector<TimedWrite>& writes, size_t& next, uint64_t position, int samples,
+                         Apply&& apply, Generate&& generate) {
+    int offset = 0;
+    while (offset < samples) {
+        while (next < writes.size() && writes[next].time <= position + offset) {
+            apply(writes[next]);
+            ++next;
+        }
+        int count = samples - offset;
+        if (next < writes.size()) {
+            count = static_cast<int>(std::min<uint64_t>(count, writes[next].time - (position + offset)));
+        }
+        generate(offset, count);
+        offset += count;
+    }
+}
+
+// renderBetweenWrites() で chip に書き込みを適用しながら buffer に samples サンプルを生成する
+void renderWrites(Chip& chip, const std::vector<TimedWrite>& writes, size_t& next, uint64_t position,
+                  float* buffer, int samples);
+
+// VGMデータからYM2151（1チップ目）の書き込みを抽出する
+// 時刻は sample_rate のサンプル単位に換算する
+bool parseVGM(const uint8_t* data, size_t size, uint32_t sample_rate,
+              RegisterStream& stream, std::string* error = nullptr);
+
+// レジスタスクリプトの読み込み
+// 1行に1コマンド（'#' 以降はコメント）
+//   RR VV    : レジスタ RR に値 VV を書き込む（16進数）
+//   wait N   : N サンプル待つ（10進数、出力サンプルレート単位）
+bool parseRegisterScript(std::istream& in, RegisterStream& stream, std::string* error = nullptr);
+
+// レジスタ書き込み列をVGMデータ（v1.50、YM2151 1チップ）に変換する
+// stream の時刻は sample_rate のサンプル単位。VGMの44100Hz単位に換算し、
+// 連続する待ち時間は1つにまとめて最も短いコマンド（0x7n / 0x62 / 0x63 / 0x61）で書き出す。
+// sample_rate が44100の場合、parseVGM() で読み戻した書き込み列は元と完全に一致する。
+void writeVGM(const RegisterStream& stream, uint32_t sample_rate, std::vector<uint8_t>& data);
+
+// writeVGM() の結果をファイルに保存する
+bool saveVGM(const std::string& path, const RegisterStream& stream, uint32_t sample_rate,
+             std::string* error = nullptr);
+
+} // namespace YM2151
+
+#endif // YM2151_VGM_H
@@ -1,6 +1,7 @@
 #ifndef YM2151_H
 #define YM2151_H
 
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 #include <array>
@@ -17,6 +18,38 @@ constexpr int OPERATOR_COUNT = 32;
 // チャンネル数
 constexpr int CHANNEL_COUNT = 8;
 
+// 内部でまとめて処理するサンプル数
+constexpr int RENDER_BLOCK = 64;
+
+// 制御レート（エンベロープとLFOを更新する間隔のサンプル数）の上限
+constexpr int MAX_CONTROL_RATE = RENDER_BLOCK;
+
+// 命令セット別の処理カーネル（内部用）
+struct Kernels;
+struct MeterSums;
+
+// レジスタ書き込みの記録（ym2151/recorder.h）
+class Recorder;
+
+// チャンネル別とマスターのレベルメーター（ym2151/meter.h）
+class LevelMeter;
+
+// 同じノートの出力を再利用するキャッシュ（ym2151/note_cache.h）
+class NoteCache;
+
+// タイムスタンプ付きレジスタ書き込み（time はサンプル単位）
+struct TimedWrite {
+    uint32_t time;
+    uint8_t  reg;
+    uint8_t  value;
+};
+
+// レジスタ書き込み（一括書き込み用）
+struct RegWrite {
+    uint8_t reg;
+    uint8_t value;
+};
+
 // FM音源のパラメータ構造体
 struct FMParameter {
     uint8_t dt1;    // Detune 1
@@ -50,12 +83,24 @@ public:
 
     void reset();
     void setParameter(const FMParameter& param);
-    float getOutput(float phase, float modulation);
+    float getOutput(float phase, float modulation) noexcept;
     
     // エンベロープ制御
-    void keyOn();
-    void keyOff();
-    void updateEnvelope();
+    void keyOn() noexcept;
+    void keyOff() noexcept;
+    void updateEnvelope() noexcept;
+
+    // 制御レートでのエンベロープの更新（Channel::render から使う）
+    // beginRamp: steps サンプル後のエンベロープを求め、それまでの getOutput では線形に補間する
+    // endRamp: 補間を終え、エンベロープを求めた値に揃える
+    void beginRamp(int steps) noexcept;
+    void endRamp() noexcept;
+
+    // 以降の出力を決める状態が other とビット単位で同じか
+    bool sameState(const Operator& other) const noexcept;
+
+    // エンベロープの現在の状態（最小レベルまで減衰すると IDLE になる）
+    EnvelopeState envelopeState() const noexcept;
 
 private:
     FMParameter params_;
@@ -67,6 +112,27 @@ private:
     EnvelopeState env_state_;
     float env_level_;
     float env_rate_;
+    
+    // パラメータから求めた値（setParameter時に計算）
+    float detune_;
+    float frequency_multiplier_;
+    float sustain_level_;
+    
+    // 制御レートでの補間
+    bool ramping_;
+    float ramp_step_;
+    float ramp_target_;
+    
+    // steps サンプル分の減衰率 (1 - env_rate_)^steps（env_rate_ と steps が変わった時だけ計算）
+    float block_factor_;
+    float block_rate_;
+    int block_steps_;
+    
+    void updateDerivedParameters() noexcept;
+    void advanceEnvelope(int steps) noexcept;
+    
+    // キャッシュのキーに音色パラメータを使う
+    friend class NoteCache;
 };
 
 // チャンネルクラス
@@ -76,14 +142,24 @@ public:
     ~Channel();
 
     void reset();
-    void setFrequency(uint16_t frequency);
-    void setAlgorithm(uint8_t algorithm);
-    void setFeedback(uint8_t feedback);
+    void setFrequency(uint16_t frequency) noexcept;
+    void setAlgorithm(uint8_t algorithm) noexcept;
+    void setFeedback(uint8_t feedback) noexcept;
     void setSampleRate(uint32_t rate);
-    void keyOn();
-    void keyOff();
-    void updateEnvelopes();
-    float getOutput();
+    void keyOn() noexcept;
+    void keyOff() noexcept;
+    void updateEnvelopes() noexcept;
+    float getOutput() noexcept;
+
+    // samples サンプル分の出力を out に書き込む
+    // control_rate が1ならサンプルごとに getOutput() した場合と同じ。2以上なら
+    // control_rate サンプルごとにエンベロープを求め、その間は線形に補間する
+    // （区間は呼び出しをまたいで続くので、出力は呼び出しの区切り方によらない）
+    void render(float* out, int samples, int control_rate = 1) noexcept;
+
+    // 以降の出力を決める状態（音色、周波数、位相、フィードバック、エンベロープ）が
+    // other とビット単位で同じか（同じなら同じ書き込みを与える限り出力も同じ）
+    bool sameState(const Channel& other) const noexcept;
 
     Operator& getOperator(int index);
 
@@ -97,24 +173,105 @@ private:
     float output_;
     float feedback_buffer_[2];
     float phase_accumulator_; // 位相累積用の変数
+    float phase_increment_;   // 1サンプルあたりの位相増分
+    
+    // 制御レートの区間
+    int ramp_rate_;           // 区間の長さ（render に渡された制御レート）
+    int ramp_remaining_;      // 区間の残りサンプル数（0なら次の render で新しい区間を始める）
+    bool ramp_active_;        // オペレータがエンベロープを補間中
+    
+    void updatePhaseIncrement() noexcept;
+    void cancelRamp() noexcept;
+    
+    // キャッシュのキーに発音の開始状態を使う
+    friend class NoteCache;
 };
 
 // YM2151チップクラス
+//
+// リアルタイム安全性:
+//   setRegister / setRegisters / setChannelRegisters / getRegister /
+//   generate / generateStems はリアルタイム安全（noexcept）。
+//   これらはメモリ確保・解放、ロック、システムコール（標準出力への書き込みを含む）を
+//   一切行わないため、オーディオコールバック内から呼び出せる。
+//   コンストラクタ、reset、setSampleRate はこの保証の対象外。
+//   同じChipを複数のスレッドから同時に操作する場合は呼び出し側で同期すること。
+//   この保証は tools/ym2151_rt_audit.cpp で検査している。
 class Chip {
 public:
     Chip(uint32_t clock = 3579545);
     ~Chip();
 
     void reset();
-    void setRegister(uint8_t reg, uint8_t value);
-    uint8_t getRegister(uint8_t reg) const;
-    void generate(float* buffer, int samples);
+    void setRegister(uint8_t reg, uint8_t value) noexcept;
+    uint8_t getRegister(uint8_t reg) const noexcept;
+
+    // レジスタの一括書き込み
+    // 書き込みをまとめてデコードし、チャンネルの派生状態（周波数、アルゴリズム、
+    // フィードバック）は影響を受けたチャンネルごとに一度だけ再計算する。
+    // キーオン/オフ（0x08）はそれまでの書き込みを反映してから順番通りに処理する。
+    void setRegisters(const RegWrite* writes, size_t count) noexcept;
+
+    // チャンネル相対のレジスタブロックを書き込む（実際のレジスタ = reg + channel）
+    void setChannelRegisters(int channel, const RegWrite* writes, size_t count) noexcept;
+    void generate(float* buffer, int samples) noexcept;
+    
+    // 16ビット整数PCMでの音声生成（generate() の出力を32767倍して飽和させたもの）
+    void generate(int16_t* buffer, int samples) noexcept;
+
+    // チャンネル別出力（ステム）の生成
+    // 1回のレンダリングで各チャンネルの寄与を stems[ch] に書き込む。
+    // stems[ch] が nullptr のチャンネルは書き込みを省略する。
+    // mix を指定すると generate() と同じミックス出力も同時に書き込む。
+    void generateStems(float* const stems[CHANNEL_COUNT], int samples, float* mix = nullptr) noexcept;
     
     // サンプリングレートの設定
     void setSampleRate(uint32_t rate);
 
     // チャンネルの取得
+    // 取得した参照を通じた変更は、次の generate / generateStems の前に行うこと
+    // （重複チャンネルの判定はこの呼び出しの時点でやり直す）
     Channel& getChannel(int index);
+    
+    // 直前の生成で、他のチャンネルと状態が同じために出力を共有したチャンネル数
+    // 状態がビット単位で同じチャンネル（同じ音色・周波数でのユニゾンや音量のための重ね）は
+    // 1回だけ計算し、その出力と状態を他のチャンネルに写す。出力は変わらない。
+    // いずれかのチャンネルに書き込みがあると判定をやり直し、状態が異なれば別々に計算する。
+    int sharedChannelCount() const noexcept;
+    
+    // 制御レート（エンベロープとLFOを更新する間隔のサンプル数、1〜MAX_CONTROL_RATE）
+    // 1（既定）はサンプルごとに更新する実機準拠のモードで、リファレンス実装と一致する。
+    // 2以上では制御レートごとに値を求め、その間のエンベロープは線形に補間する
+    // （試聴・下書き用。出力は1の場合と一致しない。ノートキャッシュは使わない）。
+    // 区間は generate / generateStems の呼び出しをまたいで続き（キーオン/オフでは
+    // その時点から区間の終わりまでを補間し直す）、出力は呼び出しの区切り方によらない。
+    void setControlRate(int samples) noexcept;
+    int getControlRate() const noexcept;
+    
+    // 使用中の処理カーネルの名前（"scalar", "sse2", "avx2", "avx512"）
+    // 構築時にCPUの対応状況から選択する。環境変数 YM2151_ISA で上限を指定できる。
+    const char* kernelName() const;
+
+    // レジスタ書き込みの記録先の設定（nullptr で記録を止める）
+    // 取り付けた後の setRegister / setRegisters / setChannelRegisters の書き込みを、
+    // generate / generateStems で進めたサンプル位置とともに recorder に記録する。
+    // recorder は取り外すまで有効であること。記録はリアルタイム安全。
+    void setRecorder(Recorder* recorder);
+    Recorder* getRecorder() const;
+
+    // レベルメーターの取り付け（nullptr で計測を止める）
+    // 取り付けている間は generate / generateStems のミックス処理の中でレベルを集計し、
+    // 呼び出しごとに meter に公開する。出力は変わらない。計測はリアルタイム安全。
+    // meter は取り外すまで有効であること。
+    void setMeter(LevelMeter* meter);
+    LevelMeter* getMeter() const;
+
+    // ノートキャッシュの取り付け（nullptr で使用を止める）
+    // 取り付けている間は、開始状態が同じノートの出力をキャッシュから再生する。
+    // 出力は変わらない。キャッシュの参照と記録はリアルタイム安全。
+    // cache は取り外すまで有効であること。
+    void setNoteCache(NoteCache* cache);
+    NoteCache* getNoteCache() const;
 
 private:
     uint32_t clock_;
@@ -122,6 +279,28 @@ private:
     std::array<uint8_t, REGISTER_COUNT> registers_;
     std::array<Channel, CHANNEL_COUNT> channels_;
     
+    // ミックス・変換処理のカーネルとチャンネル出力の作業領域
+    const Kernels* kernels_;
+    std::array<std::array<float, RENDER_BLOCK>, CHANNEL_COUNT> channel_buffer_;
+    
+    // レジスタ書き込みの記録先（記録しない場合は nullptr）
+    Recorder* recorder_;
+    
+    // レベルの公開先（計測しない場合は nullptr）
+    LevelMeter* meter_;
+    
+    // ノートキャッシュ（使わない場合は nullptr）
+    NoteCache* note_cache_;
+    
+    // 制御レート（1ならサンプルごと）と、LFOを進めていないサンプル数
+    int control_rate_;
+    int lfo_pending_;
+    
+    // 重複チャンネル（出力を写す元のチャンネル番号、自分で計算する場合は -1）
+    std::array<int8_t, CHANNEL_COUNT> duplicate_of_;
+    bool duplicates_dirty_;   // チャンネルの状態が変わり、判定をやり直す必要がある
+    int shared_channels_;
+    
     // 内部タイマー
     uint8_t timer_a_val_;
     uint8_t timer_b_val_;
@@ -136,11 +315,19 @@ private:
     float lfo_phase_;
     float lfo_am_depth_;
     float lfo_pm_depth_;
+    uint32_t lfo_noise_state_;  // ランダム波形用の乱数状態
     
     // 内部処理用
-    void updateTimers();
-    void updateLFO();
-    float getLFOValue();
+    void decodeRegister(uint8_t reg, uint8_t value) noexcept;
+    void releaseCachedChannels() noexcept;
+    void updateChannelFrequency(int channel) noexcept;
+    void updateChannelAlgorithm(int channel) noexcept;
+    void updateDuplicates() noexcept;
+    void renderChannels(int samples) noexcept;
+    void finishBlock(MeterSums& sums, int samples) noexcept;
+    void updateTimers() noexcept;
+    void updateLFO(int samples) noexcept;
+    float getLFOValue() noexcept;
 };
 
 } // namespace YM2151
@@ -0,0 +1,97 @@
+#ifndef YM2151_C_H
+#define YM2151_C_H
+
+/*
+ * YM2151エミュレータのC API
+ * C++のクラスを扱えないホスト（プラグインホスト、スクリプト言語のFFIなど）向けの
+ * 不透明ハンドルによるインタフェース。共有ライブラリ ym2151_c として提供する。
+ *
+ * ABIの方針:
+ *   - 公開する構造体はすべて固定長の整数型のみで構成し、既存メンバの順序と型は変更しない
+ *   - 構造体を拡張する場合は末尾にのみ追加する（ym2151_stats は size メンバで判別）
+ *   - 互換性のない変更を行った場合は YM2151_C_ABI_VERSION を上げる
+ *
+ * ym2151_create / ym2151_destroy 以外の関数はメモリ確保やコピーを行わず、
+ * 呼び出し側のバッファへ直接書き込む。レジスタ書き込みと生成の関数は
+ * Chip と同じくリアルタイム安全（オーディオスレッドから呼び出せる）。
+ * 1つのハンドルを複数のスレッドから同時に操作してはならない。
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#  if defined(YM2151_C_EXPORTS)
+#    define YM2151_C_API __declspec(dllexport)
+#  else
+#    define YM2151_C_API __declspec(dllimport)
+#  endif
+#elif defined(__GNUC__)
+#  define YM2151_C_API __attribute__((visibility("default")))
+#else
+#  define YM2151_C_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ABIのバージョン（ym2151_abi_version() の戻り値と比較する） */
+#define YM2151_C_ABI_VERSION 1u
+
+/* チャンネル数 */
+#define YM2151_C_CHANNEL_COUNT 8
+
+/* チップのハンドル */
+typedef struct ym2151_chip ym2151_chip;
+
+/* レジスタ書き込み（YM2151::RegWrite と同じレイアウト） */
+typedef struct ym2151_write {
+    uint8_t reg;
+    uint8_t value;
+} ym2151_write;
+
+/* 統計情報 */
+typedef struct ym2151_stats {
+    uint32_t size;              /* 呼び出し側で sizeof(ym2151_stats) を設定する */
+    uint32_t reserved;
+    uint64_t samples_rendered;  /* 生成したサンプル数 */
+    uint64_t render_calls;      /* 生成関数の呼び出し回数 */
+    uint64_t register_writes;   /* レジスタ書き込み数 */
+} ym2151_stats;
+
+/* ライブラリのABIバージョン */
+YM2151_C_API uint32_t ym2151_abi_version(void);
+
+/* チップの作成と破棄（確保に失敗した場合は NULL を返す） */
+YM2151_C_API ym2151_chip* ym2151_create(uint32_t clock, uint32_t sample_rate);
+YM2151_C_API void ym2151_destroy(ym2151_chip* chip);
+
+/* リセット（統計情報もクリアする） */
+YM2151_C_API void ym2151_reset(ym2151_chip* chip);
+YM2151_C_API void ym2151_set_sample_rate(ym2151_chip* chip, uint32_t sample_rate);
+
+/* レジスタの読み書き */
+YM2151_C_API void ym2151_write_register(ym2151_chip* chip, uint8_t reg, uint8_t value);
+YM2151_C_API void ym2151_write_registers(ym2151_chip* chip, const ym2151_write* writes, size_t count);
+YM2151_C_API uint8_t ym2151_read_register(const ym2151_chip* chip, uint8_t reg);
+
+/* 呼び出し側のバッファへのモノラル出力の生成 */
+YM2151_C_API void ym2151_render_f32(ym2151_chip* chip, float* buffer, size_t samples);
+YM2151_C_API void ym2151_render_s16(ym2151_chip* chip, int16_t* buffer, size_t samples);
+
+/* チャンネル別出力の生成（stems の要素と mix は NULL 可） */
+YM2151_C_API void ym2151_render_stems_f32(ym2151_chip* chip, float* const stems[YM2151_C_CHANNEL_COUNT],
+                                          float* mix, size_t samples);
+
+/* 統計情報の取得（stats->size までのメンバを書き込む） */
+YM2151_C_API void ym2151_get_stats(const ym2151_chip* chip, ym2151_stats* stats);
+
+/* 使用中の処理カーネルの名前 */
+YM2151_C_API const char* ym2151_kernel_name(const ym2151_chip* chip);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* YM2151_C_H */
@@ -0,0 +1,362 @@
+#include "ym2151/board.h"
+#include "semaphore.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <system_error>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#define YM2151_PAUSE_X86 1
+#elif defined(_M_ARM64)
+#include <intrin.h>
+#endif
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace YM2151 {
+
+// チップ1つ分の状態とワーカー
+struct Board::Slot {
+    explicit Slot(uint32_t clock) : chip(clock) {}
+
+    Chip chip;
+    std::atomic<float> gain{1.0f};
+    std::atomic<float> pan{0.0f};
+
+    // 次のブロックに適用する書き込み（オーディオスレッドが追加する）
+    std::vector<RegWrite> pending;
+    // 依頼したブロックの書き込みと出力（ブロック番号の偶奇で二重化）
+    std::vector<RegWrite> job_writes[2];
+    std::vector<float> output[2];
+
+    // ワーカーとの受け渡し（依頼のたびに wake を1回、完了のたびに done を1回通知する）
+    std::thread worker;
+    Semaphore wake;
+    Semaphore done;
+    std::atomic<uint64_t> requested{0};
+    std::atomic<bool> quit{false};
+    std::atomic<uint64_t> completed{0};
+};
+
+namespace {
+
+constexpr float QUARTER_PI = 0.78539816339744830962f;
+
+// render() がワーカーの完了を待つ際に、眠る前にスピンする回数
+// （PAUSE 1回は数十〜百数十サイクルなので、合計で数十マイクロ秒程度）
+constexpr int SPIN_COUNT = 1000;
+
+void setError(std::string* error, const std::string& message) {
+    if (error) {
+        *error = message;
+    }
+}
+
+// スピン待ちの1回分（同じコアの別のハードウェアスレッドに実行資源を譲る）
+inline void cpuPause() noexcept {
+#if defined(YM2151_PAUSE_X86)
+    _mm_pause();
+#elif defined(_M_ARM64)
+    __yield();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// 呼び出し元のスレッドのスケジューリングポリシーと優先度をワーカーに設定する
+// （オーディオスレッドより低い優先度のワーカーを render() が待つと、優先度逆転になる）
+// Windows では std::thread のハンドルの型が処理系によって異なるため、ワーカーが起動時に
+// 自身に設定する（Board::start を参照）
+bool copyScheduling(std::thread& worker, std::string* error) {
+#if defined(_WIN32)
+    (void)worker;
+    (void)error;
+#else
+    int policy;
+    sched_param param{};
+    int result = pthread_getschedparam(pthread_self(), &policy, &param);
+    if (result == 0) {
+        result = pthread_setschedparam(worker.native_handle(), policy, &param);
+    }
+    if (result != 0) {
+        setError(error, std::string("cannot set the worker scheduling policy: ") + std::strerror(result));
+        return false;
+    }
+#endif
+    return true;
+}
+
+} // namespace
+
+Board::Board(uint32_t sample_rate)
+    : sample_rate_(sample_rate),
+      block_frames_(0),
+      running_(false),
+      threaded_(false),
+      job_(0),
+      dropped_(0) {
+}
+
+Board::~Board() {
+    stop();
+}
+
+int Board::addChip(uint32_t clock, float gain, float pan, std::string* error) {
+    if (running_) {
+        setError(error, "cannot add a chip while the board is running");
+        return -1;
+    }
+    if (static_cast<int>(slots_.size()) >= MAX_CHIPS) {
+        setError(error, "too many chips (max " + std::to_string(MAX_CHIPS) + ")");
+        return -1;
+    }
+
+    auto slot = std::make_unique<Slot>(clock);
+    slot->chip.setSampleRate(sample_rate_);
+    slot->gain.store(gain);
+    slot->pan.store(std::clamp(pan, -1.0f, 1.0f));
+    slot->pending.reserve(WRITE_QUEUE_CAPACITY);
+    for (auto& writes : slot->job_writes) {
+        writes.reserve(WRITE_QUEUE_CAPACITY);
+    }
+    slots_.push_back(std::move(slot));
+    return static_cast<int>(slots_.size()) - 1;
+}
+
+int Board::chipCount() const {
+    return static_cast<int>(slots_.size());
+}
+
+Chip& Board::chip(int index) {
+    return slots_[index]->chip;
+}
+
+uint32_t Board::getSampleRate() const {
+    return sample_rate_;
+}
+
+void Board::setGain(int index, float gain) noexcept {
+    slots_[index]->gain.store(gain, std::memory_order_relaxed);
+}
+
+void Board::setPan(int index, float pan) noexcept {
+    slots_[index]->pan.store(std::clamp(pan, -1.0f, 1.0f), std::memory_order_relaxed);
+}
+
+float Board::getGain(int index) const noexcept {
+    return slots_[index]->gain.load(std::memory_order_relaxed);
+}
+
+float Board::getPan(int index) const noexcept {
+    return slots_[index]->pan.load(std::memory_order_relaxed);
+}
+
+bool Board::start(int block_frames, bool threaded, std::string* error) {
+    if (running_) {
+        setError(error, "the board is already running");
+        return false;
+    }
+    if (block_frames <= 0) {
+        setError(error, "block size must be positive");
+        return false;
+    }
+
+    block_frames_ = block_frames;
+    job_ = 0;
+    for (auto& slot : slots_) {
+        for (int parity = 0; parity < 2; ++parity) {
+            slot->job_writes[parity].clear();
+            slot->output[parity].assign(static_cast<size_t>(block_frames), 0.0f);
+        }
+        slot->requested.store(0);
+        slot->quit.store(false);
+        slot->completed.store(0);
+    }
+
+    running_ = true;
+    threaded_ = threaded;
+    if (threaded_) {
+        for (auto& slot : slots_) {
+            try {
+                Slot* target = slot.get();
+#if defined(_WIN32)
+                const int priority = GetThreadPriority(GetCurrentThread());
+                slot->worker = std::thread([this, target, priority] {
+                    SetThreadPriority(GetCurrentThread(), priority);
+                    workerLoop(*target);
+                });
+#else
+                slot->worker = std::thread([this, target] { workerLoop(*target); });
+#endif
+            } catch (const std::system_error& e) {
+                stop();
+                setError(error, std::string("cannot start a worker thread: ") + e.what());
+                return false;
+            }
+            if (!copyScheduling(slot->worker, error)) {
+                stop();
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void Board::stop() {
+    if (!running_) {
+        return;
+    }
+    for (auto& slot : slots_) {
+        if (slot->worker.joinable()) {
+            slot->quit.store(true, std::memory_order_release);
+            slot->wake.post();
+            slot->worker.join();
+        }
+        // 待たずに終えたブロックの通知を捨てる（次の start() で数が合うように）
+        while (slot->wake.tryWait()) {
+        }
+        while (slot->done.tryWait()) {
+        }
+    }
+    running_ = false;
+    threaded_ = false;
+}
+
+bool Board::isRunning() const {
+    return running_;
+}
+
+bool Board::isThreaded() const {
+    return threaded_;
+}
+
+int Board::blockFrames() const {
+    return block_frames_;
+}
+
+int Board::latency() const {
+    return threaded_ ? block_frames_ : 0;
+}
+
+bool Board::write(int index, uint8_t reg, uint8_t value) noexcept {
+    std::vector<RegWrite>& pending = slots_[index]->pending;
+    if (pending.size() >= WRITE_QUEUE_CAPACITY) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    pending.push_back(RegWrite{reg, value});
+    return true;
+}
+
+uint64_t Board::droppedWrites() const noexcept {
+    return dropped_.load(std::memory_order_relaxed);
+}
+
+void Board::dispatch(Slot& slot, uint64_t job) noexcept {
+    // 書き込みを依頼するブロックに移す（容量を確保済みのベクタの交換なので確保は起きない）
+    std::vector<RegWrite>& writes = slot.job_writes[job & 1];
+    writes.clear();
+    writes.swap(slot.pending);
+
+    if (!threaded_) {
+        renderJob(slot, job);
+        return;
+    }
+    // 書き込みと前のブロックの出力は requested の release で渡す
+    slot.requested.store(job, std::memory_order_release);
+    slot.wake.post();
+}
+
+void Board::renderJob(Slot& slot, uint64_t job) noexcept {
+    const int parity = static_cast<int>(job & 1);
+    const std::vector<RegWrite>& writes = slot.job_writes[parity];
+    slot.chip.setRegisters(writes.data(), writes.size());
+    slot.chip.generate(slot.output[parity].data(), block_frames_);
+}
+
+void Board::workerLoop(Slot& slot) {
+    uint64_t done = 0;
+    for (;;) {
+        slot.wake.wait();
+        if (slot.quit.load(std::memory_order_acquire)) {
+            return;
+        }
+        const uint64_t job = slot.requested.load(std::memory_order_acquire);
+        if (job == done) {
+            continue;
+        }
+        renderJob(slot, job);
+        done = job;
+        slot.completed.store(job, std::memory_order_release);
+        slot.done.post();
+    }
+}
+
+void Board::mix(float* stereo, int parity) noexcept {
+    const size_t samples = static_cast<size_t>(block_frames_) * 2;
+    std::memset(stereo, 0, sizeof(float) * samples);
+
+    // チップの順に加算する（スレッドの有無によらず同じ結果になる）
+    for (auto& slot : slots_) {
+        // 定パワーのパン（中央で左右とも gain / √2）
+        const float gain = slot->gain.load(std::memory_order_relaxed);
+        const float angle = (slot->pan.load(std::memory_order_relaxed) + 1.0f) * QUARTER_PI;
+        const float left = gain * std::cos(angle);
+        const float right = gain * std::sin(angle);
+
+        const float* in = slot->output[parity].data();
+        for (int i = 0; i < block_frames_; ++i) {
+            stereo[i * 2] += in[i] * left;
+            stereo[i * 2 + 1] += in[i] * right;
+        }
+    }
+}
+
+void Board::render(float* stereo) noexcept {
+    if (!running_) {
+        std::memset(stereo, 0, sizeof(float) * static_cast<size_t>(block_frames_) * 2);
+        return;
+    }
+
+    if (!threaded_) {
+        ++job_;
+        for (auto& slot : slots_) {
+            dispatch(*slot, job_);
+        }
+        mix(stereo, static_cast<int>(job_ & 1));
+        return;
+    }
+
+    // 前回依頼したブロックの完了を待つ（最も遅いチップの1ブロック分の生成時間が上限）
+    // 完了間近なら起床の遅延を避けるために少しだけスピンし、間に合わなければセマフォで眠る。
+    // ワーカーはブロックごとに done を1回通知するので、スピン中に完了した場合も1回消費する
+    // （通知済みなら wait() はカーネルに入らずに戻る）
+    const uint64_t previous = job_;
+    if (previous > 0) {
+        for (auto& slot : slots_) {
+            for (int spin = 0; spin < SPIN_COUNT && slot->completed.load(std::memory_order_acquire) < previous;
+                 ++spin) {
+                cpuPause();
+            }
+            slot->done.wait();
+        }
+    }
+
+    // 次のブロックを依頼してから、前回のブロックを合成する
+    ++job_;
+    for (auto& slot : slots_) {
+        dispatch(*slot, job_);
+    }
+    if (previous > 0) {
+        mix(stereo, static_cast<int>(previous & 1));
+    } else {
+        std::memset(stereo, 0, sizeof(float) * static_cast<size_t>(block_frames_) * 2);
+    }
+}
+
+} // namespace YM2151
@@ -0,0 +1,138 @@
+#include "ym2151/chip_array.h"
+#include "denormal.h"
+#include "kernels.h"
+#include "lane_kernel.h"
+#include <algorithm>
+#include <cstring>
+
+namespace YM2151 {
+namespace detail {
+
+namespace {
+
+float phaseIncrement(uint16_t frequency, uint32_t sample_rate) noexcept {
+    // Channel::updatePhaseIncrement() と同じ式
+    return TWO_PI * frequency / static_cast<float>(sample_rate);
+}
+
+void keyOnLane(const LaneState& s, int lane, int channel) noexcept {
+    s.key_on[channel * s.lanes + lane] = 1;
+    for (int op = 0; op < 4; ++op) {
+        const int index = (channel * 4 + op) * s.lanes + lane;
+        // Operator::keyOn() と同じ（AR=31なので即座に最大レベルからディケイへ）
+        if (ATTACK_RATE == 31) {
+            s.env_level[index] = 1.0f;
+            s.env_state[index] = STATE_DECAY;
+            s.env_rate[index] = DECAY_RATE;
+        } else {
+            s.env_level[index] = 0.8f;
+            s.env_state[index] = STATE_ATTACK;
+            s.env_rate[index] = ATTACK_RATE * ATTACK_RATE_FACTOR * 10.0f;
+        }
+    }
+}
+
+void keyOffLane(const LaneState& s, int lane, int channel) noexcept {
+    s.key_on[channel * s.lanes + lane] = 0;
+    for (int op = 0; op < 4; ++op) {
+        const int index = (channel * 4 + op) * s.lanes + lane;
+        s.env_state[index] = STATE_RELEASE;
+        s.env_rate[index] = RELEASE_RATE;
+    }
+}
+
+// レーン lane の演算用状態を初期値にする（lane >= count のパディングも含む）
+void clearLane(const LaneState& s, int lane) noexcept {
+    for (int ch = 0; ch < CHANNEL_COUNT; ++ch) {
+        const int index = ch * s.lanes + lane;
+        s.phase[index] = 0.0f;
+        s.increment[index] = phaseIncrement(0, s.sample_rate);
+        s.feedback0[index] = 0.0f;
+        s.feedback1[index] = 0.0f;
+        s.feedback_scale[index] = 0.0f;
+        s.key_on[index] = 0;
+        s.connection[index] = algorithm_connection[0];
+        for (int op = 0; op < 4; ++op) {
+            const int op_index = (ch * 4 + op) * s.lanes + lane;
+            s.env_level[op_index] = 0.0f;
+            s.env_rate[op_index] = 0.0f;
+            s.env_state[op_index] = STATE_IDLE;
+        }
+    }
+}
+
+} // namespace
+
+void resetLanes(const LaneState& state) noexcept {
+    // テーブルとカーネルの選択はレンダリング前（構築時）に済ませておく
+    initSineTable();
+    selectKernels();
+    for (int lane = 0; lane < state.lanes; ++lane) {
+        clearLane(state, lane);
+    }
+    std::memset(state.registers, 0, static_cast<size_t>(state.count) * REGISTER_COUNT);
+}
+
+void resetLane(const LaneState& state, int lane) noexcept {
+    clearLane(state, lane);
+    std::memset(state.registers + lane * REGISTER_COUNT, 0, REGISTER_COUNT);
+}
+
+void updateLaneIncrements(const LaneState& state) noexcept {
+    for (int lane = 0; lane < state.lanes; ++lane) {
+        const uint8_t* registers = lane < state.count ? state.registers + lane * REGISTER_COUNT : nullptr;
+        for (int ch = 0; ch < CHANNEL_COUNT; ++ch) {
+            const uint16_t frequency = registers
+                ? static_cast<uint16_t>((registers[0x18 + ch] << 8) | registers[0x10 + ch]) : 0;
+            state.increment[ch * state.lanes + lane] = phaseIncrement(frequency, state.sample_rate);
+        }
+    }
+}
+
+void writeLaneRegister(const LaneState& state, int lane, uint8_t reg, uint8_t value) noexcept {
+    // Chip::decodeRegister() と同じレジスタを解釈する（LFOとタイマーは出力に影響しないため保存のみ）
+    uint8_t* registers = state.registers + lane * REGISTER_COUNT;
+    registers[reg] = value;
+
+    if (reg == 0x08) {
+        // キーオン/オフ
+        if (value & 0x80) {
+            keyOnLane(state, lane, value & 0x07);
+        } else {
+            keyOffLane(state, lane, value & 0x07);
+        }
+    } else if (reg >= 0x10 && reg <= 0x1F) {
+        // チャンネル周波数
+        const int ch = reg & 0x07;
+        const uint16_t frequency = static_cast<uint16_t>((registers[0x18 + ch] << 8) | registers[0x10 + ch]);
+        state.increment[ch * state.lanes + lane] = phaseIncrement(frequency, state.sample_rate);
+    } else if (reg >= 0x20 && reg <= 0x27) {
+        // アルゴリズム、フィードバック
+        const int ch = reg & 0x07;
+        const int feedback = (value >> 3) & 0x07;
+        state.connection[ch * state.lanes + lane] = algorithm_connection[value & 0x07];
+        state.feedback_scale[ch * state.lanes + lane] = feedback * 0.1f;
+    }
+}
+
+void renderLanes(const LaneState& state, float* const* outputs, int samples) noexcept {
+    DenormalGuard denormal_guard;
+    const Kernels& kernels = selectKernels();
+    const int lanes = state.lanes;
+
+    for (int position = 0; position < samples; position += RENDER_BLOCK) {
+        const int count = std::min(RENDER_BLOCK, samples - position);
+        kernels.lanes(state, count);
+
+        // レーンごとの出力へ書き出す
+        for (int lane = 0; lane < state.count; ++lane) {
+            float* out = outputs[lane] + position;
+            for (int i = 0; i < count; ++i) {
+                out[i] = state.mix[i * lanes + lane] * OUTPUT_GAIN;
+            }
+        }
+    }
+}
+
+} // namespace detail
+} // namespace YM2151
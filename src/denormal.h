@@ -0,0 +1,93 @@
+#ifndef YM2151_DENORMAL_H
+#define YM2151_DENORMAL_H
+
+// 非正規化数の扱いを一時的に切り替えるガード（ライブラリ内部用）
+// 生成処理の入口で構築し、非正規化数を0として扱う（FTZ / DAZ）。
+// 非正規化数の演算はx86などで数十〜数百倍遅くなり、キーオン中の長い減衰や
+// 小さなフィードバックが続く区間でオーディオスレッドが止まる原因になるため。
+// （キーオフしたチャンネルは出力が0になり、エンベロープもフィードバックも止まるので、
+// このコアにはリリースの減衰やキーオフ後に減衰するフィードバックの経路はない）
+//
+// 現在の演算ではエンベロープは0.001で打ち切り、オペレータ出力もその範囲に収まるので
+// 非正規化数は発生せず、出力は変わらない（ym2151_diff でリファレンス実装と一致を確認している）。
+// このガードは演算の変更や呼び出し側のパラメータによる想定外の経路への保険。
+// 呼び出し元の設定は破棄時に元に戻す（変更が必要な場合のみ制御レジスタに書き込む）。
+
+#include <cstdint>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define YM2151_DENORMAL_MXCSR 1
+#elif defined(__aarch64__) && !defined(_MSC_VER)
+#define YM2151_DENORMAL_FPCR 1
+#endif
+
+namespace YM2151 {
+
+class DenormalGuard {
+public:
+    DenormalGuard() noexcept : saved_(read()), changed_(false) {
+        const uint64_t wanted = saved_ | FLUSH_BITS;
+        if (wanted != saved_) {
+            write(wanted);
+            changed_ = true;
+        }
+    }
+
+    ~DenormalGuard() {
+        if (changed_) {
+            write(saved_);
+        }
+    }
+
+    DenormalGuard(const DenormalGuard&) = delete;
+    DenormalGuard& operator=(const DenormalGuard&) = delete;
+
+private:
+#if defined(YM2151_DENORMAL_MXCSR)
+    // FTZ（ビット15）。DAZ（ビット6）はSSE2以降（x86-64では常に対応）。
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+    static constexpr uint64_t FLUSH_BITS = 0x8040;
+#else
+    static constexpr uint64_t FLUSH_BITS = 0x8000;
+#endif
+
+    static uint64_t read() noexcept {
+        return _mm_getcsr();
+    }
+
+    static void write(uint64_t value) noexcept {
+        _mm_setcsr(static_cast<unsigned int>(value));
+    }
+#elif defined(YM2151_DENORMAL_FPCR)
+    // FPCR の FZ（ビット24）。入力・出力の両方の非正規化数を0として扱う。
+    static constexpr uint64_t FLUSH_BITS = 1ull << 24;
+
+    static uint64_t read() noexcept {
+        uint64_t value;
+        __asm__ __volatile__("mrs %0, fpcr" : "=r"(value));
+        return value;
+    }
+
+    static void write(uint64_t value) noexcept {
+        __asm__ __volatile__("msr fpcr, %0" : : "r"(value));
+    }
+#else
+    // 対応していない環境では何もしない
+    static constexpr uint64_t FLUSH_BITS = 0;
+
+    static uint64_t read() noexcept {
+        return 0;
+    }
+
+    static void write(uint64_t) noexcept {
+    }
+#endif
+
+    uint64_t saved_;
+    bool changed_;
+};
+
+} // namespace YM2151
+
+#endif // YM2151_DENORMAL_H
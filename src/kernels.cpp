@@ -0,0 +1,116 @@
+#include "kernels.h"
+#include "lane_kernel.h"
+#include "meter_kernel.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(YM2151_X86_KERNELS) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace YM2151 {
+
+namespace {
+
+void mixScalar(const float* const* in, int count, float gain, float* out, int samples) {
+    for (int i = 0; i < samples; ++i) {
+        float sum = 0.0f;
+        for (int c = 0; c < count; ++c) {
+            sum += in[c][i];
+        }
+        out[i] = sum * gain;
+    }
+}
+
+// チャンネルごとに加算と計測を1回の走査で行う（加算順序は mixScalar と同じ）
+void mixMeteredScalar(const float* const* in, int count, float gain, float* out, int samples, MeterSums& sums) {
+    detail::mixMeteredSpan(in, count, gain, out, 0, samples, sums);
+}
+
+void scaleScalar(const float* in, float gain, float* out, int samples) {
+    for (int i = 0; i < samples; ++i) {
+        out[i] = in[i] * gain;
+    }
+}
+
+void toInt16Scalar(const float* in, int16_t* out, int samples) {
+    for (int i = 0; i < samples; ++i) {
+        out[i] = static_cast<int16_t>(std::clamp(in[i] * 32767.0f, -32768.0f, 32767.0f));
+    }
+}
+
+const Kernels scalar_kernels = {"scalar", mixScalar, mixMeteredScalar, scaleScalar, toInt16Scalar, detail::renderLaneBlock};
+
+// CPUの対応状況
+struct CpuFeatures {
+    bool sse2 = false;
+    bool avx2 = false;
+    bool avx512 = false;
+};
+
+CpuFeatures detectCpuFeatures() {
+    CpuFeatures features;
+#if defined(YM2151_X86_KERNELS)
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int max_leaf = info[0];
+    __cpuid(info, 1);
+    features.sse2 = (info[3] & (1 << 26)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (osxsave && avx && max_leaf >= 7) {
+        // OSがYMM/ZMMレジスタを保存するか確認
+        const unsigned long long xcr0 = _xgetbv(0);
+        __cpuidex(info, 7, 0);
+        features.avx2 = (xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5)) != 0;
+        features.avx512 = (xcr0 & 0xE6) == 0xE6 && (info[1] & (1 << 16)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    features.sse2 = __builtin_cpu_supports("sse2");
+    features.avx2 = __builtin_cpu_supports("avx2");
+    features.avx512 = __builtin_cpu_supports("avx512f");
+#endif
+#endif
+    return features;
+}
+
+const Kernels& chooseKernels() {
+    const CpuFeatures cpu = detectCpuFeatures();
+
+    // 環境変数による上限の指定（テスト用）
+    int limit = 3;
+    if (const char* isa = std::getenv("YM2151_ISA")) {
+        if (std::strcmp(isa, "scalar") == 0) limit = 0;
+        else if (std::strcmp(isa, "sse2") == 0) limit = 1;
+        else if (std::strcmp(isa, "avx2") == 0) limit = 2;
+    }
+
+    if (limit >= 3 && cpu.avx512 && avx512Kernels()) return *avx512Kernels();
+    if (limit >= 2 && cpu.avx2 && avx2Kernels()) return *avx2Kernels();
+    if (limit >= 1 && cpu.sse2 && sse2Kernels()) return *sse2Kernels();
+    return scalar_kernels;
+}
+
+} // namespace
+
+const Kernels* scalarKernels() {
+    return &scalar_kernels;
+}
+
+#if !defined(YM2151_X86_KERNELS)
+// x86以外ではスカラー版のみ
+const Kernels* sse2Kernels() { return nullptr; }
+const Kernels* avx2Kernels() { return nullptr; }
+const Kernels* avx512Kernels() { return nullptr; }
+#endif
+
+const Kernels& selectKernels() {
+    // CPUの判定はプロセス内で一度だけ行う
+    static const Kernels& kernels = chooseKernels();
+    return kernels;
+}
+
+} // namespace YM2151
@@ -0,0 +1,65 @@
+#ifndef YM2151_KERNELS_H
+#define YM2151_KERNELS_H
+
+// ブロック単位の処理カーネル（ライブラリ内部用）
+// 命令セットごとに別々の翻訳単位でビルドし、実行時にCPUの対応状況から選択する。
+// どのカーネルもスカラー版とビット単位で同じ結果を返す。
+
+#include "ym2151/ym2151.h"
+#include <cstdint>
+
+namespace YM2151 {
+
+namespace detail {
+struct LaneState;
+}
+
+// レベル計測の集計（Kernels::mixMetered が呼び出しごとに加算する）
+struct MeterSums {
+    struct Bus {
+        float peak;       // 絶対値の最大
+        double squares;   // 2乗和
+        uint32_t clips;   // ±1.0 を超えたサンプル数
+    };
+    Bus channels[CHANNEL_COUNT];
+    Bus master;
+    uint32_t samples;
+};
+
+struct Kernels {
+    const char* name;
+
+    // out[i] = (0 + in[0][i] + in[1][i] + ... + in[count-1][i]) * gain
+    // チャンネルの加算順序はスカラー版と同じ（0から順に加算）
+    void (*mix)(const float* const* in, int count, float gain, float* out, int samples);
+
+    // mix と同じ出力を書き込み、同じ走査の中でレベルを sums に加算する
+    // チャンネル c のレベルは in[c][i] * gain、マスターのレベルは out[i]
+    // （2乗和の加算順序は命令セットごとに異なる）
+    void (*mixMetered)(const float* const* in, int count, float gain, float* out, int samples, MeterSums& sums);
+
+    // out[i] = in[i] * gain
+    void (*scale)(const float* in, float gain, float* out, int samples);
+
+    // out[i] = int16(clamp(in[i] * 32767, -32768, 32767))（0方向への切り捨て）
+    void (*toInt16)(const float* in, int16_t* out, int samples);
+
+    // ChipArray の samples サンプル分（RENDER_BLOCK 以下）を計算し state.mix に書き込む
+    // （lane_kernel.h をその命令セットでビルドしたもの）
+    void (*lanes)(const detail::LaneState& state, int samples);
+};
+
+// 命令セットごとのカーネル（対応していない環境では nullptr）
+const Kernels* scalarKernels();
+const Kernels* sse2Kernels();
+const Kernels* avx2Kernels();
+const Kernels* avx512Kernels();
+
+// CPUの対応状況と環境変数 YM2151_ISA（scalar / sse2 / avx2 / avx512）から
+// 使用するカーネルを選択する
+// 環境変数で指定された命令セットに対応していない場合は、対応している範囲で最も近いものを使う
+const Kernels& selectKernels();
+
+} // namespace YM2151
+
+#endif // YM2151_KERNELS_H
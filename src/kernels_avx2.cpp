@@ -0,0 +1,119 @@
+// AVX2カーネル（-mavx2 でビルド）
+#include "kernels.h"
+#include "lane_kernel.h"
+#include "meter_kernel.h"
+#include <immintrin.h>
+#include <algorithm>
+
+namespace YM2151 {
+
+namespace {
+
+void mixAVX2(const float* const* in, int count, float gain, float* out, int samples) {
+    const __m256 g = _mm256_set1_ps(gain);
+    int i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        __m256 sum = _mm256_setzero_ps();
+        for (int c = 0; c < count; ++c) {
+            sum = _mm256_add_ps(sum, _mm256_loadu_ps(in[c] + i));
+        }
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(sum, g));
+    }
+    for (; i < samples; ++i) {
+        float sum = 0.0f;
+        for (int c = 0; c < count; ++c) {
+            sum += in[c][i];
+        }
+        out[i] = sum * gain;
+    }
+}
+
+// 1チャンネルずつ出力バッファに加算しながら計測する（加算順序は mixAVX2 と同じ）
+// 計測の累積（ピーク、2乗和、クリップ数）はチャンネルの走査の間レジスタに置く
+void mixMeteredAVX2(const float* const* in, int count, float gain, float* out, int samples, MeterSums& sums) {
+    const __m256 g = _mm256_set1_ps(gain);
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 limit = _mm256_set1_ps(detail::CLIP_LEVEL);
+    const int end = samples & ~7;
+
+    for (int i = 0; i < end; i += 8) {
+        _mm256_storeu_ps(out + i, _mm256_setzero_ps());
+    }
+    for (int c = 0; c <= count; ++c) {
+        const bool master = c == count;
+        __m256 peak = _mm256_setzero_ps();
+        __m256 squares = _mm256_setzero_ps();
+        __m256i clips = _mm256_setzero_si256();
+        for (int i = 0; i < end; i += 8) {
+            __m256 level;
+            if (master) {
+                level = _mm256_mul_ps(_mm256_loadu_ps(out + i), g);
+                _mm256_storeu_ps(out + i, level);
+            } else {
+                const __m256 x = _mm256_loadu_ps(in[c] + i);
+                _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), x));
+                level = _mm256_mul_ps(x, g);
+            }
+            level = _mm256_andnot_ps(sign, level);
+            peak = _mm256_max_ps(level, peak);
+            squares = _mm256_add_ps(squares, _mm256_mul_ps(level, level));
+            clips = _mm256_sub_epi32(clips, _mm256_castps_si256(_mm256_cmp_ps(level, limit, _CMP_GT_OQ)));
+        }
+
+        alignas(32) float peaks[8];
+        alignas(32) float sums_of_squares[8];
+        alignas(32) uint32_t counts[8];
+        _mm256_store_ps(peaks, peak);
+        _mm256_store_ps(sums_of_squares, squares);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(counts), clips);
+        float p = 0.0f;
+        float s = 0.0f;
+        uint32_t n = 0;
+        for (int k = 0; k < 8; ++k) {
+            p = std::max(p, peaks[k]);
+            s += sums_of_squares[k];
+            n += counts[k];
+        }
+        detail::accumulate(master ? sums.master : sums.channels[c], p, s, n);
+    }
+    detail::mixMeteredSpan(in, count, gain, out, end, samples, sums);
+}
+
+void scaleAVX2(const float* in, float gain, float* out, int samples) {
+    const __m256 g = _mm256_set1_ps(gain);
+    int i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(in + i), g));
+    }
+    for (; i < samples; ++i) {
+        out[i] = in[i] * gain;
+    }
+}
+
+void toInt16AVX2(const float* in, int16_t* out, int samples) {
+    const __m256 scale = _mm256_set1_ps(32767.0f);
+    const __m256 lo = _mm256_set1_ps(-32768.0f);
+    const __m256 hi = _mm256_set1_ps(32767.0f);
+    int i = 0;
+    for (; i + 16 <= samples; i += 16) {
+        __m256 a = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i), scale), lo), hi);
+        __m256 b = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i + 8), scale), lo), hi);
+        // packsは128ビットレーンごとに詰めるので、並びを戻す
+        __m256i packed = _mm256_packs_epi32(_mm256_cvttps_epi32(a), _mm256_cvttps_epi32(b));
+        packed = _mm256_permute4x64_epi64(packed, 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), packed);
+    }
+    for (; i < samples; ++i) {
+        out[i] = static_cast<int16_t>(std::clamp(in[i] * 32767.0f, -32768.0f, 32767.0f));
+    }
+}
+
+const Kernels avx2_kernels = {"avx2", mixAVX2, mixMeteredAVX2, scaleAVX2, toInt16AVX2, detail::renderLaneBlock};
+
+} // namespace
+
+const Kernels* avx2Kernels() {
+    return &avx2_kernels;
+}
+
+} // namespace YM2151
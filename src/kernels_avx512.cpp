@@ -0,0 +1,106 @@
+// AVX-512カーネル（-mavx512f でビルド）
+#include "kernels.h"
+#include "lane_kernel.h"
+#include "meter_kernel.h"
+#include <immintrin.h>
+#include <algorithm>
+
+namespace YM2151 {
+
+namespace {
+
+void mixAVX512(const float* const* in, int count, float gain, float* out, int samples) {
+    const __m512 g = _mm512_set1_ps(gain);
+    int i = 0;
+    for (; i + 16 <= samples; i += 16) {
+        __m512 sum = _mm512_setzero_ps();
+        for (int c = 0; c < count; ++c) {
+            sum = _mm512_add_ps(sum, _mm512_loadu_ps(in[c] + i));
+        }
+        _mm512_storeu_ps(out + i, _mm512_mul_ps(sum, g));
+    }
+    for (; i < samples; ++i) {
+        float sum = 0.0f;
+        for (int c = 0; c < count; ++c) {
+            sum += in[c][i];
+        }
+        out[i] = sum * gain;
+    }
+}
+
+// 1チャンネルずつ出力バッファに加算しながら計測する（加算順序は mixAVX512 と同じ）
+// 計測の累積（ピーク、2乗和、クリップ数）はチャンネルの走査の間レジスタに置く
+void mixMeteredAVX512(const float* const* in, int count, float gain, float* out, int samples, MeterSums& sums) {
+    const __m512 g = _mm512_set1_ps(gain);
+    const __m512 limit = _mm512_set1_ps(detail::CLIP_LEVEL);
+    const __m512i one = _mm512_set1_epi32(1);
+    const int end = samples & ~15;
+
+    for (int i = 0; i < end; i += 16) {
+        _mm512_storeu_ps(out + i, _mm512_setzero_ps());
+    }
+    for (int c = 0; c <= count; ++c) {
+        const bool master = c == count;
+        __m512 peak = _mm512_setzero_ps();
+        __m512 squares = _mm512_setzero_ps();
+        __m512i clips = _mm512_setzero_si512();
+        for (int i = 0; i < end; i += 16) {
+            __m512 level;
+            if (master) {
+                level = _mm512_mul_ps(_mm512_loadu_ps(out + i), g);
+                _mm512_storeu_ps(out + i, level);
+            } else {
+                const __m512 x = _mm512_loadu_ps(in[c] + i);
+                _mm512_storeu_ps(out + i, _mm512_add_ps(_mm512_loadu_ps(out + i), x));
+                level = _mm512_mul_ps(x, g);
+            }
+            level = _mm512_abs_ps(level);
+            peak = _mm512_max_ps(level, peak);
+            squares = _mm512_add_ps(squares, _mm512_mul_ps(level, level));
+            const __mmask16 over = _mm512_cmp_ps_mask(level, limit, _CMP_GT_OQ);
+            clips = _mm512_mask_add_epi32(clips, over, clips, one);
+        }
+
+        detail::accumulate(master ? sums.master : sums.channels[c],
+                           _mm512_reduce_max_ps(peak), _mm512_reduce_add_ps(squares),
+                           static_cast<uint32_t>(_mm512_reduce_add_epi32(clips)));
+    }
+    detail::mixMeteredSpan(in, count, gain, out, end, samples, sums);
+}
+
+void scaleAVX512(const float* in, float gain, float* out, int samples) {
+    const __m512 g = _mm512_set1_ps(gain);
+    int i = 0;
+    for (; i + 16 <= samples; i += 16) {
+        _mm512_storeu_ps(out + i, _mm512_mul_ps(_mm512_loadu_ps(in + i), g));
+    }
+    for (; i < samples; ++i) {
+        out[i] = in[i] * gain;
+    }
+}
+
+void toInt16AVX512(const float* in, int16_t* out, int samples) {
+    const __m512 scale = _mm512_set1_ps(32767.0f);
+    const __m512 lo = _mm512_set1_ps(-32768.0f);
+    const __m512 hi = _mm512_set1_ps(32767.0f);
+    int i = 0;
+    for (; i + 16 <= samples; i += 16) {
+        __m512 v = _mm512_min_ps(_mm512_max_ps(_mm512_mul_ps(_mm512_loadu_ps(in + i), scale), lo), hi);
+        // 飽和付きで32ビット整数から16ビット整数へ縮小
+        __m256i packed = _mm512_cvtsepi32_epi16(_mm512_cvttps_epi32(v));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), packed);
+    }
+    for (; i < samples; ++i) {
+        out[i] = static_cast<int16_t>(std::clamp(in[i] * 32767.0f, -32768.0f, 32767.0f));
+    }
+}
+
+const Kernels avx512_kernels = {"avx512", mixAVX512, mixMeteredAVX512, scaleAVX512, toInt16AVX512, detail::renderLaneBlock};
+
+} // namespace
+
+const Kernels* avx512Kernels() {
+    return &avx512_kernels;
+}
+
+} // namespace YM2151
@@ -0,0 +1,117 @@
+// SSE2カーネル（-msse2 でビルド）
+#include "kernels.h"
+#include "lane_kernel.h"
+#include "meter_kernel.h"
+#include <emmintrin.h>
+#include <algorithm>
+
+namespace YM2151 {
+
+namespace {
+
+void mixSSE2(const float* const* in, int count, float gain, float* out, int samples) {
+    const __m128 g = _mm_set1_ps(gain);
+    int i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        __m128 sum = _mm_setzero_ps();
+        for (int c = 0; c < count; ++c) {
+            sum = _mm_add_ps(sum, _mm_loadu_ps(in[c] + i));
+        }
+        _mm_storeu_ps(out + i, _mm_mul_ps(sum, g));
+    }
+    for (; i < samples; ++i) {
+        float sum = 0.0f;
+        for (int c = 0; c < count; ++c) {
+            sum += in[c][i];
+        }
+        out[i] = sum * gain;
+    }
+}
+
+// 1チャンネルずつ出力バッファに加算しながら計測する（加算順序は mixSSE2 と同じ）
+// 計測の累積（ピーク、2乗和、クリップ数）はチャンネルの走査の間レジスタに置く
+void mixMeteredSSE2(const float* const* in, int count, float gain, float* out, int samples, MeterSums& sums) {
+    const __m128 g = _mm_set1_ps(gain);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 limit = _mm_set1_ps(detail::CLIP_LEVEL);
+    const int end = samples & ~3;
+
+    for (int i = 0; i < end; i += 4) {
+        _mm_storeu_ps(out + i, _mm_setzero_ps());
+    }
+    for (int c = 0; c <= count; ++c) {
+        const bool master = c == count;
+        __m128 peak = _mm_setzero_ps();
+        __m128 squares = _mm_setzero_ps();
+        __m128i clips = _mm_setzero_si128();
+        for (int i = 0; i < end; i += 4) {
+            __m128 level;
+            if (master) {
+                level = _mm_mul_ps(_mm_loadu_ps(out + i), g);
+                _mm_storeu_ps(out + i, level);
+            } else {
+                const __m128 x = _mm_loadu_ps(in[c] + i);
+                _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), x));
+                level = _mm_mul_ps(x, g);
+            }
+            level = _mm_andnot_ps(sign, level);
+            peak = _mm_max_ps(level, peak);
+            squares = _mm_add_ps(squares, _mm_mul_ps(level, level));
+            clips = _mm_sub_epi32(clips, _mm_castps_si128(_mm_cmpgt_ps(level, limit)));
+        }
+
+        alignas(16) float peaks[4];
+        alignas(16) float sums_of_squares[4];
+        alignas(16) uint32_t counts[4];
+        _mm_store_ps(peaks, peak);
+        _mm_store_ps(sums_of_squares, squares);
+        _mm_store_si128(reinterpret_cast<__m128i*>(counts), clips);
+        float p = 0.0f;
+        float s = 0.0f;
+        uint32_t n = 0;
+        for (int k = 0; k < 4; ++k) {
+            p = std::max(p, peaks[k]);
+            s += sums_of_squares[k];
+            n += counts[k];
+        }
+        detail::accumulate(master ? sums.master : sums.channels[c], p, s, n);
+    }
+    detail::mixMeteredSpan(in, count, gain, out, end, samples, sums);
+}
+
+void scaleSSE2(const float* in, float gain, float* out, int samples) {
+    const __m128 g = _mm_set1_ps(gain);
+    int i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(in + i), g));
+    }
+    for (; i < samples; ++i) {
+        out[i] = in[i] * gain;
+    }
+}
+
+void toInt16SSE2(const float* in, int16_t* out, int samples) {
+    const __m128 scale = _mm_set1_ps(32767.0f);
+    const __m128 lo = _mm_set1_ps(-32768.0f);
+    const __m128 hi = _mm_set1_ps(32767.0f);
+    int i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        __m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i), scale), lo), hi);
+        __m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale), lo), hi);
+        __m128i packed = _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+    }
+    for (; i < samples; ++i) {
+        out[i] = static_cast<int16_t>(std::clamp(in[i] * 32767.0f, -32768.0f, 32767.0f));
+    }
+}
+
+const Kernels sse2_kernels = {"sse2", mixSSE2, mixMeteredSSE2, scaleSSE2, toInt16SSE2, detail::renderLaneBlock};
+
+} // namespace
+
+const Kernels* sse2Kernels() {
+    return &sse2_kernels;
+}
+
+} // namespace YM2151
@@ -0,0 +1,266 @@
+#ifndef YM2151_LANE_KERNEL_H
+#define YM2151_LANE_KERNEL_H
+
+// ChipArray のレーン方向の演算（ライブラリ内部用）
+// 命令セットごとの翻訳単位（kernels.cpp, kernels_*.cpp）でそれぞれインクルードし、
+// その命令セットでベクトル化した版を Kernels::lanes として登録する。
+// 翻訳単位ごとに別のコードになるため、関数はすべて無名名前空間に置く。
+//
+// ループはコンパイラが自動ベクトル化できるよう、タイル（LANE_TILE レーン）単位の
+// 固定長ループと分岐のない選択で書いている。各レーンの結果は Chip とビット単位で一致する。
+
+#include "ym2151/chip_array.h"
+#include "oscillator.h"
+#include <cmath>
+#include <cstdint>
+
+namespace YM2151 {
+namespace detail {
+
+constexpr int TILE = LANE_TILE;
+
+// オペレータのパラメータ
+// Chip と同じくオペレータのレジスタはデコードしないため、全レーンで
+// Operator::reset() の既定値（MUL=1, DT1=DT2=0, AR=31, DR=SR=SL=0, RR=15）を使う。
+constexpr float FREQUENCY_MULTIPLIER = 1.0f;
+constexpr float DETUNE = 0.0f;
+constexpr float SUSTAIN_LEVEL = 1.0f - (0 / 15.0f);
+constexpr int ATTACK_RATE = 31;
+constexpr float DECAY_RATE = 0 * DECAY_RATE_FACTOR;
+constexpr float SUSTAIN_RATE = 0 * SUSTAIN_RATE_FACTOR;
+constexpr float RELEASE_RATE = 15 * RELEASE_RATE_FACTOR;
+
+constexpr int32_t STATE_IDLE = static_cast<int32_t>(EnvelopeState::IDLE);
+constexpr int32_t STATE_ATTACK = static_cast<int32_t>(EnvelopeState::ATTACK);
+constexpr int32_t STATE_DECAY = static_cast<int32_t>(EnvelopeState::DECAY);
+constexpr int32_t STATE_SUSTAIN = static_cast<int32_t>(EnvelopeState::SUSTAIN);
+constexpr int32_t STATE_RELEASE = static_cast<int32_t>(EnvelopeState::RELEASE);
+
+// アルゴリズムの接続
+// ビット0-3: OP1〜OP4がキャリア（出力に加算される）
+// ビット4-5, 6-7, 8-9: OP2, OP3, OP4の変調元（0〜2: OP1〜OP3、3: 変調なし）
+constexpr int32_t NO_SOURCE = 3;
+
+constexpr int32_t connectionWord(int carriers, int source2, int source3, int source4) {
+    return carriers | (source2 << 4) | (source3 << 6) | (source4 << 8);
+}
+
+constexpr int32_t algorithm_connection[8] = {
+    connectionWord(0x8, 0, 1, 2),                  // 0: OP1->OP2->OP3->OP4
+    connectionWord(0xC, 0, NO_SOURCE, 1),          // 1: OP1->OP2->OP4, OP3
+    connectionWord(0xA, NO_SOURCE, 0, 2),          // 2: OP1->OP3->OP4, OP2
+    connectionWord(0xC, NO_SOURCE, 0, 1),          // 3: OP1->OP3, OP2->OP4
+    connectionWord(0xA, 0, NO_SOURCE, 2),          // 4: OP1->OP2, OP3->OP4
+    connectionWord(0xE, 0, NO_SOURCE, NO_SOURCE),  // 5: OP1->OP2, OP3, OP4
+    connectionWord(0xD, NO_SOURCE, 1, NO_SOURCE),  // 6: OP1, OP2->OP3, OP4
+    connectionWord(0xF, NO_SOURCE, NO_SOURCE, NO_SOURCE),  // 7: OP1, OP2, OP3, OP4
+};
+
+namespace {
+
+// 1タイル分のオペレータ状態へのポインタ
+struct OperatorTile {
+    float* level;
+    float* rate;
+    int32_t* state;
+};
+
+inline OperatorTile operatorState(const LaneState& s, int channel, int op, int base) noexcept {
+    const int offset = (channel * 4 + op) * s.lanes + base;
+    return OperatorTile{s.env_level + offset, s.env_rate + offset, s.env_state + offset};
+}
+
+// 1タイル分の位相を0〜2πの範囲に正規化（wrapPhase() と同じ結果をレーン方向にまとめて求める）
+// |位相| >= 16 のレーンは reducePhase() と同じ縮約を全レーンで同時に進め、
+// 整数の割り算は誤差を補正した浮動小数点の割り算で行う。
+inline void wrapTile(float* phase) noexcept {
+    int32_t slow = 0;
+    for (int l = 0; l < TILE; ++l) {
+        slow |= (phase[l] >= 16.0f) | (phase[l] <= -16.0f);
+    }
+
+    if (slow) {
+        alignas(64) float magnitude[TILE];
+        for (int l = 0; l < TILE; ++l) {
+            magnitude[l] = std::fabs(phase[l]);
+        }
+
+        int32_t pending;
+        do {
+            pending = 0;
+            for (int l = 0; l < TILE; ++l) {
+                const float x = magnitude[l];
+                const float lower = bitsFloat(floatBits(x) & 0xFF800000u);
+                const float first = x - TWO_PI;
+                const float second = first - TWO_PI;
+                const bool jump = second > lower;
+
+                const uint32_t second_bits = floatBits(second);
+                const int32_t step = jump ? static_cast<int32_t>(floatBits(first) - second_bits) : 1;
+                const int32_t mantissa = static_cast<int32_t>(second_bits & 0x007FFFFFu) - 1;
+                int32_t count = static_cast<int32_t>(static_cast<float>(mantissa) / static_cast<float>(step));
+                count -= static_cast<int32_t>(count * step > mantissa);
+                count += static_cast<int32_t>((count + 1) * step <= mantissa);
+                const float bottom = bitsFloat(second_bits - static_cast<uint32_t>(count * step));
+
+                const float next = jump ? (bottom - TWO_PI) - TWO_PI : second;
+                const float reduced = (x >= 16.0f) ? next : x;
+                magnitude[l] = reduced;
+                pending |= reduced >= 16.0f;
+            }
+        } while (pending);
+
+        for (int l = 0; l < TILE; ++l) {
+            phase[l] = std::copysign(magnitude[l], phase[l]);
+        }
+    }
+
+    // |位相| < 16 の範囲は繰り返し回数が高々3回なので分岐なしで処理する
+    for (int l = 0; l < TILE; ++l) {
+        float w = phase[l];
+        for (int i = 0; i < 3; ++i) {
+            const float wrapped = w - TWO_PI;
+            w = (w >= TWO_PI) ? wrapped : w;
+        }
+        for (int i = 0; i < 3; ++i) {
+            const float wrapped = w + TWO_PI;
+            w = (w < 0.0f) ? wrapped : w;
+        }
+        phase[l] = w;
+    }
+}
+
+// 1タイル分のオペレータ出力（Operator::getOutput() と同じ計算）
+// キーオフ中のレーンも計算するが、エンベロープの状態は更新しない（出力は呼び出し側で捨てる）
+inline void operatorTile(const OperatorTile& op, const float* phase, const float* modulation,
+                  const int32_t* key_on, float* out) noexcept {
+    alignas(64) float wrapped[TILE];
+    for (int l = 0; l < TILE; ++l) {
+        wrapped[l] = phase[l] * FREQUENCY_MULTIPLIER + DETUNE + modulation[l];
+    }
+    wrapTile(wrapped);
+
+    // エンベロープの更新（Operator::updateEnvelope() と同じ状態遷移）
+    alignas(64) float envelope[TILE];
+    float* __restrict levels = op.level;
+    float* __restrict rates = op.rate;
+    int32_t* __restrict states = op.state;
+    for (int l = 0; l < TILE; ++l) {
+        const float level = levels[l];
+        const float rate = rates[l];
+        const int32_t state = states[l];
+
+        const float rise = level + (1.0f - level) * rate;
+        const float fall = level - level * rate;
+        float next = (state == STATE_ATTACK) ? rise : fall;
+        next = (state == STATE_IDLE) ? level : next;
+
+        // 状態ごとの終了判定（該当しない状態では成立しない）
+        const float attack_end = (state == STATE_ATTACK) ? 0.99f : 2.0f;
+        const float decay_end = (state == STATE_DECAY) ? SUSTAIN_LEVEL : -1.0f;
+        const float falling_end = ((state == STATE_SUSTAIN) | (state == STATE_RELEASE)) ? ENVELOPE_FLOOR : -1.0f;
+        const bool attack_done = next > attack_end;
+        const bool decay_done = next <= decay_end;
+        const bool falling_done = next < falling_end;
+
+        next = attack_done ? 1.0f : next;
+        next = decay_done ? SUSTAIN_LEVEL : next;
+        next = falling_done ? 0.0f : next;
+        int32_t next_state = falling_done ? STATE_IDLE : state;
+        next_state = decay_done ? STATE_SUSTAIN : next_state;
+        next_state = attack_done ? STATE_DECAY : next_state;
+        float next_rate = decay_done ? SUSTAIN_RATE : rate;
+        next_rate = attack_done ? DECAY_RATE : next_rate;
+
+        const bool active = key_on[l] != 0;
+        levels[l] = active ? next : level;
+        rates[l] = active ? next_rate : rate;
+        states[l] = active ? next_state : state;
+        envelope[l] = next * 2.0f;
+    }
+
+    // サイン波テーブルの参照とエンベロープの適用
+    for (int l = 0; l < TILE; ++l) {
+        out[l] = sine_table[sineIndex(wrapped[l])] * envelope[l] * 8192.0f;
+    }
+}
+
+// 1タイル分のチャンネル出力を acc に加算する（Channel::getOutput() と同じ計算）
+inline void channelTile(const LaneState& s, int channel, int base, float* acc) noexcept {
+    const int offset = channel * s.lanes + base;
+    float* phase = s.phase + offset;
+    const float* increment = s.increment + offset;
+    float* feedback0 = s.feedback0 + offset;
+    float* feedback1 = s.feedback1 + offset;
+    const float* feedback_scale = s.feedback_scale + offset;
+    const int32_t* key_on = s.key_on + offset;
+    const int32_t* connection = s.connection + offset;
+
+    alignas(64) float modulation[TILE];
+    alignas(64) float out[4][TILE];
+
+    // 基本位相（キーオフ中も進める）とフィードバック
+    for (int l = 0; l < TILE; ++l) {
+        const float p = phase[l] + increment[l];
+        const float wrapped = p - TWO_PI;
+        phase[l] = (p >= TWO_PI) ? wrapped : p;
+        const float feedback = (feedback0[l] + feedback1[l]) * feedback_scale[l];
+        modulation[l] = (feedback_scale[l] > 0.0f) ? feedback : 0.0f;
+    }
+    operatorTile(operatorState(s, channel, 0, base), phase, modulation, key_on, out[0]);
+
+    // OP2〜OP4は接続に応じて前段の出力で変調する
+    for (int op = 1; op < 4; ++op) {
+        const int shift = 2 + op * 2;
+        for (int l = 0; l < TILE; ++l) {
+            const int32_t source = (connection[l] >> shift) & 3;
+            float m = 0.0f;
+            m = (source == 0) ? out[0][l] : m;
+            m = (source == 1) ? out[1][l] : m;
+            m = (source == 2) ? out[2][l] : m;
+            modulation[l] = m;
+        }
+        operatorTile(operatorState(s, channel, op, base), phase, modulation, key_on, out[op]);
+    }
+
+    // キャリアの出力をOP1から順に加算
+    for (int l = 0; l < TILE; ++l) {
+        const int32_t c = connection[l];
+        float sum = 0.0f;
+        sum += (c & 1) ? out[0][l] : 0.0f;
+        sum += (c & 2) ? out[1][l] : 0.0f;
+        sum += (c & 4) ? out[2][l] : 0.0f;
+        sum += (c & 8) ? out[3][l] : 0.0f;
+
+        const bool active = key_on[l] != 0;
+        acc[l] += active ? sum : 0.0f;
+        feedback1[l] = active ? feedback0[l] : feedback1[l];
+        feedback0[l] = active ? out[0][l] : feedback0[l];
+    }
+}
+
+// RENDER_BLOCK 以下の samples サンプル分を全タイルについて計算し、state.mix に書き込む
+inline void renderLaneBlock(const LaneState& state, int samples) noexcept {
+    const int lanes = state.lanes;
+
+    // タイルごとにブロック分を計算する（1タイルの状態はL1キャッシュに収まる）
+    for (int base = 0; base < lanes; base += TILE) {
+        for (int i = 0; i < samples; ++i) {
+            float* acc = state.mix + i * lanes + base;
+            for (int l = 0; l < TILE; ++l) {
+                acc[l] = 0.0f;
+            }
+            // チャンネル0から順に加算（Chip のミックスと同じ順序）
+            for (int ch = 0; ch < CHANNEL_COUNT; ++ch) {
+                channelTile(state, ch, base, acc);
+            }
+        }
+    }
+}
+
+} // namespace
+
+} // namespace detail
+} // namespace YM2151
+
+#endif // YM2151_LANE_KERNEL_H
@@ -0,0 +1,105 @@
+#include "ym2151/meter.h"
+#include "kernels.h"
+#include <algorithm>
+#include <cmath>
+
+namespace YM2151 {
+
+LevelMeter::LevelMeter()
+    : sequence_(0),
+      blocks_(0),
+      samples_(0),
+      clear_hold_(false) {
+    reset();
+}
+
+LevelMeter::~LevelMeter() {
+}
+
+void LevelMeter::reset() noexcept {
+    sequence_.store(sequence_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    blocks_.store(0, std::memory_order_relaxed);
+    samples_.store(0, std::memory_order_relaxed);
+    for (Bus& bus : channels_) {
+        store(bus, 0.0f, 0.0f, 0, 0.0f, 0);
+    }
+    store(master_, 0.0f, 0.0f, 0, 0.0f, 0);
+    clear_hold_.store(false, std::memory_order_relaxed);
+    std::fill(std::begin(hold_), std::end(hold_), 0.0f);
+    std::fill(std::begin(total_clips_), std::end(total_clips_), 0);
+
+    sequence_.store(sequence_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void LevelMeter::store(Bus& bus, float peak, float rms, uint32_t clips, float hold, uint64_t total) noexcept {
+    bus.peak.store(peak, std::memory_order_relaxed);
+    bus.rms.store(rms, std::memory_order_relaxed);
+    bus.clips.store(clips, std::memory_order_relaxed);
+    bus.peak_hold.store(hold, std::memory_order_relaxed);
+    bus.total_clips.store(total, std::memory_order_relaxed);
+}
+
+void LevelMeter::load(const Bus& bus, BusLevel& level) noexcept {
+    level.peak = bus.peak.load(std::memory_order_relaxed);
+    level.rms = bus.rms.load(std::memory_order_relaxed);
+    level.clips = bus.clips.load(std::memory_order_relaxed);
+    level.peak_hold = bus.peak_hold.load(std::memory_order_relaxed);
+    level.total_clips = bus.total_clips.load(std::memory_order_relaxed);
+}
+
+void LevelMeter::publish(const MeterSums& sums) noexcept {
+    if (sums.samples == 0) {
+        return;
+    }
+    if (clear_hold_.exchange(false, std::memory_order_relaxed)) {
+        std::fill(std::begin(hold_), std::end(hold_), 0.0f);
+    }
+
+    // シーケンスを奇数にしてから書き込み、偶数に戻して公開する
+    const uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const double samples = static_cast<double>(sums.samples);
+    for (int bus = 0; bus <= CHANNEL_COUNT; ++bus) {
+        const MeterSums::Bus& sum = bus < CHANNEL_COUNT ? sums.channels[bus] : sums.master;
+        hold_[bus] = std::max(hold_[bus], sum.peak);
+        total_clips_[bus] += sum.clips;
+        const float rms = static_cast<float>(std::sqrt(sum.squares / samples));
+        store(bus < CHANNEL_COUNT ? channels_[bus] : master_, sum.peak, rms, sum.clips, hold_[bus], total_clips_[bus]);
+    }
+    blocks_.store(blocks_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    samples_.store(sums.samples, std::memory_order_relaxed);
+
+    sequence_.store(sequence + 2, std::memory_order_release);
+}
+
+void LevelMeter::read(LevelSnapshot& snapshot) const noexcept {
+    for (;;) {
+        const uint64_t before = sequence_.load(std::memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+
+        snapshot.blocks = blocks_.load(std::memory_order_relaxed);
+        snapshot.samples = samples_.load(std::memory_order_relaxed);
+        for (int ch = 0; ch < CHANNEL_COUNT; ++ch) {
+            load(channels_[ch], snapshot.channels[ch]);
+        }
+        load(master_, snapshot.master);
+
+        // 読んでいる間に書き込みがなければ一貫している
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence_.load(std::memory_order_relaxed) == before) {
+            return;
+        }
+    }
+}
+
+void LevelMeter::clearHold() noexcept {
+    clear_hold_.store(true, std::memory_order_relaxed);
+}
+
+} // namespace YM2151
@@ -0,0 +1,72 @@
+#ifndef YM2151_METER_KERNEL_H
+#define YM2151_METER_KERNEL_H
+
+// レベル計測の共通部分（ライブラリ内部用）
+// 命令セットごとの翻訳単位（kernels.cpp, kernels_*.cpp）でそれぞれインクルードし、
+// ベクトル化できない端数とブロック内の集計の加算に使う。
+// 翻訳単位ごとに別のコードになるため、関数はすべて無名名前空間に置く。
+
+#include "kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace YM2151 {
+namespace detail {
+namespace {
+
+// これを超える絶対値をクリップとして数える（int16 変換で飽和する範囲）
+constexpr float CLIP_LEVEL = 1.0f;
+
+// 1サンプル分の計測（NaN はピークに反映しない）
+inline void meterSample(float value, float& peak, float& squares, uint32_t& clips) {
+    const float level = std::fabs(value);
+    peak = std::max(peak, level);
+    squares += level * level;
+    clips += level > CLIP_LEVEL ? 1 : 0;
+}
+
+// ブロック内の集計を加える
+inline void accumulate(MeterSums::Bus& bus, float peak, float squares, uint32_t clips) {
+    bus.peak = std::max(bus.peak, peak);
+    bus.squares += squares;
+    bus.clips += clips;
+}
+
+// mixMetered の端数（[begin, end)）のスカラー処理
+// チャンネルの加算と計測の後、マスターのゲインと計測を行う
+inline void mixMeteredSpan(const float* const* in, int count, float gain, float* out,
+                           int begin, int end, MeterSums& sums) {
+    if (begin >= end) {
+        return;
+    }
+    for (int i = begin; i < end; ++i) {
+        out[i] = 0.0f;
+    }
+    for (int c = 0; c < count; ++c) {
+        const float* src = in[c];
+        float peak = 0.0f;
+        float squares = 0.0f;
+        uint32_t clips = 0;
+        for (int i = begin; i < end; ++i) {
+            out[i] += src[i];
+            meterSample(src[i] * gain, peak, squares, clips);
+        }
+        accumulate(sums.channels[c], peak, squares, clips);
+    }
+
+    float peak = 0.0f;
+    float squares = 0.0f;
+    uint32_t clips = 0;
+    for (int i = begin; i < end; ++i) {
+        out[i] = out[i] * gain;
+        meterSample(out[i], peak, squares, clips);
+    }
+    accumulate(sums.master, peak, squares, clips);
+}
+
+} // namespace
+} // namespace detail
+} // namespace YM2151
+
+#endif // YM2151_METER_KERNEL_H
@@ -0,0 +1,354 @@
+#include "ym2151/midi.h"
+#include <cmath>
+#include <algorithm>
+
+namespace YM2151 {
+
+namespace {
+
+// レジスタアドレス
+constexpr uint8_t REG_KEY_ON = 0x08;
+constexpr uint8_t REG_FREQ_LOW = 0x10;
+constexpr uint8_t REG_FREQ_HIGH = 0x18;
+
+// ノート番号→周波数レジスタ値のテーブル
+// 周波数レジスタにはサンプルプログラムと同じく周波数(Hz)の2倍を設定する
+std::array<uint16_t, MIDI_NOTE_COUNT> buildNoteTable() {
+    std::array<uint16_t, MIDI_NOTE_COUNT> table{};
+    for (int note = 0; note < MIDI_NOTE_COUNT; ++note) {
+        // A4 = 69 = 440Hz
+        double frequency = 440.0 * std::pow(2.0, (note - 69) / 12.0);
+        table[note] = static_cast<uint16_t>(std::lround(frequency * 2.0));
+    }
+    return table;
+}
+
+const std::array<uint16_t, MIDI_NOTE_COUNT> note_table = buildNoteTable();
+
+} // namespace
+
+uint16_t midiNoteToFrequency(uint8_t note) {
+    return note_table[note & 0x7F];
+}
+
+MidiDriver::MidiDriver() : bank_(nullptr) {
+    reset();
+}
+
+MidiDriver::~MidiDriver() {
+}
+
+void MidiDriver::reset() {
+    // 全ボイスを空きスタックに戻す
+    for (int i = 0; i < CHANNEL_COUNT; ++i) {
+        voices_[i] = Voice{NONE, NONE, 0, 0, false, -1};
+        free_[i] = static_cast<uint8_t>(CHANNEL_COUNT - 1 - i);  // チャンネル0から使う
+    }
+    free_count_ = CHANNEL_COUNT;
+    held_ = VoiceList{NONE, NONE};
+    released_ = VoiceList{NONE, NONE};
+
+    for (auto& notes : note_voice_) {
+        notes.fill(NONE);
+    }
+    channel_program_.fill(0);
+
+    queue_head_ = 0;
+    queue_size_ = 0;
+    last_time_ = 0;
+    dropped_events_ = 0;
+    dropped_writes_ = 0;
+    now_ = 0;
+}
+
+void MidiDriver::setPatchBank(const PatchBank* bank) {
+    bank_ = bank;
+
+    // ロード済みの音色は次のノートオンで再適用させる
+    for (auto& voice : voices_) {
+        voice.program = -1;
+    }
+}
+
+void MidiDriver::processMessage(uint32_t time, const uint8_t* data, size_t length) {
+    if (length == 0) {
+        return;
+    }
+
+    uint8_t status = data[0] & 0xF0;
+    uint8_t midi_channel = data[0] & 0x0F;
+
+    switch (status) {
+        case 0x80:  // ノートオフ
+            if (length >= 3) {
+                noteOff(time, midi_channel, data[1]);
+            }
+            break;
+
+        case 0x90:  // ノートオン（ベロシティ0はノートオフ）
+            if (length >= 3) {
+                noteOn(time, midi_channel, data[1], data[2]);
+            }
+            break;
+
+        case 0xB0:  // コントロールチェンジ
+            // オールサウンドオフ / オールノートオフ
+            if (length >= 3 && (data[1] == 120 || data[1] == 123)) {
+                allNotesOff(time);
+            }
+            break;
+
+        case 0xC0:  // プログラムチェンジ
+            if (length >= 2) {
+                programChange(time, midi_channel, data[1]);
+            }
+            break;
+
+        default:
+            // その他のメッセージは無視
+            break;
+    }
+}
+
+void MidiDriver::noteOn(uint32_t time, uint8_t midi_channel, uint8_t note, uint8_t velocity) {
+    midi_channel &= 0x0F;
+    note &= 0x7F;
+
+    if (velocity == 0) {
+        noteOff(time, midi_channel, note);
+        return;
+    }
+
+    // 書き込み（キーオフ、音色、周波数2つ、キーオン）がキューに収まることを先に確かめる
+    const uint8_t program_number = channel_program_[midi_channel];
+    const int next = nextVoice(midi_channel, note);
+    const Patch* patch = nullptr;
+    if (voices_[next].program != program_number && bank_) {
+        patch = bank_->find(program_number);
+    }
+    if (!reserve(4 + (patch ? patch->count : 0))) {
+        return;
+    }
+
+    // 同じノートが発音中なら同じボイスで再発音する
+    int voice_index = note_voice_[midi_channel][note];
+    if (voice_index != NONE) {
+        listRemove(voices_[voice_index].held ? held_ : released_, voice_index);
+    } else {
+        voice_index = allocateVoice();
+    }
+
+    Voice& voice = voices_[voice_index];
+
+    // 奪ったボイスの逆引きを解除
+    int8_t& previous_owner = note_voice_[voice.midi_channel][voice.note];
+    if (previous_owner == voice_index) {
+        previous_owner = NONE;
+    }
+
+    // 発音中・リリース中のボイスは一度キーオフしてから再発音する
+    push(time, REG_KEY_ON, static_cast<uint8_t>(voice_index));
+
+    // プログラムが異なる場合のみレジスタブロックを適用
+    if (voice.program != program_number) {
+        if (patch) {
+            for (int i = 0; i < patch->count; ++i) {
+                push(time, static_cast<uint8_t>(patch->registers[i].reg + voice_index),
+                     patch->registers[i].value);
+            }
+        }
+        voice.program = program_number;
+    }
+
+    // 周波数設定とキーオン
+    // ベロシティはこの実装ではTLが出力に反映されないため使用しない
+    uint16_t frequency = midiNoteToFrequency(note);
+    push(time, static_cast<uint8_t>(REG_FREQ_LOW + voice_index), frequency & 0xFF);
+    push(time, static_cast<uint8_t>(REG_FREQ_HIGH + voice_index), frequency >> 8);
+    push(time, REG_KEY_ON, static_cast<uint8_t>(0x80 | voice_index));
+
+    voice.midi_channel = midi_channel;
+    voice.note = note;
+    voice.held = true;
+    listPush(held_, voice_index);
+    note_voice_[midi_channel][note] = static_cast<int8_t>(voice_index);
+}
+
+void MidiDriver::noteOff(uint32_t time, uint8_t midi_channel, uint8_t note) {
+    int voice_index = note_voice_[midi_channel & 0x0F][note & 0x7F];
+    if (voice_index == NONE || !voices_[voice_index].held || !reserve(1)) {
+        return;
+    }
+    releaseVoice(time, voice_index);
+}
+
+void MidiDriver::programChange(uint32_t time, uint8_t midi_channel, uint8_t program) {
+    // 実際のレジスタ適用は次のノートオン時に行う
+    (void)time;
+    channel_program_[midi_channel & 0x0F] = program & 0x7F;
+}
+
+void MidiDriver::allNotesOff(uint32_t time) {
+    size_t held = 0;
+    for (int voice = held_.head; voice != NONE; voice = voices_[voice].next) {
+        ++held;
+    }
+    if (held == 0 || !reserve(held)) {
+        return;
+    }
+    while (held_.head != NONE) {
+        releaseVoice(time, held_.head);
+    }
+}
+
+bool MidiDriver::popWrite(TimedWrite& write) {
+    if (queue_size_ == 0) {
+        return false;
+    }
+    write = queue_[queue_head_];
+    queue_head_ = (queue_head_ + 1) % QUEUE_CAPACITY;
+    --queue_size_;
+    return true;
+}
+
+size_t MidiDriver::pendingWrites() const {
+    return queue_size_;
+}
+
+void MidiDriver::render(Chip& chip, float* buffer, int samples) {
+    const uint32_t block_end = now_ + static_cast<uint32_t>(samples);
+    int position = 0;
+
+    while (position < samples) {
+        // 現在位置までに到達した書き込みを一括で適用
+        RegWrite batch[64];
+        size_t batch_size = 0;
+        while (queue_size_ > 0) {
+            const TimedWrite& write = queue_[queue_head_];
+            if (static_cast<int32_t>(write.time - (now_ + position)) > 0) {
+                break;
+            }
+            batch[batch_size++] = RegWrite{write.reg, write.value};
+            queue_head_ = (queue_head_ + 1) % QUEUE_CAPACITY;
+            --queue_size_;
+            if (batch_size == 64) {
+                chip.setRegisters(batch, batch_size);
+                batch_size = 0;
+            }
+        }
+        chip.setRegisters(batch, batch_size);
+
+        // 次の書き込みまで（またはブロック終端まで）をまとめて生成
+        int span = samples - position;
+        if (queue_size_ > 0) {
+            uint32_t next = queue_[queue_head_].time;
+            if (static_cast<int32_t>(next - block_end) < 0) {
+                span = static_cast<int>(next - (now_ + position));
+            }
+        }
+        chip.generate(buffer + position, span);
+        position += span;
+    }
+
+    now_ = block_end;
+}
+
+uint32_t MidiDriver::currentTime() const {
+    return now_;
+}
+
+uint32_t MidiDriver::droppedEvents() const {
+    return dropped_events_;
+}
+
+uint32_t MidiDriver::droppedWrites() const {
+    return dropped_writes_;
+}
+
+// noteOn で使うボイス（allocateVoice と同じ選び方で、状態は変えない）
+int MidiDriver::nextVoice(uint8_t midi_channel, uint8_t note) const {
+    if (note_voice_[midi_channel][note] != NONE) {
+        return note_voice_[midi_channel][note];
+    }
+    if (free_count_ > 0) {
+        return free_[free_count_ - 1];
+    }
+    return released_.head != NONE ? released_.head : held_.head;
+}
+
+int MidiDriver::allocateVoice() {
+    // 1. 空きボイス
+    if (free_count_ > 0) {
+        return free_[--free_count_];
+    }
+
+    // 2. 最も古いリリース中のボイス（最も音量が小さいとみなす）
+    if (released_.head != NONE) {
+        int voice = released_.head;
+        listRemove(released_, voice);
+        return voice;
+    }
+
+    // 3. 最も古い発音中のボイス
+    int voice = held_.head;
+    listRemove(held_, voice);
+    return voice;
+}
+
+void MidiDriver::listPush(VoiceList& list, int voice) {
+    voices_[voice].prev = list.tail;
+    voices_[voice].next = NONE;
+    if (list.tail != NONE) {
+        voices_[list.tail].next = static_cast<int8_t>(voice);
+    } else {
+        list.head = static_cast<int8_t>(voice);
+    }
+    list.tail = static_cast<int8_t>(voice);
+}
+
+void MidiDriver::listRemove(VoiceList& list, int voice) {
+    Voice& v = voices_[voice];
+    if (v.prev != NONE) {
+        voices_[v.prev].next = v.next;
+    } else {
+        list.head = v.next;
+    }
+    if (v.next != NONE) {
+        voices_[v.next].prev = v.prev;
+    } else {
+        list.tail = v.prev;
+    }
+    v.prev = NONE;
+    v.next = NONE;
+}
+
+void MidiDriver::releaseVoice(uint32_t time, int voice) {
+    listRemove(held_, voice);
+    voices_[voice].held = false;
+    listPush(released_, voice);
+    push(time, REG_KEY_ON, static_cast<uint8_t>(voice));
+}
+
+// イベントの書き込みがすべてキューに収まるか（収まらなければイベントを破棄したものとして数える）
+bool MidiDriver::reserve(size_t writes) {
+    if (queue_size_ + writes <= QUEUE_CAPACITY) {
+        return true;
+    }
+    ++dropped_events_;
+    dropped_writes_ += static_cast<uint32_t>(writes);
+    return false;
+}
+
+// reserve() で確保済みの書き込みをキューに入れる
+void MidiDriver::push(uint32_t time, uint8_t reg, uint8_t value) {
+    // キューは時刻順を保つ（過去に戻る時刻は直前の時刻に揃える）
+    if (queue_size_ > 0 && static_cast<int32_t>(time - last_time_) < 0) {
+        time = last_time_;
+    }
+    last_time_ = time;
+
+    queue_[(queue_head_ + queue_size_) % QUEUE_CAPACITY] = TimedWrite{time, reg, value};
+    ++queue_size_;
+}
+
+} // namespace YM2151
@@ -0,0 +1,454 @@
+#include "ym2151/note_cache.h"
+#include <algorithm>
+#include <cstring>
+
+namespace YM2151 {
+
+NoteCache::NoteCache(size_t capacity_bytes)
+    : free_page_(NONE),
+      used_pages_(0),
+      free_entry_(NONE),
+      entry_count_(0),
+      lru_head_(NONE),
+      lru_tail_(NONE),
+      table_mask_(0),
+      max_note_samples_(0) {
+    // ページ（出力と先頭の状態）とノートの管理情報を1組として、容量に収まる数を確保する
+    // （ノートは少なくとも1ページを使うので、ノート数の上限はページ数と同じ）
+    const size_t unit = PAGE_SIZE * sizeof(float) + sizeof(Channel) + sizeof(Entry);
+    const size_t count = std::max<size_t>(capacity_bytes / unit, 4);
+
+    pages_.assign(count * PAGE_SIZE, 0.0f);
+    page_states_.resize(count);
+    page_next_.assign(count, NONE);
+    entries_.resize(count);
+
+    size_t table_size = 1;
+    while (table_size < count * 2) {
+        table_size <<= 1;
+    }
+    table_.assign(table_size, NONE);
+    table_mask_ = table_size - 1;
+
+    max_note_samples_ = static_cast<uint32_t>(std::min<size_t>(count / 4 * PAGE_SIZE, UINT32_MAX));
+    max_note_samples_ = std::max<uint32_t>(max_note_samples_, PAGE_SIZE);
+
+    resetStats();
+    clear();
+}
+
+NoteCache::~NoteCache() {
+}
+
+void NoteCache::clear() noexcept {
+    for (size_t i = 0; i < page_next_.size(); ++i) {
+        page_next_[i] = i + 1 < page_next_.size() ? static_cast<int32_t>(i + 1) : NONE;
+    }
+    free_page_ = 0;
+    used_pages_ = 0;
+
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        Entry& entry = entries_[i];
+        entry.used = false;
+        entry.recording = false;
+        entry.pins = 0;
+        entry.length = 0;
+        entry.first_page = NONE;
+        entry.last_page = NONE;
+        entry.lru_prev = NONE;
+        entry.lru_next = i + 1 < entries_.size() ? static_cast<int32_t>(i + 1) : NONE;
+        for (Checkpoint& checkpoint : entry.checkpoints) {
+            checkpoint.valid = false;
+        }
+    }
+    free_entry_ = 0;
+    entry_count_ = 0;
+    lru_head_ = NONE;
+    lru_tail_ = NONE;
+
+    std::fill(table_.begin(), table_.end(), NONE);
+    voices_.fill(Voice{});
+}
+
+NoteCacheStats NoteCache::stats() const noexcept {
+    NoteCacheStats stats = stats_;
+    stats.entries = entry_count_;
+    stats.used_bytes = used_pages_ * (PAGE_SIZE * sizeof(float) + sizeof(Channel)) + entry_count_ * sizeof(Entry);
+    stats.capacity_bytes = page_next_.size() * (PAGE_SIZE * sizeof(float) + sizeof(Channel) + sizeof(Entry));
+    return stats;
+}
+
+void NoteCache::resetStats() noexcept {
+    stats_ = NoteCacheStats{};
+}
+
+void NoteCache::makeKey(const Channel& channel, Key& key) noexcept {
+    // 発音に影響するチャンネルの状態をすべて並べる
+    // （エンベロープの状態はキーオンで音色パラメータから決まるので含めない）
+    key.fill(0);
+    size_t offset = 0;
+    auto append = [&](const void* data, size_t size) {
+        std::memcpy(key.data() + offset, data, size);
+        offset += size;
+    };
+    for (const Operator& op : channel.operators_) {
+        const FMParameter& p = op.params_;
+        const uint8_t params[] = {p.dt1, p.mul, p.tl, p.ks, p.ar, p.amsen,
+                                  p.dt2, p.dr, p.sr, p.sl, p.rr, static_cast<uint8_t>(p.ssgeg)};
+        append(params, sizeof(params));
+    }
+    append(&channel.algorithm_, sizeof(channel.algorithm_));
+    append(&channel.feedback_, sizeof(channel.feedback_));
+    append(&channel.phase_increment_, sizeof(float));
+    append(&channel.phase_accumulator_, sizeof(float));
+    append(&channel.feedback_buffer_[0], sizeof(float));
+    append(&channel.feedback_buffer_[1], sizeof(float));
+}
+
+uint64_t NoteCache::hashKey(const Key& key) noexcept {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (uint8_t byte : key) {
+        hash = (hash ^ byte) * 1099511628211ull;
+    }
+    return hash;
+}
+
+int32_t NoteCache::find(const Key& key, uint64_t hash) const noexcept {
+    for (size_t slot = hash & table_mask_;; slot = (slot + 1) & table_mask_) {
+        const int32_t index = table_[slot];
+        if (index == NONE) {
+            return NONE;
+        }
+        const Entry& entry = entries_[index];
+        if (entry.hash == hash && entry.key == key) {
+            return index;
+        }
+    }
+}
+
+void NoteCache::insert(int32_t index) noexcept {
+    size_t slot = entries_[index].hash & table_mask_;
+    while (table_[slot] != NONE) {
+        slot = (slot + 1) & table_mask_;
+    }
+    table_[slot] = index;
+}
+
+void NoteCache::erase(int32_t index) noexcept {
+    size_t slot = entries_[index].hash & table_mask_;
+    while (table_[slot] != index) {
+        slot = (slot + 1) & table_mask_;
+    }
+
+    // 後ろの要素を詰めて、探索が途切れないようにする
+    table_[slot] = NONE;
+    size_t next = slot;
+    for (;;) {
+        next = (next + 1) & table_mask_;
+        const int32_t moved = table_[next];
+        if (moved == NONE) {
+            break;
+        }
+        const size_t home = entries_[moved].hash & table_mask_;
+        // home が (slot, next] の範囲にあれば移動できない
+        const bool stays = slot <= next ? (slot < home && home <= next) : (slot < home || home <= next);
+        if (!stays) {
+            table_[slot] = moved;
+            table_[next] = NONE;
+            slot = next;
+        }
+    }
+}
+
+void NoteCache::unlink(int32_t index) noexcept {
+    Entry& entry = entries_[index];
+    if (entry.lru_prev != NONE) {
+        entries_[entry.lru_prev].lru_next = entry.lru_next;
+    } else {
+        lru_head_ = entry.lru_next;
+    }
+    if (entry.lru_next != NONE) {
+        entries_[entry.lru_next].lru_prev = entry.lru_prev;
+    } else {
+        lru_tail_ = entry.lru_prev;
+    }
+    entry.lru_prev = NONE;
+    entry.lru_next = NONE;
+}
+
+void NoteCache::touch(int32_t index) noexcept {
+    if (lru_head_ == index) {
+        return;
+    }
+    Entry& entry = entries_[index];
+    if (entry.lru_prev != NONE || entry.lru_next != NONE || lru_tail_ == index) {
+        unlink(index);
+    }
+    entry.lru_next = lru_head_;
+    if (lru_head_ != NONE) {
+        entries_[lru_head_].lru_prev = index;
+    }
+    lru_head_ = index;
+    if (lru_tail_ == NONE) {
+        lru_tail_ = index;
+    }
+}
+
+void NoteCache::evict(int32_t index) noexcept {
+    Entry& entry = entries_[index];
+    erase(index);
+    unlink(index);
+
+    int32_t page = entry.first_page;
+    while (page != NONE) {
+        const int32_t next = page_next_[page];
+        page_next_[page] = free_page_;
+        free_page_ = page;
+        --used_pages_;
+        page = next;
+    }
+
+    entry.used = false;
+    entry.first_page = NONE;
+    entry.last_page = NONE;
+    entry.lru_next = free_entry_;
+    free_entry_ = index;
+    --entry_count_;
+    ++stats_.evictions;
+}
+
+bool NoteCache::evictOne() noexcept {
+    // 最も長く使われていないノートから、再生・記録中でないものを追い出す
+    for (int32_t index = lru_tail_; index != NONE; index = entries_[index].lru_prev) {
+        if (entries_[index].pins == 0) {
+            evict(index);
+            return true;
+        }
+    }
+    return false;
+}
+
+int32_t NoteCache::allocateEntry() noexcept {
+    if (free_entry_ == NONE && !evictOne()) {
+        return NONE;
+    }
+    const int32_t index = free_entry_;
+    free_entry_ = entries_[index].lru_next;
+    entries_[index].lru_next = NONE;
+    ++entry_count_;
+    return index;
+}
+
+int32_t NoteCache::allocatePage() noexcept {
+    // ページを持たないノート（記録を始めたばかりのもの）を追い出しても空きはできない
+    while (free_page_ == NONE) {
+        if (!evictOne()) {
+            return NONE;
+        }
+    }
+    const int32_t page = free_page_;
+    free_page_ = page_next_[page];
+    page_next_[page] = NONE;
+    ++used_pages_;
+    return page;
+}
+
+void NoteCache::keyOn(int index, const Channel& channel, bool cacheable) noexcept {
+    Voice& voice = voices_[index];
+    if (!cacheable) {
+        ++stats_.uncacheable;
+        return;
+    }
+
+    Key key;
+    makeKey(channel, key);
+    const uint64_t hash = hashKey(key);
+    const int32_t found = find(key, hash);
+    if (found != NONE) {
+        Entry& entry = entries_[found];
+        if (entry.recording) {
+            // 別のチャンネルが記録中のノートは再生できない
+            ++stats_.misses;
+            return;
+        }
+        ++stats_.hits;
+        ++entry.pins;
+        touch(found);
+        voice.mode = Mode::PLAYING;
+        voice.entry = found;
+        voice.position = 0;
+        voice.page = entry.first_page;
+        return;
+    }
+
+    ++stats_.misses;
+    const int32_t slot = allocateEntry();
+    if (slot == NONE) {
+        ++stats_.uncacheable;
+        return;
+    }
+    Entry& entry = entries_[slot];
+    entry.key = key;
+    entry.hash = hash;
+    entry.used = true;
+    entry.recording = true;
+    entry.pins = 1;
+    entry.length = 0;
+    entry.first_page = NONE;
+    entry.last_page = NONE;
+    entry.next_extra = 0;
+    for (Checkpoint& checkpoint : entry.checkpoints) {
+        checkpoint.valid = false;
+    }
+    entry.checkpoints[0].valid = true;
+    entry.checkpoints[0].position = 0;
+    entry.checkpoints[0].state = channel;
+    insert(slot);
+    touch(slot);
+
+    voice.mode = Mode::RECORDING;
+    voice.entry = slot;
+    voice.position = 0;
+    voice.page = NONE;
+}
+
+void NoteCache::finishRecording(Voice& voice, const Channel& channel) noexcept {
+    Entry& entry = entries_[voice.entry];
+    entry.recording = false;
+    entry.checkpoints[1].valid = true;
+    entry.checkpoints[1].position = entry.length;
+    entry.checkpoints[1].state = channel;
+    --entry.pins;
+    voice = Voice{};
+}
+
+void NoteCache::stopPlaying(Voice& voice) noexcept {
+    --entries_[voice.entry].pins;
+    voice = Voice{};
+}
+
+void NoteCache::release(int index, Channel& channel) noexcept {
+    Voice& voice = voices_[index];
+    if (voice.mode == Mode::RECORDING) {
+        // 記録中のチャンネルは通常通り計算しているので、現在の状態が記録の終わりの状態になる
+        finishRecording(voice, channel);
+        return;
+    }
+    if (voice.mode != Mode::PLAYING) {
+        return;
+    }
+
+    // 現在位置以前で最も近い状態（再生中のページの先頭か、保持している途中の状態）から、
+    // 現在位置まで計算し直す（ページの先頭からなので PAGE_SIZE 未満）
+    Entry& entry = entries_[voice.entry];
+    const Channel* nearest = nullptr;
+    uint32_t nearest_position = 0;
+    if (voice.page != NONE) {
+        nearest = &page_states_[voice.page];
+        nearest_position = voice.position - voice.position % PAGE_SIZE;
+    }
+    for (const Checkpoint& checkpoint : entry.checkpoints) {
+        if (checkpoint.valid && checkpoint.position <= voice.position &&
+            (!nearest || checkpoint.position > nearest_position)) {
+            nearest = &checkpoint.state;
+            nearest_position = checkpoint.position;
+        }
+    }
+    channel = *nearest;
+    const uint32_t steps = voice.position - nearest_position;
+    for (uint32_t i = 0; i < steps; ++i) {
+        channel.getOutput();
+    }
+    stats_.resimulated_samples += steps;
+    stats_.max_resimulated = std::max(stats_.max_resimulated, steps);
+
+    // 同じ長さで止めるノートのために、この位置の状態を保持する
+    if (steps > 0) {
+        Checkpoint& checkpoint = entry.checkpoints[2 + entry.next_extra];
+        entry.next_extra = (entry.next_extra + 1) % (CHECKPOINTS - 2);
+        checkpoint.valid = true;
+        checkpoint.position = voice.position;
+        checkpoint.state = channel;
+    }
+    stopPlaying(voice);
+}
+
+void NoteCache::abandon(int index, Channel& channel) noexcept {
+    Voice& voice = voices_[index];
+    if (voice.mode == Mode::RECORDING) {
+        finishRecording(voice, channel);
+    } else if (voice.mode == Mode::PLAYING) {
+        stopPlaying(voice);
+    }
+}
+
+bool NoteCache::active(int index) const noexcept {
+    return voices_[index].mode != Mode::LIVE;
+}
+
+void NoteCache::render(int index, Channel& channel, float* out, int samples) noexcept {
+    Voice& voice = voices_[index];
+    int i = 0;
+
+    if (voice.mode == Mode::PLAYING) {
+        const Entry& entry = entries_[voice.entry];
+        while (i < samples) {
+            if (voice.position == entry.length) {
+                // 記録の終わりから先は、その時点の状態から通常通り計算する
+                channel = entry.checkpoints[1].state;
+                stopPlaying(voice);
+                break;
+            }
+            const uint32_t offset = voice.position % PAGE_SIZE;
+            const uint32_t count = std::min({static_cast<uint32_t>(samples - i), entry.length - voice.position,
+                                             static_cast<uint32_t>(PAGE_SIZE) - offset});
+            std::memcpy(out + i, &pages_[static_cast<size_t>(voice.page) * PAGE_SIZE + offset], sizeof(float) * count);
+            i += static_cast<int>(count);
+            voice.position += count;
+            stats_.cached_samples += count;
+            if (voice.position % PAGE_SIZE == 0) {
+                voice.page = page_next_[voice.page];
+            }
+        }
+    }
+
+    while (i < samples && voice.mode == Mode::RECORDING) {
+        Entry& entry = entries_[voice.entry];
+        const uint32_t offset = entry.length % PAGE_SIZE;
+        if (entry.length >= max_note_samples_) {
+            finishRecording(voice, channel);
+            break;
+        }
+        if (offset == 0) {
+            // ページを使い切ったので次のページをつなぐ
+            const int32_t page = allocatePage();
+            if (page == NONE) {
+                finishRecording(voice, channel);
+                break;
+            }
+            if (entry.last_page == NONE) {
+                entry.first_page = page;
+            } else {
+                page_next_[entry.last_page] = page;
+            }
+            entry.last_page = page;
+            page_states_[page] = channel;
+        }
+
+        const uint32_t count = std::min({static_cast<uint32_t>(samples - i), static_cast<uint32_t>(PAGE_SIZE) - offset,
+                                         max_note_samples_ - entry.length});
+        float* page = &pages_[static_cast<size_t>(entry.last_page) * PAGE_SIZE + offset];
+        for (uint32_t k = 0; k < count; ++k) {
+            page[k] = out[i + k] = channel.getOutput();
+        }
+        i += static_cast<int>(count);
+        entry.length += count;
+    }
+
+    for (; i < samples; ++i) {
+        out[i] = channel.getOutput();
+    }
+}
+
+} // namespace YM2151
@@ -0,0 +1,160 @@
+#include "ym2151/offline.h"
+#include "denormal.h"
+#include "kernels.h"
+#include "oscillator.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <system_error>
+#include <thread>
+
+namespace YM2151 {
+
+namespace {
+
+void setError(std::string* error, const std::string& message) {
+    if (error) {
+        *error = message;
+    }
+}
+
+// チャンネル1つ分のタイムライン
+struct Track {
+    explicit Track(uint32_t clock) : chip(clock) {}
+
+    Chip chip;
+    size_t next = 0;                 // 次の書き込み（書き込み列全体での位置）
+    std::vector<float> buffer;       // 現在のウィンドウの出力（ゲイン適用前）
+};
+
+// 書き込みが影響するチャンネル（全チャンネルに影響する場合は -1）
+int targetChannel(const TimedWrite& write) {
+    if (write.reg == 0x08) {
+        return write.value & 0x07;
+    }
+    if (write.reg >= 0x10 && write.reg <= 0x27) {
+        return write.reg & 0x07;
+    }
+    return -1;
+}
+
+// begin から samples サンプル分のチャンネル出力を track.buffer に書き込む
+// 書き込みの適用とサンプルの計算の順序は Chip::generate を書き込み時刻で区切った場合と同じ
+// （チャンネルの出力は生成の区切り方によらないので、書き込みのない区間はまとめて生成する）
+void renderTrack(Track& track, const std::vector<TimedWrite>& writes, int index, uint64_t begin,
+                 uint32_t samples, int control_rate) {
+    DenormalGuard denormal_guard;
+    Channel& channel = track.chip.getChannel(index);
+    float* out = track.buffer.data();
+
+    renderBetweenWrites(
+        writes, track.next, begin, static_cast<int>(samples),
+        [&track, index](const TimedWrite& write) {
+            const int target = targetChannel(write);
+            if (target < 0 || target == index) {
+                track.chip.setRegister(write.reg, write.value);
+            }
+        },
+        [&channel, out, control_rate](int offset, int count) { channel.render(out + offset, count, control_rate); });
+}
+
+} // namespace
+
+OfflineRenderer::OfflineRenderer(uint32_t sample_rate, int threads)
+    : sample_rate_(sample_rate),
+      threads_(0),
+      control_rate_(1) {
+    setThreads(threads);
+}
+
+void OfflineRenderer::setThreads(int threads) {
+    if (threads <= 0) {
+        threads = static_cast<int>(std::thread::hardware_concurrency());
+    }
+    threads_ = std::clamp(threads, 1, CHANNEL_COUNT);
+}
+
+int OfflineRenderer::getThreads() const {
+    return threads_;
+}
+
+void OfflineRenderer::setControlRate(int samples) {
+    control_rate_ = std::clamp(samples, 1, MAX_CONTROL_RATE);
+}
+
+int OfflineRenderer::getControlRate() const {
+    return control_rate_;
+}
+
+uint32_t OfflineRenderer::getSampleRate() const {
+    return sample_rate_;
+}
+
+bool OfflineRenderer::render(const RegisterStream& stream, uint32_t tail, std::vector<float>& mix,
+                             OfflineStems* stems, std::string* error) const {
+    if (sample_rate_ == 0) {
+        setError(error, "sample rate must be positive");
+        return false;
+    }
+
+    const uint64_t total = static_cast<uint64_t>(stream.total_samples) + tail;
+    const size_t window = static_cast<size_t>(std::min<uint64_t>(WINDOW, total));
+
+    // チャンネルごとのタイムライン（書き込み列は共有し、適用する書き込みを各々で選ぶ）
+    std::vector<std::unique_ptr<Track>> tracks;
+    for (int ch = 0; ch < CHANNEL_COUNT; ++ch) {
+        tracks.emplace_back(new Track(stream.clock));
+        tracks[ch]->chip.setSampleRate(sample_rate_);
+        tracks[ch]->chip.setControlRate(control_rate_);
+        tracks[ch]->buffer.resize(window);
+    }
+
+    mix.assign(static_cast<size_t>(total), 0.0f);
+    if (stems) {
+        for (std::vector<float>& stem : *stems) {
+            stem.assign(static_cast<size_t>(total), 0.0f);
+        }
+    }
+
+    const Kernels& kernels = selectKernels();
+    const float* channels[CHANNEL_COUNT];
+    for (int ch = 0; ch < CHANNEL_COUNT; ++ch) {
+        channels[ch] = tracks[ch]->buffer.data();
+    }
+
+    for (uint64_t begin = 0; begin < total; begin += WINDOW) {
+        const uint32_t count = static_cast<uint32_t>(std::min<uint64_t>(WINDOW, total - begin));
+
+        // チャンネルのタイムラインを並行して生成する
+        // （スレッドを起動できない場合は、起動できた数で続ける。出力は変わらない）
+        std::atomic<int> next_track(0);
+        auto work = [&] {
+            for (int ch; (ch = next_track.fetch_add(1, std::memory_order_relaxed)) < CHANNEL_COUNT;) {
+                renderTrack(*tracks[ch], stream.writes, ch, begin, count, control_rate_);
+            }
+        };
+        std::vector<std::thread> helpers;
+        try {
+            for (int i = 1; i < threads_; ++i) {
+                helpers.emplace_back(work);
+            }
+        } catch (const std::system_error&) {
+        }
+        work();
+        for (std::thread& helper : helpers) {
+            helper.join();
+        }
+
+        // generate() / generateStems() と同じ順序で合成する
+        DenormalGuard denormal_guard;
+        kernels.mix(channels, CHANNEL_COUNT, OUTPUT_GAIN, mix.data() + begin, static_cast<int>(count));
+        if (stems) {
+            for (int ch = 0; ch < CHANNEL_COUNT; ++ch) {
+                kernels.scale(channels[ch], OUTPUT_GAIN, (*stems)[ch].data() + begin, static_cast<int>(count));
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace YM2151
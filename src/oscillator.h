@@ -0,0 +1,109 @@
+#ifndef YM2151_OSCILLATOR_H
+#define YM2151_OSCILLATOR_H
+
+// オペレータの計算に使う定数、位相処理とサイン波テーブル（ライブラリ内部用）
+// Chip と ChipArray で同じ計算を共有し、出力をビット単位で一致させる。
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace YM2151 {
+
+// 定数定義
+constexpr float PI = 3.14159265358979323846f;
+constexpr float TWO_PI = 2.0f * PI;
+
+// エンベロープ生成用の定数
+constexpr float ATTACK_RATE_FACTOR = 0.001f;
+constexpr float DECAY_RATE_FACTOR = 0.0001f;
+constexpr float SUSTAIN_RATE_FACTOR = 0.00005f;
+constexpr float RELEASE_RATE_FACTOR = 0.0002f;
+
+// エンベロープを打ち切るレベル（これ未満は0として発音を終える）
+// 指数減衰を非正規化数の範囲まで続けないための下限も兼ねる。
+constexpr float ENVELOPE_FLOOR = 0.001f;
+
+// チップ出力のゲイン（全チャンネル合成後に適用）
+constexpr float OUTPUT_GAIN = 100.0f;
+
+// サイン波テーブル
+constexpr int SINE_TABLE_SIZE = 1024;
+extern std::array<float, SINE_TABLE_SIZE> sine_table;
+
+// サイン波テーブルの初期化
+// Operator / ChipArray の構築時に一度だけ実行する（スレッドセーフ）。
+// レンダリング経路からは呼ばないこと。
+void initSineTable();
+
+// 位相からサイン波テーブルのインデックスを求める
+inline int sineIndex(float phase) noexcept {
+    return static_cast<int>(phase * SINE_TABLE_SIZE / TWO_PI) & (SINE_TABLE_SIZE - 1);
+}
+
+// サイン波の取得（テーブル参照）
+// テーブルは initSineTable() で初期化済みであること
+inline float getSine(float phase) noexcept {
+    return sine_table[sineIndex(phase)];
+}
+
+inline uint32_t floatBits(float value) noexcept {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline float bitsFloat(uint32_t bits) noexcept {
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// 大きな位相を縮約する（phase >= 16）
+// 「2πを繰り返し減算する」ループと同じ結果をビット単位で返す。
+// 同じ2の冪の区間 [2^k, 2^(k+1)) に留まる間は、1回の減算で丸められる量が
+// （最初の1回を除いて）一定になるため、その区間内の減算をまとめて行う。
+// 区間内の値はビット表現の下位23ビットが最小単位(2^(k-23))の整数になるので、
+// 指数部を取り出す代わりにビット表現のまま計算する。
+inline float reducePhase(float phase) noexcept {
+    while (phase >= 16.0f) {
+        const float lower = bitsFloat(floatBits(phase) & 0xFF800000u);
+
+        // 2回は通常通り減算し、2回目の減算量を区間内の一定の減算量とする
+        const float first = phase - TWO_PI;
+        const float second = first - TWO_PI;
+        if (!(second > lower)) {
+            phase = second;
+            continue;
+        }
+
+        // first と second は同じ区間にあるので、ビット表現の差が最小単位での減算量になる
+        const uint32_t second_bits = floatBits(second);
+        const int32_t step = static_cast<int32_t>(floatBits(first) - second_bits);
+        const int32_t mantissa = static_cast<int32_t>(second_bits & 0x007FFFFFu);
+        const int32_t count = (mantissa - 1) / step;
+        const float bottom = bitsFloat(second_bits - static_cast<uint32_t>(count * step));
+
+        // 区間の下端に近づいた後の2回の減算は必ず下の区間へ移るので続けて行う
+        phase = (bottom - TWO_PI) - TWO_PI;
+    }
+    return phase;
+}
+
+// 位相を0〜2πの範囲に正規化
+inline float wrapPhase(float phase) noexcept {
+    if (phase >= 16.0f) {
+        phase = reducePhase(phase);
+    } else if (phase <= -16.0f) {
+        // 丸めは符号に対して対称なので負の位相も同じ方法で縮約できる
+        phase = -reducePhase(-phase);
+    }
+    while (phase >= TWO_PI) phase -= TWO_PI;
+    while (phase < 0) phase += TWO_PI;
+    return phase;
+}
+
+} // namespace YM2151
+
+#endif // YM2151_OSCILLATOR_H
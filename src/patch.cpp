@@ -0,0 +1,230 @@
+#include "ym2151/patch.h"
+#include <fstream>
+#include <sstream>
+
+namespace YM2151 {
+
+namespace {
+
+// .opm のオペレータ行（M1, C1, M2, C2）とレジスタ上のスロットの対応
+// レジスタ上のスロット順は M1, M2, C1, C2
+struct OperatorLine {
+    const char* tag;
+    int slot;
+};
+
+constexpr OperatorLine operator_lines[4] = {
+    {"M1:", 0},
+    {"C1:", 2},
+    {"M2:", 1},
+    {"C2:", 3},
+};
+
+// 解析中の音色
+struct PatchSource {
+    int number = -1;
+    std::string name;
+    int ch[7] = {};       // PAN FL CON AMS PMS SLOT NE
+    int op[4][11] = {};   // AR D1R D2R RR D1L TL KS MUL DT1 DT2 AMS-EN（スロット順）
+    unsigned lines = 0;   // 読み込み済みの行（ビットマスク）
+};
+
+constexpr unsigned LINE_CH = 1 << 0;
+constexpr unsigned LINE_OPS = 0x0F << 1;
+
+bool readValues(std::istringstream& stream, int* values, int count) {
+    for (int i = 0; i < count; ++i) {
+        if (!(stream >> values[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void setError(std::string* error, int line, const std::string& message) {
+    if (error) {
+        *error = "line " + std::to_string(line) + ": " + message;
+    }
+}
+
+// 解析した値をレジスタブロックに変換
+Patch compile(const PatchSource& source) {
+    Patch patch;
+    patch.number = source.number;
+    patch.name = source.name;
+
+    auto add = [&patch](int reg, int value) {
+        patch.registers[patch.count++] = RegWrite{static_cast<uint8_t>(reg), static_cast<uint8_t>(value)};
+    };
+
+    // RL / FB / CON
+    add(0x20, (source.ch[0] & 0xC0) | ((source.ch[1] & 0x07) << 3) | (source.ch[2] & 0x07));
+    // PMS / AMS
+    add(0x38, ((source.ch[4] & 0x07) << 4) | (source.ch[3] & 0x03));
+
+    for (int slot = 0; slot < 4; ++slot) {
+        const int* op = source.op[slot];
+        const int offset = slot * 8;
+        add(0x40 + offset, ((op[8] & 0x07) << 4) | (op[7] & 0x0F));    // DT1 / MUL
+        add(0x60 + offset, op[5] & 0x7F);                               // TL
+        add(0x80 + offset, ((op[6] & 0x03) << 6) | (op[0] & 0x1F));    // KS / AR
+        add(0xA0 + offset, (op[10] ? 0x80 : 0x00) | (op[1] & 0x1F));  // AMS-EN / D1R
+        add(0xC0 + offset, ((op[9] & 0x03) << 6) | (op[2] & 0x1F));    // DT2 / D2R
+        add(0xE0 + offset, ((op[4] & 0x0F) << 4) | (op[3] & 0x0F));    // D1L / RR
+    }
+
+    return patch;
+}
+
+} // namespace
+
+void Patch::apply(Chip& chip, int channel) const {
+    chip.setChannelRegisters(channel, registers.data(), count);
+}
+
+PatchBank::PatchBank() {
+    clear();
+}
+
+PatchBank::~PatchBank() {
+}
+
+void PatchBank::clear() {
+    patches_.clear();
+    index_.fill(-1);
+}
+
+bool PatchBank::loadOPM(const std::string& path, std::string* error) {
+    std::ifstream file(path);
+    if (!file) {
+        if (error) {
+            *error = "cannot open " + path;
+        }
+        return false;
+    }
+    return parseOPM(file, error);
+}
+
+bool PatchBank::parseOPM(std::istream& in, std::string* error) {
+    PatchSource source;
+    std::string line;
+    int line_number = 0;
+
+    // 完成した音色をバンクに登録
+    auto flush = [&]() -> bool {
+        if (source.number < 0) {
+            return true;
+        }
+        if ((source.lines & (LINE_CH | LINE_OPS)) != (LINE_CH | LINE_OPS)) {
+            setError(error, line_number, "incomplete voice @:" + std::to_string(source.number));
+            return false;
+        }
+        add(compile(source));
+        source = PatchSource();
+        return true;
+    };
+
+    while (std::getline(in, line)) {
+        ++line_number;
+
+        // コメントと空白の除去
+        size_t comment = line.find("//");
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos) {
+            continue;
+        }
+        line.erase(0, start);
+
+        if (line.compare(0, 2, "@:") == 0) {
+            if (!flush()) {
+                return false;
+            }
+            std::istringstream stream(line.substr(2));
+            if (!(stream >> source.number) || source.number < 0 || source.number > 255) {
+                setError(error, line_number, "invalid voice number");
+                return false;
+            }
+            std::getline(stream >> std::ws, source.name);
+            while (!source.name.empty() && (source.name.back() == '\r' || source.name.back() == ' ')) {
+                source.name.pop_back();
+            }
+            continue;
+        }
+
+        // LFO行はチップ全体の設定なので音色には含めない
+        if (line.compare(0, 4, "LFO:") == 0) {
+            continue;
+        }
+
+        if (source.number < 0) {
+            setError(error, line_number, "parameter line outside of a voice");
+            return false;
+        }
+
+        if (line.compare(0, 3, "CH:") == 0) {
+            std::istringstream stream(line.substr(3));
+            if (!readValues(stream, source.ch, 7)) {
+                setError(error, line_number, "CH: expects 7 values");
+                return false;
+            }
+            source.lines |= LINE_CH;
+            continue;
+        }
+
+        bool matched = false;
+        for (const auto& op_line : operator_lines) {
+            if (line.compare(0, 3, op_line.tag) == 0) {
+                std::istringstream stream(line.substr(3));
+                if (!readValues(stream, source.op[op_line.slot], 11)) {
+                    setError(error, line_number, std::string(op_line.tag) + " expects 11 values");
+                    return false;
+                }
+                source.lines |= 1u << (op_line.slot + 1);
+                matched = true;
+                break;
+            }
+        }
+
+        if (!matched) {
+            setError(error, line_number, "unknown line: " + line);
+            return false;
+        }
+    }
+
+    return flush();
+}
+
+void PatchBank::add(const Patch& patch) {
+    const int number = patch.number & 0xFF;
+    if (index_[number] >= 0) {
+        patches_[index_[number]] = patch;
+        return;
+    }
+    index_[number] = static_cast<int16_t>(patches_.size());
+    patches_.push_back(patch);
+}
+
+const Patch* PatchBank::find(int number) const {
+    if (number < 0 || number > 255 || index_[number] < 0) {
+        return nullptr;
+    }
+    return &patches_[index_[number]];
+}
+
+size_t PatchBank::size() const {
+    return patches_.size();
+}
+
+bool PatchBank::apply(Chip& chip, int channel, int number) const {
+    const Patch* patch = find(number);
+    if (!patch) {
+        return false;
+    }
+    patch->apply(chip, channel);
+    return true;
+}
+
+} // namespace YM2151
@@ -0,0 +1,102 @@
+#include "ym2151/recorder.h"
+#include <algorithm>
+#include <limits>
+
+namespace YM2151 {
+
+Recorder::Recorder(size_t capacity)
+    : size_(0), dropped_(0), position_(0), clock_(3579545), sample_rate_(44100) {
+    reserve(capacity);
+}
+
+Recorder::~Recorder() {
+}
+
+void Recorder::reserve(size_t capacity) {
+    while (chunks_.size() * CHUNK_SIZE < capacity) {
+        chunks_.emplace_back(new TimedWrite[CHUNK_SIZE]);
+    }
+}
+
+void Recorder::clear() noexcept {
+    size_ = 0;
+    dropped_ = 0;
+    position_ = 0;
+}
+
+void Recorder::record(uint8_t reg, uint8_t value) noexcept {
+    if (size_ >= chunks_.size() * CHUNK_SIZE) {
+        ++dropped_;
+        return;
+    }
+    chunks_[size_ / CHUNK_SIZE][size_ % CHUNK_SIZE] = TimedWrite{position_, reg, value};
+    ++size_;
+}
+
+void Recorder::advance(int samples) noexcept {
+    // 時刻は32ビット（44100Hzで約27時間）で飽和させる
+    const uint32_t limit = std::numeric_limits<uint32_t>::max();
+    const uint32_t count = static_cast<uint32_t>(samples);
+    position_ = count > limit - position_ ? limit : position_ + count;
+}
+
+void Recorder::setClock(uint32_t clock) noexcept {
+    clock_ = clock;
+}
+
+void Recorder::setSampleRate(uint32_t rate) noexcept {
+    sample_rate_ = rate;
+}
+
+uint32_t Recorder::getClock() const noexcept {
+    return clock_;
+}
+
+uint32_t Recorder::getSampleRate() const noexcept {
+    return sample_rate_;
+}
+
+size_t Recorder::size() const noexcept {
+    return size_;
+}
+
+size_t Recorder::capacity() const noexcept {
+    return chunks_.size() * CHUNK_SIZE;
+}
+
+uint64_t Recorder::dropped() const noexcept {
+    return dropped_;
+}
+
+uint32_t Recorder::position() const noexcept {
+    return position_;
+}
+
+const TimedWrite& Recorder::operator[](size_t index) const noexcept {
+    return chunks_[index / CHUNK_SIZE][index % CHUNK_SIZE];
+}
+
+void Recorder::exportStream(RegisterStream& stream) const {
+    stream.writes.clear();
+    stream.writes.reserve(size_);
+    for (size_t chunk = 0; chunk * CHUNK_SIZE < size_; ++chunk) {
+        const size_t count = std::min(CHUNK_SIZE, size_ - chunk * CHUNK_SIZE);
+        stream.writes.insert(stream.writes.end(), chunks_[chunk].get(), chunks_[chunk].get() + count);
+    }
+    stream.total_samples = position_;
+    stream.clock = clock_;
+}
+
+void Recorder::writeVGM(std::vector<uint8_t>& data) const {
+    RegisterStream stream;
+    exportStream(stream);
+    YM2151::writeVGM(stream, sample_rate_, data);
+}
+
+bool Recorder::saveVGM(const std::string& path, std::string* error) const {
+    RegisterStream stream;
+    exportStream(stream);
+    return YM2151::saveVGM(path, stream, sample_rate_, error);
+}
+
+} // namespace YM2151
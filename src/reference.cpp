@@ -0,0 +1,296 @@
+#include "ym2151/reference.h"
+#include <cmath>
+
+namespace YM2151 {
+
+namespace {
+
+constexpr float PI = 3.14159265358979323846f;
+constexpr float TWO_PI = 2.0f * PI;
+
+constexpr int SINE_TABLE_SIZE = 1024;
+
+constexpr float ATTACK_RATE_FACTOR = 0.001f;
+constexpr float DECAY_RATE_FACTOR = 0.0001f;
+constexpr float SUSTAIN_RATE_FACTOR = 0.00005f;
+constexpr float RELEASE_RATE_FACTOR = 0.0002f;
+
+constexpr float OPERATOR_GAIN = 8192.0f;
+constexpr float OUTPUT_GAIN = 100.0f;
+
+std::array<float, SINE_TABLE_SIZE> buildSineTable() {
+    std::array<float, SINE_TABLE_SIZE> table{};
+    for (int i = 0; i < SINE_TABLE_SIZE; ++i) {
+        table[i] = std::sin(TWO_PI * i / SINE_TABLE_SIZE);
+    }
+    return table;
+}
+
+float sine(float phase) {
+    static const std::array<float, SINE_TABLE_SIZE> table = buildSineTable();
+    int index = static_cast<int>(phase * SINE_TABLE_SIZE / TWO_PI) & (SINE_TABLE_SIZE - 1);
+    return table[index];
+}
+
+} // namespace
+
+ReferenceChip::ReferenceChip(uint32_t clock) : clock_(clock), sample_rate_(44100) {
+    reset();
+}
+
+void ReferenceChip::reset() {
+    registers_.fill(0);
+    for (auto& channel : channels_) {
+        for (auto& op : channel.ops) {
+            resetOperator(op);
+        }
+        channel.frequency = 0;
+        channel.algorithm = 0;
+        channel.feedback = 0;
+        channel.key_on = false;
+        channel.phase = 0.0f;
+        channel.feedback_buffer[0] = 0.0f;
+        channel.feedback_buffer[1] = 0.0f;
+    }
+    lfo_frequency_ = 0;
+    lfo_phase_ = 0.0f;
+}
+
+void ReferenceChip::setSampleRate(uint32_t rate) {
+    sample_rate_ = rate;
+}
+
+void ReferenceChip::setRegister(uint8_t reg, uint8_t value) {
+    registers_[reg] = value;
+
+    if (reg == 0x01) {
+        // LFO周波数
+        lfo_frequency_ = value & 0x0F;
+    } else if (reg == 0x08) {
+        // キーオン/オフ
+        ChannelState& channel = channels_[value & 0x07];
+        channel.key_on = (value & 0x80) != 0;
+        for (auto& op : channel.ops) {
+            if (channel.key_on) {
+                keyOnOperator(op);
+            } else {
+                keyOffOperator(op);
+            }
+        }
+    } else if (reg >= 0x10 && reg <= 0x1F) {
+        // チャンネル周波数（0x10-0x17: 下位8ビット、0x18-0x1F: 上位8ビット）
+        int ch = reg & 0x07;
+        channels_[ch].frequency = static_cast<uint16_t>((registers_[0x18 + ch] << 8) | registers_[0x10 + ch]);
+    } else if (reg >= 0x20 && reg <= 0x27) {
+        // アルゴリズム、フィードバック
+        ChannelState& channel = channels_[reg & 0x07];
+        channel.algorithm = value & 0x07;
+        channel.feedback = (value >> 3) & 0x07;
+    }
+    // その他のレジスタは保存のみ
+}
+
+void ReferenceChip::setOperatorParameter(int channel, int op, const FMParameter& param) {
+    channels_[channel & 0x07].ops[op & 0x03].params = param;
+}
+
+uint8_t ReferenceChip::getRegister(uint8_t reg) const {
+    return registers_[reg];
+}
+
+void ReferenceChip::generate(float* buffer, int samples) {
+    for (int i = 0; i < samples; ++i) {
+        // LFOの位相を進める（出力には影響しない）
+        if (lfo_frequency_ > 0) {
+            lfo_phase_ += lfo_frequency_ * 0.01f / sample_rate_;
+            if (lfo_phase_ >= 1.0f) lfo_phase_ -= 1.0f;
+        }
+
+        // 全チャンネルをチャンネル0から順に合成
+        float output = 0.0f;
+        for (auto& channel : channels_) {
+            output += channelOutput(channel);
+        }
+        buffer[i] = output * OUTPUT_GAIN;
+    }
+}
+
+void ReferenceChip::resetOperator(OperatorState& op) {
+    op.params.dt1 = 0;
+    op.params.mul = 1;
+    op.params.tl = 127;
+    op.params.ks = 0;
+    op.params.ar = 31;
+    op.params.amsen = 0;
+    op.params.dr = 0;
+    op.params.dt2 = 0;
+    op.params.sr = 0;
+    op.params.sl = 0;
+    op.params.rr = 15;
+    op.params.ssgeg = false;
+    op.env_state = EnvelopeState::IDLE;
+    op.env_level = 0.0f;
+    op.env_rate = 0.0f;
+    op.envelope = 0.0f;
+}
+
+void ReferenceChip::keyOnOperator(OperatorState& op) {
+    op.env_state = EnvelopeState::ATTACK;
+    op.env_rate = op.params.ar * ATTACK_RATE_FACTOR * 10.0f;
+
+    if (op.params.ar == 31) {
+        // 最速アタックは即座に最大レベルからディケイへ
+        op.env_level = 1.0f;
+        op.env_state = EnvelopeState::DECAY;
+        op.env_rate = op.params.dr * DECAY_RATE_FACTOR;
+    } else {
+        op.env_level = 0.8f;
+    }
+    op.envelope = op.env_level;
+}
+
+void ReferenceChip::keyOffOperator(OperatorState& op) {
+    op.env_state = EnvelopeState::RELEASE;
+    op.env_rate = op.params.rr * RELEASE_RATE_FACTOR;
+}
+
+void ReferenceChip::stepEnvelope(OperatorState& op) {
+    float sustain_level = 1.0f - (op.params.sl / 15.0f);
+
+    switch (op.env_state) {
+        case EnvelopeState::IDLE:
+            break;
+
+        case EnvelopeState::ATTACK:
+            op.env_level += (1.0f - op.env_level) * op.env_rate;
+            if (op.env_level > 0.99f) {
+                op.env_level = 1.0f;
+                op.env_state = EnvelopeState::DECAY;
+                op.env_rate = op.params.dr * DECAY_RATE_FACTOR;
+            }
+            break;
+
+        case EnvelopeState::DECAY:
+            op.env_level -= op.env_level * op.env_rate;
+            if (op.env_level <= sustain_level) {
+                op.env_level = sustain_level;
+                op.env_state = EnvelopeState::SUSTAIN;
+                op.env_rate = op.params.sr * SUSTAIN_RATE_FACTOR;
+            } else if (op.env_level < 0.001f) {
+                // サスティンレベルが0（SL=15）の場合は最小レベルで停止
+                op.env_level = 0.0f;
+                op.env_state = EnvelopeState::IDLE;
+            }
+            break;
+
+        case EnvelopeState::SUSTAIN:
+        case EnvelopeState::RELEASE:
+            op.env_level -= op.env_level * op.env_rate;
+            if (op.env_level < 0.001f) {
+                op.env_level = 0.0f;
+                op.env_state = EnvelopeState::IDLE;
+            }
+            break;
+    }
+
+    op.envelope = op.env_level * 2.0f;
+}
+
+float ReferenceChip::operatorOutput(OperatorState& op, float phase, float modulation) {
+    float detune = op.params.dt1 * 0.05f + op.params.dt2 * 0.1f;
+    float multiplier = op.params.mul ? op.params.mul : 0.5f;
+
+    // 位相を 0〜2π に正規化（2πを繰り返し加減算する）
+    float current_phase = phase * multiplier + detune + modulation;
+    while (current_phase >= TWO_PI) current_phase -= TWO_PI;
+    while (current_phase < 0) current_phase += TWO_PI;
+
+    float sine_value = sine(current_phase);
+
+    // エンベロープはサイン値の取得後に1サンプル進める
+    stepEnvelope(op);
+
+    return sine_value * op.envelope * OPERATOR_GAIN;
+}
+
+float ReferenceChip::channelOutput(ChannelState& channel) {
+    // 基本位相はキーオフ中も進める
+    channel.phase += TWO_PI * channel.frequency / static_cast<float>(sample_rate_);
+    if (channel.phase >= TWO_PI) channel.phase -= TWO_PI;
+
+    if (!channel.key_on) {
+        return 0.0f;
+    }
+
+    float feedback = 0.0f;
+    if (channel.feedback > 0) {
+        feedback = (channel.feedback_buffer[0] + channel.feedback_buffer[1]) * (channel.feedback * 0.1f);
+    }
+
+    // OP1は常にフィードバックで変調される
+    auto& ops = channel.ops;
+    const float p = channel.phase;
+    float o1 = operatorOutput(ops[0], p, feedback);
+    float o2 = 0.0f;
+    float o3 = 0.0f;
+    float o4 = 0.0f;
+    float output = 0.0f;
+
+    switch (channel.algorithm) {
+        case 0:  // OP1->OP2->OP3->OP4
+            o2 = operatorOutput(ops[1], p, o1);
+            o3 = operatorOutput(ops[2], p, o2);
+            o4 = operatorOutput(ops[3], p, o3);
+            output = o4;
+            break;
+        case 1:  // OP1->OP2->OP4, OP3
+            o2 = operatorOutput(ops[1], p, o1);
+            o3 = operatorOutput(ops[2], p, 0.0f);
+            o4 = operatorOutput(ops[3], p, o2);
+            output = o3 + o4;
+            break;
+        case 2:  // OP1->OP3->OP4, OP2
+            o2 = operatorOutput(ops[1], p, 0.0f);
+            o3 = operatorOutput(ops[2], p, o1);
+            o4 = operatorOutput(ops[3], p, o3);
+            output = o2 + o4;
+            break;
+        case 3:  // OP1->OP3, OP2->OP4
+            o2 = operatorOutput(ops[1], p, 0.0f);
+            o3 = operatorOutput(ops[2], p, o1);
+            o4 = operatorOutput(ops[3], p, o2);
+            output = o3 + o4;
+            break;
+        case 4:  // OP1->OP2, OP3->OP4
+            o2 = operatorOutput(ops[1], p, o1);
+            o3 = operatorOutput(ops[2], p, 0.0f);
+            o4 = operatorOutput(ops[3], p, o3);
+            output = o2 + o4;
+            break;
+        case 5:  // OP1->OP2, OP3, OP4
+            o2 = operatorOutput(ops[1], p, o1);
+            o3 = operatorOutput(ops[2], p, 0.0f);
+            o4 = operatorOutput(ops[3], p, 0.0f);
+            output = o2 + o3 + o4;
+            break;
+        case 6:  // OP1, OP2->OP3, OP4
+            o2 = operatorOutput(ops[1], p, 0.0f);
+            o3 = operatorOutput(ops[2], p, o2);
+            o4 = operatorOutput(ops[3], p, 0.0f);
+            output = o1 + o3 + o4;
+            break;
+        default:  // 7: OP1, OP2, OP3, OP4
+            o2 = operatorOutput(ops[1], p, 0.0f);
+            o3 = operatorOutput(ops[2], p, 0.0f);
+            o4 = operatorOutput(ops[3], p, 0.0f);
+            output = o1 + o2 + o3 + o4;
+            break;
+    }
+
+    channel.feedback_buffer[1] = channel.feedback_buffer[0];
+    channel.feedback_buffer[0] = o1;
+
+    return output;
+}
+
+} // namespace YM2151
@@ -0,0 +1,100 @@
+#ifndef YM2151_SEMAPHORE_H
+#define YM2151_SEMAPHORE_H
+
+// ワーカースレッドを起こすセマフォ（ライブラリ内部用）
+// post() はロックもメモリ確保も行わず、待っているスレッドがあればカーネルに起こさせるだけなので、
+// オーディオスレッドから呼べる（ミューテックスと条件変数による受け渡しでは、ワーカーが
+// ロックを持っている間オーディオスレッドが待たされる優先度逆転が起こりうる）。
+// C++17 には std::counting_semaphore がないため、OSのセマフォを使う
+// （macOS は名前なしの POSIX セマフォに対応していないので dispatch のセマフォを使う）。
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <dispatch/dispatch.h>
+#else
+#include <cerrno>
+#include <semaphore.h>
+#endif
+
+namespace YM2151 {
+
+class Semaphore {
+public:
+    Semaphore() noexcept {
+#if defined(_WIN32)
+        handle_ = CreateSemaphoreW(nullptr, 0, 0x7FFFFFFF, nullptr);
+#elif defined(__APPLE__)
+        handle_ = dispatch_semaphore_create(0);
+#else
+        sem_init(&handle_, 0, 0);
+#endif
+    }
+
+    ~Semaphore() {
+#if defined(_WIN32)
+        CloseHandle(handle_);
+#elif defined(__APPLE__)
+        dispatch_release(handle_);
+#else
+        sem_destroy(&handle_);
+#endif
+    }
+
+    Semaphore(const Semaphore&) = delete;
+    Semaphore& operator=(const Semaphore&) = delete;
+
+    void post() noexcept {
+#if defined(_WIN32)
+        ReleaseSemaphore(handle_, 1, nullptr);
+#elif defined(__APPLE__)
+        dispatch_semaphore_signal(handle_);
+#else
+        sem_post(&handle_);
+#endif
+    }
+
+    void wait() noexcept {
+#if defined(_WIN32)
+        WaitForSingleObject(handle_, INFINITE);
+#elif defined(__APPLE__)
+        dispatch_semaphore_wait(handle_, DISPATCH_TIME_FOREVER);
+#else
+        while (sem_wait(&handle_) != 0 && errno == EINTR) {
+        }
+#endif
+    }
+
+    // 通知が残っていれば1回消費して true を返す（待たない）
+    bool tryWait() noexcept {
+#if defined(_WIN32)
+        return WaitForSingleObject(handle_, 0) == WAIT_OBJECT_0;
+#elif defined(__APPLE__)
+        return dispatch_semaphore_wait(handle_, DISPATCH_TIME_NOW) == 0;
+#else
+        int result;
+        while ((result = sem_trywait(&handle_)) != 0 && errno == EINTR) {
+        }
+        return result == 0;
+#endif
+    }
+
+private:
+#if defined(_WIN32)
+    HANDLE handle_;
+#elif defined(__APPLE__)
+    dispatch_semaphore_t handle_;
+#else
+    sem_t handle_;
+#endif
+};
+
+} // namespace YM2151
+
+#endif // YM2151_SEMAPHORE_H
@@ -0,0 +1,208 @@
+#include "ym2151/sequencer.h"
+#include "ym2151/midi.h"
+#include <algorithm>
+#include <cstring>
+
+namespace YM2151 {
+
+namespace {
+
+// レジスタアドレス
+constexpr uint8_t REG_KEY_ON = 0x08;
+constexpr uint8_t REG_FREQ_LOW = 0x10;
+constexpr uint8_t REG_FREQ_HIGH = 0x18;
+
+// テンポの上限（MIDIのテンポと同じ24ビット）
+constexpr uint32_t MAX_TEMPO = 0xFFFFFF;
+
+constexpr uint64_t MICROSECONDS = 1000000;
+
+} // namespace
+
+Sequencer::Sequencer(size_t capacity)
+    : queue_(std::max<size_t>(capacity, 1)),
+      sample_rate_(44100),
+      ticks_per_quarter_(DEFAULT_TICKS_PER_QUARTER),
+      initial_tempo_(DEFAULT_TEMPO) {
+    reset();
+}
+
+Sequencer::~Sequencer() {
+}
+
+void Sequencer::reset() noexcept {
+    queue_head_ = 0;
+    queue_size_ = 0;
+    last_tick_ = 0;
+    tempo_ = initial_tempo_;
+    anchor_tick_ = 0;
+    anchor_sample_ = 0;
+    now_ = 0;
+    paused_ = false;
+    generate_calls_ = 0;
+}
+
+void Sequencer::setSampleRate(uint32_t rate) noexcept {
+    sample_rate_ = rate;
+}
+
+void Sequencer::setTicksPerQuarter(uint16_t ticks) noexcept {
+    ticks_per_quarter_ = ticks ? ticks : 1;
+}
+
+uint32_t Sequencer::getSampleRate() const noexcept {
+    return sample_rate_;
+}
+
+uint16_t Sequencer::getTicksPerQuarter() const noexcept {
+    return ticks_per_quarter_;
+}
+
+void Sequencer::setTempo(uint32_t microseconds_per_quarter) noexcept {
+    initial_tempo_ = std::min(std::max<uint32_t>(microseconds_per_quarter, 1), MAX_TEMPO);
+    tempo_ = initial_tempo_;
+}
+
+uint32_t Sequencer::getTempo() const noexcept {
+    return tempo_;
+}
+
+bool Sequencer::add(const SequenceEvent& event) noexcept {
+    if (queue_size_ == queue_.size()) {
+        return false;
+    }
+
+    // キューは時刻順を保つ（前に戻る時刻は直前の時刻に揃える）
+    SequenceEvent& slot = queue_[(queue_head_ + queue_size_) % queue_.size()];
+    slot = event;
+    if (queue_size_ > 0 && slot.tick < last_tick_) {
+        slot.tick = last_tick_;
+    }
+    last_tick_ = slot.tick;
+    ++queue_size_;
+    return true;
+}
+
+size_t Sequencer::add(const SequenceEvent* events, size_t count) noexcept {
+    size_t added = 0;
+    while (added < count && add(events[added])) {
+        ++added;
+    }
+    return added;
+}
+
+void Sequencer::pause() noexcept {
+    paused_ = true;
+}
+
+void Sequencer::resume() noexcept {
+    paused_ = false;
+}
+
+bool Sequencer::isPaused() const noexcept {
+    return paused_;
+}
+
+uint64_t Sequencer::tickToSample(uint32_t tick) const noexcept {
+    if (tick <= anchor_tick_) {
+        return anchor_sample_;
+    }
+
+    // samples = round(dt * tempo * rate / (1000000 * ppq)) を64ビットに収めて計算する
+    // dt = q * ppq + r と分けると dt * T / D = q * T / 1000000 + r * T / D（T = tempo * rate, D = 1000000 * ppq）
+    // となり、q * T / 1000000 の整数部分を先に取り出せば残りは64ビットに収まる
+    // （テンポは24ビット、サンプリングレートは1MHz以下を想定）
+    const uint64_t ppq = ticks_per_quarter_;
+    const uint64_t dt = tick - anchor_tick_;
+    const uint64_t q = dt / ppq;
+    const uint64_t r = dt % ppq;
+    const uint64_t t = static_cast<uint64_t>(tempo_) * sample_rate_;
+    const uint64_t d = MICROSECONDS * ppq;
+
+    const uint64_t qb = q * (t % MICROSECONDS);
+    const uint64_t whole = q * (t / MICROSECONDS) + qb / MICROSECONDS;
+    const uint64_t rest = (qb % MICROSECONDS) * ppq + r * t;
+    return anchor_sample_ + whole + (rest + d / 2) / d;
+}
+
+void Sequencer::apply(Chip& chip, const SequenceEvent& event) noexcept {
+    const uint8_t channel = event.channel & 0x07;
+
+    switch (event.type) {
+        case SequenceEvent::Type::NOTE_ON: {
+            const uint16_t frequency = midiNoteToFrequency(event.note);
+            const RegWrite writes[] = {
+                {static_cast<uint8_t>(REG_FREQ_LOW + channel), static_cast<uint8_t>(frequency & 0xFF)},
+                {static_cast<uint8_t>(REG_FREQ_HIGH + channel), static_cast<uint8_t>(frequency >> 8)},
+                {REG_KEY_ON, static_cast<uint8_t>(0x80 | channel)},
+            };
+            chip.setRegisters(writes, 3);
+            break;
+        }
+
+        case SequenceEvent::Type::NOTE_OFF:
+            chip.setRegister(REG_KEY_ON, channel);
+            break;
+
+        case SequenceEvent::Type::REGISTER:
+            chip.setRegister(event.reg, event.value);
+            break;
+
+        case SequenceEvent::Type::TEMPO:
+            // 変更したティックを新しい起点にする
+            anchor_sample_ = tickToSample(event.tick);
+            anchor_tick_ = std::max(anchor_tick_, event.tick);
+            tempo_ = std::min(std::max<uint32_t>(event.tempo, 1), MAX_TEMPO);
+            break;
+    }
+}
+
+void Sequencer::render(Chip& chip, float* buffer, int samples) noexcept {
+    if (paused_) {
+        std::memset(buffer, 0, sizeof(float) * static_cast<size_t>(std::max(samples, 0)));
+        return;
+    }
+
+    int position = 0;
+    while (position < samples) {
+        // 現在位置までに期限の来たイベントを適用
+        while (queue_size_ > 0) {
+            const SequenceEvent& event = queue_[queue_head_];
+            if (tickToSample(event.tick) > now_) {
+                break;
+            }
+            apply(chip, event);
+            queue_head_ = (queue_head_ + 1) % queue_.size();
+            --queue_size_;
+        }
+
+        // 次のイベントまで（またはバッファの終わりまで）を1回で生成
+        int span = samples - position;
+        if (queue_size_ > 0) {
+            const uint64_t next = tickToSample(queue_[queue_head_].tick);
+            span = static_cast<int>(std::min<uint64_t>(static_cast<uint64_t>(span), next - now_));
+        }
+        chip.generate(buffer + position, span);
+        ++generate_calls_;
+        position += span;
+        now_ += static_cast<uint64_t>(span);
+    }
+}
+
+uint64_t Sequencer::currentSample() const noexcept {
+    return now_;
+}
+
+size_t Sequencer::pendingEvents() const noexcept {
+    return queue_size_;
+}
+
+bool Sequencer::finished() const noexcept {
+    return queue_size_ == 0;
+}
+
+uint64_t Sequencer::generateCalls() const noexcept {
+    return generate_calls_;
+}
+
+} // namespace YM2151
@@ -0,0 +1,292 @@
+#include "ym2151/vgm.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace YM2151 {
+
+namespace {
+
+uint32_t readLE32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+void writeLE32(uint8_t* p, uint32_t value) {
+    p[0] = static_cast<uint8_t>(value);
+    p[1] = static_cast<uint8_t>(value >> 8);
+    p[2] = static_cast<uint8_t>(value >> 16);
+    p[3] = static_cast<uint8_t>(value >> 24);
+}
+
+// 待ち時間を最も短いコマンド列で書き出す
+void writeWait(std::vector<uint8_t>& data, uint64_t samples) {
+    while (samples > 0) {
+        if (samples <= 16) {
+            data.push_back(static_cast<uint8_t>(0x70 + samples - 1));
+            return;
+        }
+        if (samples == 735) {
+            data.push_back(0x62);
+            return;
+        }
+        if (samples == 882) {
+            data.push_back(0x63);
+            return;
+        }
+        if (samples <= 32) {
+            // 0x7n 2つの方が 0x61 より短い
+            data.push_back(0x7F);
+            samples -= 16;
+            continue;
+        }
+        const uint32_t count = static_cast<uint32_t>(std::min<uint64_t>(samples, 0xFFFF));
+        data.push_back(0x61);
+        data.push_back(static_cast<uint8_t>(count));
+        data.push_back(static_cast<uint8_t>(count >> 8));
+        samples -= count;
+    }
+}
+
+void setError(std::string* error, const std::string& message) {
+    if (error) {
+        *error = message;
+    }
+}
+
+// VGMコマンドのオペランド長（YM2151と待ち時間以外のコマンドを読み飛ばすため）
+int operandLength(uint8_t command) {
+    if (command >= 0x30 && command <= 0x3F) return 1;
+    if (command >= 0x40 && command <= 0x4E) return 2;
+    if (command == 0x4F || command == 0x50) return 1;
+    if (command >= 0x51 && command <= 0x5F) return 2;
+    if (command >= 0x70 && command <= 0x8F) return 0;
+    if (command == 0x90 || command == 0x91 || command == 0x95) return 4;
+    if (command == 0x92) return 5;
+    if (command == 0x93) return 10;
+    if (command == 0x94) return 1;
+    if (command >= 0xA0 && command <= 0xBF) return 2;
+    if (command >= 0xC0 && command <= 0xDF) return 3;
+    if (command >= 0xE0) return 4;
+    return -1;
+}
+
+} // namespace
+
+void renderWrites(Chip& chip, const std::vector<TimedWrite>& writes, size_t& next, uint64_t position,
+                  float* buffer, int samples) {
+    renderBetweenWrites(
+        writes, next, position, samples,
+        [&chip](const TimedWrite& write) { chip.setRegister(write.reg, write.value); },
+        [&chip, buffer](int offset, int count) { chip.generate(buffer + offset, count); });
+}
+
+bool parseVGM(const uint8_t* data, size_t size, uint32_t sample_rate,
+              RegisterStream& stream, std::string* error) {
+    stream.writes.clear();
+    stream.total_samples = 0;
+
+    if (size < 0x40 || data[0] != 'V' || data[1] != 'g' || data[2] != 'm' || data[3] != ' ') {
+        setError(error, "not a VGM file (gzip-compressed .vgz is not supported)");
+        return false;
+    }
+
+    const uint32_t version = readLE32(data + 0x08);
+
+    // YM2151のクロック（上位ビットはデュアルチップ指定）
+    if (size >= 0x34) {
+        const uint32_t clock = readLE32(data + 0x30) & 0x3FFFFFFF;
+        if (clock != 0) {
+            stream.clock = clock;
+        }
+    }
+
+    // データ開始位置（v1.50未満は0x40固定）
+    size_t offset = 0x40;
+    if (version >= 0x150 && size >= 0x38) {
+        const uint32_t relative = readLE32(data + 0x34);
+        if (relative != 0) {
+            offset = 0x34 + static_cast<size_t>(relative);
+        }
+    }
+
+    // 時刻はVGMの44100Hz単位で積算し、書き込みごとに換算する
+    uint64_t vgm_time = 0;
+    auto toSamples = [sample_rate](uint64_t t) {
+        return static_cast<uint32_t>(t * sample_rate / VGM_SAMPLE_RATE);
+    };
+
+    while (offset < size) {
+        const uint8_t command = data[offset];
+
+        switch (command) {
+            case 0x54:  // YM2151 書き込み
+                if (offset + 3 > size) {
+                    setError(error, "truncated YM2151 write");
+                    return false;
+                }
+                stream.writes.push_back(TimedWrite{toSamples(vgm_time), data[offset + 1], data[offset + 2]});
+                offset += 3;
+                continue;
+
+            case 0x61:  // nサンプル待ち
+                if (offset + 3 > size) {
+                    setError(error, "truncated wait");
+                    return false;
+                }
+                vgm_time += static_cast<uint32_t>(data[offset + 1]) | (static_cast<uint32_t>(data[offset + 2]) << 8);
+                offset += 3;
+                continue;
+
+            case 0x62:  // 1/60秒待ち
+                vgm_time += 735;
+                ++offset;
+                continue;
+
+            case 0x63:  // 1/50秒待ち
+                vgm_time += 882;
+                ++offset;
+                continue;
+
+            case 0x66:  // データ終端
+                stream.total_samples = toSamples(vgm_time);
+                return true;
+
+            case 0x67:  // データブロック（読み飛ばす）
+                if (offset + 7 > size) {
+                    setError(error, "truncated data block");
+                    return false;
+                }
+                offset += 7 + readLE32(data + offset + 3);
+                continue;
+
+            default:
+                break;
+        }
+
+        if (command >= 0x70 && command <= 0x7F) {
+            // 1-16サンプル待ち
+            vgm_time += (command & 0x0F) + 1;
+        } else if (command >= 0x80 && command <= 0x8F) {
+            // YM2612 DAC書き込み + 待ち
+            vgm_time += command & 0x0F;
+        }
+
+        const int length = operandLength(command);
+        if (length < 0) {
+            std::ostringstream message;
+            message << "unknown VGM command 0x" << std::hex << static_cast<int>(command)
+                    << " at offset 0x" << offset;
+            setError(error, message.str());
+            return false;
+        }
+        offset += 1 + length;
+    }
+
+    // 終端コマンドがなくてもデータの終わりまでを有効とする
+    stream.total_samples = toSamples(vgm_time);
+    return true;
+}
+
+bool parseRegisterScript(std::istream& in, RegisterStream& stream, std::string* error) {
+    stream.writes.clear();
+    stream.total_samples = 0;
+
+    uint32_t time = 0;
+    std::string line;
+    int line_number = 0;
+
+    while (std::getline(in, line)) {
+        ++line_number;
+
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+
+        std::istringstream tokens(line);
+        std::string first;
+        if (!(tokens >> first)) {
+            continue;
+        }
+
+        if (first == "wait") {
+            uint32_t samples = 0;
+            if (!(tokens >> samples)) {
+                setError(error, "line " + std::to_string(line_number) + ": wait expects a sample count");
+                return false;
+            }
+            time += samples;
+            continue;
+        }
+
+        unsigned reg = 0;
+        unsigned value = 0;
+        std::istringstream reg_token(first);
+        if (!(reg_token >> std::hex >> reg) || !(tokens >> std::hex >> value) || reg > 0xFF || value > 0xFF) {
+            setError(error, "line " + std::to_string(line_number) + ": expected \"REG VALUE\" in hex or \"wait N\"");
+            return false;
+        }
+        stream.writes.push_back(TimedWrite{time, static_cast<uint8_t>(reg), static_cast<uint8_t>(value)});
+    }
+
+    stream.total_samples = time;
+    return true;
+}
+
+void writeVGM(const RegisterStream& stream, uint32_t sample_rate, std::vector<uint8_t>& data) {
+    // 時刻はVGMの44100Hz単位に換算してから差分を取る（換算の誤差を積算しない）
+    auto toVGM = [sample_rate](uint64_t t) {
+        return t * VGM_SAMPLE_RATE / sample_rate;
+    };
+
+    data.assign(0x40, 0);
+    data.reserve(0x40 + stream.writes.size() * 4 + 1);
+    data[0] = 'V';
+    data[1] = 'g';
+    data[2] = 'm';
+    data[3] = ' ';
+    writeLE32(data.data() + 0x08, 0x150);               // バージョン
+    writeLE32(data.data() + 0x30, stream.clock);        // YM2151のクロック
+    writeLE32(data.data() + 0x34, 0x40 - 0x34);         // データ開始位置（相対）
+
+    // 同じ時刻の書き込みの間には待ちを入れず、書き込みのない区間は1つの待ちにまとめる
+    uint64_t vgm_time = 0;
+    for (const TimedWrite& write : stream.writes) {
+        const uint64_t time = toVGM(write.time);
+        if (time > vgm_time) {
+            writeWait(data, time - vgm_time);
+            vgm_time = time;
+        }
+        data.push_back(0x54);
+        data.push_back(write.reg);
+        data.push_back(write.value);
+    }
+
+    const uint64_t total = std::max(toVGM(stream.total_samples), vgm_time);
+    writeWait(data, total - vgm_time);
+    data.push_back(0x66);
+
+    writeLE32(data.data() + 0x04, static_cast<uint32_t>(data.size() - 0x04));  // EOFまでの相対位置
+    writeLE32(data.data() + 0x18, static_cast<uint32_t>(total));               // 全サンプル数
+}
+
+bool saveVGM(const std::string& path, const RegisterStream& stream, uint32_t sample_rate,
+             std::string* error) {
+    std::vector<uint8_t> data;
+    writeVGM(stream, sample_rate, data);
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        setError(error, "cannot open " + path);
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    if (!file) {
+        setError(error, "cannot write " + path);
+        return false;
+    }
+    return true;
+}
+
+} // namespace YM2151
@@ -1,24 +1,18 @@
 #include "ym2151/ym2151.h"
+#include "ym2151/recorder.h"
+#include "ym2151/meter.h"
+#include "ym2151/note_cache.h"
+#include "denormal.h"
+#include "kernels.h"
+#include "oscillator.h"
 #include <cmath>
 #include <algorithm>
-#include <iostream>
 
 namespace YM2151 {
 
-// 定数定義
-constexpr float PI = 3.14159265358979323846f;
-constexpr float TWO_PI = 2.0f * PI;
-
 // サイン波テーブル
-constexpr int SINE_TABLE_SIZE = 1024;
 std::array<float, SINE_TABLE_SIZE> sine_table;
 
-// エンベロープ生成用の定数
-constexpr float ATTACK_RATE_FACTOR = 0.001f;
-constexpr float DECAY_RATE_FACTOR = 0.0001f;
-constexpr float SUSTAIN_RATE_FACTOR = 0.00005f;
-constexpr float RELEASE_RATE_FACTOR = 0.0002f;
-
 // アルゴリズム接続テーブル（YM2151は8種類のアルゴリズムを持つ）
 constexpr std::array<std::array<int, 4>, 8> algorithm_connection = {{
     {0, 1, 2, 3},  // アルゴリズム0: OP1->OP2->OP3->OP4->出力
@@ -31,38 +25,23 @@ constexpr std::array<std::array<int, 4>, 8> algorithm_connection = {{
     {0, 1, 2, 3}   // アルゴリズム7: OP1->出力, OP2->出力, OP3->出力, OP4->出力
 }};
 
-// サイン波テーブルの初期化
+// サイン波テーブルの初期化（一度だけ実行する）
 void initSineTable() {
-    static bool initialized = false;
-    if (!initialized) {
+    static const bool initialized = [] {
         for (int i = 0; i < SINE_TABLE_SIZE; ++i) {
             sine_table[i] = std::sin(TWO_PI * i / SINE_TABLE_SIZE);
         }
-        initialized = true;
-    }
-}
-
-// サイン波の取得（テーブル参照）
-float getSine(float phase) {
-    // テーブルが初期化されていない場合は初期化
-    initSineTable();
-    
-    // 位相をインデックスに変換
-    int index = static_cast<int>(phase * SINE_TABLE_SIZE / TWO_PI) & (SINE_TABLE_SIZE - 1);
-    
-    // デバッグ出力
-    static bool debug_printed = false;
-    if (!debug_printed) {
-        std::cout << "getSine - phase: " << phase << ", index: " << index << ", value: " << sine_table[index] << std::endl;
-        debug_printed = true;
-    }
-    
-    return sine_table[index];
+        return true;
+    }();
+    (void)initialized;
 }
 
 // Operator実装
 Operator::Operator() : envelope_(0.0f), phase_(0.0f), output_(0.0f), 
-                       env_state_(EnvelopeState::IDLE), env_level_(0.0f), env_rate_(0.0f) {
+                       env_state_(EnvelopeState::IDLE), env_level_(0.0f), env_rate_(0.0f),
+                       detune_(0.0f), frequency_multiplier_(1.0f), sustain_level_(1.0f),
+                       ramping_(false), ramp_step_(0.0f), ramp_target_(0.0f),
+                       block_factor_(1.0f), block_rate_(0.0f), block_steps_(0) {
     initSineTable();
     reset();
 }
@@ -79,6 +58,9 @@ void Operator::reset() {
     env_state_ = EnvelopeState::IDLE;
     env_level_ = 0.0f;
     env_rate_ = 0.0f;
+    ramping_ = false;
+    ramp_step_ = 0.0f;
+    ramp_target_ = 0.0f;
     
     // デフォルトパラメータの設定
     params_.dt1 = 0;
@@ -93,13 +75,23 @@ void Operator::reset() {
     params_.sl = 0;
     params_.rr = 15;   // 中速リリース
     params_.ssgeg = false;
+    
+    updateDerivedParameters();
 }
 
 void Operator::setParameter(const FMParameter& param) {
     params_ = param;
+    updateDerivedParameters();
+}
+
+void Operator::updateDerivedParameters() noexcept {
+    // パラメータから求まる値は毎サンプル計算せずに保持しておく
+    detune_ = params_.dt1 * 0.05f + params_.dt2 * 0.1f;
+    frequency_multiplier_ = params_.mul ? params_.mul : 0.5f;
+    sustain_level_ = 1.0f - (params_.sl / 15.0f);
 }
 
-void Operator::keyOn() {
+void Operator::keyOn() noexcept {
     // アタックフェーズの開始
     env_state_ = EnvelopeState::ATTACK;
     
@@ -118,12 +110,9 @@ void Operator::keyOn() {
     
     // エンベロープ値を即座に反映
     envelope_ = env_level_;
-    
-    // デバッグ出力
-    std::cout << "Operator::keyOn - env_level: " << env_level_ << ", env_rate: " << env_rate_ << ", envelope: " << envelope_ << std::endl;
 }
 
-void Operator::keyOff() {
+void Operator::keyOff() noexcept {
     // リリースフェーズの開始
     env_state_ = EnvelopeState::RELEASE;
     
@@ -131,9 +120,9 @@ void Operator::keyOff() {
     env_rate_ = params_.rr * RELEASE_RATE_FACTOR;
 }
 
-void Operator::updateEnvelope() {
-    // サスティンレベルを事前に計算
-    float sustain_level = 1.0f - (params_.sl / 15.0f);
+void Operator::updateEnvelope() noexcept {
+    // サスティンレベル（setParameterで計算済み）
+    const float sustain_level = sustain_level_;
     
     // エンベロープ状態に応じた処理
     switch (env_state_) {
@@ -162,6 +151,11 @@ void Operator::updateEnvelope() {
                 env_level_ = sustain_level;
                 env_state_ = EnvelopeState::SUSTAIN;
                 env_rate_ = params_.sr * SUSTAIN_RATE_FACTOR;
+            } else if (env_level_ < ENVELOPE_FLOOR) {
+                // サスティンレベルが0（SL=15）の場合は最小レベルで停止する
+                // （0に達するまで減衰させると非正規化数の演算が続く）
+                env_level_ = 0.0f;
+                env_state_ = EnvelopeState::IDLE;
             }
             break;
             
@@ -170,7 +164,7 @@ void Operator::updateEnvelope() {
             env_level_ -= env_level_ * env_rate_;
             
             // 最小レベルに達したら停止
-            if (env_level_ < 0.001f) {
+            if (env_level_ < ENVELOPE_FLOOR) {
                 env_level_ = 0.0f;
                 env_state_ = EnvelopeState::IDLE;
             }
@@ -181,7 +175,7 @@ void Operator::updateEnvelope() {
             env_level_ -= env_level_ * env_rate_;
             
             // 最小レベルに達したら停止
-            if (env_level_ < 0.001f) {
+            if (env_level_ < ENVELOPE_FLOOR) {
                 env_level_ = 0.0f;
                 env_state_ = EnvelopeState::IDLE;
             }
@@ -192,47 +186,120 @@ void Operator::updateEnvelope() {
     envelope_ = env_level_ * 2.0f;  // 出力を2倍に増幅
 }
 
-float Operator::getOutput(float phase, float modulation) {
-    // デチューン値の適用
-    float detune = params_.dt1 * 0.05f + params_.dt2 * 0.1f;
-    
-    // 周波数乗数の適用
-    float frequency_multiplier = params_.mul ? params_.mul : 0.5f;
+void Operator::advanceEnvelope(int steps) noexcept {
+    // updateEnvelope() を steps 回行った場合の状態を1回で求める
+    // 各フェーズの更新は目標との差に (1 - env_rate_) を掛けることなので、steps 回分の係数をまとめて掛ける
+    // （フェーズの切り替えは区間の終わりで判定する）
+    if (env_state_ == EnvelopeState::IDLE) {
+        return;
+    }
+    if (block_rate_ != env_rate_ || block_steps_ != steps) {
+        block_factor_ = std::pow(1.0f - env_rate_, static_cast<float>(steps));
+        block_rate_ = env_rate_;
+        block_steps_ = steps;
+    }
     
-    // 位相計算（変調を含む）
-    float current_phase = phase * frequency_multiplier + detune + modulation;
+    switch (env_state_) {
+        case EnvelopeState::IDLE:
+            break;
+            
+        case EnvelopeState::ATTACK:
+            env_level_ = 1.0f - (1.0f - env_level_) * block_factor_;
+            if (env_level_ > 0.99f) {
+                env_level_ = 1.0f;
+                env_state_ = EnvelopeState::DECAY;
+                env_rate_ = params_.dr * DECAY_RATE_FACTOR;
+            }
+            break;
+            
+        case EnvelopeState::DECAY:
+            env_level_ *= block_factor_;
+            if (env_level_ <= sustain_level_) {
+                env_level_ = sustain_level_;
+                env_state_ = EnvelopeState::SUSTAIN;
+                env_rate_ = params_.sr * SUSTAIN_RATE_FACTOR;
+            } else if (env_level_ < ENVELOPE_FLOOR) {
+                env_level_ = 0.0f;
+                env_state_ = EnvelopeState::IDLE;
+            }
+            break;
+            
+        case EnvelopeState::SUSTAIN:
+        case EnvelopeState::RELEASE:
+            env_level_ *= block_factor_;
+            if (env_level_ < ENVELOPE_FLOOR) {
+                env_level_ = 0.0f;
+                env_state_ = EnvelopeState::IDLE;
+            }
+            break;
+    }
+}
+
+void Operator::beginRamp(int steps) noexcept {
+    const float start = envelope_;
+    advanceEnvelope(steps);
+    ramp_target_ = env_level_ * 2.0f;
+    ramp_step_ = (ramp_target_ - start) / static_cast<float>(steps);
+    ramping_ = true;
+}
+
+void Operator::endRamp() noexcept {
+    envelope_ = ramp_target_;
+    ramping_ = false;
+}
+
+EnvelopeState Operator::envelopeState() const noexcept {
+    return env_state_;
+}
+
+bool Operator::sameState(const Operator& other) const noexcept {
+    // 浮動小数点数はビット表現で比較する（-0.0 と 0.0 は別の状態として扱う）
+    // phase_ / output_ は書き込むだけで以降の出力に影響しないので比較しない
+    // block_* は減衰率のキャッシュで、同じ env_rate_ からは同じ値を求めるので比較しない
+    const FMParameter& a = params_;
+    const FMParameter& b = other.params_;
+    return env_state_ == other.env_state_ &&
+           floatBits(envelope_) == floatBits(other.envelope_) &&
+           floatBits(env_level_) == floatBits(other.env_level_) &&
+           floatBits(env_rate_) == floatBits(other.env_rate_) &&
+           floatBits(detune_) == floatBits(other.detune_) &&
+           floatBits(frequency_multiplier_) == floatBits(other.frequency_multiplier_) &&
+           floatBits(sustain_level_) == floatBits(other.sustain_level_) &&
+           ramping_ == other.ramping_ &&
+           floatBits(ramp_step_) == floatBits(other.ramp_step_) &&
+           floatBits(ramp_target_) == floatBits(other.ramp_target_) &&
+           a.dt1 == b.dt1 && a.mul == b.mul && a.tl == b.tl && a.ks == b.ks && a.ar == b.ar &&
+           a.amsen == b.amsen && a.dr == b.dr && a.dt2 == b.dt2 && a.sr == b.sr && a.sl == b.sl &&
+           a.rr == b.rr && a.ssgeg == b.ssgeg;
+}
+
+float Operator::getOutput(float phase, float modulation) noexcept {
+    // 位相計算（デチューン・周波数乗数・変調を含む）
+    float current_phase = phase * frequency_multiplier_ + detune_ + modulation;
     
     // 位相を0〜2πの範囲に正規化
-    while (current_phase >= TWO_PI) current_phase -= TWO_PI;
-    while (current_phase < 0) current_phase += TWO_PI;
+    current_phase = wrapPhase(current_phase);
     
     // サイン波生成
     float sine_value = getSine(current_phase);
     
-    // エンベロープの更新
-    updateEnvelope();
-    
-    // エンベロープの適用（トータルレベルも考慮）
-    // トータルレベルを計算（0が最大音量、127が最小音量）
-    float level = 1.0f;  // デバッグ用に一時的に1.0に設定
-    
-    // 出力レベルを調整（音量を適切なレベルに調整）
-    output_ = sine_value * envelope_ * level * 8192.0f;
-    
-    // デバッグ出力
-    static bool debug_printed = false;
-    if (!debug_printed) {
-        std::cout << "Operator::getOutput - phase: " << current_phase << ", sine: " << sine_value
-                  << ", env: " << envelope_ << ", level: " << level
-                  << ", output: " << output_ << std::endl;
-        debug_printed = true;
+    // エンベロープの更新（制御レートで更新している間は補間する）
+    if (ramping_) {
+        envelope_ += ramp_step_;
+    } else {
+        updateEnvelope();
     }
     
+    // エンベロープの適用
+    // トータルレベルは出力に反映しない（常に1.0として扱う）
+    output_ = sine_value * envelope_ * 8192.0f;
+    
     return output_;
 }
 
 // Channel実装
-Channel::Channel() : frequency_(0), algorithm_(0), feedback_(0), sample_rate_(44100), keyOnFlag_(false), output_(0.0f), phase_accumulator_(0.0f) {
+Channel::Channel() : frequency_(0), algorithm_(0), feedback_(0), sample_rate_(44100), keyOnFlag_(false), output_(0.0f), phase_accumulator_(0.0f), phase_increment_(0.0f),
+                     ramp_rate_(1), ramp_remaining_(0), ramp_active_(false) {
     feedback_buffer_[0] = 0.0f;
     feedback_buffer_[1] = 0.0f;
     reset();
@@ -254,37 +321,47 @@ void Channel::reset() {
     feedback_buffer_[0] = 0.0f;
     feedback_buffer_[1] = 0.0f;
     phase_accumulator_ = 0.0f;  // 位相累積変数の初期化
+    ramp_rate_ = 1;
+    ramp_remaining_ = 0;
+    ramp_active_ = false;
+    updatePhaseIncrement();
 }
 
 void Channel::setSampleRate(uint32_t rate) {
     sample_rate_ = rate;
+    updatePhaseIncrement();
 }
 
-void Channel::setFrequency(uint16_t frequency) {
+void Channel::setFrequency(uint16_t frequency) noexcept {
     frequency_ = frequency;
+    updatePhaseIncrement();
+}
+
+void Channel::updatePhaseIncrement() noexcept {
+    // 1サンプルあたりの位相増分（周波数・サンプリングレートの変更時のみ計算）
+    phase_increment_ = TWO_PI * frequency_ / static_cast<float>(sample_rate_);
 }
 
-void Channel::setAlgorithm(uint8_t algorithm) {
+void Channel::setAlgorithm(uint8_t algorithm) noexcept {
     algorithm_ = algorithm & 0x07;  // 0-7の範囲に制限
 }
 
-void Channel::setFeedback(uint8_t feedback) {
+void Channel::setFeedback(uint8_t feedback) noexcept {
     feedback_ = feedback & 0x07;  // 0-7の範囲に制限
 }
 
-void Channel::keyOn() {
+void Channel::keyOn() noexcept {
+    cancelRamp();
     keyOnFlag_ = true;
     
     // 各オペレータのキーオン処理
     for (auto& op : operators_) {
         op.keyOn();
     }
-    
-    // デバッグ出力
-    std::cout << "Channel::keyOn - frequency: " << frequency_ << ", algorithm: " << static_cast<int>(algorithm_) << std::endl;
 }
 
-void Channel::keyOff() {
+void Channel::keyOff() noexcept {
+    cancelRamp();
     keyOnFlag_ = false;
     
     // 各オペレータのキーオフ処理
@@ -293,23 +370,99 @@ void Channel::keyOff() {
     }
 }
 
-void Channel::updateEnvelopes() {
+void Channel::updateEnvelopes() noexcept {
     // 各オペレータのエンベロープ更新
     for (auto& op : operators_) {
         op.updateEnvelope();
     }
 }
 
+void Channel::cancelRamp() noexcept {
+    // 補間中の区間を打ち切る（エンベロープは区間の終わりの値になる）
+    // 次の render では区間の残りを補間し直すので、区間の境界は変わらない
+    if (ramp_active_) {
+        for (auto& op : operators_) {
+            op.endRamp();
+        }
+        ramp_active_ = false;
+    }
+}
+
+void Channel::render(float* out, int samples, int control_rate) noexcept {
+    if (control_rate != ramp_rate_) {
+        cancelRamp();
+        ramp_rate_ = control_rate;
+        ramp_remaining_ = 0;
+    }
+    if (control_rate <= 1) {
+        for (int i = 0; i < samples; ++i) {
+            out[i] = getOutput();
+        }
+        return;
+    }
+    
+    for (int position = 0; position < samples;) {
+        if (ramp_remaining_ == 0) {
+            ramp_remaining_ = control_rate;
+        }
+        const int count = std::min(ramp_remaining_, samples - position);
+        
+        // キーオフ中はエンベロープを進めない（getOutput() と同じ）
+        if (keyOnFlag_ && !ramp_active_) {
+            for (auto& op : operators_) {
+                op.beginRamp(ramp_remaining_);
+            }
+            ramp_active_ = true;
+        }
+        for (int i = 0; i < count; ++i) {
+            out[position + i] = getOutput();
+        }
+        position += count;
+        ramp_remaining_ -= count;
+        if (ramp_remaining_ == 0) {
+            cancelRamp();
+        }
+    }
+}
+
+bool Channel::sameState(const Channel& other) const noexcept {
+    // 最も異なりやすい位相から比較する（output_ は書き込むだけなので比較しない）
+    if (floatBits(phase_accumulator_) != floatBits(other.phase_accumulator_) ||
+        floatBits(phase_increment_) != floatBits(other.phase_increment_) ||
+        keyOnFlag_ != other.keyOnFlag_ ||
+        algorithm_ != other.algorithm_ ||
+        feedback_ != other.feedback_ ||
+        frequency_ != other.frequency_ ||
+        sample_rate_ != other.sample_rate_ ||
+        floatBits(feedback_buffer_[0]) != floatBits(other.feedback_buffer_[0]) ||
+        floatBits(feedback_buffer_[1]) != floatBits(other.feedback_buffer_[1]) ||
+        ramp_rate_ != other.ramp_rate_ ||
+        ramp_remaining_ != other.ramp_remaining_ ||
+        ramp_active_ != other.ramp_active_) {
+        return false;
+    }
+    for (size_t i = 0; i < operators_.size(); ++i) {
+        if (!operators_[i].sameState(other.operators_[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
 Operator& Channel::getOperator(int index) {
     return operators_[index & 0x03];  // 0-3の範囲に制限
 }
 
-float Channel::getOutput() {
-    // 基本位相の計算（累積）
-    float phase_increment = TWO_PI * frequency_ / static_cast<float>(sample_rate_);
-    phase_accumulator_ += phase_increment;
+float Channel::getOutput() noexcept {
+    // 基本位相の計算（累積、キーオフ中も進める）
+    phase_accumulator_ += phase_increment_;
     if (phase_accumulator_ >= TWO_PI) phase_accumulator_ -= TWO_PI;
     
+    // キーオンフラグがfalseの場合は0を返す
+    if (!keyOnFlag_) {
+        return 0.0f;
+    }
+    
     // フィードバック値の計算
     float feedback = 0.0f;
     if (feedback_ > 0) {
@@ -319,14 +472,6 @@ float Channel::getOutput() {
     // アルゴリズムに基づいて各オペレータの出力を計算
     float op_outputs[4] = {0.0f, 0.0f, 0.0f, 0.0f};
     
-    // キーオンフラグがfalseの場合は0を返す
-    if (!keyOnFlag_) {
-        return 0.0f;
-    }
-    
-    // デバッグ出力
-    std::cout << "Channel::getOutput - phase_accumulator: " << phase_accumulator_ << ", frequency: " << frequency_ << std::endl;
-    
     // アルゴリズムに応じた接続パターンで計算
     switch (algorithm_) {
         case 0:  // OP1->OP2->OP3->OP4->出力
@@ -367,9 +512,6 @@ float Channel::getOutput() {
             op_outputs[2] = operators_[2].getOutput(phase_accumulator_, 0.0f);
             op_outputs[3] = operators_[3].getOutput(phase_accumulator_, op_outputs[2]);
             output_ = op_outputs[1] + op_outputs[3];
-            
-            // デバッグ出力
-            std::cout << "Algorithm 4 - op_outputs: " << op_outputs[0] << ", " << op_outputs[1] << ", " << op_outputs[2] << ", " << op_outputs[3] << ", output: " << output_ << std::endl;
             break;
             
         case 5:  // OP1->OP2->出力, OP3->出力, OP4->出力
@@ -394,9 +536,6 @@ float Channel::getOutput() {
             op_outputs[2] = operators_[2].getOutput(phase_accumulator_, 0.0f);
             op_outputs[3] = operators_[3].getOutput(phase_accumulator_, 0.0f);
             output_ = op_outputs[0] + op_outputs[1] + op_outputs[2] + op_outputs[3];
-            
-            // デバッグ出力
-            std::cout << "Algorithm 7 - op_outputs: " << op_outputs[0] << ", " << op_outputs[1] << ", " << op_outputs[2] << ", " << op_outputs[3] << ", output: " << output_ << std::endl;
             break;
             
         default:
@@ -416,6 +555,14 @@ float Channel::getOutput() {
 Chip::Chip(uint32_t clock) : 
     clock_(clock), 
     sample_rate_(44100),  // デフォルトサンプリングレート
+    kernels_(&selectKernels()),
+    recorder_(nullptr),
+    meter_(nullptr),
+    note_cache_(nullptr),
+    control_rate_(1),
+    lfo_pending_(0),
+    duplicates_dirty_(true),
+    shared_channels_(0),
     timer_a_val_(0),
     timer_b_val_(0),
     timer_a_enabled_(false),
@@ -426,7 +573,8 @@ Chip::Chip(uint32_t clock) :
     lfo_waveform_(0),
     lfo_phase_(0.0f),
     lfo_am_depth_(0.0f),
-    lfo_pm_depth_(0.0f) {
+    lfo_pm_depth_(0.0f),
+    lfo_noise_state_(1) {
     
     reset();
 }
@@ -440,7 +588,12 @@ void Chip::reset() {
         reg = 0;
     }
     
-    // チャンネルの初期化
+    // チャンネルの初期化（キャッシュの再生・記録は状態を戻さずに止める）
+    for (int ch = 0; ch < CHANNEL_COUNT; ++ch) {
+        if (note_cache_) {
+            note_cache_->abandon(ch, channels_[ch]);
+        }
+    }
     for (auto& channel : channels_) {
         channel.reset();
         channel.setSampleRate(sample_rate_);
@@ -460,12 +613,90 @@ void Chip::reset() {
     lfo_phase_ = 0.0f;
     lfo_am_depth_ = 0.0f;
     lfo_pm_depth_ = 0.0f;
+    lfo_noise_state_ = 1;
+    lfo_pending_ = 0;
+    
+    // 重複チャンネルの判定をやり直す
+    duplicate_of_.fill(-1);
+    duplicates_dirty_ = true;
+    shared_channels_ = 0;
 }
 
-void Chip::setRegister(uint8_t reg, uint8_t value) {
+void Chip::setRegister(uint8_t reg, uint8_t value) noexcept {
+    if (recorder_) {
+        recorder_->record(reg, value);
+    }
     registers_[reg] = value;
     
     // レジスタ値に基づいて内部状態を更新
+    decodeRegister(reg, value);
+}
+
+void Chip::setRegisters(const RegWrite* writes, size_t count) noexcept {
+    // 再計算が必要なチャンネル（ビットマスク）
+    uint8_t frequency_dirty = 0;
+    uint8_t algorithm_dirty = 0;
+    
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t reg = writes[i].reg;
+        const uint8_t value = writes[i].value;
+        if (recorder_) {
+            recorder_->record(reg, value);
+        }
+        registers_[reg] = value;
+        
+        if (reg >= 0x10 && reg <= 0x1F) {
+            frequency_dirty |= 1 << (reg & 0x07);
+        } else if (reg >= 0x20 && reg <= 0x27) {
+            algorithm_dirty |= 1 << (reg & 0x07);
+        } else {
+            if (reg == 0x08) {
+                // キーオン/オフの前に対象チャンネルの状態を確定させる
+                const int channel = value & 0x07;
+                const uint8_t bit = 1 << channel;
+                if (frequency_dirty & bit) {
+                    updateChannelFrequency(channel);
+                }
+                if (algorithm_dirty & bit) {
+                    updateChannelAlgorithm(channel);
+                }
+                frequency_dirty &= ~bit;
+                algorithm_dirty &= ~bit;
+            }
+            decodeRegister(reg, value);
+        }
+    }
+    
+    // 影響を受けたチャンネルの派生状態を一度だけ再計算
+    for (int channel = 0; channel < CHANNEL_COUNT; ++channel) {
+        if (frequency_dirty & (1 << channel)) {
+            updateChannelFrequency(channel);
+        }
+        if (algorithm_dirty & (1 << channel)) {
+            updateChannelAlgorithm(channel);
+        }
+    }
+}
+
+void Chip::setChannelRegisters(int channel, const RegWrite* writes, size_t count) noexcept {
+    // チャンネル番号を加算したブロックを作り、一括書き込みに渡す
+    constexpr size_t CHUNK = 32;
+    RegWrite chunk[CHUNK];
+    
+    channel &= 0x07;
+    while (count > 0) {
+        size_t n = std::min(count, CHUNK);
+        for (size_t i = 0; i < n; ++i) {
+            chunk[i].reg = static_cast<uint8_t>(writes[i].reg + channel);
+            chunk[i].value = writes[i].value;
+        }
+        setRegisters(chunk, n);
+        writes += n;
+        count -= n;
+    }
+}
+
+void Chip::decodeRegister(uint8_t reg, uint8_t value) noexcept {
     switch (reg) {
         case 0x01:  // LFO周波数
             lfo_frequency_ = value & 0x0F;
@@ -474,11 +705,18 @@ void Chip::setRegister(uint8_t reg, uint8_t value) {
         case 0x08:  // キーオン/オフ
             {
                 uint8_t channel = value & 0x07;
-                uint8_t slot = (value >> 3) & 0x03;
                 bool key_on = (value & 0x80) != 0;
+                duplicates_dirty_ = true;
                 
+                if (note_cache_) {
+                    note_cache_->release(channel, channels_[channel]);
+                }
                 if (key_on) {
                     channels_[channel].keyOn();
+                    if (note_cache_) {
+                        // LFOの位相に依存するノートと、制御レートで補間するノートはキャッシュしない
+                        note_cache_->keyOn(channel, channels_[channel], lfo_frequency_ == 0 && control_rate_ == 1);
+                    }
                 } else {
                     channels_[channel].keyOff();
                 }
@@ -491,31 +729,14 @@ void Chip::setRegister(uint8_t reg, uint8_t value) {
             
         case 0x10: case 0x11: case 0x12: case 0x13:
         case 0x14: case 0x15: case 0x16: case 0x17:  // チャンネル周波数（下位8ビット）
-            {
-                uint8_t channel = reg & 0x07;
-                uint16_t freq = (registers_[0x18 + channel] << 8) | value;
-                channels_[channel].setFrequency(freq);
-            }
-            break;
-            
         case 0x18: case 0x19: case 0x1A: case 0x1B:
         case 0x1C: case 0x1D: case 0x1E: case 0x1F:  // チャンネル周波数（上位8ビット）
-            {
-                uint8_t channel = reg & 0x07;
-                uint16_t freq = (value << 8) | registers_[0x10 + channel];
-                channels_[channel].setFrequency(freq);
-            }
+            updateChannelFrequency(reg & 0x07);
             break;
             
         case 0x20: case 0x21: case 0x22: case 0x23:
         case 0x24: case 0x25: case 0x26: case 0x27:  // アルゴリズム、フィードバック
-            {
-                uint8_t channel = reg & 0x07;
-                uint8_t algorithm = value & 0x07;
-                uint8_t feedback = (value >> 3) & 0x07;
-                channels_[channel].setAlgorithm(algorithm);
-                channels_[channel].setFeedback(feedback);
-            }
+            updateChannelAlgorithm(reg & 0x07);
             break;
             
         // オペレータパラメータの設定（省略）
@@ -527,37 +748,76 @@ void Chip::setRegister(uint8_t reg, uint8_t value) {
     }
 }
 
-uint8_t Chip::getRegister(uint8_t reg) const {
+void Chip::releaseCachedChannels() noexcept {
+    if (note_cache_) {
+        for (int ch = 0; ch < CHANNEL_COUNT; ++ch) {
+            note_cache_->release(ch, channels_[ch]);
+        }
+    }
+}
+
+void Chip::updateChannelFrequency(int channel) noexcept {
+    duplicates_dirty_ = true;
+    if (note_cache_) {
+        note_cache_->release(channel, channels_[channel]);
+    }
+    uint16_t freq = (registers_[0x18 + channel] << 8) | registers_[0x10 + channel];
+    channels_[channel].setFrequency(freq);
+}
+
+void Chip::updateChannelAlgorithm(int channel) noexcept {
+    duplicates_dirty_ = true;
+    if (note_cache_) {
+        note_cache_->release(channel, channels_[channel]);
+    }
+    uint8_t value = registers_[0x20 + channel];
+    channels_[channel].setAlgorithm(value & 0x07);
+    channels_[channel].setFeedback((value >> 3) & 0x07);
+}
+
+uint8_t Chip::getRegister(uint8_t reg) const noexcept {
     return registers_[reg];
 }
 
 void Chip::setSampleRate(uint32_t rate) {
+    releaseCachedChannels();
+    duplicates_dirty_ = true;
     sample_rate_ = rate;
     
     // 各チャンネルにもサンプリングレートを設定
     for (auto& channel : channels_) {
         channel.setSampleRate(rate);
     }
+    
+    if (recorder_) {
+        recorder_->setSampleRate(rate);
+    }
 }
 
 Channel& Chip::getChannel(int index) {
+    // 呼び出し側が状態を変更できるよう、キャッシュからの再生を止めて現在の状態に戻す
+    // （変更されるかもしれないので重複チャンネルの判定もやり直す）
+    duplicates_dirty_ = true;
+    if (note_cache_) {
+        note_cache_->release(index & 0x07, channels_[index & 0x07]);
+    }
     return channels_[index & 0x07];  // 0-7の範囲に制限
 }
 
-void Chip::updateTimers() {
+void Chip::updateTimers() noexcept {
     // タイマーの更新処理（省略）
 }
 
-void Chip::updateLFO() {
-    // LFOの更新処理
+void Chip::updateLFO(int samples) noexcept {
+    // LFOの更新処理（samples サンプル分をまとめて進める）
     if (lfo_frequency_ > 0) {
         float lfo_step = lfo_frequency_ * 0.01f / sample_rate_;
-        lfo_phase_ += lfo_step;
-        if (lfo_phase_ >= 1.0f) lfo_phase_ -= 1.0f;
+        lfo_phase_ += lfo_step * samples;
+        if (lfo_phase_ >= 1.0f) lfo_phase_ -= std::floor(lfo_phase_);
     }
 }
 
-float Chip::getLFOValue() {
+float Chip::getLFOValue() noexcept {
     // LFO波形の生成
     float lfo_value = 0.0f;
     
@@ -579,33 +839,208 @@ float Chip::getLFOValue() {
             break;
             
         case 3:  // ランダム
-            // 簡易的な疑似ランダム
-            lfo_value = static_cast<float>(std::rand()) / RAND_MAX;
+            // 簡易的な疑似ランダム（線形合同法、std::randはロックを取るため使わない）
+            lfo_noise_state_ = lfo_noise_state_ * 1664525u + 1013904223u;
+            lfo_value = static_cast<float>(lfo_noise_state_ >> 8) / static_cast<float>(0xFFFFFF);
             break;
     }
     
     return lfo_value;
 }
 
-void Chip::generate(float* buffer, int samples) {
+void Chip::updateDuplicates() noexcept {
+    // 状態が同じチャンネルのうち、最も番号の小さいものだけを計算する
+    // （ノートキャッシュから再生・記録中のチャンネルは対象外）
+    shared_channels_ = 0;
+    for (int ch = 0; ch < CHANNEL_COUNT; ++ch) {
+        duplicate_of_[ch] = -1;
+        if (note_cache_ && note_cache_->active(ch)) {
+            continue;
+        }
+        for (int leader = 0; leader < ch; ++leader) {
+            if (duplicate_of_[leader] < 0 && !(note_cache_ && note_cache_->active(leader)) &&
+                channels_[ch].sameState(channels_[leader])) {
+                duplicate_of_[ch] = static_cast<int8_t>(leader);
+                ++shared_channels_;
+                break;
+            }
+        }
+    }
+    duplicates_dirty_ = false;
+}
+
+void Chip::renderChannels(int samples) noexcept {
+    // タイマーとLFOの更新（チャンネルの出力には影響しないので先にまとめて進める）
+    // LFOは制御レートごとに進める（呼び出しをまたいで区間を数える）
     for (int i = 0; i < samples; ++i) {
-        // タイマーとLFOの更新
         updateTimers();
-        updateLFO();
+    }
+    lfo_pending_ += samples;
+    while (lfo_pending_ >= control_rate_) {
+        updateLFO(control_rate_);
+        lfo_pending_ -= control_rate_;
+    }
+    
+    // 書き込みがあった後は、状態が同じチャンネルを探し直す
+    if (duplicates_dirty_) {
+        updateDuplicates();
+    }
+    
+    // チャンネルごとにブロック分の出力を計算
+    for (int ch = 0; ch < CHANNEL_COUNT; ++ch) {
+        Channel& channel = channels_[ch];
+        float* out = channel_buffer_[ch].data();
+        if (duplicate_of_[ch] >= 0) {
+            // 状態が同じチャンネルの出力と状態を写す（計算元は番号が小さいので計算済み）
+            const int leader = duplicate_of_[ch];
+            std::copy(channel_buffer_[leader].begin(), channel_buffer_[leader].begin() + samples, out);
+            channel = channels_[leader];
+            continue;
+        }
+        if (note_cache_ && note_cache_->active(ch)) {
+            note_cache_->render(ch, channel, out, samples);
+            continue;
+        }
+        channel.render(out, samples, control_rate_);
+    }
+}
+
+void Chip::generate(float* buffer, int samples) noexcept {
+    DenormalGuard denormal_guard;
+    const float* channels[CHANNEL_COUNT];
+    for (int ch = 0; ch < CHANNEL_COUNT; ++ch) {
+        channels[ch] = channel_buffer_[ch].data();
+    }
+    
+    MeterSums sums{};
+    for (int position = 0; position < samples; position += RENDER_BLOCK) {
+        const int count = std::min(RENDER_BLOCK, samples - position);
+        renderChannels(count);
         
-        // 全チャンネルの出力を合成
-        float output = 0.0f;
-        for (auto& channel : channels_) {
-            // エンベロープの更新はgetOutput内で行われるため不要
-            output += channel.getOutput();
+        // 全チャンネルの出力を合成し、出力レベルを調整
+        if (meter_) {
+            kernels_->mixMetered(channels, CHANNEL_COUNT, OUTPUT_GAIN, buffer + position, count, sums);
+        } else {
+            kernels_->mix(channels, CHANNEL_COUNT, OUTPUT_GAIN, buffer + position, count);
+        }
+    }
+    
+    finishBlock(sums, samples);
+}
+
+void Chip::generate(int16_t* buffer, int samples) noexcept {
+    DenormalGuard denormal_guard;
+    const float* channels[CHANNEL_COUNT];
+    for (int ch = 0; ch < CHANNEL_COUNT; ++ch) {
+        channels[ch] = channel_buffer_[ch].data();
+    }
+    
+    float mix[RENDER_BLOCK];
+    MeterSums sums{};
+    for (int position = 0; position < samples; position += RENDER_BLOCK) {
+        const int count = std::min(RENDER_BLOCK, samples - position);
+        renderChannels(count);
+        if (meter_) {
+            kernels_->mixMetered(channels, CHANNEL_COUNT, OUTPUT_GAIN, mix, count, sums);
+        } else {
+            kernels_->mix(channels, CHANNEL_COUNT, OUTPUT_GAIN, mix, count);
         }
+        kernels_->toInt16(mix, buffer + position, count);
+    }
+    
+    finishBlock(sums, samples);
+}
+
+void Chip::generateStems(float* const stems[CHANNEL_COUNT], int samples, float* mix) noexcept {
+    DenormalGuard denormal_guard;
+    const float* channels[CHANNEL_COUNT];
+    for (int ch = 0; ch < CHANNEL_COUNT; ++ch) {
+        channels[ch] = channel_buffer_[ch].data();
+    }
+    
+    float scratch[RENDER_BLOCK];
+    MeterSums sums{};
+    for (int position = 0; position < samples; position += RENDER_BLOCK) {
+        const int count = std::min(RENDER_BLOCK, samples - position);
         
-        // 出力レベルを調整（音量を大きくする）
-        output *= 100.0f;
+        // 各チャンネルの出力を一度だけ計算し、ステムとミックスの両方に使う
+        renderChannels(count);
+        for (int ch = 0; ch < CHANNEL_COUNT; ++ch) {
+            if (stems[ch]) {
+                kernels_->scale(channels[ch], OUTPUT_GAIN, stems[ch] + position, count);
+            }
+        }
         
-        // 出力バッファに書き込み
-        buffer[i] = output;
+        // ミックスバスはgenerate()と同じ順序で合成する
+        // （計測する場合は mix がなくても合成してマスターのレベルを求める）
+        if (meter_) {
+            kernels_->mixMetered(channels, CHANNEL_COUNT, OUTPUT_GAIN, mix ? mix + position : scratch, count, sums);
+        } else if (mix) {
+            kernels_->mix(channels, CHANNEL_COUNT, OUTPUT_GAIN, mix + position, count);
+        }
     }
+    
+    finishBlock(sums, samples);
+}
+
+void Chip::finishBlock(MeterSums& sums, int samples) noexcept {
+    if (recorder_) {
+        recorder_->advance(samples);
+    }
+    if (meter_ && samples > 0) {
+        sums.samples = static_cast<uint32_t>(samples);
+        meter_->publish(sums);
+    }
+}
+
+void Chip::setControlRate(int samples) noexcept {
+    // キャッシュから再生中のノートはサンプルごとの状態に戻してから切り替える
+    releaseCachedChannels();
+    control_rate_ = std::clamp(samples, 1, MAX_CONTROL_RATE);
+    lfo_pending_ = 0;
+    duplicates_dirty_ = true;
+}
+
+int Chip::getControlRate() const noexcept {
+    return control_rate_;
+}
+
+int Chip::sharedChannelCount() const noexcept {
+    return shared_channels_;
+}
+
+const char* Chip::kernelName() const {
+    return kernels_->name;
+}
+
+void Chip::setRecorder(Recorder* recorder) {
+    recorder_ = recorder;
+    if (recorder_) {
+        recorder_->setClock(clock_);
+        recorder_->setSampleRate(sample_rate_);
+    }
+}
+
+Recorder* Chip::getRecorder() const {
+    return recorder_;
+}
+
+void Chip::setMeter(LevelMeter* meter) {
+    meter_ = meter;
+}
+
+LevelMeter* Chip::getMeter() const {
+    return meter_;
+}
+
+void Chip::setNoteCache(NoteCache* cache) {
+    releaseCachedChannels();
+    note_cache_ = cache;
+    duplicates_dirty_ = true;
+}
+
+NoteCache* Chip::getNoteCache() const {
+    return note_cache_;
 }
 
 } // namespace YM2151
@@ -0,0 +1,125 @@
+#include "ym2151/ym2151_c.h"
+#include "ym2151/ym2151.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+// C APIの構造体とC++側の型のレイアウトが一致していることを確認
+static_assert(sizeof(ym2151_write) == sizeof(YM2151::RegWrite), "ym2151_write layout mismatch");
+static_assert(offsetof(ym2151_write, reg) == offsetof(YM2151::RegWrite, reg), "ym2151_write layout mismatch");
+static_assert(offsetof(ym2151_write, value) == offsetof(YM2151::RegWrite, value), "ym2151_write layout mismatch");
+static_assert(std::is_standard_layout<YM2151::RegWrite>::value, "RegWrite must be standard layout");
+static_assert(YM2151_C_CHANNEL_COUNT == YM2151::CHANNEL_COUNT, "channel count mismatch");
+
+struct ym2151_chip {
+    explicit ym2151_chip(uint32_t clock) : chip(clock) {}
+
+    YM2151::Chip chip;
+    uint64_t samples_rendered = 0;
+    uint64_t render_calls = 0;
+    uint64_t register_writes = 0;
+};
+
+namespace {
+
+// Chip の生成関数は int でサンプル数を受け取るため、size_t を分割して渡す
+constexpr size_t MAX_CHUNK = 1 << 20;
+
+} // namespace
+
+extern "C" {
+
+uint32_t ym2151_abi_version(void) {
+    return YM2151_C_ABI_VERSION;
+}
+
+ym2151_chip* ym2151_create(uint32_t clock, uint32_t sample_rate) {
+    ym2151_chip* chip = new (std::nothrow) ym2151_chip(clock);
+    if (chip && sample_rate > 0) {
+        chip->chip.setSampleRate(sample_rate);
+    }
+    return chip;
+}
+
+void ym2151_destroy(ym2151_chip* chip) {
+    delete chip;
+}
+
+void ym2151_reset(ym2151_chip* chip) {
+    chip->chip.reset();
+    chip->samples_rendered = 0;
+    chip->render_calls = 0;
+    chip->register_writes = 0;
+}
+
+void ym2151_set_sample_rate(ym2151_chip* chip, uint32_t sample_rate) {
+    if (sample_rate > 0) {
+        chip->chip.setSampleRate(sample_rate);
+    }
+}
+
+void ym2151_write_register(ym2151_chip* chip, uint8_t reg, uint8_t value) {
+    chip->chip.setRegister(reg, value);
+    ++chip->register_writes;
+}
+
+void ym2151_write_registers(ym2151_chip* chip, const ym2151_write* writes, size_t count) {
+    // レイアウトが同じなのでコピーせずにそのまま渡す
+    chip->chip.setRegisters(reinterpret_cast<const YM2151::RegWrite*>(writes), count);
+    chip->register_writes += count;
+}
+
+uint8_t ym2151_read_register(const ym2151_chip* chip, uint8_t reg) {
+    return chip->chip.getRegister(reg);
+}
+
+void ym2151_render_f32(ym2151_chip* chip, float* buffer, size_t samples) {
+    for (size_t position = 0; position < samples; position += MAX_CHUNK) {
+        const size_t count = std::min(MAX_CHUNK, samples - position);
+        chip->chip.generate(buffer + position, static_cast<int>(count));
+    }
+    chip->samples_rendered += samples;
+    ++chip->render_calls;
+}
+
+void ym2151_render_s16(ym2151_chip* chip, int16_t* buffer, size_t samples) {
+    for (size_t position = 0; position < samples; position += MAX_CHUNK) {
+        const size_t count = std::min(MAX_CHUNK, samples - position);
+        chip->chip.generate(buffer + position, static_cast<int>(count));
+    }
+    chip->samples_rendered += samples;
+    ++chip->render_calls;
+}
+
+void ym2151_render_stems_f32(ym2151_chip* chip, float* const stems[YM2151_C_CHANNEL_COUNT],
+                             float* mix, size_t samples) {
+    float* offset_stems[YM2151::CHANNEL_COUNT];
+    for (size_t position = 0; position < samples; position += MAX_CHUNK) {
+        const size_t count = std::min(MAX_CHUNK, samples - position);
+        for (int ch = 0; ch < YM2151::CHANNEL_COUNT; ++ch) {
+            offset_stems[ch] = stems[ch] ? stems[ch] + position : nullptr;
+        }
+        chip->chip.generateStems(offset_stems, static_cast<int>(count), mix ? mix + position : nullptr);
+    }
+    chip->samples_rendered += samples;
+    ++chip->render_calls;
+}
+
+void ym2151_get_stats(const ym2151_chip* chip, ym2151_stats* stats) {
+    // 呼び出し側が知っている範囲（stats->size）だけを書き込む
+    const uint32_t size = std::min<uint32_t>(stats->size, sizeof(ym2151_stats));
+    ym2151_stats current{};
+    current.size = size;
+    current.samples_rendered = chip->samples_rendered;
+    current.render_calls = chip->render_calls;
+    current.register_writes = chip->register_writes;
+    std::memcpy(stats, &current, size);
+}
+
+const char* ym2151_kernel_name(const ym2151_chip* chip) {
+    return chip->chip.kernelName();
+}
+
+} // extern "C"
@@ -0,0 +1,59 @@
+#ifndef YM2151_TOOLS_PCM_OUTPUT_H
+#define YM2151_TOOLS_PCM_OUTPUT_H
+
+// ym2151_render と ym2151d で共有するPCM出力の形式（ツール用）
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+namespace tools {
+
+// WAVファイルヘッダー構造体
+struct WAVHeader {
+    // RIFFチャンク
+    char riff_id[4] = {'R', 'I', 'F', 'F'};
+    uint32_t riff_size;
+    char wave_id[4] = {'W', 'A', 'V', 'E'};
+
+    // fmtチャンク
+    char fmt_id[4] = {'f', 'm', 't', ' '};
+    uint32_t fmt_size = 16;
+    uint16_t format;  // 1 = PCM, 3 = IEEE float
+    uint16_t channels;
+    uint32_t sample_rate;
+    uint32_t byte_rate;
+    uint16_t block_align;
+    uint16_t bits_per_sample;
+
+    // dataチャンク
+    char data_id[4] = {'d', 'a', 't', 'a'};
+    uint32_t data_size;
+};
+
+// モノラルのWAVヘッダー（bytes_per_sample が2なら16ビット整数、4ならfloat）
+// 長さは事前に分かるので確定値を書く（4GiBを超える場合は上限の値）
+inline WAVHeader makeWAVHeader(uint32_t sample_rate, size_t bytes_per_sample, uint64_t total_samples) {
+    WAVHeader header;
+    header.format = bytes_per_sample == 2 ? 1 : 3;
+    header.channels = 1;
+    header.sample_rate = sample_rate;
+    header.bits_per_sample = static_cast<uint16_t>(bytes_per_sample * 8);
+    header.block_align = static_cast<uint16_t>(bytes_per_sample);
+    header.byte_rate = sample_rate * header.block_align;
+    const uint64_t data_size = total_samples * bytes_per_sample;
+    header.data_size = data_size > 0xFFFFFFFFu - 36 ? 0xFFFFFFFFu : static_cast<uint32_t>(data_size);
+    header.riff_size = data_size > 0xFFFFFFFFu - 36 ? 0xFFFFFFFFu : static_cast<uint32_t>(36 + data_size);
+    return header;
+}
+
+// 16ビット整数PCMへの変換（32767倍して飽和させる。Chip::generate(int16_t*) と同じ）
+inline void convertToS16(const float* in, int16_t* out, int samples) {
+    for (int i = 0; i < samples; ++i) {
+        out[i] = static_cast<int16_t>(std::clamp(in[i] * 32767.0f, -32768.0f, 32767.0f));
+    }
+}
+
+} // namespace tools
+
+#endif // YM2151_TOOLS_PCM_OUTPUT_H
@@ -0,0 +1,378 @@
+// YM2151 最悪ケースの負荷ベンチマーク
+// 非正規化数が発生しやすい状態（キーオン中の長い減衰、0へ向かうディケイ、
+// 小さな値が続くフィードバック）でブロックごとの生成時間を計測し、
+// 遅延の突出（一部のブロックだけ処理が遅くなること）がないことを確認する。
+//
+// 各シナリオの平均・中央値・p99・最大のブロック処理時間と、中央値に対するp99の比を表示する。
+// 非正規化数の演算に落ちると減衰の終わりのブロックだけが遅くなるため、この比が大きくなる。
+// --max-ratio を指定すると、比がそれを超えたシナリオがあれば終了コード1で終了する
+// （実時間の計測なので、共有のCIマシンでは揺れる。CIでは表示だけにしている）。
+//
+// 時間によらない確認として、SL=15 へのディケイで全オペレータのエンベロープが
+// DECAY_TO_IDLE_LIMIT サンプル以内に IDLE になることを制御レート 1/8/16/32 で確かめ、
+// 超えた場合は終了コード1で終了する。生成中は DenormalGuard が非正規化数を0に丸めるので、
+// 最小レベル（ENVELOPE_FLOOR）での停止が失われても出力の非正規化数の検査では検出できない
+// （出力に非正規化数が含まれていた場合も終了コード1にするが、これはガードを設定できない環境向け）。
+//
+// --board N を指定すると、代わりに N チップの Board をワーカースレッドなし（1コアで順に生成）と
+// ワーカースレッドありで生成し、ブロックあたりの処理時間を比較する。
+//
+// --control-rate N を指定すると、各シナリオを制御レート N（エンベロープとLFOを N サンプルごとに
+// 更新して補間する）で生成する。--control-rate compare では制御レート 1/8/16/32 の
+// 平均処理時間を並べて表示する。
+//
+// "unison" シナリオは sustained と同じ設定の全チャンネルを同じ周波数で鳴らす（重複チャンネルの
+// 出力の共有が働く場合）。sustained との平均処理時間の差が共有による削減になる。
+
+#include "ym2151/ym2151.h"
+#include "ym2151/board.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+namespace {
+
+struct Options {
+    int blocks = 4000;
+    int block_size = YM2151::RENDER_BLOCK;
+    int rekey_blocks = 600;   // キーオンし直す間隔（ブロック数）
+    double max_ratio = 0.0;   // 0なら判定しない
+    int board_chips = 0;      // 0なら Board の比較を行わない
+    int control_rate = 1;
+    bool compare_control_rates = false;
+};
+
+struct Scenario {
+    const char* name;
+    std::function<void(YM2151::Chip&)> setup;   // 音色の設定（リセット直後に1回）
+};
+
+struct Stats {
+    double mean_ns;
+    double median_ns;
+    double p99_ns;
+    double max_ns;
+    long subnormals;
+};
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 >= argc) {
+            return false;
+        }
+        if (std::strcmp(argv[i], "--blocks") == 0) {
+            options.blocks = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--block-size") == 0) {
+            options.block_size = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--rekey") == 0) {
+            options.rekey_blocks = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--max-ratio") == 0) {
+            options.max_ratio = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--board") == 0) {
+            options.board_chips = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--control-rate") == 0) {
+            ++i;
+            if (std::strcmp(argv[i], "compare") == 0) {
+                options.compare_control_rates = true;
+            } else {
+                options.control_rate = std::atoi(argv[i]);
+            }
+        } else {
+            return false;
+        }
+    }
+    return options.blocks > 0 && options.block_size > 0 && options.rekey_blocks > 0 &&
+           options.board_chips >= 0 && options.board_chips <= YM2151::Board::MAX_CHIPS &&
+           options.control_rate >= 1 && options.control_rate <= YM2151::MAX_CONTROL_RATE;
+}
+
+// 全チャンネルの全オペレータに同じパラメータを設定する
+void setAllOperators(YM2151::Chip& chip, const YM2151::FMParameter& param) {
+    for (int ch = 0; ch < YM2151::CHANNEL_COUNT; ++ch) {
+        for (int op = 0; op < 4; ++op) {
+            chip.getChannel(ch).getOperator(op).setParameter(param);
+        }
+    }
+}
+
+YM2151::FMParameter defaultParameter() {
+    YM2151::FMParameter param{};
+    param.mul = 1;
+    param.tl = 127;
+    param.ar = 31;
+    param.rr = 15;
+    return param;
+}
+
+void setupChannels(YM2151::Chip& chip, int algorithm, int feedback) {
+    for (int ch = 0; ch < YM2151::CHANNEL_COUNT; ++ch) {
+        chip.setRegister(static_cast<uint8_t>(0x20 + ch), static_cast<uint8_t>((feedback << 3) | algorithm));
+        const uint16_t freq = static_cast<uint16_t>(220 + ch * 110);
+        chip.setRegister(static_cast<uint8_t>(0x10 + ch), freq & 0xFF);
+        chip.setRegister(static_cast<uint8_t>(0x18 + ch), freq >> 8);
+    }
+}
+
+void keyAll(YM2151::Chip& chip, bool on) {
+    for (int ch = 0; ch < YM2151::CHANNEL_COUNT; ++ch) {
+        chip.setRegister(0x08, static_cast<uint8_t>((on ? 0x80 : 0x00) | ch));
+    }
+}
+
+// DR=31 は1サンプルあたり 0.31% の減衰なので、最小レベル 0.001 までは約2230サンプル
+// （制御レートの区間の分と丸めの余裕を加える）。最小レベルで止まらなければ IDLE にならない
+constexpr int DECAY_TO_IDLE_LIMIT = 2400;
+
+// キーオンから全オペレータのエンベロープが IDLE になるまでのサンプル数（limit までに達しなければ -1）
+int samplesUntilIdle(const Scenario& scenario, int control_rate, int limit) {
+    YM2151::Chip chip;
+    chip.setSampleRate(44100);
+    chip.setControlRate(control_rate);
+    scenario.setup(chip);
+    keyAll(chip, true);
+
+    float sample;
+    for (int position = 0; position < limit; ++position) {
+        chip.generate(&sample, 1);
+        bool idle = true;
+        for (int ch = 0; ch < YM2151::CHANNEL_COUNT && idle; ++ch) {
+            for (int op = 0; op < 4 && idle; ++op) {
+                idle = chip.getChannel(ch).getOperator(op).envelopeState() == YM2151::EnvelopeState::IDLE;
+            }
+        }
+        if (idle) {
+            return position + 1;
+        }
+    }
+    return -1;
+}
+
+// シナリオを実行してブロックごとの処理時間を集計する
+// 各区間の最初のブロックでキーオンする
+// （キーオフしたチャンネルはこのコアでは出力が0になり、エンベロープもフィードバックも
+// 進まないため、減衰の経路はキーオンしたまま計測する）
+Stats run(const Options& options, const Scenario& scenario, int control_rate) {
+    YM2151::Chip chip;
+    chip.setSampleRate(44100);
+    chip.setControlRate(control_rate);
+    scenario.setup(chip);
+
+    std::vector<float> buffer(options.block_size);
+    std::vector<double> times(options.blocks);
+    long subnormals = 0;
+
+    for (int block = 0; block < options.blocks; ++block) {
+        if (block % options.rekey_blocks == 0) {
+            keyAll(chip, true);
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        chip.generate(buffer.data(), options.block_size);
+        const auto end = std::chrono::steady_clock::now();
+        times[block] = std::chrono::duration<double, std::nano>(end - start).count();
+
+        for (float sample : buffer) {
+            if (std::fpclassify(sample) == FP_SUBNORMAL) {
+                ++subnormals;
+            }
+        }
+    }
+
+    Stats stats;
+    double total = 0.0;
+    for (double t : times) {
+        total += t;
+    }
+    stats.mean_ns = total / options.blocks;
+    std::sort(times.begin(), times.end());
+    stats.median_ns = times[options.blocks / 2];
+    stats.p99_ns = times[std::min(options.blocks - 1, options.blocks * 99 / 100)];
+    stats.max_ns = times.back();
+    stats.subnormals = subnormals;
+    return stats;
+}
+
+// Board の1ブロックあたりの処理時間（全チップを最も重い設定で鳴らし続ける）
+Stats runBoard(const Options& options, bool threaded) {
+    YM2151::Board board(44100);
+    for (int c = 0; c < options.board_chips; ++c) {
+        const int index = board.addChip(3579545, 1.0f, c % 2 ? 0.5f : -0.5f);
+        setupChannels(board.chip(index), 0, 7);
+        keyAll(board.chip(index), true);
+    }
+    board.start(options.block_size, threaded);
+
+    std::vector<float> stereo(static_cast<size_t>(options.block_size) * 2);
+    std::vector<double> times(options.blocks);
+    for (int block = 0; block < options.blocks; ++block) {
+        const auto start = std::chrono::steady_clock::now();
+        board.render(stereo.data());
+        const auto end = std::chrono::steady_clock::now();
+        times[block] = std::chrono::duration<double, std::nano>(end - start).count();
+    }
+    board.stop();
+
+    Stats stats{};
+    double total = 0.0;
+    for (double t : times) {
+        total += t;
+    }
+    stats.mean_ns = total / options.blocks;
+    std::sort(times.begin(), times.end());
+    stats.median_ns = times[options.blocks / 2];
+    stats.p99_ns = times[std::min(options.blocks - 1, options.blocks * 99 / 100)];
+    stats.max_ns = times.back();
+    return stats;
+}
+
+int compareBoard(const Options& options) {
+    std::printf("ym2151_bench: board with %d chips, %d blocks of %d frames\n",
+                options.board_chips, options.blocks, options.block_size);
+    std::printf("%-26s %10s %10s %10s %10s\n", "mode", "mean(ns)", "median(ns)", "p99(ns)", "max(ns)");
+
+    const Stats inline_stats = runBoard(options, false);
+    const Stats threaded_stats = runBoard(options, true);
+    std::printf("%-26s %10.0f %10.0f %10.0f %10.0f\n", "inline (one core)",
+                inline_stats.mean_ns, inline_stats.median_ns, inline_stats.p99_ns, inline_stats.max_ns);
+    std::printf("%-26s %10.0f %10.0f %10.0f %10.0f\n", "worker thread per chip",
+                threaded_stats.mean_ns, threaded_stats.median_ns, threaded_stats.p99_ns, threaded_stats.max_ns);
+    std::printf("speedup (mean): %.2fx, real-time budget per block: %.0f ns\n",
+                inline_stats.mean_ns / threaded_stats.mean_ns, options.block_size * 1e9 / 44100.0);
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::fprintf(stderr,
+                     "Usage: ym2151_bench [--blocks N] [--block-size N] [--rekey N] [--max-ratio X] [--board N]\n"
+                     "                    [--control-rate N|compare]\n");
+        return 2;
+    }
+
+    if (options.board_chips > 0) {
+        return compareBoard(options);
+    }
+
+    // 比較用: 全チャンネルを最も重い設定（直列接続・最大フィードバック）で鳴らし続ける
+    const Scenario sustained{"sustained", [](YM2151::Chip& chip) {
+        setupChannels(chip, 0, 7);
+    }};
+
+    // sustained と同じ設定の全チャンネルを同じ周波数で鳴らす（1チャンネル分の計算で済む）
+    const Scenario unison{"unison (8 same voices)", [](YM2151::Chip& chip) {
+        setupChannels(chip, 0, 7);
+        for (int ch = 0; ch < YM2151::CHANNEL_COUNT; ++ch) {
+            chip.setRegister(static_cast<uint8_t>(0x10 + ch), 220);
+            chip.setRegister(static_cast<uint8_t>(0x18 + ch), 0);
+        }
+    }};
+
+    // キーオンしたままの長い減衰（SL=1 まで速く下げ、SR=4 で最小レベルまで約530ブロックかけて減衰）
+    const Scenario sustain_tail{"long sustain decay (SR=4)", [](YM2151::Chip& chip) {
+        setupChannels(chip, 7, 7);
+        YM2151::FMParameter param = defaultParameter();
+        param.dr = 31;
+        param.sl = 1;
+        param.sr = 4;
+        setAllOperators(chip, param);
+    }};
+
+    // サスティンレベル0（SL=15）へのディケイ（0に達するまで指数減衰が続く経路）
+    const Scenario decay_to_zero{"decay to silence (SL=15)", [](YM2151::Chip& chip) {
+        setupChannels(chip, 7, 0);
+        YM2151::FMParameter param = defaultParameter();
+        param.dr = 31;
+        param.sl = 15;
+        setAllOperators(chip, param);
+    }};
+
+    // 最大フィードバックのモジュレータが無音近くまで減衰していく
+    const Scenario quiet_feedback{"near-silent feedback", [](YM2151::Chip& chip) {
+        setupChannels(chip, 0, 7);
+        YM2151::FMParameter param = defaultParameter();
+        param.dr = 20;
+        param.sl = 15;
+        for (int ch = 0; ch < YM2151::CHANNEL_COUNT; ++ch) {
+            chip.getChannel(ch).getOperator(0).setParameter(param);
+        }
+    }};
+
+    const Scenario* const scenarios[] = {
+        &sustained,
+        &unison,
+        &sustain_tail,
+        &decay_to_zero,
+        &quiet_feedback,
+    };
+
+    if (options.compare_control_rates) {
+        // 制御レートごとの平均処理時間（制御レート1に対する比）
+        const int rates[] = {1, 8, 16, 32};
+        std::printf("ym2151_bench: control rates, %d blocks of %d samples\n", options.blocks, options.block_size);
+        std::printf("%-26s", "scenario");
+        for (int rate : rates) {
+            std::printf(" %13s%-3d", "mean(ns) @", rate);
+        }
+        std::printf("\n");
+        for (const Scenario* scenario : scenarios) {
+            std::printf("%-26s", scenario->name);
+            double base = 0.0;
+            for (int rate : rates) {
+                const Stats stats = run(options, *scenario, rate);
+                if (rate == 1) {
+                    base = stats.mean_ns;
+                    std::printf(" %16.0f", stats.mean_ns);
+                } else {
+                    std::printf(" %8.0f (%4.2fx)", stats.mean_ns, base / stats.mean_ns);
+                }
+            }
+            std::printf("\n");
+        }
+        return 0;
+    }
+
+    std::printf("ym2151_bench: %d blocks of %d samples, rekey every %d blocks, control rate %d\n",
+                options.blocks, options.block_size, options.rekey_blocks, options.control_rate);
+    std::printf("%-26s %10s %10s %10s %10s %8s\n",
+                "scenario", "mean(ns)", "median(ns)", "p99(ns)", "max(ns)", "p99/med");
+
+    int failed = 0;
+    for (const Scenario* scenario : scenarios) {
+        const Stats stats = run(options, *scenario, options.control_rate);
+        const double ratio = stats.median_ns > 0.0 ? stats.p99_ns / stats.median_ns : 0.0;
+        std::printf("%-26s %10.0f %10.0f %10.0f %10.0f %8.2f\n", scenario->name,
+                    stats.mean_ns, stats.median_ns, stats.p99_ns, stats.max_ns, ratio);
+
+        if (stats.subnormals > 0) {
+            std::printf("FAIL %s: %ld subnormal output samples\n", scenario->name, stats.subnormals);
+            ++failed;
+        }
+        if (options.max_ratio > 0.0 && ratio > options.max_ratio) {
+            std::printf("FAIL %s: p99 is %.2fx the median (limit %.2fx)\n",
+                        scenario->name, ratio, options.max_ratio);
+            ++failed;
+        }
+    }
+
+    for (int rate : {1, 8, 16, 32}) {
+        const int samples = samplesUntilIdle(decay_to_zero, rate, DECAY_TO_IDLE_LIMIT);
+        if (samples < 0) {
+            std::printf("FAIL %s: envelopes not idle after %d samples at control rate %d\n",
+                        decay_to_zero.name, DECAY_TO_IDLE_LIMIT, rate);
+            ++failed;
+        } else {
+            std::printf("%s: idle after %d samples at control rate %d\n", decay_to_zero.name, samples, rate);
+        }
+    }
+
+    return failed == 0 ? 0 : 1;
+}
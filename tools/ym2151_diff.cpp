@@ -0,0 +1,1965 @@
+// YM2151 差分テストドライバ
+// 製品用の Chip とリファレンス実装 ReferenceChip に同じランダムなレジスタ書き込み列を与え、
+// 出力を比較する。最初に一致しなくなったサンプルと、その時点のレジスタ状態、
+// 直前の書き込み履歴を表示して終了コード1で終了する。
+//
+// Chip は generate() と generateStems() のミックス出力の両方を比較する。
+// 許容誤差の既定値は0（ビット単位で一致）。
+//
+// --chip-array を指定すると、ChipArray の各レーンにそれぞれ別のランダムな書き込み列を与え、
+// 同じ書き込みを与えた Chip の出力と比較する。
+//
+// --recorder を指定すると、Recorder を取り付けた Chip にランダムな書き込みを与えて生成し、
+// 記録をVGMに書き出して読み戻した書き込み列を新しい Chip で再生して出力を比較する。
+//
+// --sequencer を指定すると、テンポ変更を含むランダムなイベント列を Sequencer で
+// 全体を1回の render() で生成した場合と、ランダムな長さのブロックに分け、一時停止を挟みながら
+// イベントを少しずつ追加して生成した場合を比較する。
+//
+// --board を指定すると、Board（ワーカースレッドあり・なし）のステレオ出力を、
+// 同じ書き込みを与えた個別の Chip の出力を同じ順序で合成したものと比較する
+// （スレッド動作では1ブロック遅れた出力と比較する）。
+//
+// --meter を指定すると、LevelMeter を取り付けた Chip（generate() の float 版と int16 版、
+// generateStems()）の出力がリファレンス実装と一致することと、公開されたレベルが
+// ステムとミックス出力から別に計算した値と一致することを確認する。
+// 同時に別スレッドからスナップショットを読み続け、読み出した値が一貫していることを確認する。
+//
+// --note-cache を指定すると、小さな NoteCache を取り付けた Chip と取り付けていない Chip に、
+// リセットしてから同じ手順で鳴らすジングル（キーオフの時期を時々ずらす）とランダムな書き込みを
+// 交互に与えて出力を比較する（追い出しと、発音途中での状態の復元を含む）。
+//
+// --offline を指定すると、長い無音を含むランダムな書き込み列を OfflineRenderer で
+// スレッド数を変えて生成し、1つの Chip で書き込み時刻で区切りながら生成した出力
+// （generate() のミックスと generateStems() のステム）と比較する。
+// --control-rate N を併せて指定すると、両方を制御レート N で生成して比較する
+// （制御レートの区間が生成の呼び出しの区切り方によらないことの確認を兼ねる）。
+//
+// --unison を指定すると、リセットしたチップのチャンネルを2〜3個ずつの組に分けて同じ書き込みを与え
+// （時々組の1チャンネルだけに書き込んで状態をずらす）、重複チャンネルの出力の共有と
+// その解除を繰り返しながら、出力がリファレンス実装と一致することを確認する。
+//
+// --midi を指定すると、ランダムなMIDIメッセージ（ノートオン/オフ、同じノートの再発音、
+// プログラムチェンジ、オールノートオフ、キューが溢れる量の同時発音）を MidiDriver に与えて生成し、
+// ボイス割り当てを素朴に書き直したモデルが求めた書き込みを、その時刻に与えた Chip の出力と比較する。
+// キューに収まらないイベントがイベント単位で破棄されることも確認する。
+//
+// --control-rate-reference を指定すると、制御レート 8 / 16 / 32 の Chip の出力を、サンプルごとに
+// エンベロープを更新するリファレンス実装と許容誤差の範囲で比較する（制御レート1はビット単位で比較）。
+//
+// --patch を指定すると、PatchBank が .opm を解析したレジスタブロックを既知の値と比較し、
+// 不正な入力のエラーを確認する。
+
+#include "ym2151/ym2151.h"
+#include "ym2151/board.h"
+#include "ym2151/reference.h"
+#include "ym2151/chip_array.h"
+#include "ym2151/meter.h"
+#include "ym2151/midi.h"
+#include "ym2151/note_cache.h"
+#include "ym2151/offline.h"
+#include "ym2151/recorder.h"
+#include "ym2151/sequencer.h"
+#include "ym2151/vgm.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Options {
+    uint32_t seed = 1;
+    int iterations = 1000;
+    int max_block = 512;
+    float tolerance = 0.0f;
+    uint32_t sample_rate = 44100;
+    bool chip_array = false;
+    bool recorder = false;
+    bool sequencer = false;
+    bool board = false;
+    bool meter = false;
+    bool note_cache = false;
+    bool offline = false;
+    bool unison = false;
+    bool midi = false;
+    bool patch = false;
+    bool control_rate_reference = false;
+    int control_rate = 1;
+};
+
+// 直近の書き込み履歴（表示用）
+struct WriteLog {
+    static constexpr int SIZE = 32;
+    std::array<YM2151::TimedWrite, SIZE> entries{};
+    int count = 0;
+
+    void add(uint32_t time, uint8_t reg, uint8_t value) {
+        entries[count % SIZE] = YM2151::TimedWrite{time, reg, value};
+        ++count;
+    }
+
+    void print() const {
+        int first = count > SIZE ? count - SIZE : 0;
+        std::printf("last %d writes (sample: reg=value):\n", count - first);
+        for (int i = first; i < count; ++i) {
+            const auto& w = entries[i % SIZE];
+            std::printf("  %8u: %02X=%02X\n", w.time, w.reg, w.value);
+        }
+    }
+};
+
+// 意味のあるレジスタに偏らせたランダムな書き込みを生成
+void randomWrite(std::mt19937& rng, uint8_t& reg, uint8_t& value) {
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::uniform_int_distribution<int> kind(0, 99);
+    std::uniform_int_distribution<int> channel(0, 7);
+
+    int k = kind(rng);
+    int ch = channel(rng);
+    if (k < 25) {
+        // キーオン/オフ
+        reg = 0x08;
+        value = static_cast<uint8_t>((byte(rng) & 0x80) | (byte(rng) & 0x78) | ch);
+    } else if (k < 55) {
+        // 周波数（可聴域に偏らせる）
+        uint16_t freq = static_cast<uint16_t>(std::uniform_int_distribution<int>(20, 8000)(rng));
+        reg = static_cast<uint8_t>((k & 1) ? 0x10 + ch : 0x18 + ch);
+        value = static_cast<uint8_t>((k & 1) ? (freq & 0xFF) : (freq >> 8));
+    } else if (k < 75) {
+        // アルゴリズム、フィードバック
+        reg = static_cast<uint8_t>(0x20 + ch);
+        value = static_cast<uint8_t>(byte(rng));
+    } else if (k < 80) {
+        // LFO周波数
+        reg = 0x01;
+        value = static_cast<uint8_t>(byte(rng));
+    } else {
+        // その他の任意のレジスタ
+        reg = static_cast<uint8_t>(byte(rng));
+        value = static_cast<uint8_t>(byte(rng));
+    }
+}
+
+// ランダムなオペレータのパラメータ（全項目を範囲全体から選ぶ）
+// オペレータのレジスタはまだ解釈されないので、Operator::setParameter() と
+// ReferenceChip::setOperatorParameter() で直接設定して比較する
+YM2151::FMParameter randomParameter(std::mt19937& rng) {
+    std::uniform_int_distribution<int> byte(0, 255);
+    YM2151::FMParameter param{};
+    param.dt1 = static_cast<uint8_t>(byte(rng) & 0x07);
+    param.mul = static_cast<uint8_t>(byte(rng) & 0x0F);
+    param.tl = static_cast<uint8_t>(byte(rng) & 0x7F);
+    param.ks = static_cast<uint8_t>(byte(rng) & 0x03);
+    param.ar = static_cast<uint8_t>(byte(rng) & 0x1F);
+    param.amsen = static_cast<uint8_t>(byte(rng) & 0x01);
+    param.dr = static_cast<uint8_t>(byte(rng) & 0x1F);
+    param.dt2 = static_cast<uint8_t>(byte(rng) & 0x03);
+    param.sr = static_cast<uint8_t>(byte(rng) & 0x1F);
+    param.sl = static_cast<uint8_t>(byte(rng) & 0x0F);
+    param.rr = static_cast<uint8_t>(byte(rng) & 0x0F);
+    param.ssgeg = (byte(rng) & 0x01) != 0;
+    return param;
+}
+
+void printRegisters(const YM2151::Chip& chip) {
+    std::printf("registers:\n");
+    for (int row = 0; row < 16; ++row) {
+        std::printf("  %02X:", row * 16);
+        for (int col = 0; col < 16; ++col) {
+            std::printf(" %02X", chip.getRegister(static_cast<uint8_t>(row * 16 + col)));
+        }
+        std::printf("\n");
+    }
+}
+
+bool differs(float a, float b, float tolerance) {
+    if (tolerance == 0.0f) {
+        return std::memcmp(&a, &b, sizeof(float)) != 0;
+    }
+    return !(std::fabs(a - b) <= tolerance);
+}
+
+// 比較する出力（name は表示名）
+struct Output {
+    const char* name;
+    const float* data;
+};
+
+// 比較の経過と、一致しなかった場合の表示に加える情報
+struct StreamState {
+    explicit StreamState(const Options& options) : seed(options.seed), tolerance(options.tolerance) {}
+
+    uint32_t seed;
+    float tolerance;           // 許容誤差（0ならビット単位で比較）
+    std::string detail;        // DIVERGENCE の行に加える説明（レーン、スレッド数など）
+    int iteration = -1;        // 反復の番号（compareStreams の外で全体を比較する場合は -1）
+    uint32_t position = 0;     // 比較するブロックの先頭のサンプル位置
+    float max_error = 0.0f;    // 一致したサンプルの誤差の最大
+};
+
+// expected と actual の各出力をブロック内の [begin, samples) で比較する
+// 一致しないサンプルがあれば、その位置と全出力の値（一致しなかった出力に印を付ける）を表示して
+// false を返す。レジスタ状態や書き込み履歴の表示は呼び出し側で行う。
+bool compareOutputs(StreamState& state, int samples, const Output& expected, std::initializer_list<Output> actual,
+                    int begin = 0) {
+    for (int i = begin; i < samples; ++i) {
+        bool diverged = false;
+        for (const Output& output : actual) {
+            diverged = diverged || differs(output.data[i], expected.data[i], state.tolerance);
+        }
+        if (!diverged) {
+            for (const Output& output : actual) {
+                state.max_error = std::fmax(state.max_error, std::fabs(output.data[i] - expected.data[i]));
+            }
+            continue;
+        }
+
+        const char* separator = state.detail.empty() ? "" : ", ";
+        if (state.iteration >= 0) {
+            std::printf("DIVERGENCE at sample %u (iteration %d, offset %d, seed %u%s%s)\n", state.position + i,
+                        state.iteration, i, state.seed, separator, state.detail.c_str());
+        } else {
+            std::printf("DIVERGENCE at sample %u (seed %u%s%s)\n", state.position + i, state.seed, separator,
+                        state.detail.c_str());
+        }
+        std::printf("  %-18s %.9g\n", (std::string(expected.name) + ":").c_str(), expected.data[i]);
+        for (const Output& output : actual) {
+            std::printf("  %-18s %.9g%s\n", (std::string(output.name) + ":").c_str(), output.data[i],
+                        differs(output.data[i], expected.data[i], state.tolerance) ? "  <--" : "");
+        }
+        return false;
+    }
+    return true;
+}
+
+// 差分テストの共通の手順
+// options.iterations 回、apply(state) で比較する両方に同じ書き込みを与え、ブロックの長さ
+// （block が0なら 1〜max_block からランダムに選ぶ）を決めて compare(state, samples) で生成と比較を行う。
+// apply / compare は一致しなければ表示して false を返す（compareOutputs の表示に状態を加える）。
+// 各モードはこの手順との違い（与える書き込み、生成する出力、追加の確認）だけを書く。
+template <typename Apply, typename Compare>
+bool compareStreams(const Options& options, std::mt19937& rng, StreamState& state, Apply&& apply, Compare&& compare,
+                    int block = 0) {
+    std::uniform_int_distribution<int> block_size(1, options.max_block);
+    for (state.iteration = 0; state.iteration < options.iterations; ++state.iteration) {
+        if (!apply(state)) {
+            return false;
+        }
+        const int samples = block > 0 ? block : block_size(rng);
+        if (!compare(state, samples)) {
+            return false;
+        }
+        state.position += static_cast<uint32_t>(samples);
+    }
+    return true;
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--chip-array") == 0) {
+            options.chip_array = true;
+            continue;
+        }
+        if (std::strcmp(argv[i], "--recorder") == 0) {
+            options.recorder = true;
+            continue;
+        }
+        if (std::strcmp(argv[i], "--sequencer") == 0) {
+            options.sequencer = true;
+            continue;
+        }
+        if (std::strcmp(argv[i], "--board") == 0) {
+            options.board = true;
+            continue;
+        }
+        if (std::strcmp(argv[i], "--meter") == 0) {
+            options.meter = true;
+            continue;
+        }
+        if (std::strcmp(argv[i], "--note-cache") == 0) {
+            options.note_cache = true;
+            continue;
+        }
+        if (std::strcmp(argv[i], "--offline") == 0) {
+            options.offline = true;
+            continue;
+        }
+        if (std::strcmp(argv[i], "--unison") == 0) {
+            options.unison = true;
+            continue;
+        }
+        if (std::strcmp(argv[i], "--midi") == 0) {
+            options.midi = true;
+            continue;
+        }
+        if (std::strcmp(argv[i], "--control-rate-reference") == 0) {
+            options.control_rate_reference = true;
+            continue;
+        }
+        if (std::strcmp(argv[i], "--patch") == 0) {
+            options.patch = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        if (std::strcmp(argv[i], "--seed") == 0) {
+            options.seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "--iterations") == 0) {
+            options.iterations = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--max-block") == 0) {
+            options.max_block = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--tolerance") == 0) {
+            options.tolerance = static_cast<float>(std::atof(argv[++i]));
+        } else if (std::strcmp(argv[i], "--rate") == 0) {
+            options.sample_rate = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "--control-rate") == 0) {
+            options.control_rate = std::atoi(argv[++i]);
+        } else {
+            return false;
+        }
+    }
+    return options.max_block > 0 && options.sample_rate > 0 &&
+           options.control_rate >= 1 && options.control_rate <= YM2151::MAX_CONTROL_RATE;
+}
+
+// ChipArray の各レーンと Chip の比較
+// レーン数はタイル（16レーン）の境界をまたぐように選んでいる
+int runChipArray(const Options& options) {
+    constexpr int LANES = 19;
+    auto array = std::make_unique<YM2151::ChipArray<LANES>>();
+    std::vector<YM2151::Chip> chips(LANES);
+    std::vector<std::mt19937> rngs;
+    std::vector<WriteLog> logs(LANES);
+    array->setSampleRate(options.sample_rate);
+    for (int lane = 0; lane < LANES; ++lane) {
+        chips[lane].setSampleRate(options.sample_rate);
+        rngs.emplace_back(options.seed * 1000003u + lane);
+    }
+
+    std::mt19937 rng(options.seed);
+    std::uniform_int_distribution<int> write_count(0, 8);
+
+    std::vector<float> expected(options.max_block);
+    std::vector<float> lane_data(LANES * options.max_block);
+    float* outputs[LANES];
+    for (int lane = 0; lane < LANES; ++lane) {
+        outputs[lane] = lane_data.data() + lane * options.max_block;
+    }
+
+    StreamState state(options);
+    const bool ok = compareStreams(
+        options, rng, state,
+        [&](StreamState& current) {
+            // レーンごとに独立した書き込み
+            for (int lane = 0; lane < LANES; ++lane) {
+                const int writes = write_count(rngs[lane]);
+                for (int w = 0; w < writes; ++w) {
+                    uint8_t reg;
+                    uint8_t value;
+                    randomWrite(rngs[lane], reg, value);
+                    array->setRegister(lane, reg, value);
+                    chips[lane].setRegister(reg, value);
+                    logs[lane].add(current.position, reg, value);
+                }
+            }
+            return true;
+        },
+        [&](StreamState& current, int samples) {
+            array->generate(outputs, samples);
+            for (int lane = 0; lane < LANES; ++lane) {
+                chips[lane].generate(expected.data(), samples);
+                current.detail = "lane " + std::to_string(lane);
+                if (!compareOutputs(current, samples, {"Chip", expected.data()}, {{"ChipArray", outputs[lane]}})) {
+                    printRegisters(chips[lane]);
+                    logs[lane].print();
+                    return false;
+                }
+            }
+            return true;
+        });
+    if (!ok) {
+        return 1;
+    }
+
+    std::printf("ym2151_diff: ChipArray<%d>, %d iterations, %u samples, seed %u, max error %g: OK\n",
+                LANES, options.iterations, state.position, options.seed, state.max_error);
+    return 0;
+}
+
+// 記録したセッションをVGM経由で再生し、元の出力と比較
+// VGMの時間単位は44100Hzなので、サンプリングレートは44100に固定する
+int runRecorder(const Options& options) {
+    // 最初は1チャンクだけ確保し、reserve() で増やした領域にまたがって記録する
+    YM2151::Recorder recorder(1);
+    recorder.reserve(static_cast<size_t>(options.iterations) * 8);
+    YM2151::Chip chip;
+    chip.setRecorder(&recorder);
+
+    std::mt19937 rng(options.seed);
+    std::uniform_int_distribution<int> write_count(0, 8);
+    std::uniform_int_distribution<int> block_size(1, options.max_block);
+    std::uniform_int_distribution<int> silence(0, 3);
+
+    // 書き込みのない区間（待ちの結合）を含むセッションを記録する
+    std::vector<float> recorded;
+    std::vector<float> block(options.max_block);
+    size_t write_total = 0;
+    for (int iteration = 0; iteration < options.iterations; ++iteration) {
+        int writes = silence(rng) == 0 ? 0 : write_count(rng);
+        for (int w = 0; w < writes; ++w) {
+            uint8_t reg;
+            uint8_t value;
+            randomWrite(rng, reg, value);
+            chip.setRegister(reg, value);
+        }
+        write_total += writes;
+
+        int samples = block_size(rng);
+        chip.generate(block.data(), samples);
+        recorded.insert(recorded.end(), block.begin(), block.begin() + samples);
+    }
+    chip.setRecorder(nullptr);
+
+    if (recorder.size() != write_total || recorder.dropped() != 0 || recorder.position() != recorded.size()) {
+        std::printf("RECORDER MISMATCH: %zu writes (expected %zu), %llu dropped, position %u (expected %zu)\n",
+                    recorder.size(), write_total, static_cast<unsigned long long>(recorder.dropped()),
+                    recorder.position(), recorded.size());
+        return 1;
+    }
+
+    std::vector<uint8_t> vgm;
+    recorder.writeVGM(vgm);
+    YM2151::RegisterStream stream;
+    std::string error;
+    if (!YM2151::parseVGM(vgm.data(), vgm.size(), YM2151::VGM_SAMPLE_RATE, stream, &error)) {
+        std::printf("VGM PARSE ERROR: %s\n", error.c_str());
+        return 1;
+    }
+    if (stream.writes.size() != write_total || stream.total_samples != recorded.size()) {
+        std::printf("VGM MISMATCH: %zu writes (expected %zu), %u samples (expected %zu)\n",
+                    stream.writes.size(), write_total, stream.total_samples, recorded.size());
+        return 1;
+    }
+
+    // 書き込みの時刻で区切って再生する
+    YM2151::Chip replay(stream.clock);
+    std::vector<float> replayed(recorded.size());
+    size_t next_write = 0;
+    YM2151::renderWrites(replay, stream.writes, next_write, 0, replayed.data(), static_cast<int>(replayed.size()));
+
+    StreamState state(options);
+    if (!compareOutputs(state, static_cast<int>(recorded.size()), {"recorded", recorded.data()},
+                        {{"replayed", replayed.data()}})) {
+        printRegisters(replay);
+        return 1;
+    }
+
+    std::printf("ym2151_diff: recorder, %d iterations, %zu samples, %zu writes, %zu VGM bytes, seed %u: OK\n",
+                options.iterations, recorded.size(), write_total, vgm.size(), options.seed);
+    return 0;
+}
+
+// Sequencer の生成結果がブロックの分け方・一時停止・イベントの追加の時期によらないことの確認
+int runSequencer(const Options& options) {
+    std::mt19937 rng(options.seed);
+    std::uniform_int_distribution<int> gap(0, 48);
+    std::uniform_int_distribution<int> kind(0, 99);
+    std::uniform_int_distribution<int> channel(0, 7);
+    std::uniform_int_distribution<int> note(24, 108);
+    std::uniform_int_distribution<int> tempo(200000, 1500000);
+
+    // ランダムなイベント列（同じティックのイベントも含む）
+    std::vector<YM2151::SequenceEvent> events;
+    uint32_t tick = 0;
+    for (int i = 0; i < options.iterations; ++i) {
+        tick += static_cast<uint32_t>(gap(rng) < 8 ? 0 : gap(rng));
+        const int k = kind(rng);
+        const uint8_t ch = static_cast<uint8_t>(channel(rng));
+        if (k < 40) {
+            events.push_back(YM2151::SequenceEvent::noteOn(tick, ch, static_cast<uint8_t>(note(rng))));
+        } else if (k < 70) {
+            events.push_back(YM2151::SequenceEvent::noteOff(tick, ch));
+        } else if (k < 95) {
+            uint8_t reg;
+            uint8_t value;
+            randomWrite(rng, reg, value);
+            events.push_back(YM2151::SequenceEvent::write(tick, reg, value));
+        } else {
+            events.push_back(YM2151::SequenceEvent::setTempo(tick, static_cast<uint32_t>(tempo(rng))));
+        }
+    }
+
+    // 全体を1回で生成
+    YM2151::Sequencer whole(events.size());
+    whole.setSampleRate(options.sample_rate);
+    whole.add(events.data(), events.size());
+    YM2151::Chip whole_chip;
+    whole_chip.setSampleRate(options.sample_rate);
+
+    // 最後のイベントまでの長さを求める（テンポ変更を反映するため一度生成して数える）
+    YM2151::Sequencer probe(events.size());
+    probe.setSampleRate(options.sample_rate);
+    probe.add(events.data(), events.size());
+    YM2151::Chip probe_chip;
+    probe_chip.setSampleRate(options.sample_rate);
+    std::vector<float> scratch(4096);
+    while (!probe.finished()) {
+        probe.render(probe_chip, scratch.data(), static_cast<int>(scratch.size()));
+    }
+    const int total = static_cast<int>(probe.currentSample()) + 1000;
+
+    std::vector<float> expected(total);
+    whole.render(whole_chip, expected.data(), total);
+
+    // イベントのあるサンプル位置の数 + 1 回を超えて generate() を呼んでいないこと
+    // （同じ位置のイベントはまとめて適用される）
+    if (whole.generateCalls() > events.size() + 1) {
+        std::printf("SEQUENCER: %llu generate() calls for %zu events\n",
+                    static_cast<unsigned long long>(whole.generateCalls()), events.size());
+        return 1;
+    }
+
+    // ランダムなブロックに分け、キューを小さくしてイベントを少しずつ追加し、一時停止を挟む
+    YM2151::Sequencer split(64);
+    split.setSampleRate(options.sample_rate);
+    YM2151::Chip split_chip;
+    split_chip.setSampleRate(options.sample_rate);
+    std::uniform_int_distribution<int> block_size(1, options.max_block);
+    std::uniform_int_distribution<int> pause(0, 9);
+    std::vector<float> actual(total);
+    std::vector<float> block(options.max_block);
+    size_t next_event = 0;
+    int position = 0;
+    while (position < total) {
+        next_event += split.add(events.data() + next_event, events.size() - next_event);
+
+        const int samples = std::min(block_size(rng), total - position);
+        if (pause(rng) == 0) {
+            split.pause();
+            split.render(split_chip, block.data(), samples);
+            split.resume();
+            for (int i = 0; i < samples; ++i) {
+                if (block[i] != 0.0f) {
+                    std::printf("SEQUENCER: paused render wrote a non-zero sample\n");
+                    return 1;
+                }
+            }
+        }
+        split.render(split_chip, actual.data() + position, samples);
+        position += samples;
+    }
+
+    StreamState state(options);
+    if (!compareOutputs(state, total, {"single render", expected.data()}, {{"split render", actual.data()}})) {
+        printRegisters(split_chip);
+        return 1;
+    }
+
+    std::printf("ym2151_diff: sequencer, %zu events, %d samples, %llu generate() calls, seed %u: OK\n",
+                events.size(), total, static_cast<unsigned long long>(whole.generateCalls()), options.seed);
+    return 0;
+}
+
+// Board の出力と個別の Chip を合成した出力の比較
+int runBoard(const Options& options, bool threaded) {
+    constexpr int CHIPS = 3;
+    constexpr int BLOCK = 256;
+    const float gains[CHIPS] = {1.0f, 0.5f, 0.8f};
+    const float pans[CHIPS] = {-1.0f, 0.0f, 0.3f};
+
+    YM2151::Board board(options.sample_rate);
+    std::vector<YM2151::Chip> chips;
+    for (int c = 0; c < CHIPS; ++c) {
+        board.addChip(3579545 + c * 1000, gains[c], pans[c]);
+        chips.emplace_back(3579545 + c * 1000);
+        chips.back().setSampleRate(options.sample_rate);
+    }
+    std::string error;
+    if (!board.start(BLOCK, threaded, &error)) {
+        std::printf("BOARD: %s\n", error.c_str());
+        return 1;
+    }
+
+    std::mt19937 rng(options.seed);
+    std::uniform_int_distribution<int> write_count(0, 8);
+
+    // 期待値: 1ブロック前の分も保持する
+    std::vector<float> expected[2] = {std::vector<float>(BLOCK * 2), std::vector<float>(BLOCK * 2)};
+    std::vector<float> actual(BLOCK * 2);
+    std::vector<float> chip_output(BLOCK);
+    // 左右に分けて比較する（位置をフレーム単位で表示するため）
+    std::vector<float> split[4] = {std::vector<float>(BLOCK), std::vector<float>(BLOCK), std::vector<float>(BLOCK),
+                                   std::vector<float>(BLOCK)};
+    const int delay = board.latency() / BLOCK;
+
+    StreamState state(options);
+    state.detail = threaded ? "threaded" : "inline";
+    const bool ok = compareStreams(
+        options, rng, state,
+        [&](StreamState&) {
+            for (int c = 0; c < CHIPS; ++c) {
+                const int writes = write_count(rng);
+                for (int w = 0; w < writes; ++w) {
+                    uint8_t reg;
+                    uint8_t value;
+                    randomWrite(rng, reg, value);
+                    board.write(c, reg, value);
+                    chips[c].setRegister(reg, value);
+                }
+            }
+            return true;
+        },
+        [&](StreamState& current, int samples) {
+            // Board::mix() と同じ順序で合成する
+            std::vector<float>& block = expected[current.iteration & 1];
+            std::fill(block.begin(), block.end(), 0.0f);
+            for (int c = 0; c < CHIPS; ++c) {
+                chips[c].generate(chip_output.data(), samples);
+                const float angle = (pans[c] + 1.0f) * 0.78539816339744830962f;
+                const float left = gains[c] * std::cos(angle);
+                const float right = gains[c] * std::sin(angle);
+                for (int i = 0; i < samples; ++i) {
+                    block[i * 2] += chip_output[i] * left;
+                    block[i * 2 + 1] += chip_output[i] * right;
+                }
+            }
+
+            board.render(actual.data());
+            if (current.iteration < delay) {
+                return true;
+            }
+            const std::vector<float>& reference = expected[(current.iteration - delay) & 1];
+            for (int i = 0; i < samples; ++i) {
+                split[0][i] = reference[i * 2];
+                split[1][i] = reference[i * 2 + 1];
+                split[2][i] = actual[i * 2];
+                split[3][i] = actual[i * 2 + 1];
+            }
+            // スレッド動作の出力は遅れているので、比較する位置を遅れの分だけ戻す
+            StreamState delayed = current;
+            delayed.position -= static_cast<uint32_t>(delay * BLOCK);
+            const bool same =
+                compareOutputs(delayed, samples, {"chips (left)", split[0].data()}, {{"board (left)", split[2].data()}}) &&
+                compareOutputs(delayed, samples, {"chips (right)", split[1].data()}, {{"board (right)", split[3].data()}});
+            current.max_error = delayed.max_error;
+            return same;
+        },
+        BLOCK);
+    board.stop();
+    if (!ok) {
+        return 1;
+    }
+
+    std::printf("ym2151_diff: board (%d chips, %s, latency %d), %d blocks, seed %u: OK\n",
+                CHIPS, threaded ? "threaded" : "inline", delay * BLOCK, options.iterations, options.seed);
+    return 0;
+}
+
+
+// レベルを別に計算した値（2乗和は倍精度で合計する）
+struct ExpectedLevel {
+    float peak = 0.0f;
+    double squares = 0.0;
+    uint32_t clips = 0;
+
+    void add(float value) {
+        const float level = std::fabs(value);
+        peak = std::max(peak, level);
+        squares += static_cast<double>(level) * level;
+        clips += level > 1.0f ? 1 : 0;
+    }
+};
+
+bool sameLevel(const YM2151::BusLevel& a, const YM2151::BusLevel& b) {
+    return a.peak == b.peak && a.rms == b.rms && a.clips == b.clips &&
+           a.peak_hold == b.peak_hold && a.total_clips == b.total_clips;
+}
+
+// スナップショットの中の値が互いに矛盾しないこと
+bool consistent(const YM2151::LevelSnapshot& snapshot) {
+    const YM2151::BusLevel* buses[YM2151::CHANNEL_COUNT + 1];
+    for (int ch = 0; ch < YM2151::CHANNEL_COUNT; ++ch) {
+        buses[ch] = &snapshot.channels[ch];
+    }
+    buses[YM2151::CHANNEL_COUNT] = &snapshot.master;
+    for (const YM2151::BusLevel* bus : buses) {
+        if (bus->clips > snapshot.samples || bus->total_clips < bus->clips || bus->peak_hold < bus->peak ||
+            bus->rms > bus->peak * 1.0001f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// LevelMeter による計測が出力を変えず、別に計算したレベルと一致することの確認
+int runMeter(const Options& options) {
+    YM2151::Chip chip;
+    YM2151::Chip chip16;
+    YM2151::Chip stem_chip;
+    YM2151::ReferenceChip reference;
+    YM2151::LevelMeter meter;
+    YM2151::LevelMeter meter16;
+    YM2151::LevelMeter stem_meter;
+    chip.setMeter(&meter);
+    chip16.setMeter(&meter16);
+    stem_chip.setMeter(&stem_meter);
+    for (YM2151::Chip* c : {&chip, &chip16, &stem_chip}) {
+        c->setSampleRate(options.sample_rate);
+    }
+    reference.setSampleRate(options.sample_rate);
+
+    // 監視スレッド: 読み出した値が一貫していて、累計が減らないこと
+    std::atomic<bool> done{false};
+    std::atomic<long> reads{0};
+    std::atomic<bool> torn{false};
+    std::thread reader([&] {
+        YM2151::LevelSnapshot previous{};
+        YM2151::LevelSnapshot snapshot;
+        while (!done.load(std::memory_order_relaxed)) {
+            meter.read(snapshot);
+            if (!consistent(snapshot) || snapshot.blocks < previous.blocks ||
+                snapshot.master.total_clips < previous.master.total_clips) {
+                torn.store(true);
+            }
+            previous = snapshot;
+            reads.fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    std::mt19937 rng(options.seed);
+    std::uniform_int_distribution<int> write_count(0, 8);
+
+    std::vector<float> actual(options.max_block);
+    std::vector<int16_t> actual16(options.max_block);
+    std::vector<float> expected(options.max_block);
+    std::vector<float> stem_data(YM2151::CHANNEL_COUNT * options.max_block);
+    float* stems[YM2151::CHANNEL_COUNT];
+    for (int ch = 0; ch < YM2151::CHANNEL_COUNT; ++ch) {
+        stems[ch] = stem_data.data() + ch * options.max_block;
+    }
+
+    uint64_t total_clips = 0;
+    float hold = 0.0f;
+    StreamState state(options);
+    const bool ok = compareStreams(
+        options, rng, state,
+        [&](StreamState& current) {
+            const int writes = write_count(rng);
+            for (int w = 0; w < writes; ++w) {
+                uint8_t reg;
+                uint8_t value;
+                randomWrite(rng, reg, value);
+                chip.setRegister(reg, value);
+                chip16.setRegister(reg, value);
+                stem_chip.setRegister(reg, value);
+                reference.setRegister(reg, value);
+            }
+            if (current.iteration % 97 == 0) {
+                meter.clearHold();
+                hold = 0.0f;
+            }
+            return true;
+        },
+        [&](StreamState& current, int samples) {
+            chip.generate(actual.data(), samples);
+            chip16.generate(actual16.data(), samples);
+            stem_chip.generateStems(stems, samples, nullptr);
+            reference.generate(expected.data(), samples);
+
+            if (!compareOutputs(current, samples, {"reference", expected.data()}, {{"metered", actual.data()}})) {
+                return false;
+            }
+            for (int i = 0; i < samples; ++i) {
+                const int16_t converted = static_cast<int16_t>(std::clamp(actual[i] * 32767.0f, -32768.0f, 32767.0f));
+                if (actual16[i] != converted) {
+                    std::printf("INT16 DIVERGENCE at sample %u (iteration %d, seed %u): %d (expected %d)\n",
+                                current.position + i, current.iteration, options.seed, actual16[i], converted);
+                    return false;
+                }
+            }
+
+            // ステムとミックス出力から計算したレベル
+            ExpectedLevel levels[YM2151::CHANNEL_COUNT + 1];
+            for (int ch = 0; ch < YM2151::CHANNEL_COUNT; ++ch) {
+                for (int i = 0; i < samples; ++i) {
+                    levels[ch].add(stems[ch][i]);
+                }
+            }
+            for (int i = 0; i < samples; ++i) {
+                levels[YM2151::CHANNEL_COUNT].add(actual[i]);
+            }
+            total_clips += levels[YM2151::CHANNEL_COUNT].clips;
+            hold = std::max(hold, levels[YM2151::CHANNEL_COUNT].peak);
+
+            YM2151::LevelSnapshot snapshot;
+            YM2151::LevelSnapshot snapshot16;
+            YM2151::LevelSnapshot stem_snapshot;
+            meter.read(snapshot);
+            meter16.read(snapshot16);
+            stem_meter.read(stem_snapshot);
+
+            for (int bus = 0; bus <= YM2151::CHANNEL_COUNT; ++bus) {
+                const bool master = bus == YM2151::CHANNEL_COUNT;
+                const YM2151::BusLevel& level = master ? snapshot.master : snapshot.channels[bus];
+                const YM2151::BusLevel& level16 = master ? snapshot16.master : snapshot16.channels[bus];
+                const YM2151::BusLevel& stem_level = master ? stem_snapshot.master : stem_snapshot.channels[bus];
+                const double rms = std::sqrt(levels[bus].squares / samples);
+                // ピークホールドの解除は meter だけに依頼しているので、他のメーターとは比べない
+                YM2151::BusLevel compared16 = level16;
+                YM2151::BusLevel compared_stem = stem_level;
+                compared16.peak_hold = compared_stem.peak_hold = level.peak_hold;
+
+                if (level.peak != levels[bus].peak || level.clips != levels[bus].clips ||
+                    std::fabs(level.rms - rms) > 1e-4 * rms ||
+                    !sameLevel(level, compared16) || !sameLevel(level, compared_stem) ||
+                    (master && (level.total_clips != total_clips || level.peak_hold != hold))) {
+                    std::printf("METER MISMATCH on %s%d (iteration %d, seed %u)\n",
+                                master ? "master" : "channel ", master ? 0 : bus, current.iteration, options.seed);
+                    std::printf("  expected: peak %.9g rms %.9g clips %u\n", levels[bus].peak, rms, levels[bus].clips);
+                    std::printf("  generate: peak %.9g rms %.9g clips %u hold %.9g total %llu\n", level.peak,
+                                level.rms, level.clips, level.peak_hold,
+                                static_cast<unsigned long long>(level.total_clips));
+                    std::printf("  int16:    peak %.9g rms %.9g clips %u\n", level16.peak, level16.rms, level16.clips);
+                    std::printf("  stems:    peak %.9g rms %.9g clips %u\n", stem_level.peak, stem_level.rms,
+                                stem_level.clips);
+                    return false;
+                }
+            }
+            if (snapshot.blocks != static_cast<uint64_t>(current.iteration) + 1 ||
+                snapshot.samples != static_cast<uint32_t>(samples)) {
+                std::printf("METER MISMATCH: %llu blocks, %u samples (expected %d, %d)\n",
+                            static_cast<unsigned long long>(snapshot.blocks), snapshot.samples, current.iteration + 1,
+                            samples);
+                return false;
+            }
+            return true;
+        });
+
+    done.store(true);
+    reader.join();
+    if (!ok) {
+        return 1;
+    }
+    if (torn.load()) {
+        std::printf("METER: the reader thread saw an inconsistent snapshot (seed %u)\n", options.seed);
+        return 1;
+    }
+    std::printf("ym2151_diff: meter, %d iterations, %u samples, %ld concurrent reads, seed %u: OK\n",
+                options.iterations, state.position, reads.load(), options.seed);
+    return 0;
+}
+
+// NoteCache を取り付けても出力が変わらないことの確認
+int runNoteCache(const Options& options) {
+    // 追い出しが起きるよう、ジングル数曲分より小さい容量にする
+    YM2151::NoteCache cache(256 * 1024);
+    YM2151::Chip cached;
+    YM2151::Chip plain;
+    cached.setNoteCache(&cache);
+    cached.setSampleRate(options.sample_rate);
+    plain.setSampleRate(options.sample_rate);
+
+    std::mt19937 rng(options.seed);
+    std::uniform_int_distribution<int> pattern_count(0, 11);
+    std::uniform_int_distribution<int> write_count(0, 8);
+    std::uniform_int_distribution<int> block_size(1, options.max_block);
+    std::uniform_int_distribution<int> percent(0, 99);
+
+    std::vector<float> actual(options.max_block);
+    std::vector<float> expected(options.max_block);
+
+    // 両方のチップに同じ操作を行う
+    auto write = [&](uint8_t reg, uint8_t value) {
+        cached.setRegister(reg, value);
+        plain.setRegister(reg, value);
+    };
+    auto compare = [&](StreamState& current, int samples) {
+        cached.generate(actual.data(), samples);
+        plain.generate(expected.data(), samples);
+        if (!compareOutputs(current, samples, {"without cache", expected.data()}, {{"with cache", actual.data()}})) {
+            printRegisters(cached);
+            return false;
+        }
+        return true;
+    };
+    // ノート1つ分を max_block ごとに区切って生成する（compareStreams の外で位置を進める）
+    auto play = [&](StreamState& current, int samples) {
+        while (samples > 0) {
+            const int count = std::min(samples, options.max_block);
+            if (!compare(current, count)) {
+                return false;
+            }
+            current.position += static_cast<uint32_t>(count);
+            samples -= count;
+        }
+        return true;
+    };
+
+    // 60% はリセットしてからジングル（パターンごとに決まった書き込みと長さ）を鳴らし、
+    // 残りはランダムな書き込み（発音途中の周波数・アルゴリズムの変更、LFO を含む）を与える。
+    // どちらの後もランダムな長さのブロックを1つ生成する
+    StreamState state(options);
+    const bool ok = compareStreams(
+        options, rng, state,
+        [&](StreamState& current) {
+            if (percent(rng) >= 60) {
+                const int writes = write_count(rng);
+                for (int w = 0; w < writes; ++w) {
+                    uint8_t reg;
+                    uint8_t value;
+                    randomWrite(rng, reg, value);
+                    write(reg, value);
+                }
+                return true;
+            }
+            cached.reset();
+            plain.reset();
+            std::mt19937 pattern(static_cast<uint32_t>(pattern_count(rng)) + 1000);
+            std::uniform_int_distribution<int> channel(0, 7);
+            std::uniform_int_distribution<int> length(1, 3000);
+            std::uniform_int_distribution<int> byte(0, 255);
+            const int notes = 2 + pattern() % 5;
+            for (int n = 0; n < notes; ++n) {
+                const int ch = channel(pattern);
+                const uint16_t freq = static_cast<uint16_t>(std::uniform_int_distribution<int>(20, 4000)(pattern));
+                write(static_cast<uint8_t>(0x20 + ch), static_cast<uint8_t>(byte(pattern)));
+                write(static_cast<uint8_t>(0x10 + ch), static_cast<uint8_t>(freq & 0xFF));
+                write(static_cast<uint8_t>(0x18 + ch), static_cast<uint8_t>(freq >> 8));
+                if (pattern() % 4 == 0) {
+                    YM2151::FMParameter param{};
+                    param.mul = static_cast<uint8_t>(pattern() % 16);
+                    param.ar = static_cast<uint8_t>(pattern() % 32);
+                    param.dr = static_cast<uint8_t>(pattern() % 32);
+                    param.sl = static_cast<uint8_t>(pattern() % 16);
+                    param.rr = static_cast<uint8_t>(pattern() % 16);
+                    const int op = static_cast<int>(pattern() % 4);
+                    cached.getChannel(ch).getOperator(op).setParameter(param);
+                    plain.getChannel(ch).getOperator(op).setParameter(param);
+                }
+                write(0x08, static_cast<uint8_t>(0x80 | ch));
+
+                // 時々キーオフを早める（キャッシュしたノートの途中で止める）
+                int samples = length(pattern);
+                if (percent(rng) < 20) {
+                    samples = std::max(1, samples - std::uniform_int_distribution<int>(0, samples)(rng));
+                }
+                if (!play(current, samples)) {
+                    return false;
+                }
+                if (pattern() % 2 == 0) {
+                    write(0x08, static_cast<uint8_t>(ch));
+                }
+            }
+            return true;
+        },
+        compare);
+    if (!ok) {
+        return 1;
+    }
+    cached.setNoteCache(nullptr);
+
+    const YM2151::NoteCacheStats stats = cache.stats();
+    if (stats.hits == 0 || stats.evictions == 0) {
+        std::printf("NOTE CACHE: expected hits and evictions (hits %llu, evictions %llu, seed %u)\n",
+                    static_cast<unsigned long long>(stats.hits), static_cast<unsigned long long>(stats.evictions),
+                    options.seed);
+        return 1;
+    }
+
+    // 長いノートを記録してから、記録と違う長さでキーオフするヒットを繰り返す
+    // （状態を戻すための計算し直しはページの先頭からなので PAGE_SIZE 未満に収まること）
+    constexpr int LONG_NOTE = 40 * static_cast<int>(YM2151::NoteCache::PAGE_SIZE);
+    YM2151::NoteCache long_cache(4 * 1024 * 1024);
+    cached.setNoteCache(&long_cache);
+    std::uniform_int_distribution<int> long_length(1, LONG_NOTE);
+    for (int round = 0; round < 30; ++round) {
+        state.iteration = options.iterations + round;
+        cached.reset();
+        plain.reset();
+        write(0x20, 0xC5);
+        write(0x10, 0x6E);
+        write(0x18, 0x01);
+        write(0x08, 0x80);
+        if (!play(state, round == 0 ? LONG_NOTE : long_length(rng))) {
+            return 1;
+        }
+        write(0x08, 0x00);
+        if (!play(state, block_size(rng))) {
+            return 1;
+        }
+    }
+    cached.setNoteCache(nullptr);
+
+    const YM2151::NoteCacheStats long_stats = long_cache.stats();
+    const uint32_t max_resimulated = std::max(stats.max_resimulated, long_stats.max_resimulated);
+    if (long_stats.hits < 29 || max_resimulated >= YM2151::NoteCache::PAGE_SIZE) {
+        std::printf("NOTE CACHE: long note hits %llu (expected 29), longest resimulation %u samples "
+                    "(limit %zu, seed %u)\n",
+                    static_cast<unsigned long long>(long_stats.hits), max_resimulated,
+                    YM2151::NoteCache::PAGE_SIZE - 1, options.seed);
+        return 1;
+    }
+    std::printf("ym2151_diff: note cache, %d iterations, %u samples, seed %u: OK\n",
+                options.iterations, state.position, options.seed);
+    std::printf("  hits %llu, misses %llu, uncacheable %llu, evictions %llu, cached samples %llu, "
+                "resimulated %llu (longest %u), %zu entries, %zu / %zu bytes\n",
+                static_cast<unsigned long long>(stats.hits), static_cast<unsigned long long>(stats.misses),
+                static_cast<unsigned long long>(stats.uncacheable), static_cast<unsigned long long>(stats.evictions),
+                static_cast<unsigned long long>(stats.cached_samples),
+                static_cast<unsigned long long>(stats.resimulated_samples + long_stats.resimulated_samples),
+                max_resimulated, stats.entries, stats.used_bytes, stats.capacity_bytes);
+    return 0;
+}
+
+// OfflineRenderer の並列生成と1つの Chip での順次生成の比較
+int runOffline(const Options& options) {
+    std::mt19937 rng(options.seed);
+    std::uniform_int_distribution<int> write_count(0, 8);
+    std::uniform_int_distribution<int> block_size(1, options.max_block);
+    std::uniform_int_distribution<int> long_gap(0, 7);
+    std::uniform_int_distribution<int> silence(1000, 20000);
+
+    // ウィンドウの境界をまたぐように、時々長い無音を挟む
+    YM2151::RegisterStream stream;
+    uint32_t time = 0;
+    for (int iteration = 0; iteration < options.iterations; ++iteration) {
+        const int writes = write_count(rng);
+        for (int w = 0; w < writes; ++w) {
+            uint8_t reg;
+            uint8_t value;
+            randomWrite(rng, reg, value);
+            stream.writes.push_back(YM2151::TimedWrite{time, reg, value});
+        }
+        time += static_cast<uint32_t>(long_gap(rng) == 0 ? silence(rng) : block_size(rng));
+    }
+    stream.total_samples = time;
+    const uint32_t tail = static_cast<uint32_t>(block_size(rng));
+    const size_t total = static_cast<size_t>(stream.total_samples) + tail;
+
+    // 書き込みの時刻で区切って順に生成する（ym2151_render と同じ手順。
+    // 書き込みのない区間もランダムな長さの呼び出しに分ける）
+    YM2151::Chip chip(stream.clock);
+    YM2151::Chip stem_chip(stream.clock);
+    chip.setSampleRate(options.sample_rate);
+    stem_chip.setSampleRate(options.sample_rate);
+    chip.setControlRate(options.control_rate);
+    stem_chip.setControlRate(options.control_rate);
+    std::vector<float> expected(total);
+    YM2151::OfflineStems expected_stems;
+    for (std::vector<float>& stem : expected_stems) {
+        stem.resize(total);
+    }
+    size_t next_write = 0;
+    size_t position = 0;
+    while (position < total) {
+        const int samples = static_cast<int>(std::min<size_t>(total - position, block_size(rng)));
+        YM2151::renderBetweenWrites(
+            stream.writes, next_write, position, samples,
+            [&](const YM2151::TimedWrite& write) {
+                chip.setRegister(write.reg, write.value);
+                stem_chip.setRegister(write.reg, write.value);
+            },
+            [&](int offset, int count) {
+                chip.generate(expected.data() + position + offset, count);
+                float* stems[YM2151::CHANNEL_COUNT];
+                for (int ch = 0; ch < YM2151::CHANNEL_COUNT; ++ch) {
+                    stems[ch] = expected_stems[ch].data() + position + offset;
+                }
+                stem_chip.generateStems(stems, count);
+            });
+        position += samples;
+    }
+
+    for (int threads : {1, 3, YM2151::CHANNEL_COUNT}) {
+        YM2151::OfflineRenderer renderer(options.sample_rate, threads);
+        renderer.setControlRate(options.control_rate);
+        std::vector<float> mix;
+        YM2151::OfflineStems stems;
+        std::string error;
+        if (!renderer.render(stream, tail, mix, threads == 1 ? nullptr : &stems, &error)) {
+            std::printf("OFFLINE RENDER ERROR: %s\n", error.c_str());
+            return 1;
+        }
+        if (mix.size() != total) {
+            std::printf("OFFLINE LENGTH MISMATCH: %zu samples (expected %zu)\n", mix.size(), total);
+            return 1;
+        }
+        StreamState state(options);
+        state.detail = std::to_string(threads) + " threads";
+        if (!compareOutputs(state, static_cast<int>(total), {"serial", expected.data()}, {{"parallel", mix.data()}})) {
+            return 1;
+        }
+        if (threads == 1) {
+            continue;
+        }
+        for (int ch = 0; ch < YM2151::CHANNEL_COUNT; ++ch) {
+            state.detail = "channel " + std::to_string(ch) + " stem, " + std::to_string(threads) + " threads";
+            if (!compareOutputs(state, static_cast<int>(total), {"serial", expected_stems[ch].data()},
+                                {{"parallel", stems[ch].data()}})) {
+                return 1;
+            }
+        }
+    }
+
+    std::printf("ym2151_diff: offline, %d iterations, %zu samples, %zu writes, control rate %d, seed %u: OK\n",
+                options.iterations, total, stream.writes.size(), options.control_rate, options.seed);
+    return 0;
+}
+
+// 書き込みの対象チャンネルを channel に置き換える（チャンネルを問わない書き込みは -1 を返す）
+int retarget(uint8_t& reg, uint8_t& value, int channel) {
+    if (reg == 0x08) {
+        const int original = value & 0x07;
+        value = static_cast<uint8_t>((value & 0xF8) | channel);
+        return original;
+    }
+    if (reg >= 0x10 && reg <= 0x27) {
+        const int original = reg & 0x07;
+        reg = static_cast<uint8_t>((reg & 0xF8) | channel);
+        return original;
+    }
+    return -1;
+}
+
+// 同じ書き込みを与えたチャンネルの組（重複チャンネル）の出力とリファレンス実装の比較
+int runUnison(const Options& options) {
+    YM2151::Chip chip;
+    YM2151::ReferenceChip reference;
+    chip.setSampleRate(options.sample_rate);
+    reference.setSampleRate(options.sample_rate);
+
+    std::mt19937 rng(options.seed);
+    std::uniform_int_distribution<int> write_count(0, 6);
+    std::uniform_int_distribution<int> percent(0, 99);
+
+    std::vector<float> actual(options.max_block);
+    std::vector<float> expected(options.max_block);
+
+    // チャンネルの組（group[ch] が同じチャンネルに同じ書き込みを与える）
+    std::array<int, YM2151::CHANNEL_COUNT> group{};
+    auto regroup = [&] {
+        int next = 0;
+        for (int ch = 0; ch < YM2151::CHANNEL_COUNT;) {
+            const int size = std::uniform_int_distribution<int>(1, 3)(rng);
+            for (int i = 0; i < size && ch < YM2151::CHANNEL_COUNT; ++i) {
+                group[ch++] = next;
+            }
+            ++next;
+        }
+        // 組の並びをばらばらにする（計算元が番号の小さいチャンネルとは限らない）
+        std::shuffle(group.begin(), group.end(), rng);
+    };
+    auto write = [&](uint8_t reg, uint8_t value) {
+        chip.setRegister(reg, value);
+        reference.setRegister(reg, value);
+    };
+
+    regroup();
+    WriteLog log;
+    uint64_t shared_blocks = 0;
+    uint64_t splits = 0;
+    int previous_shared = 0;
+
+    StreamState state(options);
+    const bool ok = compareStreams(
+        options, rng, state,
+        [&](StreamState& current) {
+            // 時々リセットして組を作り直す（位相がそろう）
+            if (percent(rng) < 5) {
+                chip.reset();
+                reference.reset();
+                regroup();
+                previous_shared = 0;
+            }
+
+            const int writes = write_count(rng);
+            for (int w = 0; w < writes; ++w) {
+                uint8_t reg;
+                uint8_t value;
+                randomWrite(rng, reg, value);
+                const int target = retarget(reg, value, 0);
+                if (target < 0) {
+                    write(reg, value);
+                    log.add(current.position, reg, value);
+                    continue;
+                }
+                // 10% は1チャンネルだけ（組の状態がずれる）、それ以外は組の全員に書き込む
+                const bool single = percent(rng) < 10;
+                for (int ch = 0; ch < YM2151::CHANNEL_COUNT; ++ch) {
+                    if (single ? ch == target : group[ch] == group[target]) {
+                        uint8_t r = reg;
+                        uint8_t v = value;
+                        retarget(r, v, ch);
+                        write(r, v);
+                        log.add(current.position, r, v);
+                    }
+                }
+            }
+            return true;
+        },
+        [&](StreamState& current, int samples) {
+            chip.generate(actual.data(), samples);
+            reference.generate(expected.data(), samples);
+
+            const int shared = chip.sharedChannelCount();
+            if (shared > 0) {
+                ++shared_blocks;
+            }
+            if (shared < previous_shared) {
+                ++splits;
+            }
+            previous_shared = shared;
+
+            current.detail = std::to_string(shared) + " shared channels";
+            if (!compareOutputs(current, samples, {"reference", expected.data()}, {{"generate", actual.data()}})) {
+                printRegisters(chip);
+                log.print();
+                return false;
+            }
+            return true;
+        });
+    if (!ok) {
+        return 1;
+    }
+
+    // 重複チャンネルの共有とその解除が起きていなければ確認にならない
+    if (shared_blocks == 0 || splits == 0) {
+        std::printf("UNISON NOT EXERCISED: %llu blocks with shared channels, %llu splits (seed %u)\n",
+                    static_cast<unsigned long long>(shared_blocks), static_cast<unsigned long long>(splits),
+                    options.seed);
+        return 1;
+    }
+
+    std::printf("ym2151_diff: unison, %d iterations, %u samples, seed %u: OK\n"
+                "  %llu blocks with shared channels, %llu splits\n",
+                options.iterations, state.position, options.seed,
+                static_cast<unsigned long long>(shared_blocks), static_cast<unsigned long long>(splits));
+    return 0;
+}
+
+// MidiDriver の期待する書き込みを求めるモデル
+// ボイスの選び方（空きボイスは番号順、次に最も古いリリース中、次に最も古い発音中）を
+// リストを使わずに毎回全ボイスを調べて求める
+class MidiModel {
+public:
+    explicit MidiModel(const YM2151::PatchBank& bank) : bank_(bank) {
+        program_.fill(0);
+    }
+
+    void noteOn(uint32_t time, int midi_channel, int note) {
+        int v = find(midi_channel, note, false);
+        if (v < 0) {
+            v = pick();
+        }
+        const YM2151::Patch* patch = nullptr;
+        if (voices_[v].program != program_[midi_channel]) {
+            patch = bank_.find(program_[midi_channel]);
+        }
+        if (!fits(4 + (patch ? patch->count : 0))) {
+            return;
+        }
+        if (voices_[v].state != FREE && (voices_[v].midi_channel != midi_channel || voices_[v].note != note)) {
+            ++steals;
+        }
+        emit(time, 0x08, static_cast<uint8_t>(v));
+        if (patch) {
+            for (int i = 0; i < patch->count; ++i) {
+                emit(time, static_cast<uint8_t>(patch->registers[i].reg + v), patch->registers[i].value);
+                ++patch_writes;
+            }
+        }
+        voices_[v].program = program_[midi_channel];
+        const uint16_t frequency = YM2151::midiNoteToFrequency(static_cast<uint8_t>(note));
+        emit(time, static_cast<uint8_t>(0x10 + v), frequency & 0xFF);
+        emit(time, static_cast<uint8_t>(0x18 + v), frequency >> 8);
+        emit(time, 0x08, static_cast<uint8_t>(0x80 | v));
+        voices_[v] = Voice{HELD, midi_channel, note, voices_[v].program, ++stamp_};
+    }
+
+    void noteOff(uint32_t time, int midi_channel, int note) {
+        const int v = find(midi_channel, note, true);
+        if (v < 0 || !fits(1)) {
+            return;
+        }
+        release(time, v);
+    }
+
+    void allNotesOff(uint32_t time) {
+        std::vector<int> held;
+        for (int v = 0; v < YM2151::CHANNEL_COUNT; ++v) {
+            if (voices_[v].state == HELD) {
+                held.push_back(v);
+            }
+        }
+        std::sort(held.begin(), held.end(), [this](int a, int b) { return voices_[a].stamp < voices_[b].stamp; });
+        if (held.empty() || !fits(held.size())) {
+            return;
+        }
+        for (int v : held) {
+            release(time, v);
+        }
+    }
+
+    void programChange(int midi_channel, int program) {
+        program_[midi_channel] = program;
+    }
+
+    // driver の現在時刻より前の書き込みは生成済み（キューから取り出されている）
+    void advance(uint32_t now) {
+        while (popped_ < writes.size() && writes[popped_].time < now) {
+            ++popped_;
+        }
+    }
+
+    size_t pending() const {
+        return writes.size() - popped_;
+    }
+
+    std::vector<YM2151::TimedWrite> writes;
+    uint32_t dropped_events = 0;
+    uint32_t dropped_writes = 0;
+    uint64_t steals = 0;
+    uint64_t patch_writes = 0;
+
+private:
+    enum State { FREE, HELD, RELEASED };
+
+    struct Voice {
+        State state = FREE;
+        int midi_channel = 0;
+        int note = 0;
+        int program = -1;
+        uint64_t stamp = 0;
+    };
+
+    int find(int midi_channel, int note, bool held_only) const {
+        for (int v = 0; v < YM2151::CHANNEL_COUNT; ++v) {
+            const Voice& voice = voices_[v];
+            if (voice.state != FREE && voice.midi_channel == midi_channel && voice.note == note) {
+                return !held_only || voice.state == HELD ? v : -1;
+            }
+        }
+        return -1;
+    }
+
+    int pick() const {
+        for (int v = 0; v < YM2151::CHANNEL_COUNT; ++v) {
+            if (voices_[v].state == FREE) {
+                return v;
+            }
+        }
+        for (State state : {RELEASED, HELD}) {
+            int oldest = -1;
+            for (int v = 0; v < YM2151::CHANNEL_COUNT; ++v) {
+                if (voices_[v].state == state && (oldest < 0 || voices_[v].stamp < voices_[oldest].stamp)) {
+                    oldest = v;
+                }
+            }
+            if (oldest >= 0) {
+                return oldest;
+            }
+        }
+        return 0;
+    }
+
+    bool fits(size_t count) {
+        if (pending() + count <= YM2151::MidiDriver::QUEUE_CAPACITY) {
+            return true;
+        }
+        ++dropped_events;
+        dropped_writes += static_cast<uint32_t>(count);
+        return false;
+    }
+
+    void release(uint32_t time, int v) {
+        emit(time, 0x08, static_cast<uint8_t>(v));
+        voices_[v].state = RELEASED;
+        voices_[v].stamp = ++stamp_;
+    }
+
+    void emit(uint32_t time, uint8_t reg, uint8_t value) {
+        writes.push_back(YM2151::TimedWrite{time, reg, value});
+    }
+
+    const YM2151::PatchBank& bank_;
+    std::array<Voice, YM2151::CHANNEL_COUNT> voices_{};
+    std::array<int, YM2151::MIDI_CHANNEL_COUNT> program_{};
+    uint64_t stamp_ = 0;
+    size_t popped_ = 0;
+};
+
+// MidiDriver の出力と、モデルが求めた書き込みをその時刻に与えた Chip の出力の比較
+int runMidi(const Options& options) {
+    std::mt19937 rng(options.seed);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::uniform_int_distribution<int> percent(0, 99);
+    std::uniform_int_distribution<int> midi_channel(0, 3);
+    std::uniform_int_distribution<int> note(48, 60);   // 同じノートの再発音が起きやすい狭い範囲
+
+    // 音色 0, 1, 2, 5（他のプログラムは音色なし）。アルゴリズムと帰還量を変えて出力に差が出るようにする
+    YM2151::PatchBank bank;
+    for (int number : {0, 1, 2, 5}) {
+        YM2151::Patch patch;
+        patch.number = number;
+        patch.registers[patch.count++] = YM2151::RegWrite{0x20, static_cast<uint8_t>(byte(rng))};
+        patch.registers[patch.count++] = YM2151::RegWrite{0x38, static_cast<uint8_t>(byte(rng))};
+        const int operators = std::uniform_int_distribution<int>(0, 24)(rng);
+        for (int i = 0; i < operators; ++i) {
+            patch.registers[patch.count++] =
+                YM2151::RegWrite{static_cast<uint8_t>(0x40 + i * 8), static_cast<uint8_t>(byte(rng))};
+        }
+        bank.add(patch);
+    }
+
+    YM2151::MidiDriver driver;
+    driver.setPatchBank(&bank);
+    MidiModel model(bank);
+    YM2151::Chip chip;
+    YM2151::Chip expected_chip;
+    chip.setSampleRate(options.sample_rate);
+    expected_chip.setSampleRate(options.sample_rate);
+
+    std::vector<float> actual(options.max_block);
+    std::vector<float> expected(options.max_block);
+    uint32_t event_time = 0;
+    size_t next_write = 0;
+    uint64_t events = 0;
+
+    StreamState state(options);
+    const bool ok = compareStreams(
+        options, rng, state,
+        [&](StreamState& current) {
+            const uint32_t now = driver.currentTime();
+            model.advance(now);
+
+            // イベント（時刻は単調増加。時々キューが溢れる量の同時発音を先の時刻にまとめて送る）
+            const bool burst = percent(rng) < 3;
+            const int count = burst ? 300 : std::uniform_int_distribution<int>(0, 5)(rng);
+            for (int e = 0; e < count; ++e) {
+                event_time = std::max(event_time, now) +
+                             static_cast<uint32_t>(burst ? 0 : std::uniform_int_distribution<int>(0, options.max_block / 4)(rng));
+                const int ch = midi_channel(rng);
+                const int k = burst ? (e % 3 == 0 ? 90 : 0) : percent(rng);
+                uint8_t message[3];
+                if (k < 45) {
+                    // ノートオン（10% はベロシティ0 = ノートオフ）
+                    const int n = note(rng);
+                    const bool zero = percent(rng) < 10;
+                    message[0] = static_cast<uint8_t>(0x90 | ch);
+                    message[1] = static_cast<uint8_t>(n);
+                    message[2] = static_cast<uint8_t>(zero ? 0 : 1 + byte(rng) % 127);
+                    driver.processMessage(event_time, message, 3);
+                    if (zero) {
+                        model.noteOff(event_time, ch, n);
+                    } else {
+                        model.noteOn(event_time, ch, n);
+                    }
+                } else if (k < 80) {
+                    const int n = note(rng);
+                    message[0] = static_cast<uint8_t>(0x80 | ch);
+                    message[1] = static_cast<uint8_t>(n);
+                    message[2] = 64;
+                    driver.processMessage(event_time, message, 3);
+                    model.noteOff(event_time, ch, n);
+                } else if (k < 95) {
+                    const int program = std::uniform_int_distribution<int>(0, 6)(rng);
+                    message[0] = static_cast<uint8_t>(0xC0 | ch);
+                    message[1] = static_cast<uint8_t>(program);
+                    driver.processMessage(event_time, message, 2);
+                    model.programChange(ch, program);
+                } else {
+                    message[0] = static_cast<uint8_t>(0xB0 | ch);
+                    message[1] = percent(rng) < 50 ? 123 : 120;
+                    message[2] = 0;
+                    driver.processMessage(event_time, message, 3);
+                    model.allNotesOff(event_time);
+                }
+                ++events;
+            }
+
+            if (driver.pendingWrites() != model.pending() || driver.droppedEvents() != model.dropped_events ||
+                driver.droppedWrites() != model.dropped_writes) {
+                std::printf("QUEUE MISMATCH at sample %u (iteration %d, seed %u): pending %zu (expected %zu), "
+                            "dropped %u events / %u writes (expected %u / %u)\n",
+                            now, current.iteration, options.seed, driver.pendingWrites(), model.pending(),
+                            driver.droppedEvents(), driver.droppedWrites(), model.dropped_events, model.dropped_writes);
+                return false;
+            }
+            return true;
+        },
+        [&](StreamState& current, int samples) {
+            // 期待値: モデルの書き込みをその時刻に与えながら生成する
+            driver.render(chip, actual.data(), samples);
+            YM2151::renderWrites(expected_chip, model.writes, next_write, current.position, expected.data(), samples);
+            if (!compareOutputs(current, samples, {"expected", expected.data()}, {{"MidiDriver", actual.data()}})) {
+                printRegisters(chip);
+                return false;
+            }
+            return true;
+        });
+    if (!ok) {
+        return 1;
+    }
+
+    if (model.dropped_events == 0 || model.steals == 0) {
+        std::printf("MIDI NOT EXERCISED: %u dropped events, %llu steals (seed %u)\n", model.dropped_events,
+                    static_cast<unsigned long long>(model.steals), options.seed);
+        return 1;
+    }
+
+    std::printf("ym2151_diff: midi, %d iterations, %u samples, seed %u: OK\n"
+                "  %llu events, %zu writes (%llu patch), %llu steals, %u events dropped (%u writes)\n",
+                options.iterations, driver.currentTime(), options.seed, static_cast<unsigned long long>(events),
+                model.writes.size(), static_cast<unsigned long long>(model.patch_writes),
+                static_cast<unsigned long long>(model.steals), model.dropped_events, model.dropped_writes);
+    return 0;
+}
+
+// 制御レート N（8 / 16 / 32）の Chip と、サンプルごとに更新するリファレンス実装の比較
+// 制御レートを上げるとエンベロープは区間の両端の値の線形補間になり、状態の切り替えも
+// 区間の終わりまで遅れるので、出力はビット単位では一致しない。その差を許容誤差の範囲で確認する。
+// オペレータのレジスタはまだ解釈されないので、キーオンの直前にチャンネルの4オペレータに
+// ランダムなエンベロープのパラメータを両方に設定する（制御レート1ではビット単位で一致する）。
+// このコアの変調量はエンベロープ1あたり8192ラジアンなので、モジュレータのエンベロープの
+// わずかな差でもキャリアの位相が大きくずれ、差の大きさに意味がなくなる。そのため
+// 全オペレータがキャリアで帰還なし（CON = 7, FB = 0）のチャンネルだけで比較する。
+// LFOは出力に影響しない（値を参照する処理がない）ので、LFO周波数の書き込みも混ぜておく。
+//
+// 許容誤差（制御レート1はビット単位で一致、または --tolerance 以内）:
+// - 各サンプルの誤差が、オペレータ1つのフルスケール（2 × 8192 × 出力ゲイン100）の
+//   0.2 / 0.35 / 0.7 倍（N = 8 / 16 / 32）以下。計測値の最大（およそ 0.14 / 0.28 / 0.54 倍。
+//   速いアタックを線形補間する誤差が大部分）に約1.3倍の余裕を加えた値で、
+//   補間の誤りで誤差が1.5倍程度に増えれば検出できる
+// - 誤差の実効値がリファレンス出力の実効値の 1% / 2% / 4% 以下
+//   （計測値は最大でおよそ 0.5% / 1.0% / 2.1%）
+// どちらもキーオン/オフから N サンプルは除く。キーオンではエンベロープが即座に変わるのに対して、
+// 区間の終わりまでの線形補間で追いかけるので、この間の誤差はチャンネルの振幅程度になる。
+int runControlRateReference(const Options& options) {
+    struct Limit {
+        int rate;
+        float sample;   // 1サンプルの誤差（オペレータ1つのフルスケールに対する比）
+        double rms;     // 誤差の実効値（リファレンス出力の実効値に対する比）
+    };
+    const Limit limits[] = {{1, 0.0f, 0.0}, {8, 0.2f, 0.01}, {16, 0.35f, 0.02}, {32, 0.7f, 0.04}};
+    constexpr float OPERATOR_FULL_SCALE = 2.0f * 8192.0f * 100.0f;
+
+    for (const Limit& limit : limits) {
+        const int rate = limit.rate;
+        YM2151::Chip chip;
+        YM2151::Chip stem_chip;
+        YM2151::ReferenceChip reference;
+        chip.setSampleRate(options.sample_rate);
+        stem_chip.setSampleRate(options.sample_rate);
+        reference.setSampleRate(options.sample_rate);
+        chip.setControlRate(rate);
+        stem_chip.setControlRate(rate);
+
+        std::mt19937 rng(options.seed);
+        std::uniform_int_distribution<int> byte(0, 255);
+        std::uniform_int_distribution<int> kind(0, 99);
+        std::uniform_int_distribution<int> channel(0, 7);
+        std::uniform_int_distribution<int> write_count(0, 4);
+
+        std::vector<float> actual(options.max_block);
+        std::vector<float> stem_mix(options.max_block);
+        std::vector<float> expected(options.max_block);
+        std::vector<float> stem_data(YM2151::CHANNEL_COUNT * options.max_block);
+        float* stems[YM2151::CHANNEL_COUNT];
+        for (int ch = 0; ch < YM2151::CHANNEL_COUNT; ++ch) {
+            stems[ch] = stem_data.data() + ch * options.max_block;
+        }
+
+        StreamState state(options);
+        state.detail = "control rate " + std::to_string(rate);
+        if (rate > 1) {
+            state.tolerance = OPERATOR_FULL_SCALE * limit.sample;
+        }
+        WriteLog log;
+        uint32_t transient_end = 0;
+        double squared_error = 0.0;
+        double squared_signal = 0.0;
+
+        auto write = [&](uint8_t reg, uint8_t value) {
+            chip.setRegister(reg, value);
+            stem_chip.setRegister(reg, value);
+            reference.setRegister(reg, value);
+            log.add(state.position, reg, value);
+        };
+        for (int ch = 0; ch < YM2151::CHANNEL_COUNT; ++ch) {
+            write(static_cast<uint8_t>(0x20 + ch), 0xC7);
+        }
+
+        auto apply = [&](StreamState& current) {
+            const int writes = write_count(rng);
+            for (int w = 0; w < writes; ++w) {
+                const int k = kind(rng);
+                const int ch = channel(rng);
+                if (k < 50) {
+                    const bool key_on = (byte(rng) & 0x80) != 0;
+                    if (key_on) {
+                        for (int op = 0; op < 4; ++op) {
+                            YM2151::FMParameter param{};
+                            param.mul = 1;
+                            param.tl = 127;
+                            param.ar = static_cast<uint8_t>(byte(rng) & 0x1F);
+                            param.dr = static_cast<uint8_t>(byte(rng) & 0x1F);
+                            param.sr = static_cast<uint8_t>(byte(rng) & 0x1F);
+                            param.sl = static_cast<uint8_t>(byte(rng) & 0x0F);
+                            param.rr = static_cast<uint8_t>(byte(rng) & 0x0F);
+                            chip.getChannel(ch).getOperator(op).setParameter(param);
+                            stem_chip.getChannel(ch).getOperator(op).setParameter(param);
+                            reference.setOperatorParameter(ch, op, param);
+                        }
+                    }
+                    write(0x08, static_cast<uint8_t>((key_on ? 0x80 : 0x00) | 0x78 | ch));
+                    transient_end = current.position + rate;
+                } else if (k < 85) {
+                    const int freq = std::uniform_int_distribution<int>(20, 8000)(rng);
+                    write(static_cast<uint8_t>(0x10 + ch), static_cast<uint8_t>(freq & 0xFF));
+                    write(static_cast<uint8_t>(0x18 + ch), static_cast<uint8_t>(freq >> 8));
+                } else if (k < 95) {
+                    // RL だけを変える（CON = 7, FB = 0 のまま）
+                    write(static_cast<uint8_t>(0x20 + ch), static_cast<uint8_t>((byte(rng) & 0xC0) | 0x07));
+                } else {
+                    write(0x01, static_cast<uint8_t>(byte(rng)));
+                }
+            }
+            return true;
+        };
+        auto compare = [&](StreamState& current, int samples) {
+            chip.generate(actual.data(), samples);
+            stem_chip.generateStems(stems, samples, stem_mix.data());
+            reference.generate(expected.data(), samples);
+
+            // キーオン / オフの直後 rate サンプルは、制御レートの更新を待つ過渡として比較しない
+            int begin = 0;
+            if (rate > 1 && transient_end > current.position) {
+                begin = static_cast<int>(std::min<uint32_t>(static_cast<uint32_t>(samples), transient_end - current.position));
+            }
+            if (!compareOutputs(current, samples, {"reference", expected.data()},
+                                {{"generate", actual.data()}, {"generateStems", stem_mix.data()}}, begin)) {
+                printRegisters(chip);
+                log.print();
+                return false;
+            }
+            for (int i = begin; i < samples; ++i) {
+                const float error = std::fmax(std::fabs(actual[i] - expected[i]), std::fabs(stem_mix[i] - expected[i]));
+                squared_error += static_cast<double>(error) * error;
+                squared_signal += static_cast<double>(expected[i]) * expected[i];
+            }
+            return true;
+        };
+        if (!compareStreams(options, rng, state, apply, compare)) {
+            return 1;
+        }
+
+        const double rms = squared_signal > 0.0 ? std::sqrt(squared_error / squared_signal) : 0.0;
+        if (rms > limit.rms) {
+            std::printf("RMS ERROR too large at control rate %d (seed %u): %.4f of the reference (limit %.4f)\n",
+                        rate, options.seed, rms, limit.rms);
+            return 1;
+        }
+        std::printf("ym2151_diff: control rate %d vs reference, %d iterations, %u samples, seed %u: OK\n"
+                    "  max error %g (%.3f of operator full scale, limit %.3f), rms error %.4f (limit %.4f)\n",
+                    rate, options.iterations, state.position, options.seed, state.max_error,
+                    state.max_error / OPERATOR_FULL_SCALE, state.tolerance / OPERATOR_FULL_SCALE, rms, limit.rms);
+    }
+    return 0;
+}
+
+// PatchBank::parseOPM の解析結果と、既知のレジスタブロックの比較
+// 値はオペレータごとに変えてあり、M1 / C1 / M2 / C2 → スロット 0 / 2 / 1 / 3 の対応と、
+// 各レジスタのビット配置を確認できる。不正な入力では行番号つきのエラーを確認する。
+// 現在のコアは 0x20 の CON / FB だけを解釈するので、音色を適用した Chip の出力が
+// 0x20 だけを書いたリファレンス実装と一致することも確認する（コアがオペレータの
+// レジスタを解釈するようになったらここが失敗するので、ドキュメントと合わせて直すこと）。
+int runPatch(const Options& options) {
+    const char* const opm =
+        "// VOPM voice data\r\n"
+        "LFO: 0 0 0 0 0\r\n"
+        "@:10 Test Voice  \r\n"
+        "CH: 192 5 3 2 6 120 0\r\n"
+        "M1: 31 10 4 7 2 20 1 1 3 0 0   // M1\r\n"
+        "C1: 25 12 5 8 3 0 2 2 4 1 1\r\n"
+        "M2: 20 14 6 9 4 40 3 3 5 2 0\r\n"
+        "C2: 15 16 7 10 5 10 0 4 6 3 1\r\n"
+        "\r\n"
+        "@:3 Replaced\n"
+        "CH: 0 0 0 0 0 120 0\n"
+        "M1: 0 0 0 0 0 0 0 0 0 0 0\n"
+        "C1: 0 0 0 0 0 0 0 0 0 0 0\n"
+        "M2: 0 0 0 0 0 0 0 0 0 0 0\n"
+        "C2: 0 0 0 0 0 0 0 0 0 0 0\n"
+        "@:3 Second\n"
+        "CH: 64 7 7 0 0 120 0\n"
+        "M1: 1 0 0 0 0 0 0 0 0 0 0\n"
+        "C1: 1 0 0 0 0 0 0 0 0 0 0\n"
+        "M2: 1 0 0 0 0 0 0 0 0 0 0\n"
+        "C2: 1 0 0 0 0 0 0 0 0 0 0\n";
+
+    // 音色10のレジスタブロック（スロット順: M1 = 0, M2 = 1, C1 = 2, C2 = 3）
+    const YM2151::RegWrite expected[YM2151::Patch::MAX_REGISTERS] = {
+        {0x20, 0xEB}, {0x38, 0x62},
+        {0x40, 0x31}, {0x60, 0x14}, {0x80, 0x5F}, {0xA0, 0x0A}, {0xC0, 0x04}, {0xE0, 0x27},  // M1
+        {0x48, 0x53}, {0x68, 0x28}, {0x88, 0xD4}, {0xA8, 0x0E}, {0xC8, 0x86}, {0xE8, 0x49},  // M2
+        {0x50, 0x42}, {0x70, 0x00}, {0x90, 0x99}, {0xB0, 0x8C}, {0xD0, 0x45}, {0xF0, 0x38},  // C1
+        {0x58, 0x64}, {0x78, 0x0A}, {0x98, 0x0F}, {0xB8, 0x90}, {0xD8, 0xC7}, {0xF8, 0x5A},  // C2
+    };
+
+    int failed = 0;
+    auto fail = [&failed](const std::string& message) {
+        std::printf("PATCH MISMATCH: %s\n", message.c_str());
+        ++failed;
+    };
+
+    YM2151::PatchBank bank;
+    std::string error;
+    std::istringstream in(opm);
+    if (!bank.parseOPM(in, &error)) {
+        fail("valid input rejected: " + error);
+        return 1;
+    }
+    if (bank.size() != 2) {
+        fail("expected 2 voices, got " + std::to_string(bank.size()));
+    }
+
+    const YM2151::Patch* patch = bank.find(10);
+    if (!patch) {
+        fail("voice 10 not found");
+        return 1;
+    }
+    if (patch->name != "Test Voice") {
+        fail("voice 10 name \"" + patch->name + "\"");
+    }
+    if (patch->count != YM2151::Patch::MAX_REGISTERS) {
+        fail("voice 10 has " + std::to_string(patch->count) + " registers");
+    }
+    for (int i = 0; i < patch->count && i < YM2151::Patch::MAX_REGISTERS; ++i) {
+        const YM2151::RegWrite& actual = patch->registers[i];
+        if (actual.reg != expected[i].reg || actual.value != expected[i].value) {
+            char text[64];
+            std::snprintf(text, sizeof(text), "voice 10 write %d: %02X=%02X (expected %02X=%02X)", i,
+                          actual.reg, actual.value, expected[i].reg, expected[i].value);
+            fail(text);
+        }
+    }
+
+    // 同じ番号の音色は後のもので置き換える
+    const YM2151::Patch* replaced = bank.find(3);
+    if (!replaced || replaced->name != "Second" || replaced->registers[0].value != 0x7F) {
+        fail("voice 3 was not replaced by the later definition");
+    }
+
+    // チャンネルへの適用（レジスタ = reg + channel）
+    YM2151::Chip chip;
+    YM2151::ReferenceChip reference;
+    chip.setSampleRate(options.sample_rate);
+    reference.setSampleRate(options.sample_rate);
+    if (!bank.apply(chip, 3, 10) || bank.apply(chip, 3, 11)) {
+        fail("PatchBank::apply result");
+    }
+    for (const YM2151::RegWrite& write : expected) {
+        const uint8_t reg = static_cast<uint8_t>(write.reg + 3);
+        if (chip.getRegister(reg) != write.value) {
+            char text[64];
+            std::snprintf(text, sizeof(text), "channel 3 register %02X=%02X (expected %02X)", reg,
+                          chip.getRegister(reg), write.value);
+            fail(text);
+        }
+    }
+
+    // 音が変わるのは CON / FB だけ
+    reference.setRegister(0x23, expected[0].value);
+    const YM2151::RegWrite note[] = {{0x13, 0xB8}, {0x1B, 0x01}, {0x08, 0x83}};
+    for (const YM2151::RegWrite& write : note) {
+        chip.setRegister(write.reg, write.value);
+        reference.setRegister(write.reg, write.value);
+    }
+    std::vector<float> actual(4096);
+    std::vector<float> reference_output(4096);
+    chip.generate(actual.data(), static_cast<int>(actual.size()));
+    reference.generate(reference_output.data(), static_cast<int>(reference_output.size()));
+    for (size_t i = 0; i < actual.size(); ++i) {
+        if (differs(actual[i], reference_output[i], options.tolerance)) {
+            std::printf("DIVERGENCE at sample %zu: patched Chip %.9g, reference with 0x23 only %.9g\n", i,
+                        actual[i], reference_output[i]);
+            ++failed;
+            break;
+        }
+    }
+
+    // 不正な入力: エラーの行番号と理由
+    struct Malformed {
+        const char* text;
+        const char* error;
+    };
+    const Malformed malformed[] = {
+        {"CH: 0 0 0 0 0 120 0\n", "line 1: parameter line outside of a voice"},
+        {"@:256 Out of range\n", "line 1: invalid voice number"},
+        {"@:x\n", "line 1: invalid voice number"},
+        {"@:1\nCH: 0 0 0 0 0 120\n", "line 2: CH: expects 7 values"},
+        {"@:1\nCH: 0 0 0 0 0 120 0\nM1: 0 0 0 0 0 0 0 0 0 0\n", "line 3: M1: expects 11 values"},
+        {"@:1\nCH: 0 0 0 0 0 120 0\nC2: 0 0 0 0 0 0 0 0 0 0 x\n", "line 3: C2: expects 11 values"},
+        {"@:1\nCH: 0 0 0 0 0 120 0\nOP: 0\n", "line 3: unknown line: OP: 0"},
+        {"@:1\nCH: 0 0 0 0 0 120 0\nM1: 0 0 0 0 0 0 0 0 0 0 0\nC1: 0 0 0 0 0 0 0 0 0 0 0\n"
+         "M2: 0 0 0 0 0 0 0 0 0 0 0\n@:2\n",
+         "line 6: incomplete voice @:1"},
+        {"@:7\nM1: 0 0 0 0 0 0 0 0 0 0 0\nC1: 0 0 0 0 0 0 0 0 0 0 0\nM2: 0 0 0 0 0 0 0 0 0 0 0\n"
+         "C2: 0 0 0 0 0 0 0 0 0 0 0\n",
+         "line 5: incomplete voice @:7"},
+    };
+    for (const Malformed& entry : malformed) {
+        YM2151::PatchBank bad;
+        std::string message;
+        std::istringstream bad_in(entry.text);
+        if (bad.parseOPM(bad_in, &message)) {
+            fail(std::string("accepted malformed input, expected \"") + entry.error + "\"");
+        } else if (message != entry.error) {
+            fail("error \"" + message + "\" (expected \"" + entry.error + "\")");
+        }
+    }
+
+    if (failed != 0) {
+        return 1;
+    }
+    std::printf("ym2151_diff: patch, %zu voices, %zu malformed inputs: OK\n", bank.size(),
+                sizeof(malformed) / sizeof(malformed[0]));
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::fprintf(stderr,
+                     "Usage: ym2151_diff [--seed N] [--iterations N] [--max-block N]\n"
+                     "                   [--tolerance X] [--rate N] [--control-rate N] [--chip-array | --recorder | --sequencer | --board | --meter |\n"
+                     "                    --note-cache | --offline | --unison | --midi | --patch |\n"
+                     "                    --control-rate-reference]\n");
+        return 2;
+    }
+
+    if (options.chip_array) {
+        return runChipArray(options);
+    }
+    if (options.recorder) {
+        return runRecorder(options);
+    }
+    if (options.sequencer) {
+        return runSequencer(options);
+    }
+    if (options.board) {
+        const int result = runBoard(options, false);
+        return result != 0 ? result : runBoard(options, true);
+    }
+    if (options.meter) {
+        return runMeter(options);
+    }
+    if (options.note_cache) {
+        return runNoteCache(options);
+    }
+    if (options.offline) {
+        return runOffline(options);
+    }
+    if (options.unison) {
+        return runUnison(options);
+    }
+    if (options.midi) {
+        return runMidi(options);
+    }
+    if (options.patch) {
+        return runPatch(options);
+    }
+    if (options.control_rate_reference) {
+        return runControlRateReference(options);
+    }
+
+    YM2151::Chip chip;
+    YM2151::Chip stem_chip;
+    YM2151::ReferenceChip reference;
+    chip.setSampleRate(options.sample_rate);
+    stem_chip.setSampleRate(options.sample_rate);
+    reference.setSampleRate(options.sample_rate);
+
+    std::mt19937 rng(options.seed);
+    std::uniform_int_distribution<int> write_count(0, 8);
+
+    std::vector<float> actual(options.max_block);
+    std::vector<float> stem_mix(options.max_block);
+    std::vector<float> expected(options.max_block);
+    std::vector<float> stem_data(YM2151::CHANNEL_COUNT * options.max_block);
+    float* stems[YM2151::CHANNEL_COUNT];
+    for (int ch = 0; ch < YM2151::CHANNEL_COUNT; ++ch) {
+        stems[ch] = stem_data.data() + ch * options.max_block;
+    }
+
+    std::uniform_int_distribution<int> parameter_change(0, 3);
+    std::uniform_int_distribution<int> parameter_channel(0, YM2151::CHANNEL_COUNT - 1);
+    std::uniform_int_distribution<int> parameter_operator(0, 3);
+
+    StreamState state(options);
+    WriteLog log;
+    int parameter_changes = 0;
+
+    const bool ok = compareStreams(
+        options, rng, state,
+        [&](StreamState& current) {
+            // ランダムな書き込み
+            int writes = write_count(rng);
+            for (int w = 0; w < writes; ++w) {
+                uint8_t reg;
+                uint8_t value;
+                randomWrite(rng, reg, value);
+                chip.setRegister(reg, value);
+                stem_chip.setRegister(reg, value);
+                reference.setRegister(reg, value);
+                log.add(current.position, reg, value);
+            }
+
+            // 時々オペレータのパラメータを変える（発音中の変更を含む）
+            if (parameter_change(rng) == 0) {
+                const int ch = parameter_channel(rng);
+                const int op = parameter_operator(rng);
+                const YM2151::FMParameter param = randomParameter(rng);
+                chip.getChannel(ch).getOperator(op).setParameter(param);
+                stem_chip.getChannel(ch).getOperator(op).setParameter(param);
+                reference.setOperatorParameter(ch, op, param);
+                ++parameter_changes;
+            }
+            return true;
+        },
+        [&](StreamState& current, int samples) {
+            // 同じ長さを生成して比較
+            chip.generate(actual.data(), samples);
+            stem_chip.generateStems(stems, samples, stem_mix.data());
+            reference.generate(expected.data(), samples);
+            if (!compareOutputs(current, samples, {"reference", expected.data()},
+                                {{"generate", actual.data()}, {"generateStems", stem_mix.data()}})) {
+                printRegisters(chip);
+                log.print();
+                return false;
+            }
+            return true;
+        });
+    if (!ok) {
+        return 1;
+    }
+
+    std::printf("ym2151_diff: %d iterations, %u samples, %d operator parameter changes, seed %u, max error %g: OK\n",
+                options.iterations, state.position, parameter_changes, options.seed, state.max_error);
+    return 0;
+}
@@ -0,0 +1,418 @@
+// YM2151 リアルタイム処理能力の負荷試験
+// 1コアで同時に生成できる Chip のストリーム数を、コールバックの期限を守れる範囲で求める。
+//
+// コールバックのフレーム数（既定では48kHzで64/128/256フレーム）ごとに、ストリーム数を
+// 増やしながら（倍々に増やした後、通らなくなった範囲を二分探索する）次の手順を繰り返す。
+//   - 各ストリームは曲に近いレジスタ書き込み（ノートのオン/オフ、音色の切り替え、
+//     ピッチの変化）を受けながら、コールバックごとに1ブロックを生成する
+//   - コールバックは実際のオーディオと同じ周期で起動し（前のコールバックが期限を過ぎた場合は
+//     すぐに起動して周期を取り直す）、全ストリームの処理時間を計測する
+//   - 処理が周期を超えたコールバックを期限超過として数える
+// 期限超過が --max-misses 以下で、p99.9 の処理時間が周期の --budget 倍以下なら、その数を維持できるとする。
+//
+// 計測スレッドはコアに固定する（Linuxのみ）。--threads T を指定すると T 個のコアで同時に
+// 計測し（隣のコアの負荷の影響を含めた値になる）、結果はコアあたりのストリーム数で表示する。
+// --realtime を指定すると計測スレッドを SCHED_FIFO で実行する（権限が必要）。
+// --min-streams N を指定すると、維持できるストリーム数が N 未満のフレーム数があれば終了コード1で終了する。
+
+#include "ym2151/ym2151.h"
+#include "ym2151/midi.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    uint32_t sample_rate = 48000;
+    std::vector<int> frames = {64, 128, 256};
+    int periods = 2000;         // 1段階あたりのコールバック数
+    double budget = 0.8;        // p99.9 の処理時間の上限（周期に対する比）
+    int max_misses = 0;         // 許容する期限超過の数
+    int max_streams = 1024;
+    int threads = 1;
+    int cpu = 0;                // 最初に固定するコア
+    bool realtime = false;
+    int min_streams = 0;        // 0なら判定しない
+};
+
+// 1段階の計測結果
+struct StepResult {
+    int streams;
+    double mean_us;
+    double p99_us;
+    double p999_us;
+    double max_us;
+    long misses;
+    bool sustainable;
+};
+
+bool parseFrames(const char* text, std::vector<int>& frames) {
+    frames.clear();
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        const int value = std::atoi(item.c_str());
+        if (value <= 0) {
+            return false;
+        }
+        frames.push_back(value);
+    }
+    return !frames.empty();
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--realtime") == 0) {
+            options.realtime = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        if (std::strcmp(argv[i], "--rate") == 0) {
+            options.sample_rate = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "--frames") == 0) {
+            if (!parseFrames(argv[++i], options.frames)) {
+                return false;
+            }
+        } else if (std::strcmp(argv[i], "--periods") == 0) {
+            options.periods = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--budget") == 0) {
+            options.budget = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--max-misses") == 0) {
+            options.max_misses = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--max-streams") == 0) {
+            options.max_streams = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--threads") == 0) {
+            options.threads = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--cpu") == 0) {
+            options.cpu = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--min-streams") == 0) {
+            options.min_streams = std::atoi(argv[++i]);
+        } else {
+            return false;
+        }
+    }
+    return options.sample_rate > 0 && options.periods >= 10 && options.budget > 0.0 &&
+           options.max_misses >= 0 && options.max_streams > 0 && options.threads > 0 && options.cpu >= 0;
+}
+
+// 計測スレッドをコアに固定し、必要ならリアルタイム優先度にする
+bool prepareThread(int cpu, bool realtime, std::string* error) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (result != 0) {
+        *error = "cannot pin to cpu " + std::to_string(cpu) + ": " + std::strerror(result);
+        return false;
+    }
+    if (realtime) {
+        sched_param param{};
+        param.sched_priority = sched_get_priority_max(SCHED_FIFO) - 1;
+        result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (result != 0) {
+            *error = std::string("cannot use SCHED_FIFO: ") + std::strerror(result);
+            return false;
+        }
+    }
+    return true;
+#else
+    (void)cpu;
+    (void)realtime;
+    *error = "thread pinning is only supported on Linux";
+    return false;
+#endif
+}
+
+// 曲に近いレジスタ書き込みを生成するストリーム
+// チャンネルごとにランダムな長さのノートと休符を繰り返し、ときどき音色を切り替え、
+// ピッチを動かす（ピッチベンド・ビブラートの代わり）
+class Stream {
+public:
+    Stream(uint32_t seed, uint32_t sample_rate)
+        : rng_(seed), sample_rate_(sample_rate) {
+        chip_.setSampleRate(sample_rate);
+        for (int ch = 0; ch < YM2151::CHANNEL_COUNT; ++ch) {
+            channels_[ch].remaining = samples(0, 200);
+            channels_[ch].on = false;
+            channels_[ch].note = 60;
+            changeProgram(ch);
+        }
+        flush();
+    }
+
+    // 1コールバック分の書き込みと生成
+    void process(float* buffer, int frames) noexcept {
+        std::uniform_int_distribution<int> permille(0, 999);
+        for (int ch = 0; ch < YM2151::CHANNEL_COUNT; ++ch) {
+            Voice& voice = channels_[ch];
+            voice.remaining -= frames;
+            if (voice.remaining <= 0) {
+                if (voice.on) {
+                    add(0x08, static_cast<uint8_t>(ch));
+                    voice.remaining = samples(10, 300);
+                } else {
+                    voice.note = static_cast<uint8_t>(std::uniform_int_distribution<int>(36, 96)(rng_));
+                    setPitch(ch, voice.note);
+                    for (int op = 0; op < 4; ++op) {
+                        add(static_cast<uint8_t>(0x60 + op * 8 + ch), static_cast<uint8_t>(permille(rng_) & 0x3F));
+                    }
+                    add(0x08, static_cast<uint8_t>(0x80 | ch));
+                    voice.remaining = samples(30, 600);
+                }
+                voice.on = !voice.on;
+            } else if (voice.on && permille(rng_) < 50) {
+                setPitch(ch, static_cast<uint8_t>(voice.note + permille(rng_) % 3 - 1));
+            }
+            if (permille(rng_) < 5) {
+                changeProgram(ch);
+            }
+        }
+        flush();
+        chip_.generate(buffer, frames);
+    }
+
+private:
+    struct Voice {
+        int remaining;   // 次のノートのオン/オフまでのサンプル数
+        bool on;
+        uint8_t note;
+    };
+
+    static constexpr size_t MAX_WRITES = 256;
+
+    int samples(int min_ms, int max_ms) {
+        const int ms = std::uniform_int_distribution<int>(min_ms, max_ms)(rng_);
+        return static_cast<int>(static_cast<int64_t>(ms) * sample_rate_ / 1000);
+    }
+
+    void add(uint8_t reg, uint8_t value) noexcept {
+        if (write_count_ < MAX_WRITES) {
+            writes_[write_count_++] = YM2151::RegWrite{reg, value};
+        }
+    }
+
+    void setPitch(int ch, uint8_t note) noexcept {
+        const uint16_t frequency = YM2151::midiNoteToFrequency(note);
+        add(static_cast<uint8_t>(0x10 + ch), static_cast<uint8_t>(frequency & 0xFF));
+        add(static_cast<uint8_t>(0x18 + ch), static_cast<uint8_t>(frequency >> 8));
+    }
+
+    // 音色の切り替え（アルゴリズム・フィードバックと4オペレータ分のパラメータ）
+    void changeProgram(int ch) noexcept {
+        std::uniform_int_distribution<int> byte(0, 255);
+        add(static_cast<uint8_t>(0x20 + ch), static_cast<uint8_t>(byte(rng_)));
+        for (int base = 0x40; base <= 0xE0; base += 0x20) {
+            for (int op = 0; op < 4; ++op) {
+                add(static_cast<uint8_t>(base + op * 8 + ch), static_cast<uint8_t>(byte(rng_)));
+            }
+        }
+    }
+
+    void flush() noexcept {
+        chip_.setRegisters(writes_, write_count_);
+        write_count_ = 0;
+    }
+
+    YM2151::Chip chip_;
+    std::mt19937 rng_;
+    uint32_t sample_rate_;
+    Voice channels_[YM2151::CHANNEL_COUNT];
+    YM2151::RegWrite writes_[MAX_WRITES];
+    size_t write_count_ = 0;
+};
+
+// 1スレッド分の計測
+struct ThreadResult {
+    std::vector<double> times_us;
+    long misses = 0;
+    std::string error;
+};
+
+void measure(const Options& options, int frames, int streams, int thread_index,
+             Clock::time_point origin, ThreadResult& result) {
+    if (!prepareThread(options.cpu + thread_index, options.realtime, &result.error)) {
+        return;
+    }
+
+    std::vector<std::unique_ptr<Stream>> stream_list;
+    for (int s = 0; s < streams; ++s) {
+        const uint32_t seed = static_cast<uint32_t>(thread_index * 100003 + s + 1);
+        stream_list.push_back(std::make_unique<Stream>(seed, options.sample_rate));
+    }
+    std::vector<float> buffer(static_cast<size_t>(frames));
+
+    // 最初の一部のコールバックはキャッシュ等が落ち着くまでの準備として計測しない
+    const int warmup = std::max(10, options.periods / 20);
+    const auto period = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(static_cast<double>(frames) / options.sample_rate));
+    result.times_us.reserve(static_cast<size_t>(options.periods));
+
+    Clock::time_point scheduled = origin;
+    for (int callback = 0; callback < warmup + options.periods; ++callback) {
+        std::this_thread::sleep_until(scheduled);
+        const Clock::time_point start = Clock::now();
+        for (auto& stream : stream_list) {
+            stream->process(buffer.data(), frames);
+        }
+        const Clock::time_point end = Clock::now();
+
+        if (callback >= warmup) {
+            result.times_us.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+            if (end - start > period) {
+                ++result.misses;
+            }
+        }
+        // 期限を過ぎた場合は音切れの後と同じく周期を取り直す
+        scheduled += period;
+        if (end > scheduled) {
+            scheduled = end;
+        }
+    }
+}
+
+bool runStep(const Options& options, int frames, int streams, StepResult& step, std::string* error) {
+    std::vector<ThreadResult> results(static_cast<size_t>(options.threads));
+    std::vector<std::thread> workers;
+    const Clock::time_point origin = Clock::now() + std::chrono::milliseconds(10);
+    for (int t = 0; t < options.threads; ++t) {
+        workers.emplace_back(measure, std::cref(options), frames, streams, t, origin, std::ref(results[t]));
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    std::vector<double> times;
+    long misses = 0;
+    for (const ThreadResult& result : results) {
+        if (!result.error.empty()) {
+            *error = result.error;
+            return false;
+        }
+        times.insert(times.end(), result.times_us.begin(), result.times_us.end());
+        misses += result.misses;
+    }
+
+    double total = 0.0;
+    for (double t : times) {
+        total += t;
+    }
+    std::sort(times.begin(), times.end());
+    const size_t count = times.size();
+    const double period_us = frames * 1e6 / options.sample_rate;
+
+    step.streams = streams;
+    step.mean_us = total / count;
+    step.p99_us = times[std::min(count - 1, count * 99 / 100)];
+    step.p999_us = times[std::min(count - 1, count * 999 / 1000)];
+    step.max_us = times.back();
+    step.misses = misses;
+    step.sustainable = misses <= options.max_misses && step.p999_us <= period_us * options.budget;
+    return true;
+}
+
+void printStep(const StepResult& step) {
+    std::printf("%8d %10.1f %10.1f %10.1f %10.1f %8ld  %s\n", step.streams, step.mean_us, step.p99_us,
+                step.p999_us, step.max_us, step.misses, step.sustainable ? "ok" : "over");
+}
+
+// 維持できるストリーム数の探索（倍々に増やしてから二分探索）
+// 1ストリームも維持できない場合は0を返す。失敗時は -1 を返す。
+int findCapacity(const Options& options, int frames, std::string* error) {
+    const double period_us = frames * 1e6 / options.sample_rate;
+    std::printf("\nframes %d (period %.0f us, budget %.0f us)\n", frames, period_us, period_us * options.budget);
+    std::printf("%8s %10s %10s %10s %10s %8s  %s\n", "streams", "mean(us)", "p99(us)", "p99.9(us)", "max(us)",
+                "misses", "result");
+
+    int good = 0;
+    int bad = 0;
+    StepResult step;
+    for (int streams = 1;; streams = std::min(streams * 2, options.max_streams)) {
+        if (!runStep(options, frames, streams, step, error)) {
+            return -1;
+        }
+        printStep(step);
+        if (!step.sustainable) {
+            bad = streams;
+            break;
+        }
+        good = streams;
+        if (streams == options.max_streams) {
+            return good;
+        }
+    }
+    while (bad - good > 1) {
+        const int streams = good + (bad - good) / 2;
+        if (!runStep(options, frames, streams, step, error)) {
+            return -1;
+        }
+        printStep(step);
+        if (step.sustainable) {
+            good = streams;
+        } else {
+            bad = streams;
+        }
+    }
+    return good;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::fprintf(stderr,
+                     "Usage: ym2151_loadtest [--rate N] [--frames 64,128,256] [--periods N] [--budget X]\n"
+                     "                       [--max-misses N] [--max-streams N] [--threads N] [--cpu N]\n"
+                     "                       [--realtime] [--min-streams N]\n");
+        return 2;
+    }
+
+    std::printf("ym2151_loadtest: %u Hz, %d callbacks per step, budget %.0f%% of the period, "
+                "%d thread(s) from cpu %d%s\n",
+                options.sample_rate, options.periods, options.budget * 100.0, options.threads, options.cpu,
+                options.realtime ? ", SCHED_FIFO" : "");
+
+    std::vector<int> capacities;
+    for (int frames : options.frames) {
+        std::string error;
+        const int capacity = findCapacity(options, frames, &error);
+        if (capacity < 0) {
+            std::fprintf(stderr, "ym2151_loadtest: %s\n", error.c_str());
+            return 1;
+        }
+        capacities.push_back(capacity);
+    }
+
+    std::printf("\n%8s %12s %16s\n", "frames", "period(us)", "streams/core");
+    int failed = 0;
+    for (size_t i = 0; i < options.frames.size(); ++i) {
+        std::printf("%8d %12.0f %16d\n", options.frames[i], options.frames[i] * 1e6 / options.sample_rate,
+                    capacities[i]);
+        if (capacities[i] < options.min_streams) {
+            std::printf("FAIL %d frames: %d streams per core (required %d)\n", options.frames[i], capacities[i],
+                        options.min_streams);
+            ++failed;
+        }
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,383 @@
+// YM2151 ストリーミングレンダラ
+// レジスタスクリプトまたはVGMを読み込み、PCM（raw / WAV）を標準出力に書き出す。
+// 合成は生産者スレッドでブロックのリングに書き込み、メインスレッドが標準出力へ書き出す。
+// これにより出力先（エンコーダ等）の背圧と合成処理が重なって実行される。
+// --parallel を指定すると、先に OfflineRenderer でチャンネルごとに並列に全体を生成し
+// （出力は同じ）、生産者スレッドはそれを出力形式に変換する。
+
+#include "ym2151/ym2151.h"
+#include "ym2151/offline.h"
+#include "ym2151/vgm.h"
+#include "pcm_output.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace {
+
+enum class InputType { AUTO, VGM, SCRIPT };
+enum class OutputFormat { RAW, WAV };
+enum class Encoding { S16, F32 };
+
+struct Options {
+    std::string input = "-";
+    InputType input_type = InputType::AUTO;
+    OutputFormat format = OutputFormat::WAV;
+    Encoding encoding = Encoding::S16;
+    uint32_t sample_rate = 44100;
+    int block_size = 1024;
+    int depth = 4;
+    uint32_t tail = 0;
+    bool parallel = false;
+    int threads = 0;
+    int control_rate = 1;
+};
+
+// 生成済みブロックのリング
+// 生産者（合成）と消費者（標準出力）の間で固定数のブロックを循環させる
+class BlockRing {
+public:
+    BlockRing(int depth, size_t block_bytes)
+        : blocks_(depth, std::vector<char>(block_bytes)), sizes_(depth, 0) {}
+
+    // 生産者: 空きブロックを取得（満杯なら待つ）
+    char* acquireFree(bool& stalled) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stalled = filled_ == static_cast<int>(blocks_.size());
+        not_full_.wait(lock, [this] { return filled_ < static_cast<int>(blocks_.size()); });
+        return blocks_[write_index_].data();
+    }
+
+    void publish(size_t bytes, bool last) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            sizes_[write_index_] = bytes;
+            write_index_ = (write_index_ + 1) % blocks_.size();
+            ++filled_;
+            finished_ = last;
+        }
+        not_empty_.notify_one();
+    }
+
+    // 消費者: 生成済みブロックを取得（空なら待つ）
+    // 全ブロックを消費し終えたら nullptr を返す
+    const char* acquireFilled(size_t& bytes, bool& underrun) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        underrun = filled_ == 0 && !finished_;
+        not_empty_.wait(lock, [this] { return filled_ > 0 || finished_; });
+        if (filled_ == 0) {
+            return nullptr;
+        }
+        bytes = sizes_[read_index_];
+        return blocks_[read_index_].data();
+    }
+
+    void release() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            read_index_ = (read_index_ + 1) % blocks_.size();
+            --filled_;
+        }
+        not_full_.notify_one();
+    }
+
+private:
+    std::vector<std::vector<char>> blocks_;
+    std::vector<size_t> sizes_;
+    size_t write_index_ = 0;
+    size_t read_index_ = 0;
+    int filled_ = 0;
+    bool finished_ = false;
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+};
+
+void printUsage() {
+    std::cerr <<
+        "Usage: ym2151_render [options] [input]\n"
+        "  input                 register script or VGM file ('-' = stdin, default)\n"
+        "  --input vgm|script    input type (default: detect from header)\n"
+        "  --format wav|raw      output container (default: wav)\n"
+        "  --encoding s16|f32    sample encoding (default: s16)\n"
+        "  --rate N              sample rate in Hz (default: 44100)\n"
+        "  --block N             samples per block (default: 1024)\n"
+        "  --depth N             number of blocks in the ring (default: 4)\n"
+        "  --tail N              extra samples rendered after the last command (default: 0)\n"
+        "  --parallel N          render the channels on N threads before writing (0 = all cores)\n"
+        "  --control-rate N      update envelopes and LFO every N samples (1-64, default: 1 = per sample)\n";
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&](const char* name) -> const char* {
+            if (i + 1 >= argc) {
+                std::cerr << name << " requires a value" << std::endl;
+                return nullptr;
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--help" || arg == "-h") {
+            return false;
+        } else if (arg == "--input") {
+            const char* v = value("--input");
+            if (!v) return false;
+            if (std::strcmp(v, "vgm") == 0) options.input_type = InputType::VGM;
+            else if (std::strcmp(v, "script") == 0) options.input_type = InputType::SCRIPT;
+            else return false;
+        } else if (arg == "--format") {
+            const char* v = value("--format");
+            if (!v) return false;
+            if (std::strcmp(v, "wav") == 0) options.format = OutputFormat::WAV;
+            else if (std::strcmp(v, "raw") == 0) options.format = OutputFormat::RAW;
+            else return false;
+        } else if (arg == "--encoding") {
+            const char* v = value("--encoding");
+            if (!v) return false;
+            if (std::strcmp(v, "s16") == 0) options.encoding = Encoding::S16;
+            else if (std::strcmp(v, "f32") == 0) options.encoding = Encoding::F32;
+            else return false;
+        } else if (arg == "--rate") {
+            const char* v = value("--rate");
+            if (!v) return false;
+            options.sample_rate = static_cast<uint32_t>(std::strtoul(v, nullptr, 10));
+        } else if (arg == "--block") {
+            const char* v = value("--block");
+            if (!v) return false;
+            options.block_size = std::atoi(v);
+        } else if (arg == "--depth") {
+            const char* v = value("--depth");
+            if (!v) return false;
+            options.depth = std::atoi(v);
+        } else if (arg == "--tail") {
+            const char* v = value("--tail");
+            if (!v) return false;
+            options.tail = static_cast<uint32_t>(std::strtoul(v, nullptr, 10));
+        } else if (arg == "--control-rate") {
+            const char* v = value("--control-rate");
+            if (!v) return false;
+            options.control_rate = std::atoi(v);
+        } else if (arg == "--parallel") {
+            const char* v = value("--parallel");
+            if (!v) return false;
+            options.parallel = true;
+            options.threads = std::atoi(v);
+        } else if (!arg.empty() && arg[0] == '-' && arg != "-") {
+            std::cerr << "unknown option: " << arg << std::endl;
+            return false;
+        } else {
+            options.input = arg;
+        }
+    }
+
+    if (options.sample_rate == 0 || options.block_size <= 0 || options.depth < 2) {
+        std::cerr << "rate and block must be positive, depth must be at least 2" << std::endl;
+        return false;
+    }
+    if (options.control_rate < 1 || options.control_rate > YM2151::MAX_CONTROL_RATE) {
+        std::cerr << "control rate must be between 1 and " << YM2151::MAX_CONTROL_RATE << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool readInput(const std::string& path, std::vector<uint8_t>& data) {
+    if (path == "-") {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        data.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+        return true;
+    }
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 2;
+    }
+
+    // 入力の読み込み
+    std::vector<uint8_t> data;
+    if (!readInput(options.input, data)) {
+        std::cerr << "cannot open " << options.input << std::endl;
+        return 1;
+    }
+
+    bool is_vgm = options.input_type == InputType::VGM;
+    if (options.input_type == InputType::AUTO) {
+        is_vgm = data.size() >= 4 && std::memcmp(data.data(), "Vgm ", 4) == 0;
+    }
+
+    YM2151::RegisterStream stream;
+    std::string error;
+    bool parsed;
+    if (is_vgm) {
+        parsed = YM2151::parseVGM(data.data(), data.size(), options.sample_rate, stream, &error);
+    } else {
+        std::istringstream script(std::string(data.begin(), data.end()));
+        parsed = YM2151::parseRegisterScript(script, stream, &error);
+    }
+    if (!parsed) {
+        std::cerr << options.input << ": " << error << std::endl;
+        return 1;
+    }
+
+    const uint64_t total_samples = static_cast<uint64_t>(stream.total_samples) + options.tail;
+
+    // 並列生成（全体を先に生成し、生産者スレッドは変換だけを行う）
+    std::vector<float> rendered;
+    double parallel_seconds = 0.0;
+    int parallel_threads = 0;
+    if (options.parallel) {
+        const auto render_start = std::chrono::steady_clock::now();
+        YM2151::OfflineRenderer renderer(options.sample_rate, options.threads);
+        renderer.setControlRate(options.control_rate);
+        if (!renderer.render(stream, options.tail, rendered, nullptr, &error)) {
+            std::cerr << options.input << ": " << error << std::endl;
+            return 1;
+        }
+        parallel_threads = renderer.getThreads();
+        parallel_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - render_start).count();
+    }
+    const size_t bytes_per_sample = options.encoding == Encoding::S16 ? 2 : 4;
+    const size_t block_bytes = options.block_size * bytes_per_sample;
+
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    // WAVヘッダー（長さは事前に分かるので確定値を書く）
+    if (options.format == OutputFormat::WAV) {
+        const tools::WAVHeader header = tools::makeWAVHeader(options.sample_rate, bytes_per_sample, total_samples);
+        std::fwrite(&header, sizeof(header), 1, stdout);
+    }
+
+    BlockRing ring(options.depth, block_bytes);
+
+    // 統計
+    uint64_t producer_stalls = 0;
+    uint64_t consumer_underruns = 0;
+    uint64_t blocks_written = 0;
+    uint64_t bytes_written = 0;
+    double synth_seconds = 0.0;
+    const auto start = std::chrono::steady_clock::now();
+
+    // 生産者スレッド: チップの合成と出力形式への変換
+    std::thread producer([&] {
+        YM2151::Chip chip(stream.clock);
+        chip.setSampleRate(options.sample_rate);
+        chip.setControlRate(options.control_rate);
+
+        std::vector<float> samples(options.block_size);
+        size_t next_write = 0;
+        uint64_t position = 0;
+
+        while (position < total_samples) {
+            bool stalled = false;
+            char* block = ring.acquireFree(stalled);
+            if (stalled) {
+                ++producer_stalls;
+            }
+
+            const auto synth_start = std::chrono::steady_clock::now();
+            const int count = static_cast<int>(std::min<uint64_t>(options.block_size, total_samples - position));
+
+            if (options.parallel) {
+                // 並列生成済みの出力を使う
+                std::memcpy(samples.data(), rendered.data() + position, count * sizeof(float));
+            } else {
+                // 書き込み時刻で区切りながら生成（サンプル単位で正確）
+                YM2151::renderWrites(chip, stream.writes, next_write, position, samples.data(), count);
+            }
+
+            // 出力形式への変換
+            if (options.encoding == Encoding::S16) {
+                tools::convertToS16(samples.data(), reinterpret_cast<int16_t*>(block), count);
+            } else {
+                std::memcpy(block, samples.data(), count * sizeof(float));
+            }
+
+            position += count;
+            synth_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - synth_start).count();
+            ring.publish(count * bytes_per_sample, position >= total_samples);
+        }
+
+        if (total_samples == 0) {
+            ring.publish(0, true);
+        }
+    });
+
+    // メインスレッド: 標準出力への書き出し
+    bool write_failed = false;
+    for (;;) {
+        size_t bytes = 0;
+        bool underrun = false;
+        const char* block = ring.acquireFilled(bytes, underrun);
+        if (!block) {
+            break;
+        }
+        if (underrun) {
+            ++consumer_underruns;
+        }
+        if (!write_failed && bytes > 0 && std::fwrite(block, 1, bytes, stdout) != bytes) {
+            write_failed = true;  // 出力先が閉じられても生産者は最後まで回して終了させる
+        }
+        bytes_written += bytes;
+        ++blocks_written;
+        ring.release();
+    }
+    producer.join();
+    std::fflush(stdout);
+
+    const double elapsed =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() + parallel_seconds;
+    const double audio_seconds = static_cast<double>(total_samples) / options.sample_rate;
+
+    std::cerr << "ym2151_render: " << total_samples << " samples (" << audio_seconds << " s) in "
+              << elapsed << " s, " << (elapsed > 0.0 ? audio_seconds / elapsed : 0.0) << "x realtime\n"
+              << "  blocks: " << blocks_written << " x " << options.block_size << " samples, depth "
+              << options.depth << ", " << bytes_written << " bytes\n"
+              << "  synthesis: " << synth_seconds << " s ("
+              << (synth_seconds > 0.0 ? total_samples / synth_seconds : 0.0) << " samples/s)\n";
+    if (options.parallel) {
+        std::cerr << "  parallel render: " << parallel_seconds << " s on " << parallel_threads << " threads ("
+                  << (parallel_seconds > 0.0 ? total_samples / parallel_seconds : 0.0) << " samples/s)\n";
+    }
+    std::cerr
+              << "  producer stalls (output backpressure): " << producer_stalls << "\n"
+              << "  consumer underruns (synthesis behind): " << consumer_underruns << std::endl;
+
+    if (write_failed) {
+        std::cerr << "ym2151_render: write to stdout failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
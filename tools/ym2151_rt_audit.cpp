@@ -0,0 +1,541 @@
+// YM2151 リアルタイム安全性の検査ツール
+// Chip のレンダリングAPI（setRegister / setRegisters / generate / generateStems）が
+// メモリ確保・解放、ミューテックス操作、書き込みシステムコール、sched_yield による
+// 待機を行わないことを検査する。
+//
+// malloc / free 系と pthread のロック関数、write 系の関数、sched_yield をこの実行ファイル内で
+// 置き換え、検査区間（armed）の間に呼ばれた回数を数える。
+// さらに標準出力・標準エラー出力をパイプに差し替え、検査区間中に
+// 何も書き込まれていないことを確認する。
+// 違反があれば内容を表示して終了コード1で終了する。
+//
+// 最初のシナリオは陽性対照で、検査区間内で意図的に new / pthread_mutex_lock / write を呼ぶ。
+// これらが3つとも数えられなければ置き換えが効いていない（静的リンクやシンボルの解決順の
+// 変化など）とみなして失敗する。陽性対照自体は違反として数えない。
+// AddressSanitizer などのサニタイザは malloc を自前で置き換えるため、そのビルドでは
+// 陽性対照で失敗する（検査はサニタイザなしのビルドで行う）。
+//
+// glibc の関数置き換えに依存するため Linux 専用。
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "ym2151/ym2151.h"
+#include "ym2151/board.h"
+#include "ym2151/chip_array.h"
+#include "ym2151/meter.h"
+#include "ym2151/note_cache.h"
+#include "ym2151/recorder.h"
+#include "ym2151/sequencer.h"
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <memory>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// glibc の実体
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void  __libc_free(void* ptr);
+}
+
+namespace {
+
+// 検査区間中のスレッドのみを数える
+thread_local bool armed = false;
+
+std::atomic<unsigned long> allocations{0};
+std::atomic<unsigned long> deallocations{0};
+std::atomic<unsigned long> lock_calls{0};
+std::atomic<unsigned long> write_calls{0};
+std::atomic<unsigned long> yield_calls{0};
+
+void countIfArmed(std::atomic<unsigned long>& counter) {
+    if (armed) {
+        counter.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+template <typename F>
+F nextSymbol(const char* name) {
+    return reinterpret_cast<F>(dlsym(RTLD_NEXT, name));
+}
+
+} // namespace
+
+// メモリ確保・解放の置き換え
+extern "C" void* malloc(size_t size) {
+    countIfArmed(allocations);
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+    countIfArmed(allocations);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size) {
+    countIfArmed(allocations);
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void* memalign(size_t alignment, size_t size) {
+    countIfArmed(allocations);
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" void* aligned_alloc(size_t alignment, size_t size) {
+    countIfArmed(allocations);
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void** out, size_t alignment, size_t size) {
+    countIfArmed(allocations);
+    void* ptr = __libc_memalign(alignment, size);
+    if (!ptr) {
+        return ENOMEM;
+    }
+    *out = ptr;
+    return 0;
+}
+
+extern "C" void free(void* ptr) {
+    if (ptr) {
+        countIfArmed(deallocations);
+    }
+    __libc_free(ptr);
+}
+
+// ロックの置き換え
+extern "C" int pthread_mutex_lock(pthread_mutex_t* mutex) {
+    countIfArmed(lock_calls);
+    static auto next = nextSymbol<int (*)(pthread_mutex_t*)>("pthread_mutex_lock");
+    return next(mutex);
+}
+
+extern "C" int pthread_mutex_trylock(pthread_mutex_t* mutex) {
+    countIfArmed(lock_calls);
+    static auto next = nextSymbol<int (*)(pthread_mutex_t*)>("pthread_mutex_trylock");
+    return next(mutex);
+}
+
+extern "C" int pthread_rwlock_rdlock(pthread_rwlock_t* lock) {
+    countIfArmed(lock_calls);
+    static auto next = nextSymbol<int (*)(pthread_rwlock_t*)>("pthread_rwlock_rdlock");
+    return next(lock);
+}
+
+extern "C" int pthread_rwlock_wrlock(pthread_rwlock_t* lock) {
+    countIfArmed(lock_calls);
+    static auto next = nextSymbol<int (*)(pthread_rwlock_t*)>("pthread_rwlock_wrlock");
+    return next(lock);
+}
+
+extern "C" int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex) {
+    countIfArmed(lock_calls);
+    static auto next = nextSymbol<int (*)(pthread_cond_t*, pthread_mutex_t*)>("pthread_cond_wait");
+    return next(cond, mutex);
+}
+
+// 書き込みの置き換え
+extern "C" ssize_t write(int fd, const void* buffer, size_t count) {
+    countIfArmed(write_calls);
+    static auto next = nextSymbol<ssize_t (*)(int, const void*, size_t)>("write");
+    return next(fd, buffer, count);
+}
+
+extern "C" ssize_t writev(int fd, const struct iovec* iov, int count) {
+    countIfArmed(write_calls);
+    static auto next = nextSymbol<ssize_t (*)(int, const struct iovec*, int)>("writev");
+    return next(fd, iov, count);
+}
+
+extern "C" size_t fwrite(const void* buffer, size_t size, size_t count, FILE* stream) {
+    countIfArmed(write_calls);
+    static auto next = nextSymbol<size_t (*)(const void*, size_t, size_t, FILE*)>("fwrite");
+    return next(buffer, size, count, stream);
+}
+
+extern "C" int fputs(const char* text, FILE* stream) {
+    countIfArmed(write_calls);
+    static auto next = nextSymbol<int (*)(const char*, FILE*)>("fputs");
+    return next(text, stream);
+}
+
+extern "C" int puts(const char* text) {
+    countIfArmed(write_calls);
+    static auto next = nextSymbol<int (*)(const char*)>("puts");
+    return next(text);
+}
+
+extern "C" int fflush(FILE* stream) {
+    countIfArmed(write_calls);
+    static auto next = nextSymbol<int (*)(FILE*)>("fflush");
+    return next(stream);
+}
+
+// 他のスレッドを待って回り続ける処理の検出（実時間優先度のスレッドでは待つ相手に譲られない）
+extern "C" int sched_yield() noexcept {
+    countIfArmed(yield_calls);
+    static auto next = nextSymbol<int (*)()>("sched_yield");
+    return next();
+}
+
+namespace {
+
+constexpr int BLOCK = 256;
+
+// 検査区間中に標準出力・標準エラー出力へ書かれたデータを捕捉するパイプ
+struct OutputCapture {
+    int pipe_fds[2] = {-1, -1};
+    int saved_stdout = -1;
+    int saved_stderr = -1;
+
+    bool begin() {
+        if (pipe(pipe_fds) != 0) {
+            return false;
+        }
+        fcntl(pipe_fds[0], F_SETFL, O_NONBLOCK);
+        fcntl(pipe_fds[1], F_SETFL, O_NONBLOCK);
+        std::fflush(stdout);
+        std::fflush(stderr);
+        saved_stdout = dup(STDOUT_FILENO);
+        saved_stderr = dup(STDERR_FILENO);
+        dup2(pipe_fds[1], STDOUT_FILENO);
+        dup2(pipe_fds[1], STDERR_FILENO);
+        return true;
+    }
+
+    // 捕捉したバイト数を返して元に戻す
+    size_t end() {
+        std::fflush(stdout);
+        std::fflush(stderr);
+        dup2(saved_stdout, STDOUT_FILENO);
+        dup2(saved_stderr, STDERR_FILENO);
+        close(saved_stdout);
+        close(saved_stderr);
+        close(pipe_fds[1]);
+
+        size_t captured = 0;
+        char buffer[256];
+        ssize_t n;
+        while ((n = read(pipe_fds[0], buffer, sizeof(buffer))) > 0) {
+            captured += static_cast<size_t>(n);
+        }
+        close(pipe_fds[0]);
+        return captured;
+    }
+};
+
+struct Result {
+    unsigned long allocations;
+    unsigned long deallocations;
+    unsigned long locks;
+    unsigned long writes;
+    unsigned long yields;
+    size_t output_bytes;
+
+    bool ok() const {
+        return allocations == 0 && deallocations == 0 && locks == 0 && writes == 0 && yields == 0 &&
+               output_bytes == 0;
+    }
+};
+
+// 検査区間で scenario を実行し、違反の回数を返す
+template <typename Scenario>
+Result audit(Scenario&& scenario) {
+    OutputCapture capture;
+    const bool captured = capture.begin();
+
+    allocations = 0;
+    deallocations = 0;
+    lock_calls = 0;
+    write_calls = 0;
+    yield_calls = 0;
+
+    armed = true;
+    scenario();
+    armed = false;
+
+    Result result{allocations.load(), deallocations.load(), lock_calls.load(), write_calls.load(),
+                  yield_calls.load(), 0};
+    if (captured) {
+        result.output_bytes = capture.end();
+    }
+    return result;
+}
+
+int failures = 0;
+int scenarios = 0;
+
+void report(const char* name, const Result& result) {
+    ++scenarios;
+    if (result.ok()) {
+        return;
+    }
+    ++failures;
+    std::printf("FAIL %s: allocations=%lu frees=%lu locks=%lu writes=%lu yields=%lu stdout/stderr bytes=%zu\n",
+                name, result.allocations, result.deallocations, result.locks, result.writes, result.yields,
+                result.output_bytes);
+}
+
+// チャンネル0-7にアルゴリズム・フィードバックを設定してキーオンした状態を作る
+void setupVoices(YM2151::Chip& chip, int algorithm, int feedback) {
+    for (int ch = 0; ch < YM2151::CHANNEL_COUNT; ++ch) {
+        chip.setRegister(static_cast<uint8_t>(0x20 + ch), static_cast<uint8_t>((feedback << 3) | algorithm));
+        uint16_t freq = static_cast<uint16_t>(440 + ch * 110);
+        chip.setRegister(static_cast<uint8_t>(0x10 + ch), freq & 0xFF);
+        chip.setRegister(static_cast<uint8_t>(0x18 + ch), freq >> 8);
+        chip.setRegister(0x08, static_cast<uint8_t>(0x80 | ch));
+    }
+}
+
+} // namespace
+
+int main() {
+    // 陽性対照: 置き換えた関数が検査区間内の呼び出しを実際に数えていること
+    // （::operator new の直接呼び出しは new 式と違って省略されない）
+    pthread_mutex_t control_mutex = PTHREAD_MUTEX_INITIALIZER;
+    const Result control = audit([&] {
+        void* memory = ::operator new(64);
+        pthread_mutex_lock(&control_mutex);
+        pthread_mutex_unlock(&control_mutex);
+        const ssize_t written = write(STDOUT_FILENO, "x", 1);
+        (void)written;
+        ::operator delete(memory);
+    });
+    if (control.allocations == 0 || control.locks == 0 || control.writes == 0 || control.output_bytes == 0) {
+        std::printf("FAIL positive control: allocations=%lu locks=%lu writes=%lu stdout/stderr bytes=%zu "
+                    "(the audit hooks are not intercepting calls)\n",
+                    control.allocations, control.locks, control.writes, control.output_bytes);
+        return 1;
+    }
+
+    // チップの構築と初期化は検査対象外（ここで確保が発生してもよい）
+    YM2151::Chip chip;
+    chip.setSampleRate(44100);
+
+    float buffer[BLOCK];
+    float stem_data[YM2151::CHANNEL_COUNT][BLOCK];
+    float* stems[YM2151::CHANNEL_COUNT];
+    for (int ch = 0; ch < YM2151::CHANNEL_COUNT; ++ch) {
+        stems[ch] = stem_data[ch];
+    }
+
+    // 全アルゴリズム×全フィードバック: キーオン、生成、キーオフ、生成
+    for (int algorithm = 0; algorithm < 8; ++algorithm) {
+        for (int feedback = 0; feedback < 8; ++feedback) {
+            char name[64];
+            std::snprintf(name, sizeof(name), "algorithm %d feedback %d", algorithm, feedback);
+            report(name, audit([&] {
+                setupVoices(chip, algorithm, feedback);
+                chip.generate(buffer, BLOCK);
+                chip.generateStems(stems, BLOCK, buffer);
+                for (int ch = 0; ch < YM2151::CHANNEL_COUNT; ++ch) {
+                    chip.setRegister(0x08, static_cast<uint8_t>(ch));
+                }
+                chip.generate(buffer, BLOCK);
+            }));
+        }
+    }
+
+    // 全レジスタ×代表値の書き込みと生成
+    const uint8_t values[] = {0x00, 0x01, 0x55, 0x7F, 0x80, 0xAA, 0xFF};
+    for (int reg = 0; reg < YM2151::REGISTER_COUNT; ++reg) {
+        char name[64];
+        std::snprintf(name, sizeof(name), "register 0x%02X", reg);
+        report(name, audit([&] {
+            for (uint8_t value : values) {
+                chip.setRegister(static_cast<uint8_t>(reg), value);
+                (void)chip.getRegister(static_cast<uint8_t>(reg));
+                chip.generate(buffer, 16);
+            }
+        }));
+    }
+
+    // 一括書き込み
+    report("setRegisters / setChannelRegisters", audit([&] {
+        YM2151::RegWrite writes[YM2151::REGISTER_COUNT];
+        for (int reg = 0; reg < YM2151::REGISTER_COUNT; ++reg) {
+            writes[reg] = YM2151::RegWrite{static_cast<uint8_t>(reg), static_cast<uint8_t>(reg * 37)};
+        }
+        chip.setRegisters(writes, YM2151::REGISTER_COUNT);
+        chip.setChannelRegisters(3, writes + 0x20, 0x20);
+        chip.generateStems(stems, BLOCK, nullptr);
+    }));
+
+    // 長時間の連続生成
+    report("sustained generate", audit([&] {
+        setupVoices(chip, 7, 7);
+        for (int i = 0; i < 1000; ++i) {
+            chip.generate(buffer, BLOCK);
+        }
+    }));
+
+    // 記録中の書き込みと生成（容量を超えた書き込みの破棄を含む）
+    YM2151::Recorder recorder(YM2151::Recorder::CHUNK_SIZE * 2);
+    chip.setRecorder(&recorder);
+    report("recording setRegister / generate", audit([&] {
+        for (int i = 0; i < 3000; ++i) {
+            setupVoices(chip, i & 7, (i >> 3) & 7);
+            chip.generate(buffer, 16);
+            chip.generateStems(stems, 16, nullptr);
+        }
+        recorder.clear();
+    }));
+    chip.setRecorder(nullptr);
+
+    // レベルメーターを取り付けた生成と読み出し
+    YM2151::LevelMeter meter;
+    YM2151::LevelSnapshot snapshot;
+    int16_t pcm[BLOCK];
+    chip.setMeter(&meter);
+    report("metered generate / generateStems / read", audit([&] {
+        for (int i = 0; i < 500; ++i) {
+            setupVoices(chip, i & 7, (i >> 3) & 7);
+            chip.generate(buffer, BLOCK);
+            chip.generate(pcm, 37);
+            chip.generateStems(stems, 16, nullptr);
+            if (i % 10 == 0) {
+                meter.clearHold();
+            }
+            meter.read(snapshot);
+        }
+    }));
+    chip.setMeter(nullptr);
+
+    // ノートキャッシュを取り付けた発音（記録、再生、途中の書き換え、追い出しを含む）
+    YM2151::NoteCache note_cache(64 * 1024);
+    chip.setNoteCache(&note_cache);
+    report("note cache keyOn / generate / release", audit([&] {
+        for (int i = 0; i < 300; ++i) {
+            chip.reset();
+            setupVoices(chip, i % 3, 7);
+            for (int block = 0; block < (i & 15) + 1; ++block) {
+                chip.generate(buffer, BLOCK);
+            }
+            if (i & 1) {
+                chip.setRegister(0x10, static_cast<uint8_t>(i));
+            }
+            chip.generateStems(stems, 16, nullptr);
+        }
+    }));
+    chip.setNoteCache(nullptr);
+
+    // 制御レートでの生成（区間をまたぐキーオン/オフと、制御レートの切り替えを含む）
+    report("control rate setControlRate / generate", audit([&] {
+        for (int i = 0; i < 300; ++i) {
+            chip.setControlRate(1 << (i % 7));
+            setupVoices(chip, i & 7, (i >> 3) & 7);
+            chip.generate(buffer, 37);
+            chip.generateStems(stems, BLOCK, buffer);
+            chip.setRegister(0x08, static_cast<uint8_t>(i & 7));
+            chip.generate(buffer, BLOCK);
+        }
+        chip.setControlRate(1);
+    }));
+
+    // 重複チャンネルの検出（全チャンネルに同じ書き込みをしてから1チャンネルずつずらす）
+    report("duplicate channels regroup / generate", audit([&] {
+        for (int i = 0; i < 100; ++i) {
+            chip.reset();
+            for (int ch = 0; ch < YM2151::CHANNEL_COUNT; ++ch) {
+                chip.setRegister(static_cast<uint8_t>(0x10 + ch), static_cast<uint8_t>(i));
+                chip.setRegister(static_cast<uint8_t>(0x08), static_cast<uint8_t>(0x80 | ch));
+            }
+            chip.generate(buffer, BLOCK);
+            chip.setRegister(static_cast<uint8_t>(0x10 + (i & 7)), static_cast<uint8_t>(i + 1));
+            chip.generateStems(stems, BLOCK, buffer);
+        }
+    }));
+
+    // シーケンサのイベント追加、一時停止と生成
+    YM2151::Sequencer sequencer(256);
+    report("Sequencer add / pause / render", audit([&] {
+        for (int i = 0; i < 200; ++i) {
+            const uint32_t tick = static_cast<uint32_t>(i * 7);
+            sequencer.add(YM2151::SequenceEvent::noteOn(tick, static_cast<uint8_t>(i & 7), static_cast<uint8_t>(40 + i % 40)));
+            sequencer.add(YM2151::SequenceEvent::noteOff(tick + 3, static_cast<uint8_t>(i & 7)));
+            if (i % 50 == 0) {
+                sequencer.add(YM2151::SequenceEvent::setTempo(tick, static_cast<uint32_t>(300000 + i * 1000)));
+            }
+        }
+        for (int i = 0; i < 200; ++i) {
+            if (i % 20 == 0) {
+                sequencer.pause();
+            }
+            sequencer.render(chip, buffer, BLOCK);
+            sequencer.resume();
+        }
+        sequencer.reset();
+    }));
+
+    // Board の書き込みと合成（ワーカースレッドなしとあり）
+    // スレッド動作ではオーディオスレッド側（render / write）だけを数える
+    YM2151::Board board(44100);
+    board.addChip(3579545, 1.0f, -0.5f);
+    board.addChip(4000000, 0.7f, 0.5f);
+    board.start(BLOCK, false);
+    float stereo[BLOCK * 2];
+    report("Board write / render (inline)", audit([&] {
+        for (int i = 0; i < 100; ++i) {
+            board.write(i & 1, static_cast<uint8_t>(0x20 + (i & 7)), static_cast<uint8_t>(i));
+            board.write(i & 1, 0x08, static_cast<uint8_t>(0x80 | (i & 7)));
+            board.setPan(i & 1, (i % 21) / 10.0f - 1.0f);
+            board.render(stereo);
+        }
+    }));
+    board.stop();
+    board.start(BLOCK, true);
+    report("Board write / render (worker threads)", audit([&] {
+        for (int i = 0; i < 200; ++i) {
+            board.write(i & 1, static_cast<uint8_t>(0x20 + (i & 7)), static_cast<uint8_t>(i));
+            board.write(i & 1, 0x08, static_cast<uint8_t>(0x80 | (i & 7)));
+            board.setGain(i & 1, (i % 10) / 10.0f);
+            board.render(stereo);
+        }
+    }));
+    board.stop();
+    report("Board render (stopped)", audit([&] {
+        board.render(stereo);
+    }));
+
+    // ChipArray のレーンごとの書き込みと生成
+    constexpr int LANES = 20;
+    auto array = std::make_unique<YM2151::ChipArray<LANES>>();
+    array->setSampleRate(44100);
+    float lane_data[LANES][BLOCK];
+    float* lanes[LANES];
+    for (int lane = 0; lane < LANES; ++lane) {
+        lanes[lane] = lane_data[lane];
+    }
+    report("ChipArray setRegister / generate", audit([&] {
+        for (int lane = 0; lane < LANES; ++lane) {
+            for (int ch = 0; ch < YM2151::CHANNEL_COUNT; ++ch) {
+                array->setRegister(lane, static_cast<uint8_t>(0x20 + ch), static_cast<uint8_t>(lane * 9 + ch));
+                array->setRegister(lane, static_cast<uint8_t>(0x10 + ch), static_cast<uint8_t>(lane * 13));
+                array->setRegister(lane, static_cast<uint8_t>(0x18 + ch), 0x02);
+                array->setRegister(lane, 0x08, static_cast<uint8_t>(0x80 | ch));
+            }
+        }
+        for (int i = 0; i < 100; ++i) {
+            array->generate(lanes, BLOCK);
+        }
+        array->resetLane(3);
+    }));
+
+    std::printf("ym2151_rt_audit: %d scenarios, %d failed\n", scenarios, failures);
+    return failures == 0 ? 0 : 1;
+}
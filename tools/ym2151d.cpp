@@ -0,0 +1,957 @@
+// YM2151 レンダリングデーモン（Unixドメインソケット、POSIXのみ）
+// 短いレンダリングを大量に行う場合に、ジョブごとにプロセスを起動してチップの構築や
+// ファイルの読み込みを行う代わりに、常駐したワーカーのプールでジョブを受け付ける。
+// 各ワーカーは起動時に構築して一度生成を済ませた Chip とバッファを持ち、ジョブごとに
+// reset して使い回すので、1ジョブの処理時間はほぼ合成の時間だけになる。
+//
+//   ym2151d --socket PATH [--workers N]                 デーモンとして待ち受ける
+//   ym2151d --socket PATH --send [options] [input]      ジョブを1つ送り、PCMを標準出力に書き出す
+//
+// 出力は同じ入力・設定の ym2151_render（--block / --depth / --parallel を除く）とバイト単位で同じ。
+//
+// プロトコル（ホストのバイト順。同じホスト内でのみ使う）:
+//   要求: JobRequest に続いて payload_size バイトの入力（レジスタスクリプトまたはVGM）
+//   応答: JobResponse に続いて size バイト（成功時は出力、失敗時はエラーメッセージ）
+//   要求の flags に FLAG_SHARED_MEMORY を指定すると、出力を共有メモリに書き込み、
+//   応答と一緒にそのファイル記述子（SCM_RIGHTS）を渡す。この場合、応答の後にデータは続かず、
+//   size は共有メモリの大きさになる。
+// 1つの接続で1つのジョブを処理し、応答を送り終えたら接続を閉じる。
+
+#include "ym2151/ym2151.h"
+#include "ym2151/vgm.h"
+#include "pcm_output.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+enum InputType : uint32_t { INPUT_AUTO = 0, INPUT_VGM = 1, INPUT_SCRIPT = 2 };
+enum OutputFormat : uint32_t { FORMAT_RAW = 0, FORMAT_WAV = 1 };
+enum Encoding : uint32_t { ENCODING_S16 = 0, ENCODING_F32 = 1 };
+
+constexpr uint32_t FLAG_SHARED_MEMORY = 1u << 0;
+
+// ジョブの要求
+struct JobRequest {
+    char magic[4] = {'Y', 'M', 'D', '1'};
+    uint32_t input = INPUT_AUTO;
+    uint32_t format = FORMAT_WAV;
+    uint32_t encoding = ENCODING_S16;
+    uint32_t sample_rate = 44100;
+    uint32_t tail = 0;            // 最後のコマンドの後に生成するサンプル数
+    uint32_t control_rate = 1;
+    uint32_t flags = 0;
+    uint32_t payload_size = 0;    // 続く入力のバイト数
+};
+
+// ジョブの応答
+struct JobResponse {
+    char magic[4] = {'Y', 'M', 'R', '1'};
+    uint32_t status = 0;          // 0 = 成功
+    uint64_t size = 0;            // 続くバイト数（共有メモリの場合はその大きさ）
+};
+
+struct Options {
+    std::string socket_path;
+    bool send = false;
+
+    // デーモン
+    int workers = 0;                          // 0ならハードウェアのスレッド数
+    int block_size = 4096;                    // 送信する1ブロックのサンプル数
+    uint32_t max_input = 64u * 1024 * 1024;   // 入力の上限（バイト）
+    uint64_t max_samples = 48000ull * 3600;   // 出力の上限（サンプル数）
+    int timeout = 30;                         // 1ジョブの期限（秒、受信・生成・送信の合計）
+    bool quiet = false;
+
+    // クライアント
+    std::string input = "-";
+    JobRequest request;
+    int repeat = 1;
+};
+
+// シグナルで終了を知らせるパイプ
+int stop_pipe[2] = {-1, -1};
+
+void onStopSignal(int) {
+    const char byte = 0;
+    const ssize_t ignored = write(stop_pipe[1], &byte, 1);
+    (void)ignored;
+}
+
+using Clock = std::chrono::steady_clock;
+
+constexpr Clock::time_point NO_DEADLINE = Clock::time_point::max();
+
+// fd が events の状態になるまで待つ
+// deadline を過ぎた場合は errno を ETIMEDOUT にして false を返す。
+// SO_RCVTIMEO / SO_SNDTIMEO は1回の recv/send しか制限しないので、少しずつ送受信する
+// クライアントがワーカーを占有し続けられないように、ジョブ全体の期限から残り時間を求めて poll() する
+bool waitFor(int fd, short events, Clock::time_point deadline) {
+    for (;;) {
+        int timeout_ms = -1;
+        if (deadline != NO_DEADLINE) {
+            const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            if (remaining <= 0) {
+                errno = ETIMEDOUT;
+                return false;
+            }
+            timeout_ms = static_cast<int>(std::min<long long>(remaining, 60 * 60 * 1000));
+        }
+        pollfd p{fd, events, 0};
+        const int ready = poll(&p, 1, timeout_ms);
+        if (ready > 0) {
+            return true;
+        }
+        if (ready < 0 && errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+bool readAll(int fd, void* data, size_t size, Clock::time_point deadline = NO_DEADLINE) {
+    char* p = static_cast<char*>(data);
+    while (size > 0) {
+        if (!waitFor(fd, POLLIN, deadline)) {
+            return false;
+        }
+        const ssize_t n = recv(fd, p, size, MSG_DONTWAIT);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool writeAll(int fd, const void* data, size_t size, Clock::time_point deadline = NO_DEADLINE) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        if (!waitFor(fd, POLLOUT, deadline)) {
+            return false;
+        }
+        const ssize_t n = send(fd, p, size, MSG_DONTWAIT);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool makeAddress(const std::string& path, sockaddr_un& address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+// ワーカー: 構築済みのチップとバッファを持ち、ジョブごとに使い回す
+class Worker {
+public:
+    Worker(int id, const Options& options)
+        : id_(id),
+          options_(options),
+          samples_(options.block_size),
+          block_(options.block_size * sizeof(float)) {
+        warmUp();
+    }
+
+    // 1つの接続のジョブを処理する
+    void serve(int fd, uint64_t job) {
+        const auto start = Clock::now();
+        // 要求の受信から応答の送信までの期限（生成の時間も含む）
+        deadline_ = start + std::chrono::seconds(options_.timeout);
+
+        JobRequest request;
+        std::string error;
+        if (!readRequest(fd, request, error)) {
+            if (!error.empty()) {
+                sendError(fd, error);
+            }
+            log(job, "rejected: " + (error.empty() ? std::string("connection closed") : error));
+            return;
+        }
+
+        double synth_seconds = 0.0;
+        const bool shared = (request.flags & FLAG_SHARED_MEMORY) != 0;
+        const bool ok = shared ? renderShared(fd, request, synth_seconds, error)
+                               : renderStream(fd, request, synth_seconds, error);
+        const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        if (!ok) {
+            log(job, "failed: " + error);
+            return;
+        }
+
+        char line[160];
+        std::snprintf(line, sizeof(line), "%llu samples in %.3f ms (synthesis %.3f ms, %s)",
+                      static_cast<unsigned long long>(totalSamples(request)), elapsed * 1e3,
+                      synth_seconds * 1e3, shared ? "shared memory" : "stream");
+        log(job, line);
+    }
+
+private:
+    // 最初のジョブで構築やページの割り当てが起きないように、一度生成しておく
+    void warmUp() {
+        chip_.setRegister(0x20, 0x07);
+        chip_.setRegister(0x10, 0xB8);
+        chip_.setRegister(0x18, 0x01);
+        chip_.setRegister(0x08, 0x80);
+        for (int i = 0; i < 4; ++i) {
+            chip_.generate(samples_.data(), options_.block_size);
+        }
+        chip_.reset();
+    }
+
+    // 要求と入力の読み込み（接続が閉じられた場合は error を空にして false を返す）
+    bool readRequest(int fd, JobRequest& request, std::string& error) {
+        if (!readAll(fd, &request, sizeof(request), deadline_)) {
+            setTimeoutError(error);
+            return false;
+        }
+        if (std::memcmp(request.magic, "YMD1", 4) != 0) {
+            error = "bad request header";
+            return false;
+        }
+        if (request.payload_size > options_.max_input) {
+            error = "input too large";
+            return false;
+        }
+        if (request.input > INPUT_SCRIPT || request.format > FORMAT_WAV || request.encoding > ENCODING_F32 ||
+            request.sample_rate == 0) {
+            error = "invalid job options";
+            return false;
+        }
+        if (request.control_rate < 1 || request.control_rate > YM2151::MAX_CONTROL_RATE) {
+            error = "control rate must be between 1 and " + std::to_string(YM2151::MAX_CONTROL_RATE);
+            return false;
+        }
+        payload_.resize(request.payload_size);
+        if (!readAll(fd, payload_.data(), payload_.size(), deadline_)) {
+            setTimeoutError(error);
+            return false;
+        }
+
+        bool is_vgm = request.input == INPUT_VGM;
+        if (request.input == INPUT_AUTO) {
+            is_vgm = payload_.size() >= 4 && std::memcmp(payload_.data(), "Vgm ", 4) == 0;
+        }
+        stream_.clock = YM2151::RegisterStream().clock;
+        bool parsed;
+        if (is_vgm) {
+            parsed = YM2151::parseVGM(payload_.data(), payload_.size(), request.sample_rate, stream_, &error);
+        } else {
+            std::istringstream script(std::string(payload_.begin(), payload_.end()));
+            parsed = YM2151::parseRegisterScript(script, stream_, &error);
+        }
+        if (!parsed) {
+            if (error.empty()) {
+                error = "cannot parse input";
+            }
+            return false;
+        }
+        if (totalSamples(request) > options_.max_samples) {
+            error = "output too long";
+            return false;
+        }
+        return true;
+    }
+
+    // 受信が期限切れで失敗した場合だけ error を設定する
+    void setTimeoutError(std::string& error) const {
+        if (errno == ETIMEDOUT) {
+            error = "timed out after " + std::to_string(options_.timeout) + " seconds";
+        }
+    }
+
+    uint64_t totalSamples(const JobRequest& request) const {
+        return static_cast<uint64_t>(stream_.total_samples) + request.tail;
+    }
+
+    static size_t bytesPerSample(const JobRequest& request) {
+        return request.encoding == ENCODING_S16 ? 2 : 4;
+    }
+
+    uint64_t outputSize(const JobRequest& request) const {
+        const uint64_t data = totalSamples(request) * bytesPerSample(request);
+        return (request.format == FORMAT_WAV ? sizeof(tools::WAVHeader) : 0) + data;
+    }
+
+    static tools::WAVHeader makeHeader(const JobRequest& request, uint64_t total_samples) {
+        return tools::makeWAVHeader(request.sample_rate, bytesPerSample(request), total_samples);
+    }
+
+    // チップをジョブの設定に戻す（このコアの出力はクロックによらないため、チップは作り直さない）
+    void prepare(const JobRequest& request) {
+        chip_.reset();
+        chip_.setSampleRate(request.sample_rate);
+        chip_.setControlRate(static_cast<int>(request.control_rate));
+        next_write_ = 0;
+        position_ = 0;
+    }
+
+    // 次のブロックを生成して出力形式に変換し、out に書き込んだバイト数を返す
+    // 書き込み時刻で区切りながら生成する（ym2151_render と同じ YM2151::renderWrites）
+    size_t renderBlock(const JobRequest& request, char* out, double& synth_seconds) {
+        const auto synth_start = std::chrono::steady_clock::now();
+        const int count = static_cast<int>(
+            std::min<uint64_t>(options_.block_size, totalSamples(request) - position_));
+        YM2151::renderWrites(chip_, stream_.writes, next_write_, position_, samples_.data(), count);
+
+        if (request.encoding == ENCODING_S16) {
+            tools::convertToS16(samples_.data(), reinterpret_cast<int16_t*>(out), count);
+        } else {
+            std::memcpy(out, samples_.data(), count * sizeof(float));
+        }
+
+        position_ += count;
+        synth_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - synth_start).count();
+        return count * bytesPerSample(request);
+    }
+
+    // 出力をブロックごとに生成しながらソケットに書き出す
+    bool renderStream(int fd, const JobRequest& request, double& synth_seconds, std::string& error) {
+        prepare(request);
+        JobResponse response;
+        response.size = outputSize(request);
+        bool ok = writeAll(fd, &response, sizeof(response), deadline_);
+        if (ok && request.format == FORMAT_WAV) {
+            const tools::WAVHeader header = makeHeader(request, totalSamples(request));
+            ok = writeAll(fd, &header, sizeof(header), deadline_);
+        }
+        while (ok && position_ < totalSamples(request)) {
+            const size_t bytes = renderBlock(request, block_.data(), synth_seconds);
+            ok = writeAll(fd, block_.data(), bytes, deadline_);
+        }
+        if (!ok) {
+            error = std::string("write failed: ") + std::strerror(errno);
+        }
+        return ok;
+    }
+
+    // 出力を共有メモリに生成し、ファイル記述子を渡す
+    bool renderShared(int fd, const JobRequest& request, double& synth_seconds, std::string& error) {
+        const uint64_t size = outputSize(request);
+        const int memory = createSharedMemory(size, error);
+        if (memory < 0) {
+            sendError(fd, error);
+            return false;
+        }
+
+        if (size > 0) {
+            void* mapped = mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, memory, 0);
+            if (mapped == MAP_FAILED) {
+                error = std::string("mmap: ") + std::strerror(errno);
+                close(memory);
+                sendError(fd, error);
+                return false;
+            }
+            char* out = static_cast<char*>(mapped);
+            if (request.format == FORMAT_WAV) {
+                const tools::WAVHeader header = makeHeader(request, totalSamples(request));
+                std::memcpy(out, &header, sizeof(header));
+                out += sizeof(header);
+            }
+            prepare(request);
+            while (position_ < totalSamples(request)) {
+                out += renderBlock(request, out, synth_seconds);
+            }
+            munmap(mapped, static_cast<size_t>(size));
+        }
+
+        JobResponse response;
+        response.size = size;
+        const bool ok = sendWithDescriptor(fd, response, memory);
+        close(memory);
+        if (!ok) {
+            error = std::string("sendmsg: ") + std::strerror(errno);
+        }
+        return ok;
+    }
+
+    // 名前を削除済みの共有メモリを作る（ファイル記述子だけが残る）
+    int createSharedMemory(uint64_t size, std::string& error) {
+        for (int attempt = 0; attempt < 16; ++attempt) {
+            const std::string name = "/ym2151d." + std::to_string(getpid()) + "." + std::to_string(id_) + "." +
+                                     std::to_string(++shm_counter_);
+            const int memory = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+            if (memory < 0) {
+                if (errno == EEXIST) {
+                    continue;
+                }
+                break;
+            }
+            shm_unlink(name.c_str());
+            if (ftruncate(memory, static_cast<off_t>(size)) != 0) {
+                error = std::string("ftruncate: ") + std::strerror(errno);
+                close(memory);
+                return -1;
+            }
+            return memory;
+        }
+        error = std::string("shm_open: ") + std::strerror(errno);
+        return -1;
+    }
+
+    bool sendWithDescriptor(int fd, const JobResponse& response, int descriptor) const {
+        iovec iov;
+        iov.iov_base = const_cast<JobResponse*>(&response);
+        iov.iov_len = sizeof(response);
+
+        union {
+            cmsghdr header;
+            char buffer[CMSG_SPACE(sizeof(int))];
+        } control;
+        std::memset(&control, 0, sizeof(control));
+
+        msghdr message{};
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(cmsg), &descriptor, sizeof(int));
+
+        ssize_t sent;
+        do {
+            if (!waitFor(fd, POLLOUT, deadline_)) {
+                return false;
+            }
+            sent = sendmsg(fd, &message, MSG_DONTWAIT);
+        } while (sent < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK));
+        // ファイル記述子は最初のバイトと一緒に届くので、残りは通常の送信で書き出す
+        return sent > 0 && writeAll(fd, reinterpret_cast<const char*>(&response) + sent,
+                                    sizeof(response) - static_cast<size_t>(sent), deadline_);
+    }
+
+    void sendError(int fd, const std::string& message) const {
+        JobResponse response;
+        response.status = 1;
+        response.size = message.size();
+        if (writeAll(fd, &response, sizeof(response), deadline_)) {
+            writeAll(fd, message.data(), message.size(), deadline_);
+        }
+    }
+
+    void log(uint64_t job, const std::string& message) const {
+        if (!options_.quiet) {
+            std::fprintf(stderr, "ym2151d: job %llu (worker %d): %s\n", static_cast<unsigned long long>(job), id_,
+                         message.c_str());
+        }
+    }
+
+    int id_;
+    const Options& options_;
+    YM2151::Chip chip_;
+    YM2151::RegisterStream stream_;
+    std::vector<uint8_t> payload_;
+    std::vector<float> samples_;
+    std::vector<char> block_;
+    size_t next_write_ = 0;
+    uint64_t position_ = 0;
+    uint64_t shm_counter_ = 0;
+    Clock::time_point deadline_ = NO_DEADLINE;   // 処理中のジョブの期限
+};
+
+// 受け付けた接続をワーカーに渡すキュー
+class ConnectionQueue {
+public:
+    void push(int fd) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            connections_.push_back(fd);
+        }
+        ready_.notify_one();
+    }
+
+    // 接続を取り出す（停止したら -1 を返す）
+    int pop(uint64_t& job) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [this] { return stopping_ || !connections_.empty(); });
+        if (stopping_) {
+            return -1;
+        }
+        const int fd = connections_.front();
+        connections_.pop_front();
+        job = ++jobs_;
+        return fd;
+    }
+
+    // 待ちの接続を閉じてワーカーを止める
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+            for (int fd : connections_) {
+                close(fd);
+            }
+            connections_.clear();
+        }
+        ready_.notify_all();
+    }
+
+private:
+    std::deque<int> connections_;
+    uint64_t jobs_ = 0;
+    bool stopping_ = false;
+    std::mutex mutex_;
+    std::condition_variable ready_;
+};
+
+int runDaemon(const Options& options) {
+    sockaddr_un address;
+    if (!makeAddress(options.socket_path, address)) {
+        std::cerr << "ym2151d: socket path is empty or too long" << std::endl;
+        return 2;
+    }
+
+    // 前回のソケットが残っていれば削除する（ソケット以外のファイルは消さない）
+    struct stat info;
+    if (lstat(options.socket_path.c_str(), &info) == 0) {
+        if (!S_ISSOCK(info.st_mode)) {
+            std::cerr << "ym2151d: " << options.socket_path << " exists and is not a socket" << std::endl;
+            return 1;
+        }
+        unlink(options.socket_path.c_str());
+    }
+
+    const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listener, 64) != 0) {
+        std::cerr << "ym2151d: " << options.socket_path << ": " << std::strerror(errno) << std::endl;
+        if (listener >= 0) {
+            close(listener);
+        }
+        return 1;
+    }
+
+    if (pipe(stop_pipe) != 0) {
+        std::cerr << "ym2151d: pipe: " << std::strerror(errno) << std::endl;
+        close(listener);
+        unlink(options.socket_path.c_str());
+        return 1;
+    }
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = onStopSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    // ワーカーの構築（チップの構築と最初の生成はここで済ませる）
+    int worker_count = options.workers;
+    if (worker_count <= 0) {
+        worker_count = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (int i = 0; i < worker_count; ++i) {
+        workers.emplace_back(new Worker(i, options));
+    }
+
+    ConnectionQueue queue;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < worker_count; ++i) {
+        Worker* worker = workers[i].get();
+        threads.emplace_back([worker, &queue] {
+            uint64_t job = 0;
+            for (int fd; (fd = queue.pop(job)) >= 0;) {
+                worker->serve(fd, job);
+                close(fd);
+            }
+        });
+    }
+
+    if (!options.quiet) {
+        std::fprintf(stderr, "ym2151d: listening on %s with %d workers\n", options.socket_path.c_str(),
+                     worker_count);
+    }
+
+    // 接続の受け付け（終了のシグナルが届くまで）
+    // accept() が記述子の不足（EMFILE / ENFILE）などで失敗すると、接続は待ちのまま残って
+    // poll() がすぐに戻り続けるので、ACCEPT_BACKOFF_MS の間は受け付けを止めて
+    // ワーカーが接続を閉じるのを待つ（エラーは失敗が続いている間は1回だけ表示する）
+    constexpr int ACCEPT_BACKOFF_MS = 100;
+    int status = 0;
+    bool backoff = false;
+    bool accept_failing = false;
+    pollfd fds[2] = {{listener, POLLIN, 0}, {stop_pipe[0], POLLIN, 0}};
+    for (;;) {
+        fds[0].events = backoff ? 0 : POLLIN;
+        const int ready = poll(fds, 2, backoff ? ACCEPT_BACKOFF_MS : -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "ym2151d: poll: " << std::strerror(errno) << std::endl;
+            status = 1;
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+        if (ready == 0) {
+            backoff = false;
+            continue;
+        }
+        if (fds[0].revents & POLLIN) {
+            const int fd = accept(listener, nullptr, nullptr);
+            if (fd >= 0) {
+                queue.push(fd);
+                accept_failing = false;
+            } else if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNABORTED) {
+                if (!accept_failing) {
+                    std::cerr << "ym2151d: accept: " << std::strerror(errno) << " (retrying every "
+                              << ACCEPT_BACKOFF_MS << " ms)" << std::endl;
+                }
+                accept_failing = true;
+                backoff = true;
+            }
+        }
+    }
+
+    // 処理中のジョブは最後まで処理し、待ちの接続は閉じる
+    queue.stop();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    close(listener);
+    unlink(options.socket_path.c_str());
+    close(stop_pipe[0]);
+    close(stop_pipe[1]);
+    if (!options.quiet) {
+        std::fprintf(stderr, "ym2151d: stopped\n");
+    }
+    return status;
+}
+
+// 応答の受信（共有メモリの場合はファイル記述子も受け取る）
+bool receiveResponse(int fd, JobResponse& response, int& descriptor) {
+    descriptor = -1;
+    iovec iov;
+    iov.iov_base = &response;
+    iov.iov_len = sizeof(response);
+
+    union {
+        cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    std::memset(&control, 0, sizeof(control));
+
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    ssize_t received;
+    do {
+        received = recvmsg(fd, &message, 0);
+    } while (received < 0 && errno == EINTR);
+    if (received <= 0) {
+        return false;
+    }
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            std::memcpy(&descriptor, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+    if (!readAll(fd, reinterpret_cast<char*>(&response) + received, sizeof(response) - static_cast<size_t>(received))) {
+        return false;
+    }
+    return std::memcmp(response.magic, "YMR1", 4) == 0;
+}
+
+// ジョブを1つ送り、出力を out に書き出す（out が nullptr なら読み捨てる）
+bool sendJob(const Options& options, const std::vector<uint8_t>& input, FILE* out, std::string& error) {
+    sockaddr_un address;
+    if (!makeAddress(options.socket_path, address)) {
+        error = "socket path is empty or too long";
+        return false;
+    }
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        error = options.socket_path + ": " + std::strerror(errno);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+
+    JobRequest request = options.request;
+    request.payload_size = static_cast<uint32_t>(input.size());
+    JobResponse response;
+    int descriptor = -1;
+    bool ok = writeAll(fd, &request, sizeof(request)) && writeAll(fd, input.data(), input.size()) &&
+              receiveResponse(fd, response, descriptor);
+    if (!ok) {
+        error = "connection to the daemon failed";
+    } else if (response.status != 0) {
+        std::string message(static_cast<size_t>(std::min<uint64_t>(response.size, 4096)), '\0');
+        readAll(fd, &message[0], message.size());
+        error = message;
+        ok = false;
+    } else if (descriptor >= 0) {
+        // 共有メモリ: 対応付けてそのまま書き出す
+        if (response.size > 0) {
+            void* mapped = mmap(nullptr, static_cast<size_t>(response.size), PROT_READ, MAP_SHARED, descriptor, 0);
+            if (mapped == MAP_FAILED) {
+                error = std::string("mmap: ") + std::strerror(errno);
+                ok = false;
+            } else {
+                if (out && std::fwrite(mapped, 1, static_cast<size_t>(response.size), out) != response.size) {
+                    error = "write to stdout failed";
+                    ok = false;
+                }
+                munmap(mapped, static_cast<size_t>(response.size));
+            }
+        }
+    } else if (request.flags & FLAG_SHARED_MEMORY) {
+        error = "daemon did not pass the shared memory";
+        ok = false;
+    } else {
+        // ソケット: 届いたブロックから順に書き出す
+        std::vector<char> buffer(64 * 1024);
+        uint64_t remaining = response.size;
+        while (ok && remaining > 0) {
+            const size_t bytes = static_cast<size_t>(std::min<uint64_t>(remaining, buffer.size()));
+            if (!readAll(fd, buffer.data(), bytes)) {
+                error = "connection closed before the end of the output";
+                ok = false;
+            } else if (out && std::fwrite(buffer.data(), 1, bytes, out) != bytes) {
+                error = "write to stdout failed";
+                ok = false;
+            }
+            remaining -= bytes;
+        }
+    }
+    if (descriptor >= 0) {
+        close(descriptor);
+    }
+    close(fd);
+    return ok;
+}
+
+bool readInput(const std::string& path, std::vector<uint8_t>& data) {
+    if (path == "-") {
+        data.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+        return true;
+    }
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+int runClient(const Options& options) {
+    std::vector<uint8_t> input;
+    if (!readInput(options.input, input)) {
+        std::cerr << "cannot open " << options.input << std::endl;
+        return 1;
+    }
+    std::signal(SIGPIPE, SIG_IGN);
+
+    // --repeat では同じジョブを繰り返し送り、1ジョブあたりの時間を計測する（出力は最初の1回だけ書き出す）
+    std::vector<double> latencies;
+    for (int i = 0; i < options.repeat; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        std::string error;
+        if (!sendJob(options, input, i == 0 ? stdout : nullptr, error)) {
+            std::cerr << "ym2151d: " << options.input << ": " << error << std::endl;
+            return 1;
+        }
+        latencies.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::fflush(stdout);
+
+    if (options.repeat > 1) {
+        double total = 0.0;
+        for (double t : latencies) {
+            total += t;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        std::fprintf(stderr, "ym2151d: %d jobs, latency mean %.3f ms, median %.3f ms, max %.3f ms\n",
+                     options.repeat, total / options.repeat * 1e3, latencies[latencies.size() / 2] * 1e3,
+                     latencies.back() * 1e3);
+    }
+    return 0;
+}
+
+void printUsage() {
+    std::cerr <<
+        "Usage: ym2151d --socket PATH [daemon options]\n"
+        "       ym2151d --socket PATH --send [job options] [input]\n"
+        "daemon options:\n"
+        "  --workers N           number of pre-warmed workers (default: all cores)\n"
+        "  --block N             samples rendered and sent per block (default: 4096)\n"
+        "  --max-input N         largest accepted input in bytes (default: 64 MiB)\n"
+        "  --max-samples N       longest accepted output in samples (default: 1 hour at 48 kHz)\n"
+        "  --timeout N           per-job deadline in seconds, covering the request, synthesis\n"
+        "                        and the response (default: 30)\n"
+        "  --quiet               do not log jobs\n"
+        "job options (same meaning as ym2151_render):\n"
+        "  input                 register script or VGM file ('-' = stdin, default)\n"
+        "  --input vgm|script    input type (default: detect from header)\n"
+        "  --format wav|raw      output container (default: wav)\n"
+        "  --encoding s16|f32    sample encoding (default: s16)\n"
+        "  --rate N              sample rate in Hz (default: 44100)\n"
+        "  --tail N              extra samples rendered after the last command (default: 0)\n"
+        "  --control-rate N      update envelopes and LFO every N samples (1-64, default: 1)\n"
+        "  --shm                 receive the output through shared memory instead of the socket\n"
+        "  --repeat N            send the job N times and report the latency (output written once)\n";
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&](const char* name) -> const char* {
+            if (i + 1 >= argc) {
+                std::cerr << name << " requires a value" << std::endl;
+                return nullptr;
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--help" || arg == "-h") {
+            return false;
+        } else if (arg == "--socket") {
+            const char* v = value("--socket");
+            if (!v) return false;
+            options.socket_path = v;
+        } else if (arg == "--send") {
+            options.send = true;
+        } else if (arg == "--workers") {
+            const char* v = value("--workers");
+            if (!v) return false;
+            options.workers = std::atoi(v);
+        } else if (arg == "--block") {
+            const char* v = value("--block");
+            if (!v) return false;
+            options.block_size = std::atoi(v);
+        } else if (arg == "--max-input") {
+            const char* v = value("--max-input");
+            if (!v) return false;
+            options.max_input = static_cast<uint32_t>(std::strtoul(v, nullptr, 10));
+        } else if (arg == "--max-samples") {
+            const char* v = value("--max-samples");
+            if (!v) return false;
+            options.max_samples = std::strtoull(v, nullptr, 10);
+        } else if (arg == "--timeout") {
+            const char* v = value("--timeout");
+            if (!v) return false;
+            options.timeout = std::atoi(v);
+        } else if (arg == "--quiet") {
+            options.quiet = true;
+        } else if (arg == "--input") {
+            const char* v = value("--input");
+            if (!v) return false;
+            if (std::strcmp(v, "vgm") == 0) options.request.input = INPUT_VGM;
+            else if (std::strcmp(v, "script") == 0) options.request.input = INPUT_SCRIPT;
+            else return false;
+        } else if (arg == "--format") {
+            const char* v = value("--format");
+            if (!v) return false;
+            if (std::strcmp(v, "wav") == 0) options.request.format = FORMAT_WAV;
+            else if (std::strcmp(v, "raw") == 0) options.request.format = FORMAT_RAW;
+            else return false;
+        } else if (arg == "--encoding") {
+            const char* v = value("--encoding");
+            if (!v) return false;
+            if (std::strcmp(v, "s16") == 0) options.request.encoding = ENCODING_S16;
+            else if (std::strcmp(v, "f32") == 0) options.request.encoding = ENCODING_F32;
+            else return false;
+        } else if (arg == "--rate") {
+            const char* v = value("--rate");
+            if (!v) return false;
+            options.request.sample_rate = static_cast<uint32_t>(std::strtoul(v, nullptr, 10));
+        } else if (arg == "--tail") {
+            const char* v = value("--tail");
+            if (!v) return false;
+            options.request.tail = static_cast<uint32_t>(std::strtoul(v, nullptr, 10));
+        } else if (arg == "--control-rate") {
+            const char* v = value("--control-rate");
+            if (!v) return false;
+            options.request.control_rate = static_cast<uint32_t>(std::atoi(v));
+        } else if (arg == "--shm") {
+            options.request.flags |= FLAG_SHARED_MEMORY;
+        } else if (arg == "--repeat") {
+            const char* v = value("--repeat");
+            if (!v) return false;
+            options.repeat = std::atoi(v);
+        } else if (!arg.empty() && arg[0] == '-' && arg != "-") {
+            std::cerr << "unknown option: " << arg << std::endl;
+            return false;
+        } else {
+            options.input = arg;
+        }
+    }
+
+    if (options.socket_path.empty()) {
+        std::cerr << "--socket is required" << std::endl;
+        return false;
+    }
+    if (options.block_size <= 0 || options.timeout <= 0 || options.repeat <= 0) {
+        std::cerr << "block, timeout and repeat must be positive" << std::endl;
+        return false;
+    }
+    if (options.request.sample_rate == 0) {
+        std::cerr << "rate must be positive" << std::endl;
+        return false;
+    }
+    if (options.request.control_rate < 1 ||
+        options.request.control_rate > static_cast<uint32_t>(YM2151::MAX_CONTROL_RATE)) {
+        std::cerr << "control rate must be between 1 and " << YM2151::MAX_CONTROL_RATE << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 2;
+    }
+    return options.send ? runClient(options) : runDaemon(options);
+}